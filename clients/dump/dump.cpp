@@ -21,11 +21,14 @@
 #include <dashel/dashel.h>
 #include "../../common/consts.h"
 #include "../../common/msg/msg.h"
+#include "../../common/msg/Capture.h"
 #include "../../common/utils/utils.h"
 #include "../../transport/dashel_plugins/dashel-plugins.h"
 #include <time.h>
 #include <iostream>
 #include <cstring>
+#include <fstream>
+#include <memory>
 
 namespace Aseba
 {
@@ -38,15 +41,18 @@ namespace Aseba
 	/*@{*/
 	
 	//! A simple message dumper.
-	//! This class calls Aseba::Message::dump() for each message
+	//! This class calls Aseba::Message::dump() for each message,
+	//! or captures them in binary form if a capture is given
 	class Dump : public Hub
 	{
 	private:
 		bool rawTime; //!< should displayed timestamps be of the form sec:usec since 1970
+		MessageCapture* capture; //!< if set, binary capture of messages instead of dumping them
 	
 	public:
-		Dump(bool rawTime) :
-			rawTime(rawTime)
+		Dump(bool rawTime, MessageCapture* capture = 0) :
+			rawTime(rawTime),
+			capture(capture)
 		{
 		}
 	
@@ -62,6 +68,14 @@ namespace Aseba
 		{
 			Message *message = Message::receive(stream);
 			
+			if (capture)
+			{
+				if (message)
+					capture->capture(*message, stream);
+				delete message;
+				return;
+			}
+			
 			dumpTime(cout, rawTime);
 			cout << stream->getTargetName()  << " ";
 			if (message)
@@ -73,6 +87,8 @@ namespace Aseba
 		
 		void connectionClosed(Stream *stream, bool abnormal)
 		{
+			if (capture)
+				capture->closed(stream);
 			dumpTime(cout);
 			cout << stream->getTargetName() << " connection closed";
 			if (abnormal)
@@ -92,6 +108,8 @@ void dumpHelp(std::ostream &stream, const char *programName)
 	stream << programName << " [options] [targets]*\n";
 	stream << "Options:\n";
 	stream << "--rawtime       : shows time in the form of sec:usec since 1970\n";
+	stream << "--capture file  : captures messages in binary form to file instead of printing them\n";
+	stream << "--decode file   : prints the messages captured in file and exits\n";
 	stream << "-h, --help      : shows this help\n";
 	stream << "-V, --version   : shows the version number\n";
 	stream << "Targets are any valid Dashel targets." << std::endl << std::endl;
@@ -110,6 +128,8 @@ int main(int argc, char *argv[])
 {
 	Dashel::initPlugins();
 	bool rawTime = false;
+	std::string captureFileName;
+	std::string decodeFileName;
 	std::vector<std::string> targets;
 	
 	int argCounter = 1;
@@ -122,6 +142,24 @@ int main(int argc, char *argv[])
 		{
 			rawTime = true;
 		}
+		else if (strcmp(arg, "--capture") == 0)
+		{
+			if (argCounter + 1 >= argc)
+			{
+				std::cerr << "capture file name needed" << std::endl;
+				return 1;
+			}
+			captureFileName = argv[++argCounter];
+		}
+		else if (strcmp(arg, "--decode") == 0)
+		{
+			if (argCounter + 1 >= argc)
+			{
+				std::cerr << "capture file name needed" << std::endl;
+				return 1;
+			}
+			decodeFileName = argv[++argCounter];
+		}
 		else if ((strcmp(arg, "-h") == 0) || (strcmp(arg, "--help") == 0))
 		{
 			dumpHelp(std::cout, argv[0]);
@@ -139,12 +177,39 @@ int main(int argc, char *argv[])
 		argCounter++;
 	}
 	
+	if (!decodeFileName.empty())
+	{
+		std::ifstream input(decodeFileName.c_str(), std::ios::binary);
+		if (!input.is_open())
+		{
+			std::cerr << "cannot open capture file " << decodeFileName << std::endl;
+			return 1;
+		}
+		if (!Aseba::MessageCapture::decode(input, std::wcout, rawTime))
+		{
+			std::cerr << decodeFileName << " is not a valid capture file or is truncated" << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+	
 	if (targets.empty())
 		targets.push_back(ASEBA_DEFAULT_TARGET);
 	
+	std::unique_ptr<Aseba::MessageCapture> capture;
+	if (!captureFileName.empty())
+	{
+		capture.reset(new Aseba::MessageCapture(captureFileName));
+		if (!capture->isOpen())
+		{
+			std::cerr << "cannot open capture file " << captureFileName << std::endl;
+			return 1;
+		}
+	}
+	
 	try
 	{
-		Aseba::Dump dump(rawTime);
+		Aseba::Dump dump(rawTime, capture.get());
 		for (size_t i = 0; i < targets.size(); i++)
 			dump.connect(targets[i]);
 		dump.run();
@@ -4,236 +4,530 @@
 		Stephane Magnenat <stephane at magnenat dot net>
 		(http://stephane.magnenat.net)
 		and other contributors, see authors.txt for details
-	
+
 	This program is free software: you can redistribute it and/or modify
 	it under the terms of the GNU Lesser General Public License as published
 	by the Free Software Foundation, version 3 of the License.
-	
+
 	This program is distributed in the hope that it will be useful,
 	but WITHOUT ANY WARRANTY; without even the implied warranty of
 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
 	GNU Lesser General Public License for more details.
-	
+
 	You should have received a copy of the GNU Lesser General Public License
 	along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <memory>
 #include <cassert>
+#include <cstring>
+#include <cstdlib>
 #include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <exception>
+#include <map>
+#include <set>
+#include <tuple>
 #include <dashel/dashel.h>
 #include "../../common/consts.h"
 #include "../../common/msg/msg.h"
 #include "../../common/msg/NodesManager.h"
 #include "../../common/utils/utils.h"
+#include "../../common/utils/AeslReader.h"
 #include "../../transport/dashel_plugins/dashel-plugins.h"
-#include <QCoreApplication>
-#include <QString>
-#include <QStringList>
-#include <QFile>
-#include <QDomDocument>
 
-namespace Aseba 
+namespace Aseba
 {
 	using namespace Dashel;
 	using namespace std;
-	
-	class MassLoader: public Hub, public NodesManager
+
+	typedef chrono::steady_clock Clock;
+
+	//! Return the duration between two time points in ms
+	static double msBetween(const Clock::time_point& begin, const Clock::time_point& end)
 	{
+		return chrono::duration<double, milli>(end - begin).count();
+	}
+
+	//! Serializes output of the deployment threads
+	static mutex outputMutex;
+
+	//! Compiles each program entry once per distinct target description, shared by all deployments
+	class CompilationCache
+	{
+	public:
+		//! Result of a compilation
+		struct Result
+		{
+			bool ok = false;
+			vector<uint16_t> bytecode;
+			wstring error;
+			double duration = 0; //!< compilation time in ms
+		};
+		typedef shared_ptr<const Result> ResultPtr;
+
 	protected:
-		QString fileName;
-		Stream* stream;
-		
+		//! A compilation is identified by the program entry and the description name and CRC
+		typedef tuple<size_t, wstring, uint16_t> Key;
+
+		const AeslReader& reader;
+		mutex cacheMutex;
+		mutex compilerMutex;
+		map<Key, shared_future<ResultPtr>> results;
+
 	public:
-		MassLoader(const QString& fileName):fileName(fileName),stream(0) {}
-		void loadToTarget(const std::string& target);
-		
+		CompilationCache(const AeslReader& reader): reader(reader) {}
+
+		//! Return the compiled entry for description, compiling it if no other deployment did; set cached accordingly; rethrow what the compilation threw
+		ResultPtr get(size_t entry, const TargetDescription& description, bool& cached)
+		{
+			const Key key(entry, description.name, description.crc());
+			promise<ResultPtr> resultPromise;
+			shared_future<ResultPtr> result;
+			{
+				lock_guard<mutex> lock(cacheMutex);
+				const auto resultIt(results.find(key));
+				cached = resultIt != results.end();
+				if (cached)
+					result = resultIt->second;
+				else
+					result = results[key] = resultPromise.get_future().share();
+			}
+			// compile outside the lock, other deployments needing this result wait on the future
+			if (!cached)
+			{
+				try
+				{
+					resultPromise.set_value(compile(entry, description));
+				}
+				catch (...)
+				{
+					// waiters get the exception as well
+					resultPromise.set_exception(current_exception());
+				}
+			}
+			return result.get();
+		}
+
+		//! Return the number of distinct compilations
+		size_t size()
+		{
+			lock_guard<mutex> lock(cacheMutex);
+			return results.size();
+		}
+
 	protected:
-		// from Hub
-		virtual void connectionCreated(Stream *stream);
-		virtual void incomingData(Stream *stream);
-		virtual void connectionClosed(Stream *stream, bool abnormal);
-	
-		// from NodesManager
-		virtual void sendMessage(const Message& message);
-		virtual void nodeDescriptionReceived(unsigned nodeId);
+		ResultPtr compile(size_t entry, const TargetDescription& description)
+		{
+			const Clock::time_point start(Clock::now());
+			shared_ptr<Result> result(make_shared<Result>());
+
+			std::wistringstream is(reader.getNodes()[entry].wcode());
+			Error error;
+			BytecodeVector bytecode;
+			unsigned allocatedVariablesCount;
+
+			{
+				// compilations are rare, serialize them as the compiler is not meant to run concurrently
+				lock_guard<mutex> lock(compilerMutex);
+				Compiler compiler;
+				compiler.setTargetDescription(&description);
+				compiler.setCommonDefinitions(&reader.getCommonDefinitions());
+				result->ok = compiler.compile(is, bytecode, allocatedVariablesCount, error);
+			}
+			if (result->ok)
+				result->bytecode.assign(bytecode.begin(), bytecode.end());
+			else
+				result->error = error.toWString();
+			result->duration = msBetween(start, Clock::now());
+			return result;
+		}
 	};
-	
-	void MassLoader::loadToTarget(const std::string& target)
+
+	//! Deploys the program to all nodes behind a single Dashel target
+	class TargetDeployer: public Hub, public NodesManager
 	{
-		while (true)
+	public:
+		//! Outcome of the deployment to one node
+		struct NodeReport
 		{
+			wstring name;
+			unsigned id = 0;
+			bool ok = false;
+			wstring message;
+			size_t bytecodeSize = 0;
+			bool cached = false;
+			double describe = 0; //!< time from connection to description, in ms
+			double compile = 0; //!< compilation time, in ms
+			double upload = 0; //!< upload time, in ms
+		};
+
+		//! Outcome of the deployment to the target
+		struct Report
+		{
+			string target;
+			bool ok = false;
+			string message;
+			double connect = 0; //!< connection time, in ms
+			double total = 0; //!< total time, in ms
+			vector<NodeReport> nodes;
+		};
+
+	protected:
+		const string target;
+		const AeslReader& reader;
+		CompilationCache& cache;
+		const unsigned timeout;
+
+		Stream* stream = nullptr;
+		Clock::time_point connectedTime;
+		Clock::time_point lastNewNodeTime;
+		set<unsigned> presentNodes; //!< nodes that announced themselves
+		set<unsigned> handledNodes; //!< nodes whose deployment is finished
+		bool closed = false;
+		Report report;
+
+	public:
+		TargetDeployer(const string& target, const AeslReader& reader, CompilationCache& cache, unsigned timeout):
+			target(target),
+			reader(reader),
+			cache(cache),
+			timeout(timeout)
+		{}
+
+		//! Connect to the target and deploy to all its nodes as soon as their descriptions arrive
+		Report deploy()
+		{
+			const Clock::time_point start(Clock::now());
+			report = Report();
+			report.target = target;
+			presentNodes.clear();
+			handledNodes.clear();
+			reset();
+			closed = false;
+
 			try
 			{
 				stream = connect(target);
-				if (stream)
+			}
+			catch (const DashelException& e)
+			{
+				report.message = string("connection failed: ") + e.what();
+				return report;
+			}
+			connectedTime = lastNewNodeTime = Clock::now();
+			report.connect = msBetween(start, connectedTime);
+
+			// ask nodes to present themselves right away, and again regularly until they answer
+			const chrono::milliseconds pingPeriod(250);
+			Clock::time_point lastPing(Clock::now());
+			pingNetwork();
+			while (!closed && !isDone())
+			{
+				step(20);
+				const Clock::time_point now(Clock::now());
+				if (msBetween(connectedTime, now) > timeout)
 				{
-					// TODO: make this timeout a parameter
-					// wait 1 s
-					UnifiedTime now;
-					while (true)
-					{
-						const UnifiedTime::Value delta((UnifiedTime() - now).value);
-						if (delta >= 1000)
-							break;
-						step(delta);
-					}
-					
-					// requests description
-					GetDescription().serialize(stream);
-					stream->flush();
-					// then run
-					run();
+					report.message = "timeout waiting for node descriptions";
+					break;
+				}
+				if (handledNodes.empty() && now - lastPing > pingPeriod)
+				{
+					pingNetwork();
+					lastPing = now;
 				}
 			}
-			catch (DashelException e)
-			{}
-			UnifiedTime(50).sleep();
+			if (closed && report.message.empty())
+				report.message = "connection closed";
+
+			report.ok = report.message.empty() && !report.nodes.empty();
+			for (const auto& node: report.nodes)
+				report.ok = report.ok && node.ok;
+			if (report.message.empty() && report.nodes.empty())
+				report.message = "no node to program";
+			report.total = msBetween(start, Clock::now());
+			return report;
 		}
-	}
-	
-	void MassLoader::connectionCreated(Stream *stream)
+
+		//! Wait until the target disconnects
+		void waitDisconnection()
+		{
+			while (stream && !closed && step(-1))
+			{
+				// drain incoming data until the connection closes
+			}
+		}
+
+		//! Disconnect from target, if connected
+		void disconnect()
+		{
+			if (stream && !closed)
+				closeStream(stream);
+			stream = nullptr;
+		}
+
+	protected:
+		//! Return whether every node that announced itself was handled, and new nodes had time to show up
+		bool isDone() const
+		{
+			if (handledNodes.empty())
+				return false;
+			for (const unsigned id: presentNodes)
+				if (handledNodes.find(id) == handledNodes.end())
+					return false;
+			return msBetween(lastNewNodeTime, Clock::now()) > 100;
+		}
+
+		// from Hub
+		virtual void incomingData(Stream *stream)
+		{
+			try
+			{
+				unique_ptr<Message> message(Message::receive(stream));
+				if (message->type == ASEBA_MESSAGE_NODE_PRESENT && presentNodes.insert(message->source).second)
+					lastNewNodeTime = Clock::now();
+				processMessage(message.get());
+			}
+			catch (const DashelException& e)
+			{
+				report.message = string("error while reading data: ") + e.what();
+			}
+		}
+
+		virtual void connectionClosed(Stream *stream, bool abnormal)
+		{
+			closed = true;
+			this->stream = nullptr;
+		}
+
+		// from NodesManager
+		virtual void sendMessage(const Message& message)
+		{
+			message.serialize(stream);
+			stream->flush();
+		}
+
+		virtual void nodeDescriptionReceived(unsigned nodeId)
+		{
+			presentNodes.insert(nodeId);
+			handledNodes.insert(nodeId);
+			const TargetDescription* description(getDescription(nodeId));
+			assert(description);
+
+			// look for code for this node in the program
+			const AeslReader::Nodes& entries(reader.getNodes());
+			size_t entry(0);
+			for (; entry < entries.size(); ++entry)
+			{
+				bool ok;
+				if (getNodeId(UTF8ToWString(entries[entry].name), entries[entry].preferedId(), &ok) == nodeId && ok)
+					break;
+			}
+			if (entry == entries.size())
+				return;
+
+			NodeReport nodeReport;
+			nodeReport.name = description->name;
+			nodeReport.id = nodeId;
+			nodeReport.describe = msBetween(connectedTime, Clock::now());
+
+			// compile, once per distinct description
+			CompilationCache::ResultPtr result;
+			try
+			{
+				result = cache.get(entry, *description, nodeReport.cached);
+			}
+			catch (const std::exception& e)
+			{
+				nodeReport.message = L"compilation failed: " + UTF8ToWString(e.what());
+				report.nodes.push_back(nodeReport);
+				return;
+			}
+			nodeReport.compile = nodeReport.cached ? 0 : result->duration;
+			if (!result->ok)
+			{
+				nodeReport.message = L"compilation error: " + result->error;
+				report.nodes.push_back(nodeReport);
+				return;
+			}
+
+			// upload and run
+			const Clock::time_point uploadStart(Clock::now());
+			try
+			{
+				sendBytecode(stream, nodeId, result->bytecode);
+				Run(nodeId).serialize(stream);
+				stream->flush();
+				nodeReport.ok = true;
+			}
+			catch (const DashelException& e)
+			{
+				nodeReport.message = L"upload failed: " + UTF8ToWString(e.what());
+			}
+			nodeReport.upload = msBetween(uploadStart, Clock::now());
+			nodeReport.bytecodeSize = result->bytecode.size();
+			report.nodes.push_back(nodeReport);
+		}
+	};
+
+	//! Print a deployment report
+	void dumpReport(wostream& stream, const TargetDeployer::Report& report)
 	{
-		//cerr << "Connection created to " << stream->getTargetName() << endl;
+		stream << UTF8ToWString(report.target) << L": " << (report.ok ? L"OK" : L"FAILED");
+		if (!report.message.empty())
+			stream << L" (" << UTF8ToWString(report.message) << L")";
+		stream << fixed << setprecision(1);
+		stream << L", connect " << report.connect << L" ms, total " << report.total << L" ms\n";
+		for (const auto& node: report.nodes)
+		{
+			stream << L"  " << node.name << L" (" << node.id << L"): ";
+			if (node.ok)
+				stream << node.bytecodeSize << L" words";
+			else
+				stream << node.message;
+			stream << L", described after " << node.describe << L" ms, compile ";
+			if (node.cached)
+				stream << L"cached";
+			else
+				stream << node.compile << L" ms";
+			stream << L", upload " << node.upload << L" ms\n";
+		}
+		stream.flush();
 	}
-	
-	void MassLoader::incomingData(Stream *stream)
+}
+
+//! Show usage
+void dumpHelp(std::ostream &stream, const char *programName)
+{
+	stream << "Aseba mass loader, loads the same program to many targets concurrently, usage:\n";
+	stream << programName << " [options] filename [targets]*\n";
+	stream << "Options:\n";
+	stream << "-t, --timeout ms: gives up on a target if its nodes are not described after ms (default: 5000)\n";
+	stream << "-l, --loop      : waits for each target to disconnect and deploys again when it reconnects\n";
+	stream << "-h, --help      : shows this help\n";
+	stream << "-V, --version   : shows the version number\n";
+	stream << "Targets are any valid Dashel targets, default is " << ASEBA_DEFAULT_TARGET << "." << std::endl;
+	stream << "Report bugs to: aseba-dev@gna.org" << std::endl;
+}
+
+//! Show version
+void dumpVersion(std::ostream &stream)
+{
+	stream << "Aseba mass loader " << ASEBA_VERSION << std::endl;
+	stream << "Aseba protocol " << ASEBA_PROTOCOL_VERSION << std::endl;
+	stream << "Licence LGPLv3: GNU LGPL version 3 <http://www.gnu.org/licenses/lgpl.html>\n";
+}
+
+int main(int argc, char *argv[])
+{
+	using namespace Aseba;
+
+	Dashel::initPlugins();
+	unsigned timeout = 5000;
+	bool loop = false;
+	std::string fileName;
+	std::vector<std::string> targets;
+
+	int argCounter = 1;
+	while (argCounter < argc)
 	{
-		try
+		const char *arg = argv[argCounter];
+
+		if ((strcmp(arg, "-t") == 0) || (strcmp(arg, "--timeout") == 0))
+		{
+			if (argCounter + 1 >= argc)
+			{
+				std::cerr << "timeout value needed" << std::endl;
+				return 1;
+			}
+			timeout = atoi(argv[++argCounter]);
+		}
+		else if ((strcmp(arg, "-l") == 0) || (strcmp(arg, "--loop") == 0))
+		{
+			loop = true;
+		}
+		else if ((strcmp(arg, "-h") == 0) || (strcmp(arg, "--help") == 0))
+		{
+			dumpHelp(std::cout, argv[0]);
+			return 0;
+		}
+		else if ((strcmp(arg, "-V") == 0) || (strcmp(arg, "--version") == 0))
+		{
+			dumpVersion(std::cout);
+			return 0;
+		}
+		else if (fileName.empty())
 		{
-			// get message
-			unique_ptr<Message> message(Message::receive(stream));
-			/*wcerr << L"  msg: ";
-			message->dump(wcerr);
-			wcerr << endl;*/
-			// process it
-			processMessage(message.get());
+			fileName = arg;
 		}
-		catch (DashelException e)
+		else
 		{
-			wcerr << L"Error while reading data: " << e.what() << endl;
+			targets.push_back(arg);
 		}
+		argCounter++;
 	}
-	
-	void MassLoader::connectionClosed(Stream *stream, bool abnormal)
+
+	if (fileName.empty())
 	{
-		//cerr << "Connection closed to " << stream->getTargetName() << endl;
-		assert(stream == this->stream);
-		this->stream = 0;
-		stop();
-		reset();
+		dumpHelp(std::cerr, argv[0]);
+		return 1;
 	}
-	
-	void MassLoader::sendMessage(const Message& message)
+	if (targets.empty())
+		targets.push_back(ASEBA_DEFAULT_TARGET);
+
+	// read the program once for all targets
+	AeslReader reader;
+	if (!reader.openFile(fileName))
 	{
-		message.serialize(stream);
-		stream->flush();
+		std::cerr << "Cannot read " << fileName << ": " << reader.getError() << std::endl;
+		return 1;
 	}
-	
-	void MassLoader::nodeDescriptionReceived(unsigned nodeId)
+	CompilationCache cache(reader);
+
+	// deploy to all targets concurrently
+	const Clock::time_point start(Clock::now());
+	std::vector<TargetDeployer::Report> reports(targets.size());
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < targets.size(); ++i)
 	{
-		//cerr << "Description received" << endl;
-		assert(stream);
-		
-		// we have a new node description, load file to see if there is code for it
-		CommonDefinitions commonDefinitions;
-		
-		// open file
-		QFile file(fileName);
-		if (!file.open(QFile::ReadOnly))
-		{
-			wcerr << QString("Cannot open file %0").arg(fileName).toStdWString() << endl;
-			return;
-		}
-		// load document
-		QDomDocument document("aesl-source");
-		QString errorMsg;
-		int errorLine;
-		int errorColumn;
-		if (!document.setContent(&file, false, &errorMsg, &errorLine, &errorColumn))
-		{
-			wcerr << QString("Error in XML source file: %0 at line %1, column %2").arg(errorMsg).arg(errorLine).arg(errorColumn).toStdWString() << endl;
-			return;
-		}
-		
-		// FIXME: this code depends on event and contants being before any code
-		QDomNode domNode = document.documentElement().firstChild();
-		while (!domNode.isNull())
-		{
-			if (domNode.isElement())
-			{
-				QDomElement element = domNode.toElement();
-				if (element.tagName() == "node")
-				{
-					bool ok;
-					const unsigned nodeId(getNodeId(element.attribute("name").toStdWString(), element.attribute("nodeId", 0).toUInt(), &ok));
-					if (ok)
-					{
-						std::wistringstream is(element.firstChild().toText().data().toStdWString());
-						Error error;
-						BytecodeVector bytecode;
-						unsigned allocatedVariablesCount;
-						
-						Compiler compiler;
-						compiler.setTargetDescription(getDescription(nodeId));
-						compiler.setCommonDefinitions(&commonDefinitions);
-						bool result = compiler.compile(is, bytecode, allocatedVariablesCount, error);
-						
-						if (result)
-						{
-							sendBytecode(stream, nodeId, std::vector<uint16_t>(bytecode.begin(), bytecode.end()));
-							Run(nodeId).serialize(stream);
-							stream->flush();
-							wcerr << QString("! %1 bytecodes loaded to target %0, you can disconnect target !").arg(element.attribute("name")).arg(bytecode.size()).toStdWString() << endl;
-						}
-						else
-						{
-							wcerr << L"Compilation error: " << error.toWString() << endl;
-							break;
-						}
-					}
-				}
-				else if (element.tagName() == "event")
+		threads.emplace_back([&, i]() {
+			TargetDeployer deployer(targets[i], reader, cache, timeout);
+			do
+			{
+				reports[i] = deployer.deploy();
+				if (loop)
 				{
-					const QString eventName(element.attribute("name"));
-					const unsigned eventSize(element.attribute("size").toUInt());
-					if (eventSize > ASEBA_MAX_EVENT_ARG_SIZE)
-					{
-						wcerr << QString("Event %1 has a length %2 larger than maximum %3").arg(eventName).arg(eventSize).arg(ASEBA_MAX_EVENT_ARG_SIZE).toStdWString() << endl;
-						break;
-					}
-					else
 					{
-						commonDefinitions.events.push_back(NamedValue(eventName.toStdWString(), eventSize));
+						std::lock_guard<std::mutex> lock(outputMutex);
+						dumpReport(std::wcout, reports[i]);
 					}
-				}
-				else if (element.tagName() == "constant")
-				{
-					commonDefinitions.constants.push_back(NamedValue(element.attribute("name").toStdWString(), element.attribute("value").toUInt()));
+					// wait for the target to go away, or retry shortly if it was never there
+					deployer.waitDisconnection();
+					deployer.disconnect();
+					UnifiedTime(50).sleep();
 				}
 			}
-			domNode = domNode.nextSibling();
-		}
+			while (loop);
+			deployer.disconnect();
+		});
 	}
-}
+	for (auto& thread: threads)
+		thread.join();
 
-int main(int argc, char *argv[])
-{
-	QCoreApplication app(argc, argv);
-	Dashel::initPlugins();
-	
-	QString target(ASEBA_DEFAULT_TARGET);
-	
-	if (app.arguments().size() < 2)
+	// report
+	bool ok(true);
+	for (const auto& report: reports)
 	{
-		std::wcerr << L"Usage: " << app.arguments().first().toStdWString() << L" filename [target]" << std::endl;
-		return 1;
+		dumpReport(std::wcout, report);
+		ok = ok && report.ok;
 	}
-	
-	if (app.arguments().size() >= 3)
-		target = app.arguments().at(2);
-	
-	Aseba::MassLoader massLoader(app.arguments().at(1));
-	massLoader.loadToTarget(target.toStdString());
-	return 0;
+	std::wcout << reports.size() << L" targets, " << cache.size() << L" distinct compilations, ";
+	std::wcout << std::fixed << std::setprecision(1) << msBetween(start, Clock::now()) << L" ms" << std::endl;
+
+	return ok ? 0 : 1;
 }
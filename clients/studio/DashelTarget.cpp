@@ -272,6 +272,9 @@ namespace Aseba
 		isRunning(true),
 		stream(0)
 	{
+		// events batches are unpacked in incomingData
+		announcedProtocolVersion = ASEBA_EVENTS_BATCH_PROTOCOL_VERSION;
+		
 		// first use local name
 		const QString& systemLocale(QLocale::system().name());
 		translators[0]->load(QString("qt_") + systemLocale, QLibraryInfo::location(QLibraryInfo::TranslationsPath));
@@ -381,7 +384,16 @@ namespace Aseba
 	{
 		
 		Message *message = Message::receive(stream);
-		emit messageAvailable(message);
+		// a batch carries several events, emit them one by one
+		const EventsBatch *batch(dynamic_cast<const EventsBatch *>(message));
+		if (batch)
+		{
+			for (const UserMessage& event: batch->events)
+				emit messageAvailable(new UserMessage(event));
+			delete message;
+		}
+		else
+			emit messageAvailable(message);
 	}
 	
 	void DashelInterface::connectionClosed(Stream* stream, bool abnormal)
@@ -32,6 +32,7 @@
 
 #include "ActionBlocks.h"
 #include "Buttons.h"
+#include "Utils.h"
 #include "UsageLogger.h"
 
 namespace Aseba { namespace ThymioVPL
@@ -40,7 +41,7 @@ namespace Aseba { namespace ThymioVPL
 	MoveActionBlock::MoveActionBlock( QGraphicsItem *parent ) :
 		Block("action", "move", parent)
 	{
-		new QGraphicsSvgItem (":/images/vpl_background_motor.svgz", this);
+		newSvgItem(":/images/vpl_background_motor.svgz", this);
 
 		for(int i=0; i<2; i++)
 		{
@@ -245,7 +246,7 @@ namespace Aseba { namespace ThymioVPL
 		notes[4] = 1; durations[4] = 1;
 		notes[5] = 2; durations[5] = 2;
 		
-		new QGraphicsSvgItem (":/images/notes.svgz", this);
+		newSvgItem(":/images/notes.svgz", this);
 	}
 	
 	void SoundActionBlock::paint (QPainter * painter, const QStyleOptionGraphicsItem * option, QWidget * widget)
@@ -418,7 +419,7 @@ namespace Aseba { namespace ThymioVPL
 		dragging(false),
 		duration(1.0)
 	{
-		new QGraphicsSvgItem (":/images/timer.svgz", this);
+		newSvgItem(":/images/timer.svgz", this);
 		
 		timer = new QTimeLine(duration, this);
 		timer->setFrameRange(0, duration/40);
@@ -43,6 +43,7 @@
 #include "ActionBlocks.h"
 #include "Scene.h"
 #include "Style.h"
+#include "Utils.h"
 #include "../../../../common/utils/utils.h"
 #include "UsageLogger.h"
 
@@ -53,7 +54,7 @@ namespace Aseba { namespace ThymioVPL
 		QGraphicsObject(parent),
 		event(0),
 		stateFilter(0),
-		blinkGraphicsItem(new QGraphicsSvgItem(":/images/vpl/blink.svg", this)),
+		blinkGraphicsItem(newSvgItem(":/images/vpl/blink.svg", this)),
 		deleteButton(new AddRemoveButton(false, this)),
 		addButton(new AddRemoveButton(true, this)),
 		deleteBlockButton(new RemoveBlockButton(this)),
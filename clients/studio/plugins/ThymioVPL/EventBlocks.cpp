@@ -29,6 +29,7 @@
 
 #include "EventBlocks.h"
 #include "Buttons.h"
+#include "Utils.h"
 #include "UsageLogger.h"
 #include "Style.h"
 
@@ -180,11 +181,11 @@ namespace Aseba { namespace ThymioVPL
 		mode(MODE_TAP),
 		orientation(0),
 		dragging(false),
-		tapSimpleSvg(new QGraphicsSvgItem (":/images/vpl_block_acc_tap_simple.svgz", this)),
-		tapAdvancedSvg(new QGraphicsSvgItem (":/images/vpl_block_acc_tap_advanced.svgz", this)),
-		quadrantSvg(new QGraphicsSvgItem (":/images/vpl_block_acc_quadrant.svgz", this)),
-		pitchSvg(new QGraphicsSvgItem (":/images/vpl_block_acc_pitch.svgz", this)),
-		rollSvg(new QGraphicsSvgItem (":/images/vpl_block_acc_roll.svgz", this))
+		tapSimpleSvg(newSvgItem(":/images/vpl_block_acc_tap_simple.svgz", this)),
+		tapAdvancedSvg(newSvgItem(":/images/vpl_block_acc_tap_advanced.svgz", this)),
+		quadrantSvg(newSvgItem(":/images/vpl_block_acc_quadrant.svgz", this)),
+		pitchSvg(newSvgItem(":/images/vpl_block_acc_pitch.svgz", this)),
+		rollSvg(newSvgItem(":/images/vpl_block_acc_roll.svgz", this))
 	{
 		tapSimpleSvg->setVisible(!advanced);
 		tapAdvancedSvg->setVisible(advanced);
@@ -380,7 +381,7 @@ namespace Aseba { namespace ThymioVPL
 	ClapEventBlock::ClapEventBlock( QGraphicsItem *parent ) :
 		BlockWithNoValues("event", "clap", parent)
 	{
-		new QGraphicsSvgItem (":/images/thymioclap.svgz", this);
+		newSvgItem(":/images/thymioclap.svgz", this);
 	}
 	
 	
@@ -388,7 +389,7 @@ namespace Aseba { namespace ThymioVPL
 	TimeoutEventBlock::TimeoutEventBlock(QGraphicsItem *parent):
 		BlockWithNoValues("event", "timeout", parent)
 	{
-		new QGraphicsSvgItem (":/images/timeout.svgz", this);
+		newSvgItem(":/images/timeout.svgz", this);
 	}
 
 } } // namespace ThymioVPL / namespace Aseba
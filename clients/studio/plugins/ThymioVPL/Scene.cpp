@@ -29,6 +29,7 @@
 #include "Block.h"
 #include "ThymioVisualProgramming.h"
 #include "Style.h"
+#include "Utils.h"
 #include "UsageLogger.h"
 
 using namespace std;
@@ -39,9 +40,9 @@ namespace Aseba { namespace ThymioVPL
 	Scene::Scene(ThymioVisualProgramming *vpl) : 
 		QGraphicsScene(vpl),
 		vpl(vpl),
-		warningGraphicsItem(new QGraphicsSvgItem(":/images/vpl/missing_block.svgz")),
-		errorGraphicsItem(new QGraphicsSvgItem(":/images/vpl/error.svgz")),
-		referredGraphicsItem(new QGraphicsSvgItem(":/images/vpl/error.svgz")),
+		warningGraphicsItem(newSvgItem(":/images/vpl/missing_block.svgz")),
+		errorGraphicsItem(newSvgItem(":/images/vpl/error.svgz")),
+		referredGraphicsItem(newSvgItem(":/images/vpl/error.svgz")),
 		referredLineItem(addLine(0, 0, 0, 0, QPen(Qt::red, 8, Qt::DashLine))),
 		sceneModified(false),
 		advancedMode(false),
@@ -190,10 +191,10 @@ namespace Aseba { namespace ThymioVPL
 		connect(eventActionsSet, SIGNAL(undoCheckpoint()), this, SIGNAL(undoCheckpoint()));
 	}
 	
-	//! Return whether we have to generate debug log information
+	//! Return whether we have to generate debug log information, never without vpl, as when rendering offline
 	bool Scene::debugLog() const
 	{
-		return vpl->debugLog;
+		return vpl && vpl->debugLog;
 	}
 
 	//! Return whether the scene is as when started
@@ -535,6 +535,7 @@ namespace Aseba { namespace ThymioVPL
 	void ThymioVisualProgramming::setColorScheme(int index)
 	{
 		Style::blockSetCurrentColorIndex(index);
+		clearPixmapCache();
 		
 		scene->update();
 		updateBlockButtonImages();
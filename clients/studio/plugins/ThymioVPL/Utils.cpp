@@ -20,19 +20,67 @@
 
 #include "Utils.h"
 #include <QSvgRenderer>
+#include <QGraphicsSvgItem>
+#include <QApplication>
 #include <QPainter>
+#include <QCache>
+#include <QHash>
 
 namespace Aseba { namespace ThymioVPL
 {
+	//! Renderers of the SVG files, parsed once and shared by all the items showing them
+	static QHash<QString, QSvgRenderer*> svgRenderers;
 	
+	//! Rasterised SVG files, least recently used ones are dropped first, cost is in kB
+	static QCache<QString, QPixmap> svgPixmaps(4096);
+	
+	//! Return the renderer of fileName, parsing it on first use; the renderer lives as long as the application
+	QSvgRenderer* sharedSvgRenderer(const QString& fileName)
+	{
+		QSvgRenderer*& renderer(svgRenderers[fileName]);
+		if (!renderer)
+			renderer = new QSvgRenderer(fileName, qApp);
+		return renderer;
+	}
+	
+	//! Create an item showing fileName, using the shared renderer of this file
+	QGraphicsSvgItem* newSvgItem(const QString& fileName, QGraphicsItem* parent)
+	{
+		QGraphicsSvgItem* item(new QGraphicsSvgItem(parent));
+		item->setSharedRenderer(sharedSvgRenderer(fileName));
+		return item;
+	}
+	
+	//! Return fileName rendered in a square of size pixels, rendering it only if it is not in cache
 	QPixmap pixmapFromSVG(const QString& fileName, int size)
 	{
-		QSvgRenderer renderer(fileName);
-		QPixmap pixmap(size, size);
+		#if QT_VERSION >= 0x050000
+		const qreal ratio(qApp->devicePixelRatio());
+		#else // QT_VERSION >= 0x050000
+		const qreal ratio(1);
+		#endif // QT_VERSION >= 0x050000
+		const QString key(QString("%1:%2:%3").arg(fileName).arg(size).arg(ratio));
+		if (const QPixmap* cached = svgPixmaps.object(key))
+			return *cached;
+		
+		const int pixelSize(qRound(size * ratio));
+		QPixmap pixmap(pixelSize, pixelSize);
 		pixmap.fill(Qt::transparent);
 		QPainter painter(&pixmap);
-		renderer.render(&painter);
+		sharedSvgRenderer(fileName)->render(&painter);
+		painter.end();
+		#if QT_VERSION >= 0x050000
+		pixmap.setDevicePixelRatio(ratio);
+		#endif // QT_VERSION >= 0x050000
+		
+		svgPixmaps.insert(key, new QPixmap(pixmap), qMax(1, pixelSize * pixelSize * 4 / 1024));
 		return pixmap;
 	}
+	
+	//! Drop all rasterised SVG files, for instance when the style changes
+	void clearPixmapCache()
+	{
+		svgPixmaps.clear();
+	}
 
 } } // namespace ThymioVPL / namespace Aseba
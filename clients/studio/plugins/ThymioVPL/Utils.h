@@ -24,10 +24,17 @@
 #include <QPixmap>
 #include <QString>
 
+class QSvgRenderer;
+class QGraphicsItem;
+class QGraphicsSvgItem;
+
 namespace Aseba { namespace ThymioVPL
 {
 	
+	QSvgRenderer* sharedSvgRenderer(const QString& fileName);
+	QGraphicsSvgItem* newSvgItem(const QString& fileName, QGraphicsItem* parent = 0);
 	QPixmap pixmapFromSVG(const QString& fileName, int size);
+	void clearPixmapCache();
 	
 } } // namespace ThymioVPL / namespace Aseba
 
@@ -19,110 +19,402 @@
 */
 
 
-#include <signal.h>
+
 #include <QApplication>
 #include <QString>
+#include <QStringList>
 #include <QSvgGenerator>
 #include <QPainter>
+#include <QPicture>
+#include <QImage>
 #include <QSize>
+#include <QFile>
+#include <QBuffer>
+#include <QByteArray>
+#include <QDir>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QDomDocument>
+#include <QThreadPool>
+#include <QtConcurrentRun>
+#include <QFuture>
 #include <QDebug>
 #include <iostream>
 #include <stdexcept>
+#include "../../common/consts.h"
 #include "plugins/ThymioVPL/EventBlocks.h"
 #include "plugins/ThymioVPL/ActionBlocks.h"
 #include "plugins/ThymioVPL/StateBlocks.h"
+#include "plugins/ThymioVPL/Scene.h"
 
 using namespace std;
 
 /**
-	\defgroup rendervplblocks Helper application that generates SVG files of VPL blocks
+	\defgroup rendervplblocks Helper application that generates SVG and PNG files of VPL blocks and programs
 */
 
 namespace Aseba { namespace ThymioVPL {
 	
-	void setupGenerator(QSvgGenerator& generator, QString& templateName)
+	//! What and how to render
+	struct RenderOptions
 	{
-		generator.setFileName(templateName + ".svg");
-		generator.setSize(QSize(256, 256));
-		generator.setViewBox(QRectF(0, 0, 256, 256));
-		generator.setTitle("VPL " + templateName);
-		generator.setDescription("This image was generated by an helper tool part of Aseba, get it at http://thymio.org");
+		QDir outputDir;
+		bool svg;
+		bool png;
+		qreal pngScale;
 		
+		RenderOptions():
+			outputDir(QDir::current()),
+			svg(false),
+			png(false),
+			pngScale(1)
+		{}
+	};
+	
+	//! An image to write, painted on the GUI thread and written by a worker thread
+	struct RenderJob
+	{
+		QString name; //!< base name of the output files
+		QString source; //!< "template" for block templates, or the program file
+		QString title; //!< title of the SVG output
+		QRectF viewBox; //!< part of the picture to output
+		QByteArray svg; //!< SVG document, if requested
+		QImage image; //!< image to write as PNG, if requested
+	};
+	
+	//! What a RenderJob produced, for the manifest
+	struct RenderResult
+	{
+		RenderJob job;
+		QStringList files;
+		QString error;
+	};
+	
+	//! Paint picture into the formats of options on job, must be called from the GUI thread as picture may hold pixmaps
+	void paintJob(RenderJob& job, const QPicture& picture, const RenderOptions& options)
+	{
+		if (options.svg)
+		{
+			QBuffer buffer(&job.svg);
+			QSvgGenerator generator;
+			generator.setOutputDevice(&buffer);
+			generator.setSize(job.viewBox.size().toSize());
+			generator.setViewBox(job.viewBox);
+			generator.setTitle(job.title);
+			generator.setDescription("This image was generated by an helper tool part of Aseba, get it at http://thymio.org");
+			
+			QPainter painter(&generator);
+			painter.drawPicture(0, 0, picture);
+			painter.end();
+		}
+		
+		if (options.png)
+		{
+			const QSize size((job.viewBox.size() * options.pngScale).toSize());
+			job.image = QImage(size, QImage::Format_ARGB32_Premultiplied);
+			job.image.fill(Qt::transparent);
+			QPainter painter(&job.image);
+			painter.setRenderHint(QPainter::Antialiasing);
+			painter.scale(options.pngScale, options.pngScale);
+			painter.translate(-job.viewBox.topLeft());
+			painter.drawPicture(0, 0, picture);
+		}
 	}
 	
-	template<typename T>
-	void renderBlock(QString templateName)
+	//! Write job in the formats of options, can be called from any thread as it only encodes a QImage and writes files
+	RenderResult writeJob(const RenderJob& job, const RenderOptions& options)
 	{
-		QSvgGenerator generator;
-		setupGenerator(generator, templateName);
+		RenderResult result;
+		result.job.name = job.name;
+		result.job.source = job.source;
+		result.job.title = job.title;
+		result.job.viewBox = job.viewBox;
 		
-		QPainter painter(&generator);
+		if (options.svg)
+		{
+			const QString fileName(job.name + ".svg");
+			QFile file(options.outputDir.filePath(fileName));
+			if (file.open(QFile::WriteOnly | QFile::Truncate) && file.write(job.svg) == job.svg.size())
+				result.files.append(fileName);
+			else
+				result.error = QString("cannot write %0").arg(fileName);
+		}
 		
-		T block;
-		block.render(painter);
+		if (options.png)
+		{
+			const QString fileName(job.name + ".png");
+			if (job.image.save(options.outputDir.filePath(fileName)))
+				result.files.append(fileName);
+			else
+				result.error = QString("cannot write %0").arg(fileName);
+		}
+		
+		return result;
 	}
 	
-	template<typename T>
-	void renderBlock(QString templateName, bool advanced)
+	//! Render and write images concurrently, painting on the GUI thread and encoding and writing on the thread pool
+	class BatchRenderer
 	{
-		QSvgGenerator generator;
-		setupGenerator(generator, templateName);
+	public:
+		BatchRenderer(const RenderOptions& options):
+			options(options)
+		{}
+		
+		//! Record block and queue it for writing as templateName
+		void addBlock(Block& block, const QString& templateName)
+		{
+			RenderJob job;
+			job.name = templateName;
+			job.source = "template";
+			job.title = "VPL " + templateName;
+			job.viewBox = QRectF(0, 0, 256, 256);
+			QPicture picture;
+			QPainter painter(&picture);
+			block.render(painter);
+			painter.end();
+			queue(job, picture);
+		}
+		
+		//! Load the VPL program of fileName, record it and queue it for writing, return false if it cannot be read
+		bool addProgram(const QString& fileName)
+		{
+			QFile file(fileName);
+			QDomDocument document;
+			QString errorMessage;
+			if (!file.open(QFile::ReadOnly) || !document.setContent(&file, &errorMessage))
+			{
+				failures.append(qMakePair(fileName, errorMessage.isEmpty() ? QString("cannot read file") : errorMessage));
+				return false;
+			}
+			
+			// either a .aesl file, in which the program is saved by the plugin, or the content saved by the plugin
+			QDomElement vplroot(document.documentElement());
+			if (vplroot.tagName() != "vplroot")
+				vplroot = vplroot.firstChildElement("node").firstChildElement("toolsPlugins").firstChildElement("ThymioVisualProgramming").firstChildElement("vplroot");
+			const QDomElement programElement(vplroot.firstChildElement("program"));
+			if (programElement.isNull() || vplroot.attribute("xml-format-version") != "1")
+			{
+				failures.append(qMakePair(fileName, QString("no VPL program in version 1 format")));
+				return false;
+			}
+			
+			Scene scene(0);
+			scene.deserialize(programElement);
+			
+			RenderJob job;
+			job.name = QFileInfo(fileName).completeBaseName();
+			job.source = fileName;
+			job.title = QString("VPL program %0").arg(fileName);
+			job.viewBox = scene.sceneRect();
+			QPicture picture;
+			QPainter painter(&picture);
+			scene.render(&painter, job.viewBox, job.viewBox);
+			painter.end();
+			queue(job, picture);
+			return true;
+		}
 		
-		QPainter painter(&generator);
+		//! Wait for all images to be written, write the manifest and return whether everything succeeded
+		bool finish()
+		{
+			bool ok(failures.empty());
+			QFile manifestFile(options.outputDir.filePath("manifest.json"));
+			if (!manifestFile.open(QFile::WriteOnly | QFile::Truncate | QFile::Text))
+			{
+				cerr << "Cannot write " << manifestFile.fileName().toLocal8Bit().constData() << endl;
+				return false;
+			}
+			QTextStream manifest(&manifestFile);
+			manifest.setCodec("UTF-8");
+			manifest << "{\n\t\"outputs\": [";
+			for (int i = 0; i < futures.size(); ++i)
+			{
+				const RenderResult result(futures[i].result());
+				manifest << (i ? ",\n" : "\n");
+				manifest << "\t\t{ \"name\": " << quoted(result.job.name);
+				manifest << ", \"source\": " << quoted(result.job.source);
+				manifest << ", \"width\": " << result.job.viewBox.width() << ", \"height\": " << result.job.viewBox.height();
+				manifest << ", \"files\": [";
+				for (int j = 0; j < result.files.size(); ++j)
+					manifest << (j ? ", " : " ") << quoted(result.files[j]) << (j + 1 == result.files.size() ? " " : "");
+				manifest << "]";
+				if (!result.error.isEmpty())
+				{
+					manifest << ", \"error\": " << quoted(result.error);
+					cerr << result.job.name.toLocal8Bit().constData() << ": " << result.error.toLocal8Bit().constData() << endl;
+					ok = false;
+				}
+				manifest << " }";
+			}
+			manifest << "\n\t],\n\t\"failures\": [";
+			for (int i = 0; i < failures.size(); ++i)
+			{
+				manifest << (i ? ",\n" : "\n");
+				manifest << "\t\t{ \"source\": " << quoted(failures[i].first) << ", \"error\": " << quoted(failures[i].second) << " }";
+				cerr << failures[i].first.toLocal8Bit().constData() << ": " << failures[i].second.toLocal8Bit().constData() << endl;
+			}
+			manifest << "\n\t]\n}\n";
+			return ok;
+		}
 		
+	protected:
+		//! Paint picture into job here, as only QImage is safe to use outside the GUI thread, then write it on the thread pool
+		void queue(RenderJob& job, const QPicture& picture)
+		{
+			paintJob(job, picture, options);
+			futures.append(QtConcurrent::run(writeJob, job, options));
+		}
+		
+		//! Return text as a JSON string
+		static QString quoted(const QString& text)
+		{
+			QString result("\"");
+			for (int i = 0; i < text.size(); ++i)
+			{
+				const QChar c(text[i]);
+				if (c == '"' || c == '\\')
+					result += QString("\\") + c;
+				else if (c == '\n')
+					result += "\\n";
+				else if (c.unicode() < 0x20)
+					result += QString("\\u%1").arg(c.unicode(), 4, 16, QChar('0'));
+				else
+					result += c;
+			}
+			return result + "\"";
+		}
+		
+	protected:
+		const RenderOptions options;
+		QList<QFuture<RenderResult> > futures;
+		QList<QPair<QString, QString> > failures; //!< programs that could not be loaded, with the reason
+	};
+	
+	template<typename T>
+	void renderBlock(BatchRenderer& renderer, QString templateName)
+	{
+		T block;
+		renderer.addBlock(block, templateName);
+	}
+	
+	template<typename T>
+	void renderBlock(BatchRenderer& renderer, QString templateName, bool advanced)
+	{
 		T block(advanced);
-		block.render(painter);
+		renderer.addBlock(block, templateName);
 	}
 	
 	template<typename T>
-	void renderBlockValue(QString templateName, unsigned i, unsigned value)
+	void renderBlockValue(BatchRenderer& renderer, QString templateName, unsigned i, unsigned value)
 	{
-		QSvgGenerator generator;
-		setupGenerator(generator, templateName);
-		
-		QPainter painter(&generator);
-		
 		T block(true);
 		block.setValue(i,value);
-		block.render(painter);
+		renderer.addBlock(block, templateName);
 	}
 	
-	void renderBlocks()
+	void renderBlocks(BatchRenderer& renderer)
 	{
 		// events
-		renderBlock<ArrowButtonsEventBlock>("event-buttons");
-		renderBlock<ProxEventBlock>("event-prox", false);
-		renderBlock<ProxEventBlock>("event-prox-advanced", true);
-		renderBlock<ProxGroundEventBlock>("event-prox-ground", false);
-		renderBlock<ProxGroundEventBlock>("event-prox-ground-advanced", true);
-		renderBlock<AccEventBlock>("event-tap", false);
-		renderBlock<AccEventBlock>("event-tap-advanced", true);
-		renderBlockValue<AccEventBlock>("event-roll", 0, 1);
-		renderBlockValue<AccEventBlock>("event-pitch", 0, 2);
-		renderBlock<ClapEventBlock>("event-clap");
-		renderBlock<TimeoutEventBlock>("");
+		renderBlock<ArrowButtonsEventBlock>(renderer, "event-buttons");
+		renderBlock<ProxEventBlock>(renderer, "event-prox", false);
+		renderBlock<ProxEventBlock>(renderer, "event-prox-advanced", true);
+		renderBlock<ProxGroundEventBlock>(renderer, "event-prox-ground", false);
+		renderBlock<ProxGroundEventBlock>(renderer, "event-prox-ground-advanced", true);
+		renderBlock<AccEventBlock>(renderer, "event-tap", false);
+		renderBlock<AccEventBlock>(renderer, "event-tap-advanced", true);
+		renderBlockValue<AccEventBlock>(renderer, "event-roll", 0, 1);
+		renderBlockValue<AccEventBlock>(renderer, "event-pitch", 0, 2);
+		renderBlock<ClapEventBlock>(renderer, "event-clap");
+		renderBlock<TimeoutEventBlock>(renderer, "event-timeout");
 		
 		// filters
-		renderBlock<StateFilterCheckBlock>("state-filter");
+		renderBlock<StateFilterCheckBlock>(renderer, "state-filter");
 		
 		// actions
-		renderBlock<MoveActionBlock>("action-motors");
-		renderBlock<TopColorActionBlock>("action-colors-up");
-		renderBlock<BottomColorActionBlock>("action-colors-down");
-		renderBlock<SoundActionBlock>("action-music");
-		renderBlock<TimerActionBlock>("action-timer");
-		renderBlock<StateFilterActionBlock>("action-states");
+		renderBlock<MoveActionBlock>(renderer, "action-motors");
+		renderBlock<TopColorActionBlock>(renderer, "action-colors-up");
+		renderBlock<BottomColorActionBlock>(renderer, "action-colors-down");
+		renderBlock<SoundActionBlock>(renderer, "action-music");
+		renderBlock<TimerActionBlock>(renderer, "action-timer");
+		renderBlock<StateFilterActionBlock>(renderer, "action-states");
 	}
 	
 } } // namespace ThymioVPL / namespace Aseba
 
+void usage(const char *execName)
+{
+	cout << "Render VPL blocks and programs to images" << endl << endl;
+	cout << "Usage: " << execName << " (OPTIONS|FILE)*" << endl;
+	cout << "  where" << endl;
+	cout << "OPTION is one of:" << endl;
+	cout << " -svg           write SVG files (default if no format is given)" << endl;
+	cout << " -png           write PNG files" << endl;
+	cout << " -scale FACTOR  scale of PNG files, 1 by default" << endl;
+	cout << " -o DIR         write files and manifest.json to DIR, the current directory by default" << endl;
+	cout << " -j COUNT       number of threads writing files, the number of cores by default" << endl;
+	cout << " -h             this help" << endl;
+	cout << "FILE is a .aesl file or a file saved by VPL, whose program is rendered;" << endl;
+	cout << "if no FILE is given, the block templates are rendered" << endl;
+	cout << "Without a display, run through xvfb-run" << endl;
+	cout << endl;
+	cout << "Version " << ASEBA_VERSION << ", Aseba protocol " << ASEBA_PROTOCOL_VERSION << endl;
+	cout << "Licence LGPLv3: GNU LGPL version 3 <http://www.gnu.org/licenses/lgpl.html>" << endl;
+}
+
 int main(int argc, char *argv[])
 {
 	QApplication app(argc, argv);
 	
-	Aseba::ThymioVPL::renderBlocks();
+	Aseba::ThymioVPL::RenderOptions options;
+	QStringList programFiles;
+	for (int i = 1; i < argc; ++i)
+	{
+		const QString arg(QString::fromLocal8Bit(argv[i]));
+		if (arg == "-h")
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		else if (arg == "-svg")
+			options.svg = true;
+		else if (arg == "-png")
+			options.png = true;
+		else if (arg == "-scale" && i + 1 < argc)
+			options.pngScale = QString(argv[++i]).toDouble();
+		else if (arg == "-o" && i + 1 < argc)
+		{
+			const QString dirName(QString::fromLocal8Bit(argv[++i]));
+			if (!QDir().mkpath(dirName))
+			{
+				cerr << "Cannot create directory " << argv[i] << endl;
+				return 1;
+			}
+			options.outputDir = QDir(dirName);
+		}
+		else if (arg == "-j" && i + 1 < argc)
+			QThreadPool::globalInstance()->setMaxThreadCount(QString(argv[++i]).toInt());
+		else if (arg.startsWith('-'))
+		{
+			usage(argv[0]);
+			return 1;
+		}
+		else
+			programFiles.append(arg);
+	}
+	if (!options.svg && !options.png)
+		options.svg = true;
+	if (options.pngScale <= 0)
+	{
+		cerr << "Invalid scale" << endl;
+		return 1;
+	}
+	
+	Aseba::ThymioVPL::BatchRenderer renderer(options);
+	if (programFiles.empty())
+		Aseba::ThymioVPL::renderBlocks(renderer);
+	else
+		foreach (const QString& fileName, programFiles)
+			renderer.addProgram(fileName);
 	
-	return 0;
+	return renderer.finish() ? 0 : 1;
 }
-
-
@@ -28,6 +28,10 @@ namespace Aseba
 				msg = tr("Script too big for target bytecode size");
 				break;
 
+			case ERROR_TOO_MANY_WHEN:
+				msg = tr("Too many when conditions, the target supports at most %0");
+				break;
+
 			case ERROR_VARIABLE_NOT_DEFINED:
 				msg = tr("%0 is not a defined variable");
 				break;
@@ -33,7 +33,10 @@
 #define ASEBA_VERSION_INT 10503
 
 /*! version of aseba protocol, including bytecodes types and constants */
-#define ASEBA_PROTOCOL_VERSION 5
+#define ASEBA_PROTOCOL_VERSION 6
+
+/*! version that hosts unpacking ASEBA_MESSAGE_EVENTS_BATCH announce in their description requests, nodes only batch events for such hosts */
+#define ASEBA_EVENTS_BATCH_PROTOCOL_VERSION 7
 
 /*! minimal accepted protocol version in targets */
 #define ASEBA_MIN_TARGET_PROTOCOL_VERSION 4
@@ -115,9 +118,18 @@ typedef enum
 
 /*! Bit inside if opcode that indicates it is a when condition */
 #define ASEBA_IF_IS_WHEN_BIT 8
-/*! Bit inside if opcode that indicates that the last evaluation was true */
+/*! Bit inside if opcode that indicates that the last evaluation was true, up to protocol version 5 */
 #define ASEBA_IF_WAS_TRUE_BIT 9
 
+/*! Mask of the operator inside if opcode, the other bits of the low byte hold part of the when slot */
+#define ASEBA_IF_OPERATOR_MASK 0x1f
+/*! Maximum number of when conditions in a program, whose last evaluations are kept by the VM */
+#define ASEBA_MAX_WHEN_SLOTS 64
+/*! Slot of the last evaluation of a when condition, assigned by the compiler from protocol version 6, held in bits 9 to 11 and 5 to 7 of if opcode */
+#define ASEBA_IF_GET_WHEN_SLOT(bytecode) ((((bytecode) >> 9) & 0x7) | (((bytecode) >> 2) & 0x38))
+/*! Bits of if opcode holding when slot */
+#define ASEBA_IF_WHEN_SLOT_BITS(slot) ((((slot) & 0x7) << 9) | (((slot) & 0x38) << 2))
+
 /*! List of masks for flags in AsebaVMState */
 typedef enum
 {
@@ -167,6 +179,7 @@ typedef enum
 	ASEBA_MESSAGE_EXECUTION_STATE_CHANGED,
 	ASEBA_MESSAGE_BREAKPOINT_SET_RESULT,
 	ASEBA_MESSAGE_NODE_PRESENT,
+	ASEBA_MESSAGE_EVENTS_BATCH, /*!< several user events, each as its length, its type and its arguments, only sent to hosts announcing ASEBA_EVENTS_BATCH_PROTOCOL_VERSION */
 	
 	/* from IDE to all nodes */
 	ASEBA_MESSAGE_GET_DESCRIPTION = 0xA000,
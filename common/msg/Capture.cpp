@@ -0,0 +1,253 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Capture.h"
+#include "../consts.h"
+#include "../utils/utils.h"
+#include "../utils/LittleEndian.h"
+#include <cstring>
+#include <memory>
+#include <dashel/dashel.h>
+
+namespace Aseba
+{
+	using namespace std;
+
+	/** \addtogroup msg */
+	/*@{*/
+
+	static const char captureMagic[8] = { 'A', 'S', 'E', 'B', 'A', 'C', 'A', 'P' };
+	static const uint16_t captureVersion = 1;
+
+	//! Return the smallest power of two greater or equal to value
+	static size_t roundUpToPowerOfTwo(size_t value)
+	{
+		size_t result(1);
+		while (result < value)
+			result <<= 1;
+		return result;
+	}
+
+	MessageCapture::MessageCapture(const std::string& fileName, size_t capacity):
+		file(fileName.c_str(), ios::binary),
+		ring(roundUpToPowerOfTwo(capacity)),
+		mask(ring.size() - 1),
+		head(0),
+		tail(0),
+		droppedCount(0),
+		pendingDropped(0),
+		nextStreamId(1),
+		stopping(false)
+	{
+		if (!file.is_open())
+			return;
+		file.write(captureMagic, sizeof(captureMagic));
+		vector<uint8_t> version;
+		appendLittleEndian(version, captureVersion);
+		file.write(reinterpret_cast<const char*>(&version[0]), version.size());
+		writer = thread(&MessageCapture::writerLoop, this);
+	}
+
+	MessageCapture::~MessageCapture()
+	{
+		if (!writer.joinable())
+			return;
+		{
+			lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wakeUp.notify_one();
+		writer.join();
+
+		// frames dropped at the end are not followed by any record
+		if (pendingDropped)
+		{
+			vector<uint8_t> dropped;
+			dropped.push_back(RECORD_DROPPED);
+			appendLittleEndian(dropped, uint32_t(pendingDropped));
+			file.write(reinterpret_cast<const char*>(&dropped[0]), dropped.size());
+		}
+	}
+
+	void MessageCapture::capture(const Message& message, const Dashel::Stream* stream)
+	{
+		if (!file.is_open())
+			return;
+
+		// declare the target name of new streams once
+		uint16_t streamId(0);
+		if (stream)
+		{
+			const auto streamIt(streamIds.find(stream));
+			if (streamIt == streamIds.end())
+			{
+				streamId = nextStreamId++;
+				const string name(stream->getTargetName());
+				record.clear();
+				record.push_back(RECORD_STREAM);
+				appendLittleEndian(record, streamId);
+				appendLittleEndian(record, uint16_t(name.size()));
+				record.insert(record.end(), name.begin(), name.end());
+				if (!push(record))
+					return;
+				streamIds[stream] = streamId;
+			}
+			else
+				streamId = streamIt->second;
+		}
+
+		record.clear();
+		record.push_back(RECORD_FRAME);
+		appendLittleEndian(record, streamId);
+		appendLittleEndian(record, uint64_t(UnifiedTime().value));
+		message.serialize(record);
+		push(record);
+	}
+
+	void MessageCapture::closed(const Dashel::Stream* stream)
+	{
+		streamIds.erase(stream);
+	}
+
+	bool MessageCapture::push(const std::vector<uint8_t>& data)
+	{
+		// tell the decoder how many frames were lost before this record
+		uint8_t dropped[5];
+		const size_t droppedSize(pendingDropped ? sizeof(dropped) : 0);
+		if (pendingDropped)
+		{
+			dropped[0] = RECORD_DROPPED;
+			for (size_t i = 0; i < 4; ++i)
+				dropped[i + 1] = uint8_t(pendingDropped >> (8 * i));
+		}
+
+		const size_t writePos(head.load(memory_order_relaxed));
+		const size_t used(writePos - tail.load(memory_order_acquire));
+		if (used + droppedSize + data.size() > ring.size())
+		{
+			++pendingDropped;
+			droppedCount.fetch_add(1, memory_order_relaxed);
+			return false;
+		}
+
+		size_t pos(writePos);
+		for (size_t i = 0; i < droppedSize; ++i, ++pos)
+			ring[pos & mask] = dropped[i];
+		for (size_t i = 0; i < data.size(); ++i, ++pos)
+			ring[pos & mask] = data[i];
+		head.store(pos, memory_order_release);
+		pendingDropped = 0;
+		return true;
+	}
+
+	void MessageCapture::writerLoop()
+	{
+		unique_lock<std::mutex> lock(mutex);
+		while (!stopping)
+		{
+			wakeUp.wait_for(lock, chrono::milliseconds(10));
+			drain();
+		}
+		drain();
+		file.flush();
+	}
+
+	void MessageCapture::drain()
+	{
+		const size_t readPos(tail.load(memory_order_relaxed));
+		const size_t writePos(head.load(memory_order_acquire));
+		if (readPos == writePos)
+			return;
+
+		// the data might wrap around the end of the ring
+		const size_t begin(readPos & mask);
+		const size_t size(writePos - readPos);
+		const size_t firstPart(min(size, ring.size() - begin));
+		file.write(reinterpret_cast<const char*>(&ring[begin]), firstPart);
+		if (firstPart < size)
+			file.write(reinterpret_cast<const char*>(&ring[0]), size - firstPart);
+		tail.store(writePos, memory_order_release);
+	}
+
+	bool MessageCapture::decode(std::istream& input, std::wostream& output, bool rawTime)
+	{
+		char magic[sizeof(captureMagic)];
+		uint16_t version;
+		if (!input.read(magic, sizeof(magic)) || memcmp(magic, captureMagic, sizeof(magic)) != 0)
+			return false;
+		if (!readLittleEndian(input, version) || version != captureVersion)
+			return false;
+
+		map<uint16_t, string> streamNames;
+		while (true)
+		{
+			const int kind(input.get());
+			if (kind == EOF)
+				return true;
+
+			if (kind == RECORD_STREAM)
+			{
+				uint16_t streamId, nameLength;
+				if (!readLittleEndian(input, streamId) || !readLittleEndian(input, nameLength))
+					return false;
+				string name(nameLength, ' ');
+				if (nameLength && !input.read(&name[0], nameLength))
+					return false;
+				streamNames[streamId] = name;
+			}
+			else if (kind == RECORD_DROPPED)
+			{
+				uint32_t count;
+				if (!readLittleEndian(input, count))
+					return false;
+				output << count << L" messages dropped by capture" << endl;
+			}
+			else if (kind == RECORD_FRAME)
+			{
+				uint16_t streamId, len, source, type;
+				uint64_t time;
+				if (!readLittleEndian(input, streamId) || !readLittleEndian(input, time) ||
+					!readLittleEndian(input, len) || !readLittleEndian(input, source) || !readLittleEndian(input, type))
+					return false;
+				// Message::create() cannot cope with oversized payloads
+				if (len > ASEBA_MAX_EVENT_ARG_SIZE)
+					return false;
+				Message::SerializationBuffer buffer;
+				buffer.rawData.resize(len);
+				if (len && !input.read(reinterpret_cast<char*>(&buffer.rawData[0]), len))
+					return false;
+
+				// same format as dumpTime() followed by Message::dump()
+				const UnifiedTime timeStamp(time);
+				output << UTF8ToWString(rawTime ? timeStamp.toRawTimeString() : timeStamp.toHumanReadableStringFromEpoch()) << L" ";
+				const auto nameIt(streamNames.find(streamId));
+				if (nameIt != streamNames.end())
+					output << UTF8ToWString(nameIt->second) << L" ";
+				unique_ptr<Message> message(Message::create(source, type, buffer));
+				message->dump(output);
+				output << endl;
+			}
+			else
+				return false;
+		}
+	}
+
+	/*@}*/
+}
@@ -0,0 +1,115 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_CAPTURE_H
+#define ASEBA_CAPTURE_H
+
+#include "msg.h"
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+namespace Dashel
+{
+	class Stream;
+}
+
+namespace Aseba
+{
+	/** \addtogroup msg */
+	/*@{*/
+
+	/**
+		Binary capture of messages, a cheap replacement for dumping them as text.
+
+		capture() copies the raw frame of a message and a timestamp into an in-memory
+		ring, without formatting nor system calls, so that capturing does not change the
+		timing of the forwarding path. A background thread writes the ring to a file,
+		which decode() later turns into the text format of Message::dump().
+		If the writer cannot keep up, frames are dropped and the number of dropped frames
+		is recorded in the file.
+
+		capture() and closed() must not be called concurrently, the background thread is
+		the only other user of the ring.
+	*/
+	class MessageCapture
+	{
+	public:
+		//! Create a capture writing to fileName through a ring of capacity bytes, rounded up to a power of two
+		MessageCapture(const std::string& fileName, size_t capacity = 1 << 20);
+		//! Write the captured frames and close the file
+		~MessageCapture();
+		//! Return whether the capture file could be opened
+		bool isOpen() const { return file.is_open(); }
+
+		//! Capture message, received from or sent to stream if not 0
+		void capture(const Message& message, const Dashel::Stream* stream = 0);
+		//! Forget stream, that was closed, its address might be reused by a new stream
+		void closed(const Dashel::Stream* stream);
+		//! Return the number of frames dropped because the ring was full
+		unsigned long long getDroppedCount() const { return droppedCount.load(std::memory_order_relaxed); }
+
+		//! Write the content of a capture file as text to output, return false if input is not a valid capture
+		static bool decode(std::istream& input, std::wostream& output, bool rawTime = false);
+
+	protected:
+		//! Kinds of records in the capture file
+		enum RecordKind
+		{
+			RECORD_FRAME = 0, //!< stream id, time in ms since epoch, raw frame
+			RECORD_STREAM = 1, //!< stream id, target name length and target name
+			RECORD_DROPPED = 2 //!< number of frames dropped before the next record
+		};
+
+		bool push(const std::vector<uint8_t>& data);
+		void writerLoop();
+		void drain();
+
+	protected:
+		std::ofstream file;
+		std::vector<uint8_t> ring;
+		const size_t mask;
+		std::atomic<size_t> head; //!< end of written data, only advanced by capture()
+		std::atomic<size_t> tail; //!< end of data written to file, only advanced by the writer thread
+		std::atomic<unsigned long long> droppedCount;
+		unsigned pendingDropped; //!< frames dropped since the last record
+
+		// producer state
+		std::vector<uint8_t> record; //!< reused buffer for the record being captured
+		std::map<const Dashel::Stream*, uint16_t> streamIds;
+		uint16_t nextStreamId;
+
+		// writer thread
+		std::mutex mutex;
+		std::condition_variable wakeUp;
+		bool stopping;
+		std::thread writer;
+	};
+
+	/*@}*/
+}
+
+#endif
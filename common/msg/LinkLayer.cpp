@@ -0,0 +1,225 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LinkLayer.h"
+#include <cassert>
+#include <algorithm>
+#include <dashel/dashel.h>
+
+namespace Aseba
+{
+	using namespace std;
+	using namespace Dashel;
+	
+	/** \addtogroup msg */
+	/*@{*/
+	
+	bool isSerialTarget(const std::string& target)
+	{
+		return target.compare(0, 4, "ser:") == 0;
+	}
+	
+	double LinkLayer::Statistics::framesPerWrite() const
+	{
+		return writes ? double(frames) / double(writes) : 0.;
+	}
+	
+	double LinkLayer::Statistics::bytesPerSecond() const
+	{
+		const double duration(chrono::duration<double>(Clock::now() - since).count());
+		return duration > 0 ? double(bytes) / duration : 0.;
+	}
+	
+	void LinkLayer::Statistics::dump(std::ostream& stream) const
+	{
+		stream << frames << " frames in " << writes << " writes (" << framesPerWrite() << " frames/write, ";
+		stream << latencyFlushes << " latency flushes), " << bytesPerSecond() << " bytes/s, ";
+		stream << "queue depth " << queueDepth << " (max " << maxQueueDepth << ") bytes";
+	}
+	
+	LinkLayer::LinkLayer(size_t mtu, unsigned maxLatency):
+		mtu(max<size_t>(mtu, 1)),
+		maxLatency(chrono::milliseconds(maxLatency)),
+		tracer(0)
+	{}
+	
+	void LinkLayer::attach(Dashel::Stream* stream)
+	{
+		links[stream] = Link();
+	}
+	
+	void LinkLayer::detach(Dashel::Stream* stream)
+	{
+		links.erase(stream);
+	}
+	
+	bool LinkLayer::isAttached(Dashel::Stream* stream) const
+	{
+		return links.find(stream) != links.end();
+	}
+	
+	void LinkLayer::send(const Message& message, Dashel::Stream* stream)
+	{
+		const uint64_t id(tracer ? Tracer::messageId(message) : 0);
+		if (tracer)
+			tracer->record(id, Tracer::ENQUEUE, stream);
+		
+		auto linkIt(links.find(stream));
+		if (linkIt == links.end())
+		{
+			message.serialize(stream);
+			if (tracer)
+				tracer->record(id, Tracer::SERIALIZE, stream);
+			stream->flush();
+			if (tracer)
+				tracer->record(id, Tracer::FLUSH, stream);
+			return;
+		}
+		
+		Link& link(linkIt->second);
+		if (link.queue.empty())
+			link.deadline = Clock::now() + maxLatency;
+		message.serialize(link.queue);
+		++link.statistics.frames;
+		if (tracer)
+		{
+			tracer->record(id, Tracer::SERIALIZE, stream);
+			link.traced.push_back(make_pair(link.queue.size(), id));
+		}
+		
+		// write all complete MTU-sized chunks, keep the remainder until more frames arrive or the deadline expires
+		const size_t size(link.queue.size() - link.queue.size() % mtu);
+		if (size)
+		{
+			try
+			{
+				write(stream, link, size);
+			}
+			catch (const DashelException&)
+			{
+				// drop the data, the caller handles the error and Hub calls connectionClosed later
+				link.queue.clear();
+				link.traced.clear();
+				link.statistics.queueDepth = 0;
+				throw;
+			}
+		}
+		link.statistics.queueDepth = link.queue.size();
+		link.statistics.maxQueueDepth = max(link.statistics.maxQueueDepth, link.queue.size());
+	}
+	
+	void LinkLayer::flushDue()
+	{
+		const Clock::time_point now(Clock::now());
+		for (auto& streamLink: links)
+		{
+			Link& link(streamLink.second);
+			if (link.queue.empty() || link.deadline > now)
+				continue;
+			++link.statistics.latencyFlushes;
+			try
+			{
+				write(streamLink.first, link, link.queue.size());
+			}
+			catch (const DashelException&)
+			{
+				// drop the data and let Hub call connectionClosed later
+				link.queue.clear();
+				link.traced.clear();
+			}
+			link.statistics.queueDepth = 0;
+		}
+	}
+	
+	void LinkLayer::flushAll()
+	{
+		for (auto& streamLink: links)
+		{
+			Link& link(streamLink.second);
+			if (link.queue.empty())
+				continue;
+			try
+			{
+				write(streamLink.first, link, link.queue.size());
+			}
+			catch (const DashelException&)
+			{
+				// drop the data and let Hub call connectionClosed later
+				link.queue.clear();
+				link.traced.clear();
+			}
+			link.statistics.queueDepth = 0;
+		}
+	}
+	
+	int LinkLayer::timeout() const
+	{
+		const Clock::time_point now(Clock::now());
+		int timeout(-1);
+		for (const auto& streamLink: links)
+		{
+			const Link& link(streamLink.second);
+			if (link.queue.empty())
+				continue;
+			const auto left(chrono::duration_cast<chrono::milliseconds>(link.deadline - now).count());
+			const int leftClamped(left > 0 ? int(left) : 0);
+			if (timeout < 0 || leftClamped < timeout)
+				timeout = leftClamped;
+		}
+		return timeout;
+	}
+	
+	const LinkLayer::Statistics& LinkLayer::getStatistics(Dashel::Stream* stream) const
+	{
+		const auto linkIt(links.find(stream));
+		assert(linkIt != links.end());
+		return linkIt->second.statistics;
+	}
+	
+	size_t LinkLayer::queueDepth() const
+	{
+		size_t depth(0);
+		for (const auto& streamLink: links)
+			depth += streamLink.second.queue.size();
+		return depth;
+	}
+	
+	void LinkLayer::write(Dashel::Stream* stream, Link& link, size_t size)
+	{
+		assert(size <= link.queue.size());
+		stream->write(&link.queue[0], size);
+		stream->flush();
+		link.queue.erase(link.queue.begin(), link.queue.begin() + size);
+		++link.statistics.writes;
+		link.statistics.bytes += size;
+		
+		// the frames ending in the written chunk are now on the link
+		while (!link.traced.empty() && link.traced.front().first <= size)
+		{
+			if (tracer)
+				tracer->record(link.traced.front().second, Tracer::FLUSH, stream);
+			link.traced.pop_front();
+		}
+		for (auto& frame: link.traced)
+			frame.first -= size;
+	}
+	
+	/*@}*/
+}
@@ -0,0 +1,129 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_LINK_LAYER_H
+#define ASEBA_LINK_LAYER_H
+
+#include "msg.h"
+#include "Tracer.h"
+#include <chrono>
+#include <deque>
+#include <map>
+#include <vector>
+#include <string>
+#include <iostream>
+
+namespace Dashel
+{
+	class Stream;
+}
+
+namespace Aseba
+{
+	/** \addtogroup msg */
+	/*@{*/
+	
+	//! Return whether a Dashel target is a serial port, for which batching writes pays off
+	bool isSerialTarget(const std::string& target);
+	
+	/**
+		Bounded-latency link layer for byte-oriented links such as USB-CDC serial ports.
+		
+		Frames sent to an attached stream are queued and written in multiples of the link
+		MTU, so that several Aseba frames share one link-level transaction. A frame never
+		waits longer than the configured maximum latency: call flushDue() regularly, for
+		instance after each Dashel::Hub::step(), using timeout() as the step timeout.
+		Streams that are not attached are written and flushed immediately.
+	*/
+	class LinkLayer
+	{
+	public:
+		typedef std::chrono::steady_clock Clock;
+		
+		//! Statistics of a batched stream
+		struct Statistics
+		{
+			unsigned long long frames = 0; //!< number of frames queued
+			unsigned long long bytes = 0; //!< number of bytes written
+			unsigned long long writes = 0; //!< number of writes to the stream
+			unsigned long long latencyFlushes = 0; //!< number of writes forced by the latency bound
+			size_t queueDepth = 0; //!< bytes currently waiting in the queue
+			size_t maxQueueDepth = 0; //!< largest number of bytes that waited in the queue
+			Clock::time_point since = Clock::now(); //!< when the statistics started
+			
+			//! Average number of frames per write
+			double framesPerWrite() const;
+			//! Average throughput in bytes per second since statistics started
+			double bytesPerSecond() const;
+			//! Dump a one-line summary of these statistics
+			void dump(std::ostream& stream) const;
+		};
+		
+	public:
+		//! Create a link layer writing chunks of mtu bytes and holding frames at most maxLatency ms
+		LinkLayer(size_t mtu = 64, unsigned maxLatency = 2);
+		
+		//! Enable batching on stream
+		void attach(Dashel::Stream* stream);
+		//! Disable batching on stream, without writing pending data as the stream might be gone
+		void detach(Dashel::Stream* stream);
+		//! Return whether stream is batched
+		bool isAttached(Dashel::Stream* stream) const;
+		
+		//! Send message to stream, batched if stream is attached, written and flushed otherwise; if writing fails, drop the frames queued for stream and rethrow
+		void send(const Message& message, Dashel::Stream* stream);
+		//! Write the queued frames whose latency bound expired, dropping the frames of streams that fail
+		void flushDue();
+		//! Write all queued frames, dropping the frames of streams that fail
+		void flushAll();
+		//! Return the time in ms until the next latency bound expires, -1 if nothing is queued
+		int timeout() const;
+		
+		//! Return the statistics of an attached stream
+		const Statistics& getStatistics(Dashel::Stream* stream) const;
+		//! Return the number of bytes queued on all streams
+		size_t queueDepth() const;
+		
+		//! Record the stages of sent messages into tracer, or stop tracing if tracer is 0
+		void setTracer(Tracer* tracer) { this->tracer = tracer; }
+		
+	protected:
+		//! A batched stream
+		struct Link
+		{
+			std::vector<uint8_t> queue; //!< frames waiting to be written
+			Clock::time_point deadline; //!< when the oldest queued frame must be written
+			std::deque<std::pair<size_t, uint64_t> > traced; //!< end in queue and id of traced frames
+			Statistics statistics;
+		};
+		
+		void write(Dashel::Stream* stream, Link& link, size_t size);
+		
+	protected:
+		const size_t mtu;
+		const Clock::duration maxLatency;
+		std::map<Dashel::Stream*, Link> links;
+		Tracer* tracer;
+	};
+	
+	/*@}*/
+}
+
+#endif
@@ -0,0 +1,241 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Metrics.h"
+#include <cassert>
+#include <cstdio>
+#include <dashel/dashel.h>
+
+namespace Aseba
+{
+	using namespace std;
+
+	/** \addtogroup msg */
+	/*@{*/
+
+	//! Write s as the value of a Prometheus label
+	static void writeLabel(ostream& stream, const string& s)
+	{
+		stream << '"';
+		for (size_t i = 0; i < s.size(); ++i)
+		{
+			if (s[i] == '"' || s[i] == '\\')
+				stream << '\\' << s[i];
+			else if (s[i] == '\n')
+				stream << "\\n";
+			else
+				stream << s[i];
+		}
+		stream << '"';
+	}
+
+	//! Write the name of the per-type counters key
+	static void writeType(ostream& stream, unsigned key)
+	{
+		if (key == Metrics::USER_MESSAGES)
+		{
+			stream << "\"user\"";
+			return;
+		}
+		char buffer[8];
+		snprintf(buffer, sizeof(buffer), "0x%04x", key);
+		stream << '"' << buffer << '"';
+	}
+
+	//! A field of the counters, with its metric name and description
+	struct CounterField
+	{
+		const char* name;
+		const char* help;
+		unsigned long long Metrics::Counters::* field;
+		bool perType; //!< whether the field is also counted per message type
+	};
+
+	static const CounterField counterFields[] =
+	{
+		{ "messages_in_total", "Messages received", &Metrics::Counters::messagesIn, true },
+		{ "bytes_in_total", "Bytes received", &Metrics::Counters::bytesIn, true },
+		{ "messages_out_total", "Messages written", &Metrics::Counters::messagesOut, true },
+		{ "bytes_out_total", "Bytes written", &Metrics::Counters::bytesOut, true },
+		{ "flushes_total", "Flushes of written data", &Metrics::Counters::flushes, false },
+		{ "write_errors_total", "Failed writes", &Metrics::Counters::writeErrors, false }
+	};
+
+	//! Write the header of a metric family
+	static void writeHeader(ostream& stream, const string& name, const char* help, const char* type)
+	{
+		stream << "# HELP " << name << " " << help << "\n";
+		stream << "# TYPE " << name << " " << type << "\n";
+	}
+
+	Metrics::Metrics():
+		lastLine(Clock::now())
+	{}
+
+	void Metrics::received(Dashel::Stream* stream, const Message& message, size_t size)
+	{
+		Counters& counters(streamCounters(stream).counters);
+		Counters& typeCounters(types[typeKey(message)]);
+		++counters.messagesIn;
+		counters.bytesIn += size;
+		++typeCounters.messagesIn;
+		typeCounters.bytesIn += size;
+		++total.messagesIn;
+		total.bytesIn += size;
+	}
+
+	void Metrics::sent(Dashel::Stream* stream, const Message& message, size_t size, bool flushed)
+	{
+		Counters& counters(streamCounters(stream).counters);
+		Counters& typeCounters(types[typeKey(message)]);
+		++counters.messagesOut;
+		counters.bytesOut += size;
+		++typeCounters.messagesOut;
+		typeCounters.bytesOut += size;
+		++total.messagesOut;
+		total.bytesOut += size;
+		if (flushed)
+		{
+			++counters.flushes;
+			++total.flushes;
+		}
+	}
+
+	void Metrics::writeError(Dashel::Stream* stream)
+	{
+		++streamCounters(stream).counters.writeErrors;
+		++total.writeErrors;
+	}
+
+	void Metrics::closed(Dashel::Stream* stream)
+	{
+		streams.erase(stream);
+	}
+
+	void Metrics::forwarded(Clock::duration duration)
+	{
+		forwardLatency.add(chrono::duration_cast<chrono::nanoseconds>(duration).count());
+	}
+
+	const Metrics::Counters& Metrics::getCounters(Dashel::Stream* stream) const
+	{
+		const auto streamIt(streams.find(stream));
+		assert(streamIt != streams.end());
+		return streamIt->second.counters;
+	}
+
+	void Metrics::dumpText(std::ostream& stream) const
+	{
+		for (const CounterField& field: counterFields)
+		{
+			const string name(string("aseba_") + field.name);
+			writeHeader(stream, name, field.help, "counter");
+			stream << name << " " << total.*field.field << "\n";
+
+			const string streamName(string("aseba_stream_") + field.name);
+			writeHeader(stream, streamName, field.help, "counter");
+			for (const auto& streamIt: streams)
+			{
+				stream << streamName << "{stream=";
+				writeLabel(stream, streamIt.second.name);
+				stream << "} " << streamIt.second.counters.*field.field << "\n";
+			}
+
+			if (!field.perType)
+				continue;
+			const string typeName(string("aseba_type_") + field.name);
+			writeHeader(stream, typeName, field.help, "counter");
+			for (const auto& typeIt: types)
+			{
+				stream << typeName << "{type=";
+				writeType(stream, typeIt.first);
+				stream << "} " << typeIt.second.*field.field << "\n";
+			}
+		}
+
+		// log2 buckets, only the range in use
+		writeHeader(stream, "aseba_forward_duration_seconds", "Time to process a received message", "histogram");
+		unsigned long long cumulated(0);
+		for (unsigned bucket = 0; bucket < Tracer::Histogram::BUCKETS_COUNT && cumulated < forwardLatency.count; ++bucket)
+		{
+			cumulated += forwardLatency.buckets[bucket];
+			if (!cumulated)
+				continue;
+			const double bound(bucket ? double((1ull << bucket) - 1) * 1e-9 : 0.);
+			stream << "aseba_forward_duration_seconds_bucket{le=\"" << bound << "\"} " << cumulated << "\n";
+		}
+		stream << "aseba_forward_duration_seconds_bucket{le=\"+Inf\"} " << forwardLatency.count << "\n";
+		stream << "aseba_forward_duration_seconds_sum " << double(forwardLatency.sum) * 1e-9 << "\n";
+		stream << "aseba_forward_duration_seconds_count " << forwardLatency.count << "\n";
+
+		for (const auto& gauge: gauges)
+		{
+			const string name("aseba_" + gauge.first);
+			writeHeader(stream, name, gauge.first.c_str(), "gauge");
+			stream << name << " " << gauge.second << "\n";
+		}
+	}
+
+	void Metrics::dumpLine(std::ostream& stream)
+	{
+		const Clock::time_point now(Clock::now());
+		const double duration(chrono::duration<double>(now - lastLine).count());
+		const double scale(duration > 0 ? 1. / duration : 0.);
+
+		stream << "in " << (total.messagesIn - lastTotal.messagesIn) * scale << " msg/s ";
+		stream << (total.bytesIn - lastTotal.bytesIn) * scale << " B/s, ";
+		stream << "out " << (total.messagesOut - lastTotal.messagesOut) * scale << " msg/s ";
+		stream << (total.bytesOut - lastTotal.bytesOut) * scale << " B/s ";
+		stream << (total.flushes - lastTotal.flushes) * scale << " flush/s, ";
+		stream << total.writeErrors - lastTotal.writeErrors << " write errors, ";
+		stream << streams.size() << " streams";
+		if (forwardLatency.count)
+			stream << ", forward p50 " << forwardLatency.quantile(0.5) << " ns p99 " << forwardLatency.quantile(0.99) << " ns";
+		for (const auto& gauge: gauges)
+			stream << ", " << gauge.first << " " << gauge.second;
+		stream << endl;
+
+		lastTotal = total;
+		lastLine = now;
+	}
+
+	void Metrics::tick(std::ostream& stream, unsigned interval)
+	{
+		if (interval && Clock::now() - lastLine >= chrono::seconds(interval))
+			dumpLine(stream);
+	}
+
+	Metrics::StreamCounters& Metrics::streamCounters(Dashel::Stream* stream)
+	{
+		auto streamIt(streams.find(stream));
+		if (streamIt != streams.end())
+			return streamIt->second;
+		StreamCounters& streamCounters(streams[stream]);
+		streamCounters.name = stream->getTargetName();
+		return streamCounters;
+	}
+
+	unsigned Metrics::typeKey(const Message& message)
+	{
+		return message.type < 0x8000 ? USER_MESSAGES : message.type;
+	}
+
+	/*@}*/
+}
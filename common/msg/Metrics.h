@@ -0,0 +1,126 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_METRICS_H
+#define ASEBA_METRICS_H
+
+#include "msg.h"
+#include "Tracer.h"
+#include <chrono>
+#include <map>
+#include <string>
+#include <iostream>
+
+namespace Dashel
+{
+	class Stream;
+}
+
+namespace Aseba
+{
+	/** \addtogroup msg */
+	/*@{*/
+
+	/**
+		Runtime metrics of a switch: counters per stream and per message type, gauges and
+		a histogram of the time taken to forward a message.
+
+		Updating the metrics only costs a few map lookups and additions per message, so
+		they can stay enabled in production, unlike dumping messages. They are exposed
+		either as text in the Prometheus exposition format, for instance by an HTTP
+		endpoint, or as a periodic one-line summary.
+		User events are counted together, as their number of types is not bounded.
+	*/
+	class Metrics
+	{
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		//! Traffic counters
+		struct Counters
+		{
+			unsigned long long messagesIn = 0; //!< number of messages received
+			unsigned long long bytesIn = 0; //!< number of bytes received
+			unsigned long long messagesOut = 0; //!< number of messages written
+			unsigned long long bytesOut = 0; //!< number of bytes written
+			unsigned long long flushes = 0; //!< number of flushes
+			unsigned long long writeErrors = 0; //!< number of failed writes
+		};
+
+		//! Key grouping all user events in the per-type counters
+		static const unsigned USER_MESSAGES = 0x10000;
+
+	public:
+		//! Create metrics, whose rates are computed since now
+		Metrics();
+
+		//! Return the size in bytes of event on the wire, header included, without serializing it
+		static size_t frameSize(const UserMessage& event) { return 6 + event.data.size() * sizeof(int16_t); }
+
+		//! Count message of size bytes as received from stream
+		void received(Dashel::Stream* stream, const Message& message, size_t size);
+		//! Count message of size bytes as written to stream, and flushed if flushed is true
+		void sent(Dashel::Stream* stream, const Message& message, size_t size, bool flushed = true);
+		//! Count a failed write to stream
+		void writeError(Dashel::Stream* stream);
+		//! Forget the counters of a closed stream, they stay in the per-type counters
+		void closed(Dashel::Stream* stream);
+		//! Add the time it took to process a received message
+		void forwarded(Clock::duration duration);
+		//! Set the value of gauge name, for instance a number of pending responses
+		void setGauge(const std::string& name, double value) { gauges[name] = value; }
+
+		//! Return the counters of stream, which must have seen traffic
+		const Counters& getCounters(Dashel::Stream* stream) const;
+		//! Return the counters of all streams, including closed ones
+		const Counters& getTotal() const { return total; }
+
+		//! Write all metrics in the Prometheus text exposition format
+		void dumpText(std::ostream& stream) const;
+		//! Write a one-line summary of the traffic since the last summary
+		void dumpLine(std::ostream& stream);
+		//! Write a one-line summary to stream every interval s, if interval is not zero; call regularly
+		void tick(std::ostream& stream, unsigned interval);
+
+	protected:
+		//! Traffic of a stream
+		struct StreamCounters
+		{
+			std::string name; //!< target name of the stream
+			Counters counters;
+		};
+
+		StreamCounters& streamCounters(Dashel::Stream* stream);
+		static unsigned typeKey(const Message& message);
+
+	protected:
+		std::map<Dashel::Stream*, StreamCounters> streams;
+		std::map<unsigned, Counters> types;
+		std::map<std::string, double> gauges;
+		Counters total;
+		Tracer::Histogram forwardLatency;
+		Counters lastTotal; //!< total at the last summary line
+		Clock::time_point lastLine; //!< time of the last summary line
+	};
+
+	/*@}*/
+}
+
+#endif
@@ -26,6 +26,177 @@ using namespace std;
 
 namespace Aseba
 {
+	//! Return the bytes taken by the content of s
+	static size_t stringMemory(const std::wstring& s)
+	{
+		return s.capacity() * sizeof(wchar_t);
+	}
+	
+	//! Return the approximate number of bytes taken by description, the maps nodes counting as two pointers more than their content
+	static size_t descriptionMemory(const SharedDescription& description)
+	{
+		const size_t mapNodeOverhead(sizeof(void*) * 4);
+		size_t bytes(sizeof(SharedDescription) + stringMemory(description.name));
+		bytes += description.namedVariables.capacity() * sizeof(TargetDescription::NamedVariable);
+		for (size_t i = 0; i < description.namedVariables.size(); ++i)
+			bytes += stringMemory(description.namedVariables[i].name);
+		bytes += description.localEvents.capacity() * sizeof(TargetDescription::LocalEvent);
+		for (size_t i = 0; i < description.localEvents.size(); ++i)
+			bytes += stringMemory(description.localEvents[i].name) + stringMemory(description.localEvents[i].description);
+		bytes += description.nativeFunctions.capacity() * sizeof(TargetDescription::NativeFunction);
+		for (size_t i = 0; i < description.nativeFunctions.size(); ++i)
+		{
+			const TargetDescription::NativeFunction& function(description.nativeFunctions[i]);
+			bytes += stringMemory(function.name) + stringMemory(function.description);
+			bytes += function.parameters.capacity() * sizeof(TargetDescription::NativeFunctionParameter);
+			for (size_t j = 0; j < function.parameters.size(); ++j)
+				bytes += stringMemory(function.parameters[j].name);
+		}
+		for (const auto& variable: description.variablesMap)
+			bytes += mapNodeOverhead + sizeof(variable) + stringMemory(variable.first);
+		for (const auto& function: description.functionsMap)
+			bytes += mapNodeOverhead + sizeof(function) + stringMemory(function.first);
+		bytes += description.namedVariablesIndex.bucket_count() * sizeof(void*);
+		for (const auto& variable: description.namedVariablesIndex)
+			bytes += mapNodeOverhead + sizeof(variable) + stringMemory(variable.first);
+		return bytes;
+	}
+	
+	SharedDescription::SharedDescription(const TargetDescription& description, uint16_t key) :
+		TargetDescription(description),
+		key(key),
+		freeVariableIndex(0)
+	{
+		// same maps as getVariablesMap() and getFunctionsMap(), which are part of the compiler library
+		for (size_t i = 0; i < namedVariables.size(); ++i)
+		{
+			const std::pair<unsigned, unsigned> variable(freeVariableIndex, namedVariables[i].size);
+			variablesMap[namedVariables[i].name] = variable;
+			// if several variables have the same name, the first one is found, as in a linear search
+			namedVariablesIndex.insert(std::make_pair(namedVariables[i].name, variable));
+			freeVariableIndex += namedVariables[i].size;
+		}
+		for (size_t i = 0; i < nativeFunctions.size(); ++i)
+			functionsMap[nativeFunctions[i].name] = i;
+		memoryUsage = descriptionMemory(*this);
+	}
+	
+	std::mutex& DescriptionsPool::mutex()
+	{
+		static std::mutex poolMutex;
+		return poolMutex;
+	}
+	
+	DescriptionsPool::Descriptions& DescriptionsPool::descriptions()
+	{
+		static Descriptions pool;
+		return pool;
+	}
+	
+	std::shared_ptr<const SharedDescription> DescriptionsPool::intern(const TargetDescription& description)
+	{
+		const uint16_t descriptionKey(key(description));
+		std::lock_guard<std::mutex> lock(mutex());
+		Descriptions& pool(descriptions());
+		
+		// look for an identical description still in use, forgetting the unused ones with the same key
+		const auto range(pool.equal_range(descriptionKey));
+		for (Descriptions::iterator it = range.first; it != range.second;)
+		{
+			const std::shared_ptr<const SharedDescription> shared(it->second.lock());
+			if (!shared)
+			{
+				it = pool.erase(it);
+				continue;
+			}
+			if (equal(*shared, description))
+				return shared;
+			++it;
+		}
+		
+		const std::shared_ptr<const SharedDescription> shared(std::make_shared<SharedDescription>(description, descriptionKey));
+		pool.insert(std::make_pair(descriptionKey, std::weak_ptr<const SharedDescription>(shared)));
+		return shared;
+	}
+	
+	DescriptionsPool::Stats DescriptionsPool::stats()
+	{
+		Stats stats;
+		std::lock_guard<std::mutex> lock(mutex());
+		for (const auto& entry: descriptions())
+		{
+			const std::shared_ptr<const SharedDescription> shared(entry.second.lock());
+			if (!shared)
+				continue;
+			// do not count ourself
+			const size_t references(shared.use_count() - 1);
+			stats.descriptions += 1;
+			stats.references += references;
+			stats.bytes += shared->memoryUsage;
+			stats.savedBytes += (references - 1) * shared->memoryUsage;
+		}
+		return stats;
+	}
+	
+	uint16_t DescriptionsPool::key(const TargetDescription& description)
+	{
+		uint16_t crc(0);
+		crc = crcXModem(crc, description.name);
+		crc = crcXModem(crc, uint16_t(description.protocolVersion));
+		crc = crcXModem(crc, uint16_t(description.bytecodeSize));
+		crc = crcXModem(crc, uint16_t(description.variablesSize));
+		crc = crcXModem(crc, uint16_t(description.stackSize));
+		for (size_t i = 0; i < description.namedVariables.size(); ++i)
+		{
+			crc = crcXModem(crc, uint16_t(description.namedVariables[i].size));
+			crc = crcXModem(crc, description.namedVariables[i].name);
+		}
+		for (size_t i = 0; i < description.localEvents.size(); ++i)
+		{
+			crc = crcXModem(crc, description.localEvents[i].name);
+			crc = crcXModem(crc, description.localEvents[i].description);
+		}
+		for (size_t i = 0; i < description.nativeFunctions.size(); ++i)
+		{
+			const TargetDescription::NativeFunction& function(description.nativeFunctions[i]);
+			crc = crcXModem(crc, function.name);
+			crc = crcXModem(crc, function.description);
+			for (size_t j = 0; j < function.parameters.size(); ++j)
+			{
+				crc = crcXModem(crc, uint16_t(function.parameters[j].size));
+				crc = crcXModem(crc, function.parameters[j].name);
+			}
+		}
+		return crc;
+	}
+	
+	bool DescriptionsPool::equal(const TargetDescription& a, const TargetDescription& b)
+	{
+		if (a.name != b.name || a.protocolVersion != b.protocolVersion ||
+			a.bytecodeSize != b.bytecodeSize || a.variablesSize != b.variablesSize || a.stackSize != b.stackSize)
+			return false;
+		if (a.namedVariables.size() != b.namedVariables.size() || a.localEvents.size() != b.localEvents.size() ||
+			a.nativeFunctions.size() != b.nativeFunctions.size())
+			return false;
+		for (size_t i = 0; i < a.namedVariables.size(); ++i)
+			if (a.namedVariables[i].name != b.namedVariables[i].name || a.namedVariables[i].size != b.namedVariables[i].size)
+				return false;
+		for (size_t i = 0; i < a.localEvents.size(); ++i)
+			if (a.localEvents[i].name != b.localEvents[i].name || a.localEvents[i].description != b.localEvents[i].description)
+				return false;
+		for (size_t i = 0; i < a.nativeFunctions.size(); ++i)
+		{
+			const TargetDescription::NativeFunction& fa(a.nativeFunctions[i]);
+			const TargetDescription::NativeFunction& fb(b.nativeFunctions[i]);
+			if (fa.name != fb.name || fa.description != fb.description || fa.parameters.size() != fb.parameters.size())
+				return false;
+			for (size_t j = 0; j < fa.parameters.size(); ++j)
+				if (fa.parameters[j].name != fb.parameters[j].name || fa.parameters[j].size != fb.parameters[j].size)
+					return false;
+		}
+		return true;
+	}
+	
 	NodesManager::Node::Node() :
 		namedVariablesReceptionCounter(0),
 		localEventsReceptionCounter(0),
@@ -35,7 +206,7 @@ namespace Aseba
 	}
 	
 	NodesManager::Node::Node(const TargetDescription& targetDescription) :
-		TargetDescription(targetDescription),
+		received(targetDescription),
 		namedVariablesReceptionCounter(0),
 		localEventsReceptionCounter(0),
 		nativeFunctionReceptionCounter(0),
@@ -45,9 +216,19 @@ namespace Aseba
 	
 	bool NodesManager::Node::isComplete() const
 	{
-		return (namedVariablesReceptionCounter == namedVariables.size()) &&
-			(localEventsReceptionCounter == localEvents.size()) &&
-			(nativeFunctionReceptionCounter == nativeFunctions.size());
+		if (description)
+			return true;
+		return (namedVariablesReceptionCounter == received.namedVariables.size()) &&
+			(localEventsReceptionCounter == received.localEvents.size()) &&
+			(nativeFunctionReceptionCounter == received.nativeFunctions.size());
+	}
+	
+	void NodesManager::Node::shareIfComplete()
+	{
+		if (description || !isComplete())
+			return;
+		description = DescriptionsPool::intern(received);
+		received = TargetDescription();
 	}
 	
 	void NodesManager::pingNetwork()
@@ -63,7 +244,7 @@ namespace Aseba
 		for (NodesMap::iterator nodeIt = nodes.begin(); nodeIt != nodes.end(); ++nodeIt)
 		{
 			// if node supports listing, 
-			if (nodeIt->second.protocolVersion >= 5 && (now - nodeIt->second.lastSeen) > delayToDisconnect && nodeIt->second.connected)
+			if (nodeIt->second.getDescription().protocolVersion >= 5 && (now - nodeIt->second.lastSeen) > delayToDisconnect && nodeIt->second.connected)
 			{
 				nodeIt->second.connected = false;
 				nodeDisconnected(nodeIt->first);
@@ -76,6 +257,7 @@ namespace Aseba
 		if (!isAnyConnected)
 		{
 			GetDescription getDescription;
+			getDescription.version = announcedProtocolVersion;
 			sendMessage(getDescription);
 		}
 	}
@@ -93,6 +275,7 @@ namespace Aseba
 				mismatchingNodes.find(message->source) == mismatchingNodes.end())
 			{
 				GetNodeDescription getNodeDescription(message->source);
+				getNodeDescription.version = announcedProtocolVersion;
 				sendMessage(getNodeDescription);
 			}
 			// or if message type is description, in that case, proceed further
@@ -150,6 +333,7 @@ namespace Aseba
 				
 				// create node and copy description into it
 				nodes[description->source] = Node(*description);
+				nodes[description->source].shareIfComplete();
 				checkIfNodeDescriptionComplete(description->source, nodes[description->source]);
 			}
 		}
@@ -163,9 +347,10 @@ namespace Aseba
 				assert (nodeIt != nodes.end());
 				
 				// copy description into array if array is empty
-				if (nodeIt->second.namedVariablesReceptionCounter < nodeIt->second.namedVariables.size())
+				if (nodeIt->second.namedVariablesReceptionCounter < nodeIt->second.received.namedVariables.size())
 				{
-					nodeIt->second.namedVariables[nodeIt->second.namedVariablesReceptionCounter++] = *description;
+					nodeIt->second.received.namedVariables[nodeIt->second.namedVariablesReceptionCounter++] = *description;
+					nodeIt->second.shareIfComplete();
 					checkIfNodeDescriptionComplete(nodeIt->first, nodeIt->second);
 				}
 			}
@@ -180,9 +365,10 @@ namespace Aseba
 				assert (nodeIt != nodes.end());
 				
 				// copy description into array if array is empty
-				if (nodeIt->second.localEventsReceptionCounter < nodeIt->second.localEvents.size())
+				if (nodeIt->second.localEventsReceptionCounter < nodeIt->second.received.localEvents.size())
 				{
-					nodeIt->second.localEvents[nodeIt->second.localEventsReceptionCounter++] = *description;
+					nodeIt->second.received.localEvents[nodeIt->second.localEventsReceptionCounter++] = *description;
+					nodeIt->second.shareIfComplete();
 					checkIfNodeDescriptionComplete(nodeIt->first, nodeIt->second);
 				}
 			}
@@ -197,9 +383,10 @@ namespace Aseba
 				assert (nodeIt != nodes.end());
 				
 				// copy description into array
-				if (nodeIt->second.nativeFunctionReceptionCounter < nodeIt->second.nativeFunctions.size())
+				if (nodeIt->second.nativeFunctionReceptionCounter < nodeIt->second.received.nativeFunctions.size())
 				{
-					nodeIt->second.nativeFunctions[nodeIt->second.nativeFunctionReceptionCounter++] = *description;
+					nodeIt->second.received.nativeFunctions[nodeIt->second.nativeFunctionReceptionCounter++] = *description;
+					nodeIt->second.shareIfComplete();
 					checkIfNodeDescriptionComplete(nodeIt->first, nodeIt->second);
 				}
 			}
@@ -221,7 +408,7 @@ namespace Aseba
 		NodesMap::const_iterator nodeIt = nodes.find(nodeId);
 		if (nodeIt != nodes.end())
 		{
-			return nodeIt->second.name;
+			return nodeIt->second.getDescription().name;
 		}
 		else
 		{
@@ -236,7 +423,7 @@ namespace Aseba
 		unsigned foundId(0);
 		for (NodesMap::const_iterator nodeIt = nodes.begin(); nodeIt != nodes.end(); ++nodeIt)
 		{
-			if (nodeIt->second.name == name)
+			if (nodeIt->second.getDescription().name == name)
 			{
 				if (ok)
 					*ok = true;
@@ -274,7 +461,15 @@ namespace Aseba
 		
 		if (ok)
 			*ok = true;
-		return &(nodeIt->second);
+		return &(nodeIt->second.getDescription());
+	}
+	
+	std::shared_ptr<const SharedDescription> NodesManager::getSharedDescription(unsigned nodeId) const
+	{
+		NodesMap::const_iterator nodeIt = nodes.find(nodeId);
+		if (nodeIt == nodes.end())
+			return std::shared_ptr<const SharedDescription>();
+		return nodeIt->second.description;
 	}
 	
 	unsigned NodesManager::getVariablePos(unsigned nodeId, const std::wstring& name, bool *ok) const
@@ -284,16 +479,27 @@ namespace Aseba
 		// node not found
 		if (nodeIt != nodes.end())
 		{
+			// once the description is complete, avoid a linear search
+			const std::shared_ptr<const SharedDescription>& description(nodeIt->second.description);
+			if (description)
+			{
+				const auto variableIt(description->namedVariablesIndex.find(name));
+				if (ok)
+					*ok = (variableIt != description->namedVariablesIndex.end());
+				return variableIt != description->namedVariablesIndex.end() ? variableIt->second.first : 0xFFFFFFFF;
+			}
+			
+			const TargetDescription& received(nodeIt->second.received);
 			size_t pos = 0;
-			for (size_t i = 0; i < nodeIt->second.namedVariables.size(); ++i)
+			for (size_t i = 0; i < received.namedVariables.size(); ++i)
 			{
-				if (nodeIt->second.namedVariables[i].name == name)
+				if (received.namedVariables[i].name == name)
 				{
 					if (ok)
 						*ok = true;
 					return pos;
 				}
-				pos += nodeIt->second.namedVariables[i].size;
+				pos += received.namedVariables[i].size;
 			}
 		}
 		
@@ -310,13 +516,24 @@ namespace Aseba
 		// node not found
 		if (nodeIt != nodes.end())
 		{
-			for (size_t i = 0; i < nodeIt->second.namedVariables.size(); ++i)
+			// once the description is complete, avoid a linear search
+			const std::shared_ptr<const SharedDescription>& description(nodeIt->second.description);
+			if (description)
+			{
+				const auto variableIt(description->namedVariablesIndex.find(name));
+				if (ok)
+					*ok = (variableIt != description->namedVariablesIndex.end());
+				return variableIt != description->namedVariablesIndex.end() ? variableIt->second.second : 0xFFFFFFFF;
+			}
+			
+			const TargetDescription& received(nodeIt->second.received);
+			for (size_t i = 0; i < received.namedVariables.size(); ++i)
 			{
-				if (nodeIt->second.namedVariables[i].name == name)
+				if (received.namedVariables[i].name == name)
 				{
 					if (ok)
 						*ok = true;
-					return nodeIt->second.namedVariables[i].size;
+					return received.namedVariables[i].size;
 				}
 			}
 		}
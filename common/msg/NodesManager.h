@@ -24,23 +24,72 @@
 #include "msg.h"
 #include "../utils/utils.h"
 #include <string>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
 
 namespace Aseba
 {
 	/** \addtogroup msg */
 	/*@{*/
 	
+	//! A complete description, never modified, along with the lookup tables that clients build out of it
+	struct SharedDescription: public TargetDescription
+	{
+		SharedDescription(const TargetDescription& description, uint16_t key);
+		
+		const uint16_t key; //!< CRC of the whole description, see DescriptionsPool::key()
+		VariablesMap variablesMap; //!< as returned by getVariablesMap()
+		unsigned freeVariableIndex; //!< as set by getVariablesMap()
+		FunctionsMap functionsMap; //!< as returned by getFunctionsMap()
+		//! Position and size of named variables, by name; if several variables have the same name, the first one
+		std::unordered_map<std::wstring, std::pair<unsigned, unsigned> > namedVariablesIndex;
+		size_t memoryUsage; //!< approximate number of bytes taken by this object
+	};
+	
+	//! Process-wide pool of the descriptions in use, so that identical nodes of all NodesManager share a single one
+	class DescriptionsPool
+	{
+	public:
+		//! Memory taken by the descriptions in use
+		struct Stats
+		{
+			size_t descriptions = 0; //!< number of distinct descriptions
+			size_t references = 0; //!< number of holders of these descriptions, typically nodes
+			size_t bytes = 0; //!< bytes taken by the distinct descriptions
+			size_t savedBytes = 0; //!< bytes that a copy of the description per holder would take in addition
+		};
+		
+	public:
+		//! Return the description equal to description, creating it if no one holds such a description yet
+		static std::shared_ptr<const SharedDescription> intern(const TargetDescription& description);
+		//! Return the memory taken by the descriptions in use
+		static Stats stats();
+		//! Return the XModem CRC of the whole description, unlike TargetDescription::crc() including the name, the version and the documentation
+		static uint16_t key(const TargetDescription& description);
+		//! Return whether a and b are identical
+		static bool equal(const TargetDescription& a, const TargetDescription& b);
+		
+	protected:
+		typedef std::unordered_multimap<uint16_t, std::weak_ptr<const SharedDescription> > Descriptions;
+		static std::mutex& mutex();
+		static Descriptions& descriptions();
+	};
+	
 	//! This helper class builds complete descriptions out of multiple message parts.
 	//! For now, it does not support the disconnection of a whole network nor the update of the description of any node
 	class NodesManager
 	{
 	protected:
 		//! Potentially partial Descriptions of nodes along with their reception status
-		struct Node: public TargetDescription
+		struct Node
 		{
 			Node();
 			Node(const TargetDescription& targetDescription);
 			
+			TargetDescription received; //!< description being received, cleared once complete
+			std::shared_ptr<const SharedDescription> description; //!< complete description, shared with the identical nodes
+			
 			unsigned namedVariablesReceptionCounter; //!< what is the status of the reception of named variables
 			unsigned localEventsReceptionCounter; //!< what is the status of the reception of local events
 			unsigned nativeFunctionReceptionCounter; //!< what is the status of the reception of native functions
@@ -49,11 +98,16 @@ namespace Aseba
 			UnifiedTime lastSeen; //!< when this node was last seen?
 			
 			bool isComplete() const;
+			//! Return the complete description if all parts were received, the one being received otherwise
+			const TargetDescription& getDescription() const { return description ? *description : received; }
+			//! If all parts were received, replace the received description by the shared one
+			void shareIfComplete();
 		};
 		//! Map from nodes id to nodes descriptions
 		typedef std::map<unsigned, Node> NodesMap;
 		NodesMap nodes; //!< all known nodes descriptions and connection status
 		std::set<unsigned> mismatchingNodes; //<! seen nodes with mismatching protocol versions
+		uint16_t announcedProtocolVersion = ASEBA_PROTOCOL_VERSION; //!< version put in description requests, subclasses that unpack EventsBatch can set it to ASEBA_EVENTS_BATCH_PROTOCOL_VERSION
 		
 	public:
 		//! Virtual destructor
@@ -70,6 +124,8 @@ namespace Aseba
 		unsigned getNodeId(const std::wstring& name, unsigned preferedId = 0, bool *ok = 0) const;
 		//! Return the description of a node and set ok to true, if provided; if invalid, return 0 and set ok to false
 		const TargetDescription *getDescription(unsigned nodeId, bool *ok = 0) const;
+		//! Return the description of a node, shared with identical nodes, if it is complete; otherwise return an empty pointer
+		std::shared_ptr<const SharedDescription> getSharedDescription(unsigned nodeId) const;
 		//! Return the position of a variable and set ok to true, if provided; if invalid, return 0xFFFFFFFF and set ok to false
 		unsigned getVariablePos(unsigned nodeId, const std::wstring& name, bool *ok = 0) const;
 		//! Return the length of a variable and set ok to true, if provided; if invalid, return 0xFFFFFFFF and set ok to false
@@ -0,0 +1,292 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Snapshot.h"
+#include "../utils/utils.h"
+#include "../utils/LittleEndian.h"
+#include <algorithm>
+#include <cstring>
+
+namespace Aseba
+{
+	using namespace std;
+
+	/** \addtogroup msg */
+	/*@{*/
+
+	static const char snapshotMagic[8] = { 'A', 'S', 'E', 'B', 'A', 'S', 'N', 'P' };
+	static const uint16_t snapshotVersion = 1;
+
+	//! Encodings of the memory of a node
+	enum NodeEncoding
+	{
+		ENCODING_FULL = 0,
+		ENCODING_DELTA = 1
+	};
+
+	//! Unchanged words between two changed ones, below which both are sent in a single range
+	static const size_t RANGE_OVERHEAD = 2;
+
+	VariablesSnapshot::VariablesSnapshot():
+		missingChunks(0)
+	{}
+
+	void VariablesSnapshot::addNode(unsigned nodeId, const TargetDescription& description, const VariablesMap& variablesMap)
+	{
+		if (!variablesMap.empty())
+		{
+			addNode(nodeId, description.variablesSize, variablesMap);
+			return;
+		}
+
+		// without a compiled program, only the variables of the node are known
+		VariablesMap layout;
+		unsigned pos(0);
+		for (size_t i = 0; i < description.namedVariables.size(); ++i)
+		{
+			layout[description.namedVariables[i].name] = make_pair(pos, description.namedVariables[i].size);
+			pos += description.namedVariables[i].size;
+		}
+		addNode(nodeId, description.variablesSize, layout);
+	}
+
+	void VariablesSnapshot::addNode(unsigned nodeId, unsigned variablesSize, const VariablesMap& layout)
+	{
+		NodeMemory& node(nodes[nodeId]);
+		missingChunks -= count(node.receivedChunks.begin(), node.receivedChunks.end(), false);
+		node.layout = layout;
+		node.data.assign(variablesSize, 0);
+		node.receivedChunks.assign((variablesSize + CHUNK_SIZE - 1) / CHUNK_SIZE, false);
+		missingChunks += node.receivedChunks.size();
+	}
+
+	std::vector<GetVariables> VariablesSnapshot::getRequests(unsigned nodeId, unsigned destId) const
+	{
+		vector<GetVariables> requests;
+		const auto nodeIt(nodes.find(nodeId));
+		if (nodeIt == nodes.end())
+			return requests;
+		if (destId == ASEBA_DEST_INVALID)
+			destId = nodeId;
+
+		const size_t size(nodeIt->second.data.size());
+		for (size_t start = 0; start < size; start += CHUNK_SIZE)
+			requests.push_back(GetVariables(destId, start, min<size_t>(CHUNK_SIZE, size - start)));
+		return requests;
+	}
+
+	bool VariablesSnapshot::received(unsigned nodeId, const Variables& variables)
+	{
+		const auto nodeIt(nodes.find(nodeId));
+		if (nodeIt == nodes.end())
+			return false;
+		NodeMemory& node(nodeIt->second);
+
+		// only accept replies to our own requests, other clients might read other ranges
+		const size_t start(variables.start);
+		if (start % CHUNK_SIZE != 0 || start >= node.data.size())
+			return false;
+		if (variables.variables.size() != min<size_t>(CHUNK_SIZE, node.data.size() - start))
+			return false;
+
+		// and only once, so that a later read of the same range does not change the snapshot
+		const size_t chunk(start / CHUNK_SIZE);
+		if (node.receivedChunks[chunk])
+			return false;
+
+		copy(variables.variables.begin(), variables.variables.end(), node.data.begin() + start);
+		node.receivedChunks[chunk] = true;
+		--missingChunks;
+		return true;
+	}
+
+	void VariablesSnapshot::encode(std::vector<uint8_t>& blob, const VariablesSnapshot* base) const
+	{
+		appendLittleEndian(blob, uint16_t(nodes.size()));
+		for (const auto& nodeIt: nodes)
+		{
+			const NodeMemory& node(nodeIt.second);
+			const NodeMemory* baseNode(nullptr);
+			if (base)
+			{
+				const auto baseIt(base->nodes.find(nodeIt.first));
+				if (baseIt != base->nodes.end() && baseIt->second.data.size() == node.data.size())
+					baseNode = &baseIt->second;
+			}
+
+			appendLittleEndian(blob, uint16_t(nodeIt.first));
+			appendLittleEndian(blob, uint16_t(node.data.size()));
+			blob.push_back(baseNode ? ENCODING_DELTA : ENCODING_FULL);
+
+			appendLittleEndian(blob, uint16_t(node.layout.size()));
+			for (const auto& variable: node.layout)
+			{
+				const string name(WStringToUTF8(variable.first));
+				appendLittleEndian(blob, uint16_t(variable.second.first));
+				appendLittleEndian(blob, uint16_t(variable.second.second));
+				appendLittleEndian(blob, uint16_t(name.size()));
+				blob.insert(blob.end(), name.begin(), name.end());
+			}
+
+			if (!baseNode)
+			{
+				for (size_t i = 0; i < node.data.size(); ++i)
+					appendLittleEndian(blob, node.data[i]);
+				continue;
+			}
+
+			// ranges of changed words, merged when the gap between them is cheaper to send than a new range
+			vector<pair<size_t, size_t> > ranges;
+			for (size_t i = 0; i < node.data.size(); ++i)
+			{
+				if (node.data[i] == baseNode->data[i])
+					continue;
+				if (!ranges.empty() && i - (ranges.back().first + ranges.back().second) <= RANGE_OVERHEAD)
+					ranges.back().second = i + 1 - ranges.back().first;
+				else
+					ranges.push_back(make_pair(i, 1));
+			}
+			appendLittleEndian(blob, uint16_t(ranges.size()));
+			for (const auto& range: ranges)
+			{
+				appendLittleEndian(blob, uint16_t(range.first));
+				appendLittleEndian(blob, uint16_t(range.second));
+				for (size_t i = range.first; i < range.first + range.second; ++i)
+					appendLittleEndian(blob, node.data[i]);
+			}
+		}
+	}
+
+	bool VariablesSnapshot::decode(const std::vector<uint8_t>& blob, uint32_t* id)
+	{
+		size_t pos(0);
+		uint16_t version, nodesCount;
+		uint32_t snapshotId, baseId;
+		if (blob.size() < sizeof(snapshotMagic) || memcmp(&blob[0], snapshotMagic, sizeof(snapshotMagic)) != 0)
+			return false;
+		pos += sizeof(snapshotMagic);
+		if (!readLittleEndian(blob, pos, version) || version != snapshotVersion)
+			return false;
+		if (!readLittleEndian(blob, pos, snapshotId) || !readLittleEndian(blob, pos, baseId) || !readLittleEndian(blob, pos, nodesCount))
+			return false;
+
+		NodesMemory decoded;
+		for (unsigned n = 0; n < nodesCount; ++n)
+		{
+			uint16_t nodeId, variablesSize, variablesCount;
+			if (!readLittleEndian(blob, pos, nodeId) || !readLittleEndian(blob, pos, variablesSize))
+				return false;
+			if (pos >= blob.size())
+				return false;
+			const uint8_t encoding(blob[pos++]);
+			NodeMemory& node(decoded[nodeId]);
+
+			if (!readLittleEndian(blob, pos, variablesCount))
+				return false;
+			for (unsigned v = 0; v < variablesCount; ++v)
+			{
+				uint16_t position, size, nameLength;
+				if (!readLittleEndian(blob, pos, position) || !readLittleEndian(blob, pos, size) || !readLittleEndian(blob, pos, nameLength))
+					return false;
+				if (blob.size() - pos < nameLength)
+					return false;
+				const string name(blob.begin() + pos, blob.begin() + pos + nameLength);
+				pos += nameLength;
+				node.layout[UTF8ToWString(name)] = make_pair(unsigned(position), unsigned(size));
+			}
+
+			if (encoding == ENCODING_FULL)
+			{
+				node.data.resize(variablesSize);
+				for (size_t i = 0; i < node.data.size(); ++i)
+					if (!readLittleEndian(blob, pos, node.data[i]))
+						return false;
+			}
+			else if (encoding == ENCODING_DELTA)
+			{
+				// the base must hold the memory of the node
+				const auto baseIt(nodes.find(nodeId));
+				if (baseIt == nodes.end() || baseIt->second.data.size() != variablesSize)
+					return false;
+				node.data = baseIt->second.data;
+
+				uint16_t rangesCount;
+				if (!readLittleEndian(blob, pos, rangesCount))
+					return false;
+				for (unsigned r = 0; r < rangesCount; ++r)
+				{
+					uint16_t start, length;
+					if (!readLittleEndian(blob, pos, start) || !readLittleEndian(blob, pos, length))
+						return false;
+					if (size_t(start) + length > node.data.size())
+						return false;
+					for (size_t i = start; i < size_t(start) + length; ++i)
+						if (!readLittleEndian(blob, pos, node.data[i]))
+							return false;
+				}
+			}
+			else
+				return false;
+			node.receivedChunks.assign((variablesSize + CHUNK_SIZE - 1) / CHUNK_SIZE, true);
+		}
+		if (pos != blob.size())
+			return false;
+
+		nodes.swap(decoded);
+		missingChunks = 0;
+		if (id)
+			*id = snapshotId;
+		return true;
+	}
+
+	SnapshotHistory::SnapshotHistory(size_t capacity):
+		capacity(capacity),
+		nextId(uint32_t(UnifiedTime().value))
+	{}
+
+	std::vector<uint8_t> SnapshotHistory::encode(const VariablesSnapshot& snapshot, uint32_t baseId)
+	{
+		const VariablesSnapshot* base(nullptr);
+		for (const auto& remembered: snapshots)
+			if (baseId != 0 && remembered.first == baseId)
+				base = &remembered.second;
+		if (!base)
+			baseId = 0;
+
+		// 0 means no base
+		if (nextId == 0)
+			++nextId;
+		const uint32_t id(nextId++);
+
+		vector<uint8_t> blob(snapshotMagic, snapshotMagic + sizeof(snapshotMagic));
+		appendLittleEndian(blob, snapshotVersion);
+		appendLittleEndian(blob, id);
+		appendLittleEndian(blob, baseId);
+		snapshot.encode(blob, base);
+
+		// the base might be the oldest snapshot, only forget it once encoding is done
+		snapshots.push_back(make_pair(id, snapshot));
+		while (snapshots.size() > capacity)
+			snapshots.pop_front();
+		return blob;
+	}
+
+	/*@}*/
+}
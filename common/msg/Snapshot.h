@@ -0,0 +1,131 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_SNAPSHOT_H
+#define ASEBA_SNAPSHOT_H
+
+#include "msg.h"
+#include <deque>
+#include <map>
+#include <vector>
+
+namespace Aseba
+{
+	/** \addtogroup msg */
+	/*@{*/
+
+	/**
+		The whole variables memory of one or several nodes, at about the same time.
+
+		A snapshot is assembled from the replies to the GetVariables requests returned by
+		getRequests(), which cover the memory of a node with as few messages as possible.
+		They can all be sent at once, the replies are matched by node and start position,
+		the caller giving the id of the node a reply comes from, as switches may remap ids.
+
+		Once complete, a snapshot is encoded by SnapshotHistory into a compact binary blob,
+		all integers being little-endian:
+		- magic "ASEBASNP", u16 version
+		- u32 id, u32 id of the base snapshot, 0 if none
+		- u16 number of nodes, then for each node:
+			- u16 node id, u16 variables size, u8 encoding (0 full, 1 delta)
+			- u16 number of variables, then for each variable: u16 position, u16 size,
+			  u16 length of the name, name in UTF-8
+			- if full: the whole memory, one i16 per word
+			- if delta: u16 number of ranges, then for each range: u16 start, u16 length,
+			  the words of the range that changed since the base snapshot
+	*/
+	class VariablesSnapshot
+	{
+	public:
+		//! Maximum number of words in a Variables reply, the start position takes the last one
+		static const unsigned CHUNK_SIZE = ASEBA_MAX_EVENT_ARG_COUNT - 1;
+
+		//! Memory of a node
+		struct NodeMemory
+		{
+			VariablesMap layout; //!< position and size of the named variables
+			std::vector<int16_t> data; //!< content of the variables memory
+			std::vector<bool> receivedChunks; //!< for each chunk of CHUNK_SIZE words, whether it was received
+		};
+		typedef std::map<unsigned, NodeMemory> NodesMemory;
+
+	public:
+		VariablesSnapshot();
+
+		//! Add node nodeId, using variablesMap as layout if not empty, or the named variables of description otherwise
+		void addNode(unsigned nodeId, const TargetDescription& description, const VariablesMap& variablesMap);
+		//! Add node nodeId, whose variablesSize words of memory are laid out as in layout
+		void addNode(unsigned nodeId, unsigned variablesSize, const VariablesMap& layout);
+		//! Return the requests for the memory of node nodeId, addressed to destId, which is nodeId by default
+		std::vector<GetVariables> getRequests(unsigned nodeId, unsigned destId = ASEBA_DEST_INVALID) const;
+		//! Store the content of variables from node nodeId if it is the reply to a request of this snapshot still waiting for it, return whether it was
+		bool received(unsigned nodeId, const Variables& variables);
+		//! Return whether all the requested memory was received
+		bool isComplete() const { return missingChunks == 0; }
+		//! Return whether node nodeId is part of this snapshot
+		bool contains(unsigned nodeId) const { return nodes.find(nodeId) != nodes.end(); }
+		//! Return the memory of the nodes
+		const NodesMemory& getNodes() const { return nodes; }
+
+		/**
+			Read blob into this snapshot and set id to its id, return false if blob is not a valid snapshot.
+			The nodes encoded as delta are applied to the memory this snapshot holds, which must be the
+			base of blob, typically the result of the previous call.
+		*/
+		bool decode(const std::vector<uint8_t>& blob, uint32_t* id = 0);
+
+	protected:
+		friend class SnapshotHistory;
+
+		//! Append the encoding of the memory of the nodes to blob, as a delta for nodes of base of the same size
+		void encode(std::vector<uint8_t>& blob, const VariablesSnapshot* base) const;
+
+	protected:
+		NodesMemory nodes;
+		unsigned missingChunks; //!< number of chunks still expected
+	};
+
+	/**
+		Encoder of complete snapshots, that remembers the last few of them so that the next ones can
+		be encoded as the words that changed since, for periodic archival.
+		Ids start from the current time, so that ids from a previous run are unlikely to be
+		taken for a base.
+	*/
+	class SnapshotHistory
+	{
+	public:
+		//! Create a history remembering the last capacity snapshots
+		SnapshotHistory(size_t capacity = 16);
+
+		//! Remember snapshot under a new id and return its encoding, as a delta from snapshot baseId if it is remembered
+		std::vector<uint8_t> encode(const VariablesSnapshot& snapshot, uint32_t baseId = 0);
+		//! Return the id of the last encoded snapshot, 0 if none
+		uint32_t getLastId() const { return snapshots.empty() ? 0 : snapshots.back().first; }
+
+	protected:
+		const size_t capacity;
+		uint32_t nextId;
+		std::deque<std::pair<uint32_t, VariablesSnapshot> > snapshots;
+	};
+
+	/*@}*/
+}
+
+#endif
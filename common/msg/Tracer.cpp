@@ -0,0 +1,304 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Tracer.h"
+#include <cstdio>
+#include <vector>
+#include <dashel/dashel.h>
+#ifndef WIN32
+	#include <unistd.h>
+#else // WIN32
+	#include <process.h>
+	#define getpid _getpid
+#endif // WIN32
+
+namespace Aseba
+{
+	using namespace std;
+
+	/** \addtogroup msg */
+	/*@{*/
+
+	//! Beyond this number of messages in flight, forget the ones idle for more than a second
+	static const size_t FLIGHTS_LIMIT = 4096;
+
+	static const char* stageNames[Tracer::STAGES_COUNT] = { "receive", "enqueue", "serialize", "flush" };
+
+	//! Write s as a JSON string
+	static void writeJsonString(ostream& stream, const string& s)
+	{
+		stream << '"';
+		for (size_t i = 0; i < s.size(); ++i)
+		{
+			const unsigned char c(s[i]);
+			if (c == '"' || c == '\\')
+				stream << '\\' << c;
+			else if (c < 0x20)
+			{
+				char escaped[8];
+				snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+				stream << escaped;
+			}
+			else
+				stream << c;
+		}
+		stream << '"';
+	}
+
+	//! Continue the FNV-1a hash with size bytes of data
+	static uint64_t fnv1a(uint64_t hash, const uint8_t* data, size_t size)
+	{
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= data[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	//! Write a duration in ns as µs with three decimals, the unit of Chrome traces
+	static void writeMicroseconds(ostream& stream, long long ns)
+	{
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "%lld.%03lld", ns / 1000, ns % 1000);
+		stream << buffer;
+	}
+
+	void Tracer::Histogram::add(unsigned long long delay)
+	{
+		unsigned bucket(0);
+		while (bucket < BUCKETS_COUNT - 1 && (delay >> bucket) != 0)
+			++bucket;
+		++buckets[bucket];
+		++count;
+		sum += delay;
+		if (delay > max)
+			max = delay;
+	}
+
+	unsigned long long Tracer::Histogram::quantile(double q) const
+	{
+		const unsigned long long rank(static_cast<unsigned long long>(q * count));
+		unsigned long long seen(0);
+		for (unsigned bucket = 0; bucket < BUCKETS_COUNT; ++bucket)
+		{
+			seen += buckets[bucket];
+			if (seen > rank)
+			{
+				const unsigned long long bound(bucket ? (1ull << bucket) - 1 : 0);
+				return bound < max ? bound : max;
+			}
+		}
+		return max;
+	}
+
+	void Tracer::Histogram::dump(std::ostream& stream) const
+	{
+		stream << count << " messages, p50 " << quantile(0.5) << " ns, p90 " << quantile(0.9);
+		stream << " ns, p99 " << quantile(0.99) << " ns, max " << max << " ns";
+	}
+
+	Tracer::Tracer(const std::string& fileName, const std::string& processName):
+		fileName(fileName),
+		file(fileName.c_str()),
+		firstEvent(true),
+		pid(getpid()),
+		lastTick(Clock::now())
+	{
+		if (!file.is_open())
+			return;
+		file << "[\n";
+		file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"args\":{\"name\":";
+		writeJsonString(file, processName);
+		file << "}}";
+		file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << LOCAL_THREAD << ",\"args\":{\"name\":\"local\"}}";
+		firstEvent = false;
+		threads[0] = LOCAL_THREAD;
+	}
+
+	Tracer::~Tracer()
+	{
+		if (!file.is_open())
+			return;
+		file << "\n]\n";
+		writeHistograms();
+	}
+
+	uint64_t Tracer::messageId(const Message& message)
+	{
+		vector<uint8_t> frame;
+		message.serialize(frame);
+		return fnv1a(14695981039346656037ull, frame.data(), frame.size());
+	}
+
+	void Tracer::record(uint64_t id, Stage stage, Dashel::Stream* stream, uint64_t wireId)
+	{
+		const Clock::time_point now(Clock::now());
+
+		// a message enters the process when received, or when first seen if it originates here
+		auto flightIt(flights.find(id));
+		if (stage == RECEIVE || flightIt == flights.end())
+		{
+			if (flights.size() >= FLIGHTS_LIMIT)
+			{
+				for (auto it = flights.begin(); it != flights.end();)
+				{
+					if (now - it->second.last > chrono::seconds(1))
+						it = flights.erase(it);
+					else
+						++it;
+				}
+				if (flights.size() >= FLIGHTS_LIMIT)
+					flights.clear();
+			}
+			Flight& flight(flights[id]);
+			flight.origin = now;
+			flight.last = now;
+			flight.link = (file.is_open() && stage == RECEIVE && stream) ? linkId(id, stream, false, now) : id;
+			flightIt = flights.find(id);
+		}
+		Flight& flight(flightIt->second);
+
+		histograms[stage].add(chrono::duration_cast<chrono::nanoseconds>(now - flight.origin).count());
+
+		if (file.is_open())
+		{
+			// a slice spans from the previous stage, flows link the write of a message to its reception in the next process
+			const unsigned thread(threadOf(stream));
+			writeEvent(stageNames[stage], 'X', flight.link, flight.last, thread, now - flight.last);
+			if (stage == RECEIVE && stream)
+				writeEvent("message", 'f', flight.link, flight.last, thread);
+			else if (stage == FLUSH && stream)
+				writeEvent("message", 's', linkId(wireId ? wireId : id, stream, true, now), flight.last, thread);
+		}
+		flight.last = now;
+	}
+
+	void Tracer::tick()
+	{
+		const Clock::time_point now(Clock::now());
+		if (now - lastTick < chrono::seconds(1))
+			return;
+		lastTick = now;
+		if (!file.is_open())
+			return;
+		file.flush();
+		writeHistograms();
+	}
+
+	void Tracer::dumpHistograms(std::ostream& stream) const
+	{
+		for (unsigned stage = 0; stage < STAGES_COUNT; ++stage)
+		{
+			if (!histograms[stage].count)
+				continue;
+			stream << stageNames[stage] << ": ";
+			histograms[stage].dump(stream);
+			stream << "\n";
+		}
+	}
+
+	void Tracer::writeEvent(const char* name, char phase, uint64_t id, Clock::time_point time, unsigned thread, Clock::duration duration)
+	{
+		char idString[24];
+		snprintf(idString, sizeof(idString), "0x%016llx", static_cast<unsigned long long>(id));
+
+		file << (firstEvent ? "" : ",\n");
+		firstEvent = false;
+		file << "{\"name\":\"" << name << "\",\"cat\":\"aseba\",\"ph\":\"" << phase << "\",\"ts\":";
+		writeMicroseconds(file, chrono::duration_cast<chrono::nanoseconds>(time.time_since_epoch()).count());
+		file << ",\"pid\":" << pid << ",\"tid\":" << thread;
+		if (phase == 'X')
+		{
+			// zero-length slices are hard to see and cannot hold flow ends
+			const long long ns(chrono::duration_cast<chrono::nanoseconds>(duration).count());
+			file << ",\"dur\":";
+			writeMicroseconds(file, ns > 0 ? ns : 1);
+			file << ",\"args\":{\"id\":\"" << idString << "\"}}";
+		}
+		else
+		{
+			file << ",\"id\":\"" << idString << "\"";
+			if (phase == 'f')
+				file << ",\"bp\":\"e\"";
+			file << "}";
+		}
+	}
+
+	uint64_t Tracer::linkId(uint64_t wireId, Dashel::Stream* stream, bool sending, Clock::time_point now)
+	{
+		// counts restart when a frame was not seen for a second, so both ends of the stream
+		// agree on them whenever they forget idle frames
+		if (occurrences.size() >= FLIGHTS_LIMIT)
+		{
+			for (auto it = occurrences.begin(); it != occurrences.end();)
+			{
+				if (now - it->second.last > chrono::seconds(1))
+					it = occurrences.erase(it);
+				else
+					++it;
+			}
+		}
+
+		auto occurrencesIt(occurrences.find(OccurrencesKey(stream, sending, wireId)));
+		if (occurrencesIt == occurrences.end())
+		{
+			const Occurrences first = { 0, now };
+			occurrencesIt = occurrences.insert(make_pair(OccurrencesKey(stream, sending, wireId), first)).first;
+		}
+		Occurrences& seen(occurrencesIt->second);
+		if (now - seen.last > chrono::seconds(1))
+			seen.count = 0;
+		const unsigned long long count(seen.count++);
+		seen.last = now;
+
+		uint8_t countBytes[8];
+		for (size_t i = 0; i < sizeof(countBytes); ++i)
+			countBytes[i] = uint8_t(count >> (8 * i));
+		return fnv1a(wireId, countBytes, sizeof(countBytes));
+	}
+
+	unsigned Tracer::threadOf(Dashel::Stream* stream)
+	{
+		if (!stream)
+			return LOCAL_THREAD;
+
+		auto threadIt(threads.find(stream));
+		if (threadIt != threads.end())
+			return threadIt->second;
+
+		// each stream is shown as a thread named after its target
+		const unsigned thread(threads.size());
+		threads[stream] = thread;
+		file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << thread << ",\"args\":{\"name\":";
+		writeJsonString(file, stream->getTargetName());
+		file << "}}";
+		return thread;
+	}
+
+	void Tracer::writeHistograms() const
+	{
+		ofstream histogramsFile((fileName + ".histograms").c_str());
+		histogramsFile << "delay since reception, per stage\n";
+		dumpHistograms(histogramsFile);
+	}
+
+	/*@}*/
+}
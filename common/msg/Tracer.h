@@ -0,0 +1,156 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_TRACER_H
+#define ASEBA_TRACER_H
+
+#include "msg.h"
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <iostream>
+
+namespace Dashel
+{
+	class Stream;
+}
+
+namespace Aseba
+{
+	/** \addtogroup msg */
+	/*@{*/
+
+	/**
+		Latency tracer following messages through the hops of a process.
+
+		Each hop of a message (reception, queueing, serialization, write to a stream) is
+		recorded with a monotonic nanosecond timestamp into a Chrome trace file, which
+		can be opened with chrome://tracing or Perfetto. Within a process, a message is
+		identified by a hash of its whole frame: type, source, destination and payload.
+		Across processes, flow events link the write of a message on a stream to its
+		reception at the other end, without changing the wire format: their id combines
+		the hash of the frame as written with the number of identical frames that went
+		through the stream in the same direction before. Both ends count the same frames,
+		so merging the trace files of processes on the same host links the hops of a
+		message, and repeated identical messages keep distinct ids.
+
+		The delay of each stage since the message entered the process is also accumulated
+		into log2 histograms, written next to the trace file by tick().
+	*/
+	class Tracer
+	{
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		//! Hops of a message in a process
+		enum Stage
+		{
+			RECEIVE = 0, //!< message read from a stream
+			ENQUEUE, //!< message queued to be sent to a stream
+			SERIALIZE, //!< message serialized for a stream
+			FLUSH, //!< message written and flushed to a stream
+			STAGES_COUNT
+		};
+
+		//! Log2 histogram of delays in ns
+		struct Histogram
+		{
+			static const unsigned BUCKETS_COUNT = 64;
+			unsigned long long buckets[BUCKETS_COUNT] = {}; //!< bucket i counts delays in [2^(i-1), 2^i[ ns
+			unsigned long long count = 0; //!< number of delays
+			unsigned long long sum = 0; //!< sum of delays in ns
+			unsigned long long max = 0; //!< largest delay in ns
+
+			//! Add a delay in ns
+			void add(unsigned long long delay);
+			//! Return an upper bound of the given quantile (between 0 and 1) in ns
+			unsigned long long quantile(double q) const;
+			//! Dump a one-line summary of this histogram
+			void dump(std::ostream& stream) const;
+		};
+
+	public:
+		//! Create a tracer writing to fileName, naming this process processName in the trace
+		Tracer(const std::string& fileName, const std::string& processName);
+		//! Close the trace file
+		~Tracer();
+		//! Return whether the trace file could be opened
+		bool isOpen() const { return file.is_open(); }
+
+		//! Trace thread of the stages that are not related to a stream
+		static const unsigned LOCAL_THREAD = 0;
+
+		//! Return the id identifying message in a process
+		static uint64_t messageId(const Message& message);
+
+		//! Record that message id reached stage on stream, which may be 0 if the stage is not related to a stream;
+		//! if node ids were remapped since reception, wireId is the id of the message as written to stream, 0 otherwise
+		void record(uint64_t id, Stage stage, Dashel::Stream* stream = 0, uint64_t wireId = 0);
+		//! Record that message reached stage on stream
+		void record(const Message& message, Stage stage, Dashel::Stream* stream = 0) { record(messageId(message), stage, stream); }
+
+		//! Flush the trace file and rewrite the histograms file, at most once per second; call regularly
+		void tick();
+		//! Dump the histograms of all stages
+		void dumpHistograms(std::ostream& stream) const;
+		//! Return the histogram of delays since reception for stage
+		const Histogram& getHistogram(Stage stage) const { return histograms[stage]; }
+
+	protected:
+		//! Times of a message in flight in this process
+		struct Flight
+		{
+			Clock::time_point origin; //!< when the message entered this process
+			Clock::time_point last; //!< when the message reached its last stage
+			uint64_t link; //!< link id of the message when it entered this process
+		};
+
+		//! Number of identical frames that went through a stream in one direction
+		struct Occurrences
+		{
+			unsigned long long count; //!< frames seen so far
+			Clock::time_point last; //!< when the last one was seen
+		};
+		//! Stream, whether frames are sent to it, and message id
+		typedef std::tuple<Dashel::Stream*, bool, uint64_t> OccurrencesKey;
+
+		void writeEvent(const char* name, char phase, uint64_t id, Clock::time_point time, unsigned thread, Clock::duration duration = Clock::duration::zero());
+		uint64_t linkId(uint64_t wireId, Dashel::Stream* stream, bool sending, Clock::time_point now);
+		unsigned threadOf(Dashel::Stream* stream);
+		void writeHistograms() const;
+
+	protected:
+		const std::string fileName;
+		std::ofstream file;
+		bool firstEvent;
+		const unsigned pid;
+		std::map<Dashel::Stream*, unsigned> threads; //!< trace thread id of each stream
+		std::map<uint64_t, Flight> flights; //!< messages in flight in this process
+		std::map<OccurrencesKey, Occurrences> occurrences; //!< frames seen on each stream, to compute link ids
+		Histogram histograms[STAGES_COUNT];
+		Clock::time_point lastTick;
+	};
+
+	/*@}*/
+}
+
+#endif
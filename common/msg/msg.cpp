@@ -26,6 +26,7 @@
 #include <iomanip>
 #include <map>
 #include <iterator>
+#include <cstring>
 #include <dashel/dashel.h>
 
 using namespace std;
@@ -48,6 +49,7 @@ namespace Aseba
 			registerMessageType<ListNodes>(ASEBA_MESSAGE_LIST_NODES);
 			
 			registerMessageType<NodePresent>(ASEBA_MESSAGE_NODE_PRESENT);
+			registerMessageType<EventsBatch>(ASEBA_MESSAGE_EVENTS_BATCH);
 			
 			registerMessageType<GetDescription>(ASEBA_MESSAGE_GET_DESCRIPTION);
 			registerMessageType<GetNodeDescription>(ASEBA_MESSAGE_GET_NODE_DESCRIPTION);
@@ -153,7 +155,16 @@ namespace Aseba
 	
 	//
 	
-	void Message::serialize(Stream* stream) const
+	size_t Message::serialize(Stream* stream) const
+	{
+		// build the complete frame first so that the stream sees a single write
+		vector<uint8_t> frame;
+		serialize(frame);
+		stream->write(&frame[0], frame.size());
+		return frame.size();
+	}
+	
+	void Message::serialize(vector<uint8_t>& frame) const
 	{
 		SerializationBuffer buffer;
 		serializeSpecific(buffer);
@@ -166,18 +177,19 @@ namespace Aseba
 			cerr << endl;
 			terminate();
 		}
+		const size_t headerPos(frame.size());
+		frame.resize(headerPos + 6);
 		uint16_t t;
-		swapEndian(len);
-		stream->write(&len, 2);
+		t = swapEndianCopy(len);
+		memcpy(&frame[headerPos], &t, 2);
 		t = swapEndianCopy(source);
-		stream->write(&t, 2);
+		memcpy(&frame[headerPos + 2], &t, 2);
 		t = swapEndianCopy(type);
-		stream->write(&t, 2);
-		if (buffer.rawData.size())
-			stream->write(&buffer.rawData[0], buffer.rawData.size());
+		memcpy(&frame[headerPos + 4], &t, 2);
+		frame.insert(frame.end(), buffer.rawData.begin(), buffer.rawData.end());
 	}
 	
-	Message *Message::receive(Stream* stream)
+	Message *Message::receive(Stream* stream, size_t* frameSize)
 	{
 		// read header
 		uint16_t len, source, type;
@@ -193,6 +205,8 @@ namespace Aseba
 		buffer.rawData.resize(len);
 		if (len)
 			stream->read(&buffer.rawData[0], len);
+		if (frameSize)
+			*frameSize = 6 + len;
 		
 		// deserialize message
 		return create(source, type, buffer);
@@ -370,6 +384,60 @@ namespace Aseba
 	
 	//
 	
+	void EventsBatch::serializeSpecific(SerializationBuffer& buffer) const
+	{
+		for (const auto& event: events)
+		{
+			buffer.add(static_cast<uint16_t>(event.data.size() * 2));
+			buffer.add(event.type);
+			for (const auto word: event.data)
+				buffer.add(word);
+		}
+	}
+	
+	void EventsBatch::deserializeSpecific(SerializationBuffer& buffer)
+	{
+		events.clear();
+		while (buffer.readPos < buffer.rawData.size())
+		{
+			const uint16_t len(buffer.get<uint16_t>());
+			const uint16_t eventType(buffer.get<uint16_t>());
+			if ((len % 2 != 0) || (buffer.readPos + len > buffer.rawData.size()))
+			{
+				cerr << "EventsBatch::deserializeSpecific(SerializationBuffer& buffer) : fatal error: invalid event size.\n";
+				cerr << "event size: " << len << ", event type: " << eventType << ", batch size: " << buffer.rawData.size();
+				cerr << endl;
+				terminate();
+			}
+			UserMessage event(eventType);
+			event.source = source;
+			event.data.resize(len / 2);
+			for (auto& word: event.data)
+				word = buffer.get<int16_t>();
+			events.push_back(event);
+		}
+	}
+	
+	void EventsBatch::dumpSpecific(wostream &stream) const
+	{
+		stream << dec << "events batch of " << events.size() << " events";
+		for (const auto& event: events)
+		{
+			stream << "\n\t";
+			event.dump(stream);
+		}
+	}
+	
+	bool operator ==(const EventsBatch &lhs, const EventsBatch &rhs)
+	{
+		return
+			static_cast<const Message&>(lhs) == static_cast<const Message&>(rhs) &&
+			lhs.events == rhs.events
+		;
+	}
+	
+	//
+	
 	void CmdMessage::serializeSpecific(SerializationBuffer& buffer) const
 	{
 		buffer.add(dest);
@@ -84,8 +84,11 @@ namespace Aseba
 		
 		// (de-)serialization methods
 		
-		void serialize(Dashel::Stream* stream) const;
-		static Message *receive(Dashel::Stream* stream);
+		//! Write the frame of this message to stream and return its size in bytes, header included
+		size_t serialize(Dashel::Stream* stream) const;
+		void serialize(std::vector<uint8_t>& frame) const;
+		//! Read a message from stream, if frameSize is set, store there the size in bytes of the frame read, header included
+		static Message *receive(Dashel::Stream* stream, size_t* frameSize = nullptr);
 		static Message *create(uint16_t source, uint16_t type, SerializationBuffer& buffer);
 		Message* clone() const;
 		void dump(std::wostream &stream) const;
@@ -123,6 +126,25 @@ namespace Aseba
 	
 	bool operator ==(const UserMessage &lhs, const UserMessage &rhs);
 	
+	//! Several user messages sent at once by a node, to hosts that announced ASEBA_EVENTS_BATCH_PROTOCOL_VERSION
+	class EventsBatch : public Message
+	{
+	public:
+		using EventsVector = std::vector<UserMessage>;
+		EventsVector events; //!< events in the order they were emitted, all from the source of the batch
+	
+	public:
+		EventsBatch() : Message(ASEBA_MESSAGE_EVENTS_BATCH) { }
+		
+	protected:
+		virtual void serializeSpecific(SerializationBuffer& buffer) const override;
+		virtual void deserializeSpecific(SerializationBuffer& buffer) override;
+		virtual void dumpSpecific(std::wostream &stream) const override;
+		virtual operator const char * () const override { return "events batch"; }
+	};
+	
+	bool operator ==(const EventsBatch &lhs, const EventsBatch &rhs);
+	
 	//! Commands messages talk to a specific node
 	class CmdMessage : public Message
 	{
@@ -0,0 +1,465 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#ifndef WIN32
+	#include <sys/types.h>
+	#include <sys/stat.h>
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#else // WIN32
+	#include <windows.h>
+#endif // WIN32
+#include "AeslReader.h"
+#include "utils.h"
+#include "../consts.h"
+
+namespace Aseba
+{
+	using namespace std;
+
+	/** \addtogroup utils */
+	/*@{*/
+
+	namespace
+	{
+		//! Return whether [p,end) starts with prefix
+		bool startsWith(const char* p, const char* end, const char* prefix)
+		{
+			const size_t len(strlen(prefix));
+			return size_t(end - p) >= len && memcmp(p, prefix, len) == 0;
+		}
+
+		//! Return the first occurrence of pattern in [p,end), or end if none
+		const char* find(const char* p, const char* end, const char* pattern)
+		{
+			const size_t len(strlen(pattern));
+			for (; size_t(end - p) >= len; ++p)
+				if (*p == *pattern && memcmp(p, pattern, len) == 0)
+					return p;
+			return end;
+		}
+
+		//! Append code point c to s in UTF-8
+		void appendUTF8(string& s, unsigned long c)
+		{
+			if (c < 0x80)
+				s += char(c);
+			else if (c < 0x800)
+			{
+				s += char(0xC0 | (c >> 6));
+				s += char(0x80 | (c & 0x3F));
+			}
+			else if (c < 0x10000)
+			{
+				s += char(0xE0 | (c >> 12));
+				s += char(0x80 | ((c >> 6) & 0x3F));
+				s += char(0x80 | (c & 0x3F));
+			}
+			else
+			{
+				s += char(0xF0 | (c >> 18));
+				s += char(0x80 | ((c >> 12) & 0x3F));
+				s += char(0x80 | ((c >> 6) & 0x3F));
+				s += char(0x80 | (c & 0x3F));
+			}
+		}
+
+		//! Decode the character data in [p,end): entities, CDATA sections, comments and line ends
+		string decode(const char* p, const char* end)
+		{
+			string s;
+			s.reserve(end - p);
+			while (p < end)
+			{
+				const char c(*p);
+				if (c == '&')
+				{
+					const char* semicolon(p + 1);
+					while (semicolon < end && *semicolon != ';' && semicolon - p < 12)
+						++semicolon;
+					const string entity(p + 1, semicolon);
+					if (semicolon < end && *semicolon == ';')
+					{
+						if (entity == "lt") s += '<';
+						else if (entity == "gt") s += '>';
+						else if (entity == "amp") s += '&';
+						else if (entity == "quot") s += '"';
+						else if (entity == "apos") s += '\'';
+						else if (entity.size() > 2 && entity[0] == '#' && entity[1] == 'x')
+							appendUTF8(s, strtoul(entity.c_str() + 2, nullptr, 16));
+						else if (entity.size() > 1 && entity[0] == '#')
+							appendUTF8(s, strtoul(entity.c_str() + 1, nullptr, 10));
+						else
+							s.append(p, semicolon + 1);
+						p = semicolon + 1;
+					}
+					else
+					{
+						s += c;
+						++p;
+					}
+				}
+				else if (c == '\r')
+				{
+					// XML normalizes line ends to \n
+					s += '\n';
+					++p;
+					if (p < end && *p == '\n')
+						++p;
+				}
+				else if (c == '<' && startsWith(p, end, "<![CDATA["))
+				{
+					const char* cdataEnd(find(p + 9, end, "]]>"));
+					s.append(p + 9, cdataEnd);
+					p = min(cdataEnd + 3, end);
+				}
+				else if (c == '<' && startsWith(p, end, "<!--"))
+				{
+					p = min(find(p + 4, end, "-->") + 3, end);
+				}
+				else
+				{
+					s += c;
+					++p;
+				}
+			}
+			return s;
+		}
+
+		bool isSpace(char c)
+		{
+			return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+		}
+
+		//! Attributes of an element, in source order
+		typedef vector<pair<string, string>> Attributes;
+
+		//! Return the value of attribute name, or the empty string
+		string attribute(const Attributes& attributes, const char* name)
+		{
+			for (const auto& attribute: attributes)
+				if (attribute.first == name)
+					return attribute.second;
+			return string();
+		}
+
+		//! Parse a start tag with p after '<'; on success p points after '>'
+		bool parseStartTag(const char*& p, const char* end, string& name, Attributes& attributes, bool& selfClosing)
+		{
+			const char* nameBegin(p);
+			while (p < end && !isSpace(*p) && *p != '>' && *p != '/')
+				++p;
+			name.assign(nameBegin, p);
+			attributes.clear();
+			selfClosing = false;
+			while (p < end)
+			{
+				while (p < end && isSpace(*p))
+					++p;
+				if (p >= end)
+					return false;
+				if (*p == '>')
+				{
+					++p;
+					return true;
+				}
+				if (*p == '/')
+				{
+					selfClosing = true;
+					++p;
+					continue;
+				}
+				const char* attributeBegin(p);
+				while (p < end && !isSpace(*p) && *p != '=' && *p != '>')
+					++p;
+				const string attributeName(attributeBegin, p);
+				while (p < end && isSpace(*p))
+					++p;
+				if (p >= end || *p != '=')
+					return false;
+				++p;
+				while (p < end && isSpace(*p))
+					++p;
+				if (p >= end || (*p != '"' && *p != '\''))
+					return false;
+				const char quote(*p++);
+				const char* valueBegin(p);
+				while (p < end && *p != quote)
+					++p;
+				if (p >= end)
+					return false;
+				attributes.emplace_back(attributeName, decode(valueBegin, p));
+				++p;
+			}
+			return false;
+		}
+	}
+
+	unsigned AeslReader::Node::preferedId() const
+	{
+		return nodeId.empty() ? 0 : unsigned(atoi(nodeId.c_str()));
+	}
+
+	string AeslReader::Node::code() const
+	{
+		return decode(begin, end);
+	}
+
+	wstring AeslReader::Node::wcode() const
+	{
+		return UTF8ToWString(code());
+	}
+
+	AeslReader::AeslReader()
+	{}
+
+	AeslReader::~AeslReader()
+	{
+		close();
+	}
+
+	bool AeslReader::openFile(const std::string& fileName, NodeFilter filter)
+	{
+		close();
+		#ifndef WIN32
+		const int fd(open(fileName.c_str(), O_RDONLY));
+		if (fd < 0)
+		{
+			error = "Cannot open file " + fileName;
+			return false;
+		}
+		struct stat fileStat;
+		if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0)
+		{
+			void* ptr(mmap(nullptr, size_t(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0));
+			if (ptr != MAP_FAILED)
+			{
+				mapping = ptr;
+				mappingSize = size_t(fileStat.st_size);
+			}
+		}
+		::close(fd);
+		#else // WIN32
+		HANDLE file(CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			error = "Cannot open file " + fileName;
+			return false;
+		}
+		fileHandle = file;
+		LARGE_INTEGER fileSize;
+		if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+		{
+			mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mappingHandle)
+			{
+				mapping = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+				if (mapping)
+					mappingSize = size_t(fileSize.QuadPart);
+			}
+		}
+		#endif // WIN32
+		if (!mapping)
+		{
+			close();
+			error = "Cannot map file " + fileName;
+			return false;
+		}
+		return load(static_cast<const char*>(mapping), mappingSize, filter);
+	}
+
+	bool AeslReader::openMemory(const char* buffer, size_t size, NodeFilter filter)
+	{
+		close();
+		copy.assign(buffer, buffer + size);
+		return load(copy.data(), copy.size(), filter);
+	}
+
+	void AeslReader::close()
+	{
+		loaded = false;
+		error.clear();
+		commonDefinitions.events.clear();
+		commonDefinitions.constants.clear();
+		nodes.clear();
+		copy.clear();
+		#ifndef WIN32
+		if (mapping)
+			munmap(mapping, mappingSize);
+		#else // WIN32
+		if (mapping)
+			UnmapViewOfFile(mapping);
+		if (mappingHandle)
+			CloseHandle(mappingHandle);
+		if (fileHandle)
+			CloseHandle(fileHandle);
+		mappingHandle = nullptr;
+		fileHandle = nullptr;
+		#endif // WIN32
+		mapping = nullptr;
+		mappingSize = 0;
+	}
+
+	bool AeslReader::load(const char* data, size_t size, const NodeFilter& filter)
+	{
+		loaded = parse(data, size, filter);
+		if (!loaded)
+		{
+			commonDefinitions.events.clear();
+			commonDefinitions.constants.clear();
+			nodes.clear();
+		}
+		return loaded;
+	}
+
+	bool AeslReader::parse(const char* data, size_t size, const NodeFilter& filter)
+	{
+		const char* p(data);
+		const char* const end(data + size);
+		unsigned depth(0);
+		bool rootSeen(false);
+		string name;
+		Attributes attributes;
+		bool selfClosing;
+
+		while (true)
+		{
+			p = static_cast<const char*>(memchr(p, '<', end - p));
+			if (!p)
+				break;
+
+			// skip processing instructions, comments, CDATA outside nodes and declarations
+			if (startsWith(p, end, "<?"))
+			{
+				p = min(find(p, end, "?>") + 2, end);
+				continue;
+			}
+			if (startsWith(p, end, "<!--"))
+			{
+				p = min(find(p, end, "-->") + 3, end);
+				continue;
+			}
+			if (startsWith(p, end, "<![CDATA["))
+			{
+				p = min(find(p, end, "]]>") + 3, end);
+				continue;
+			}
+			if (startsWith(p, end, "<!"))
+			{
+				p = min(find(p, end, ">") + 1, end);
+				continue;
+			}
+			if (startsWith(p, end, "</"))
+			{
+				if (depth > 0)
+					--depth;
+				p = min(find(p, end, ">") + 1, end);
+				continue;
+			}
+
+			// start tag
+			++p;
+			if (!parseStartTag(p, end, name, attributes, selfClosing))
+			{
+				error = "Unexpected end of file in tag " + name;
+				return false;
+			}
+			if (depth == 0)
+			{
+				if (name != "network")
+				{
+					error = "Root element is " + name + " instead of network";
+					return false;
+				}
+				rootSeen = true;
+			}
+			else if (depth == 1)
+			{
+				if (name == "event")
+				{
+					const string eventName(attribute(attributes, "name"));
+					const int eventSize(atoi(attribute(attributes, "size").c_str()));
+					if (eventSize > ASEBA_MAX_EVENT_ARG_SIZE)
+					{
+						ostringstream oss;
+						oss << "Event " << eventName << " has a length " << eventSize << " larger than maximum " << ASEBA_MAX_EVENT_ARG_SIZE;
+						error = oss.str();
+						return false;
+					}
+					commonDefinitions.events.push_back(NamedValue(UTF8ToWString(eventName), eventSize));
+				}
+				else if (name == "constant")
+				{
+					commonDefinitions.constants.push_back(NamedValue(UTF8ToWString(attribute(attributes, "name")), atoi(attribute(attributes, "value").c_str())));
+				}
+				else if (name == "node")
+				{
+					Node node;
+					node.name = attribute(attributes, "name");
+					node.nodeId = attribute(attributes, "nodeId");
+					node.begin = node.end = p;
+					if (!selfClosing)
+					{
+						// find the closing tag, skipping CDATA sections and comments that might contain it
+						while (true)
+						{
+							const char* q(static_cast<const char*>(memchr(p, '<', end - p)));
+							if (!q)
+							{
+								error = "Unexpected end of file in code of node " + node.name;
+								return false;
+							}
+							if (startsWith(q, end, "<![CDATA["))
+								p = min(find(q, end, "]]>") + 3, end);
+							else if (startsWith(q, end, "<!--"))
+								p = min(find(q, end, "-->") + 3, end);
+							else if (startsWith(q, end, "</node"))
+							{
+								node.end = q;
+								p = min(find(q, end, ">") + 1, end);
+								break;
+							}
+							else
+								p = q + 1;
+						}
+					}
+					if (!filter || filter(node.name, node.preferedId()))
+						nodes.push_back(node);
+					continue;
+				}
+			}
+			if (!selfClosing)
+				++depth;
+		}
+
+		if (!rootSeen)
+		{
+			error = "No network element found";
+			return false;
+		}
+		return true;
+	}
+
+	/*@}*/
+}
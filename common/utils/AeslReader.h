@@ -0,0 +1,110 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_AESL_READER_H
+#define ASEBA_AESL_READER_H
+
+#include "../../compiler/compiler.h"
+#include <string>
+#include <vector>
+#include <functional>
+
+namespace Aseba
+{
+	/** \addtogroup utils */
+	/*@{*/
+
+	/**
+		Streaming reader for AESL project files.
+
+		The file is memory-mapped and scanned once, without building a DOM.
+		Events and constants are decoded while scanning, as they are needed by every
+		node. The code of each node is kept as a view into the mapped file and is only
+		decoded when requested, so that loaders only pay for the nodes they use.
+		Views stay valid as long as the reader is alive.
+	*/
+	class AeslReader
+	{
+	public:
+		//! A node entry, with its code as a view into the source
+		struct Node
+		{
+			std::string name; //!< name attribute, empty if absent
+			std::string nodeId; //!< nodeId attribute, empty if absent
+			const char* begin = nullptr; //!< start of the raw, XML-escaped code
+			const char* end = nullptr; //!< end of the raw, XML-escaped code
+
+			//! Return the identifier stored in the file, or 0 if none
+			unsigned preferedId() const;
+			//! Decode the code of this node to UTF-8
+			std::string code() const;
+			//! Decode the code of this node to a wide string, ready for the compiler
+			std::wstring wcode() const;
+		};
+		//! Nodes entries, in file order
+		typedef std::vector<Node> Nodes;
+		//! A filter deciding from the name and stored id whether a node must be kept
+		typedef std::function<bool(const std::string& name, unsigned preferedId)> NodeFilter;
+
+	public:
+		AeslReader();
+		~AeslReader();
+		AeslReader(const AeslReader&) = delete;
+		AeslReader& operator=(const AeslReader&) = delete;
+
+		//! Map and scan fileName, keeping only the nodes accepted by filter if given; return whether it succeeded
+		bool openFile(const std::string& fileName, NodeFilter filter = NodeFilter());
+		//! Scan a copy of buffer, keeping only the nodes accepted by filter if given; return whether it succeeded
+		bool openMemory(const char* buffer, size_t size, NodeFilter filter = NodeFilter());
+
+		//! Return whether the last open succeeded
+		bool isLoaded() const { return loaded; }
+		//! Return the reason why the last open failed
+		const std::string& getError() const { return error; }
+		//! Return the events and constants of the project
+		const CommonDefinitions& getCommonDefinitions() const { return commonDefinitions; }
+		//! Return the kept nodes entries
+		const Nodes& getNodes() const { return nodes; }
+
+	protected:
+		void close();
+		bool load(const char* data, size_t size, const NodeFilter& filter);
+		bool parse(const char* data, size_t size, const NodeFilter& filter);
+
+	protected:
+		bool loaded = false;
+		std::string error;
+		CommonDefinitions commonDefinitions;
+		Nodes nodes;
+
+		// source storage, either a mapping or a private copy
+		std::vector<char> copy;
+		void* mapping = nullptr;
+		size_t mappingSize = 0;
+		#ifdef WIN32
+		void* fileHandle = nullptr;
+		void* mappingHandle = nullptr;
+		#endif // WIN32
+	};
+
+	/*@}*/
+}
+
+#endif
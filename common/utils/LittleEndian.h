@@ -0,0 +1,90 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_LITTLE_ENDIAN_H
+#define ASEBA_LITTLE_ENDIAN_H
+
+#include <cstring>
+#include <istream>
+#include <vector>
+#include <stdint.h>
+
+namespace Aseba
+{
+	/** \addtogroup utils */
+	/*@{*/
+
+	// Helpers to store integers and doubles in binary files and blobs independently of the host
+
+	//! Append the little-endian representation of an integer or a bool to buffer
+	template<typename T>
+	void appendLittleEndian(std::vector<uint8_t>& buffer, T value)
+	{
+		for (size_t i = 0; i < sizeof(T); ++i)
+			buffer.push_back(uint8_t(uint64_t(value) >> (8 * i)));
+	}
+
+	//! Append a double to buffer, as its little-endian IEEE 754 representation
+	inline void appendLittleEndian(std::vector<uint8_t>& buffer, double value)
+	{
+		uint64_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		appendLittleEndian(buffer, bits);
+	}
+
+	//! Read a little-endian integer or bool from buffer at pos and advance pos, return false at the end of buffer
+	template<typename T>
+	bool readLittleEndian(const std::vector<uint8_t>& buffer, size_t& pos, T& value)
+	{
+		if (pos > buffer.size() || buffer.size() - pos < sizeof(T))
+			return false;
+		uint64_t v(0);
+		for (size_t i = sizeof(T); i > 0; --i)
+			v = (v << 8) | buffer[pos + i - 1];
+		pos += sizeof(T);
+		value = T(v);
+		return true;
+	}
+
+	//! Read a double written by appendLittleEndian from buffer at pos and advance pos, return false at the end of buffer
+	inline bool readLittleEndian(const std::vector<uint8_t>& buffer, size_t& pos, double& value)
+	{
+		uint64_t bits;
+		if (!readLittleEndian(buffer, pos, bits))
+			return false;
+		memcpy(&value, &bits, sizeof(value));
+		return true;
+	}
+
+	//! Read a little-endian integer or bool from input, return false at the end of input
+	template<typename T>
+	bool readLittleEndian(std::istream& input, T& value)
+	{
+		std::vector<uint8_t> bytes(sizeof(T));
+		if (!input.read(reinterpret_cast<char*>(&bytes[0]), sizeof(T)))
+			return false;
+		size_t pos(0);
+		return readLittleEndian(bytes, pos, value);
+	}
+
+	/*@}*/
+}
+
+#endif
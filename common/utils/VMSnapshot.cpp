@@ -0,0 +1,137 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "VMSnapshot.h"
+#include <fstream>
+#include <iterator>
+
+namespace Aseba
+{
+	using namespace std;
+
+	/** \addtogroup utils */
+	/*@{*/
+
+	static const char snapshotMagic[8] = { 'A', 'S', 'E', 'B', 'A', 'V', 'M', 'S' };
+	static const uint16_t snapshotVersion = 1;
+
+	void SnapshotWriter::write(const std::vector<uint8_t>& bytes)
+	{
+		write(uint32_t(bytes.size()));
+		buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+	}
+
+	void SnapshotWriter::write(const std::vector<uint16_t>& words)
+	{
+		write(uint32_t(words.size()));
+		for (const uint16_t word: words)
+			write(word);
+	}
+
+	bool SnapshotReader::read(std::vector<uint8_t>& bytes)
+	{
+		uint32_t size;
+		if (!read(size))
+			return false;
+		if (buffer.size() - pos < size)
+			return fail();
+		bytes.assign(buffer.begin() + pos, buffer.begin() + pos + size);
+		pos += size;
+		return true;
+	}
+
+	bool SnapshotReader::read(std::vector<uint16_t>& words)
+	{
+		uint32_t size;
+		if (!read(size))
+			return false;
+		if ((buffer.size() - pos) / 2 < size)
+			return fail();
+		words.resize(size);
+		for (uint16_t& word: words)
+			read(word);
+		return true;
+	}
+
+	std::vector<uint8_t> VMSnapshot::serialize() const
+	{
+		vector<uint8_t> blob(snapshotMagic, snapshotMagic + sizeof(snapshotMagic));
+		SnapshotWriter writer(blob);
+		writer.write(snapshotVersion);
+		writer.write(world);
+		writer.write(uint32_t(nodes.size()));
+		for (const auto& node: nodes)
+		{
+			writer.write(node.nodeId);
+			writer.write(node.vm);
+			writer.write(node.glue);
+		}
+		return blob;
+	}
+
+	bool VMSnapshot::deserialize(const std::vector<uint8_t>& blob)
+	{
+		if (blob.size() < sizeof(snapshotMagic) || memcmp(&blob[0], snapshotMagic, sizeof(snapshotMagic)) != 0)
+			return false;
+		const vector<uint8_t> content(blob.begin() + sizeof(snapshotMagic), blob.end());
+		SnapshotReader reader(content);
+
+		uint16_t version;
+		uint32_t nodesCount;
+		vector<uint8_t> decodedWorld;
+		if (!reader.read(version) || version != snapshotVersion)
+			return false;
+		if (!reader.read(decodedWorld) || !reader.read(nodesCount))
+			return false;
+		Nodes decodedNodes;
+		for (uint32_t i = 0; i < nodesCount; ++i)
+		{
+			Node node;
+			if (!reader.read(node.nodeId) || !reader.read(node.vm) || !reader.read(node.glue))
+				return false;
+			decodedNodes.push_back(move(node));
+		}
+		if (!reader.isComplete())
+			return false;
+
+		world.swap(decodedWorld);
+		nodes.swap(decodedNodes);
+		return true;
+	}
+
+	bool VMSnapshot::save(const std::string& fileName) const
+	{
+		const vector<uint8_t> blob(serialize());
+		ofstream ofs(fileName.c_str(), ofstream::binary);
+		ofs.write(reinterpret_cast<const char*>(blob.data()), blob.size());
+		return bool(ofs);
+	}
+
+	bool VMSnapshot::load(const std::string& fileName)
+	{
+		ifstream ifs(fileName.c_str(), ifstream::binary);
+		if (!ifs.is_open())
+			return false;
+		const vector<uint8_t> blob((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+		return deserialize(blob);
+	}
+
+	/*@}*/
+}
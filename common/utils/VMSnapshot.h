@@ -0,0 +1,136 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_VM_SNAPSHOT_H
+#define ASEBA_VM_SNAPSHOT_H
+
+#include "LittleEndian.h"
+#include "../../vm/vm.h"
+#include <string>
+#include <vector>
+
+namespace Aseba
+{
+	/** \addtogroup utils */
+	/*@{*/
+
+	//! Appends values to a byte buffer, little-endian, see LittleEndian.h
+	class SnapshotWriter
+	{
+	public:
+		explicit SnapshotWriter(std::vector<uint8_t>& buffer): buffer(buffer) {}
+
+		//! Append an integer, a bool or a double
+		template<typename T>
+		void write(T value) { appendLittleEndian(buffer, value); }
+		//! Append bytes, preceded by their count
+		void write(const std::vector<uint8_t>& bytes);
+		//! Append words, preceded by their count
+		void write(const std::vector<uint16_t>& words);
+
+	protected:
+		std::vector<uint8_t>& buffer;
+	};
+
+	//! Reads values written by SnapshotWriter from a byte buffer, once a read failed all the next ones fail
+	class SnapshotReader
+	{
+	public:
+		explicit SnapshotReader(const std::vector<uint8_t>& buffer): buffer(buffer) {}
+
+		//! Read an integer, a bool or a double, return false at the end of the buffer
+		template<typename T>
+		bool read(T& value)
+		{
+			if (failed || !readLittleEndian(buffer, pos, value))
+				return fail();
+			return true;
+		}
+		//! Read bytes preceded by their count
+		bool read(std::vector<uint8_t>& bytes);
+		//! Read words preceded by their count
+		bool read(std::vector<uint16_t>& words);
+		//! Return whether all reads succeeded and the whole buffer was read
+		bool isComplete() const { return !failed && pos == buffer.size(); }
+
+	protected:
+		bool fail() { failed = true; return false; }
+
+	protected:
+		const std::vector<uint8_t>& buffer;
+		size_t pos = 0;
+		bool failed = false;
+	};
+
+	/**
+		Compact binary snapshot of nodes, to start simulations from a prepared state.
+
+		For each node, the snapshot holds the state of its VM, as saved by AsebaVMSaveState(),
+		and the state of its glue that is not in the VM, such as timers, in a format of the
+		glue's own. It can also hold the state of the world the nodes live in.
+		Snapshots are stored little-endian, so that they can be exchanged between hosts.
+	*/
+	class VMSnapshot
+	{
+	public:
+		//! The state of a node
+		struct Node
+		{
+			uint16_t nodeId = 0;
+			std::vector<uint16_t> vm; //!< state of the VM, as saved by AsebaVMSaveState()
+			std::vector<uint8_t> glue; //!< state of the glue, written with SnapshotWriter
+
+			// inline, so that asebacommon does not depend on asebavm
+
+			//! Save the state of vm
+			void saveVM(const AsebaVMState* vm)
+			{
+				this->vm.resize(AsebaVMGetStateSize(vm));
+				AsebaVMSaveState(vm, this->vm.data(), this->vm.size());
+				nodeId = vm->nodeId;
+			}
+			//! Restore the state of vm, return false if it does not fit vm
+			bool restoreVM(AsebaVMState* vm) const
+			{
+				return AsebaVMRestoreState(vm, this->vm.data(), this->vm.size()) != 0;
+			}
+		};
+		//! Nodes, in an order that is the responsibility of the glue
+		typedef std::vector<Node> Nodes;
+
+	public:
+		std::vector<uint8_t> world; //!< state of the world, written with SnapshotWriter
+		Nodes nodes;
+
+	public:
+		//! Return the serialized snapshot
+		std::vector<uint8_t> serialize() const;
+		//! Read a serialized snapshot, return false if blob is not a valid snapshot, in which case this is unchanged
+		bool deserialize(const std::vector<uint8_t>& blob);
+		//! Write the serialized snapshot to fileName, return false on error
+		bool save(const std::string& fileName) const;
+		//! Read a serialized snapshot from fileName, return false on error, in which case this is unchanged
+		bool load(const std::string& fileName);
+	};
+
+	/*@}*/
+}
+
+#endif
@@ -158,6 +158,12 @@ namespace Aseba
 		left = period;
 	}
 	
+	void SoftTimer::setState(double period, double left)
+	{
+		setPeriod(period);
+		this->left = left;
+	}
+	
 	std::string WStringToUTF8(const std::wstring& s)
 	{
 		std::string os;
@@ -142,6 +142,10 @@ namespace Aseba
 		void step(double dt);
 		//! Set the period in s, 0 disables the timer
 		void setPeriod(double period);
+		//! Return the time left until next call to callback, in s
+		double getLeft() const { return left; }
+		//! Set the period and the time left until next call to callback, in s, to restore a saved timer
+		void setState(double period, double left);
 	};
 	
 	//! Transform a wstring into an UTF8 string, this function is thread-safe
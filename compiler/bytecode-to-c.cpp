@@ -0,0 +1,502 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bytecode-to-c.h"
+#include "../common/consts.h"
+#include <vector>
+#include <set>
+#include <fstream>
+#include <cstdlib>
+#include <cstdio>
+#ifndef WIN32
+#include <dlfcn.h>
+#include <unistd.h>
+#endif // WIN32
+
+namespace Aseba
+{
+	/** \addtogroup compiler */
+	/*@{*/
+
+	namespace
+	{
+		//! Return the C expression computing a binary operation on a and b, in the same way as the VM
+		const char* binaryOperationExpression(unsigned op)
+		{
+			switch (op)
+			{
+				case ASEBA_OP_SHIFT_LEFT: return "a << b";
+				case ASEBA_OP_SHIFT_RIGHT: return "a >> b";
+				case ASEBA_OP_ADD: return "a + b";
+				case ASEBA_OP_SUB: return "a - b";
+				case ASEBA_OP_MULT: return "a * b";
+				case ASEBA_OP_DIV: return "a / b";
+				case ASEBA_OP_MOD: return "a % b";
+				case ASEBA_OP_BIT_OR: return "a | b";
+				case ASEBA_OP_BIT_XOR: return "a ^ b";
+				case ASEBA_OP_BIT_AND: return "a & b";
+				case ASEBA_OP_EQUAL: return "a == b";
+				case ASEBA_OP_NOT_EQUAL: return "a != b";
+				case ASEBA_OP_BIGGER_THAN: return "a > b";
+				case ASEBA_OP_BIGGER_EQUAL_THAN: return "a >= b";
+				case ASEBA_OP_SMALLER_THAN: return "a < b";
+				case ASEBA_OP_SMALLER_EQUAL_THAN: return "a <= b";
+				case ASEBA_OP_OR: return "a || b";
+				case ASEBA_OP_AND: return "a && b";
+				default: return "0";
+			}
+		}
+
+		//! Return the C expression computing a unary operation on a, in the same way as the VM
+		const char* unaryOperationExpression(unsigned op)
+		{
+			switch (op)
+			{
+				case ASEBA_UNARY_OP_SUB: return "-a";
+				case ASEBA_UNARY_OP_ABS: return "a >= 0 ? a : -a";
+				case ASEBA_UNARY_OP_BIT_NOT: return "~a";
+				default: return "0";
+			}
+		}
+
+		//! Return the size in words of the instruction starting with bytecode
+		unsigned instructionSize(uint16_t bytecode)
+		{
+			return BytecodeElement(bytecode).getWordSize();
+		}
+
+		//! Return whether bytecode starts an instruction known to the VM
+		bool isKnownInstruction(uint16_t bytecode)
+		{
+			return (bytecode >> 12) <= ASEBA_BYTECODE_SUB_RET;
+		}
+
+		//! Translate one region of bytecode to a C function
+		class RegionTranslator
+		{
+		public:
+			RegionTranslator(const std::vector<uint16_t>& code, const std::set<unsigned>& jumpTargets, unsigned begin, unsigned end, std::ostream& out):
+				code(code),
+				jumpTargets(jumpTargets),
+				begin(begin),
+				end(end),
+				out(out)
+			{
+				// find instructions boundaries, stop at the first instruction that cannot be translated
+				unsigned pc = begin;
+				while (pc < end)
+				{
+					if (!isKnownInstruction(code[pc]) || pc + instructionSize(code[pc]) > end)
+						break;
+					instructions.insert(pc);
+					pc += instructionSize(code[pc]);
+				}
+				this->end = pc;
+			}
+
+			unsigned getEnd() const { return end; }
+
+			void translate()
+			{
+				out << "static uint16_t region_" << begin << "(AsebaVMState *vm, uint16_t *stepsLeft, const AsebaCompiledRuntime *runtime)\n";
+				out << "{\n";
+				out << "\tint16_t * const V = vm->variables;\n";
+				out << "\tint16_t * const S = vm->stack;\n";
+				out << "\tint16_t sp = vm->sp;\n";
+				out << "\tuint16_t steps = stepsLeft ? *stepsLeft : 0;\n";
+				out << "\t(void)V; (void)S; (void)runtime;\n";
+				out << "\tswitch (vm->pc)\n";
+				out << "\t{\n";
+				for (const unsigned pc: instructions)
+					out << "\t\tcase " << pc << ": goto L" << pc << ";\n";
+				out << "\t\tdefault: return 0;\n";
+				out << "\t}\n";
+				for (const unsigned pc: instructions)
+				{
+					out << "\tL" << pc << ": ASEBA_COMPILED_STEP(" << pc << ")\n";
+					translateInstruction(pc);
+				}
+				// falling out of the region, continue where the next instruction would be
+				out << "\tASEBA_COMPILED_EXIT(" << end << ")\n";
+				out << "\tleave:\n";
+				out << "\tvm->sp = sp;\n";
+				out << "\tif (stepsLeft)\n";
+				out << "\t\t*stepsLeft = steps;\n";
+				out << "\treturn 1;\n";
+				out << "}\n\n";
+			}
+
+		protected:
+			//! Write a transfer of control to address target, wrapped as the VM does
+			void jumpTo(unsigned target)
+			{
+				target &= 0xffff;
+				if (instructions.find(target) != instructions.end())
+					out << "goto L" << target << ";";
+				else
+					out << "ASEBA_COMPILED_EXIT(" << target << ")";
+			}
+
+			//! Return the constants pushed right before the native call at pc, topmost first, which are on top of the stack whatever the path to pc
+			std::vector<int16_t> constantNativeArgs(unsigned pc) const
+			{
+				std::vector<int16_t> args;
+				auto it(instructions.find(pc));
+				while (it != instructions.begin() && args.size() < ASEBA_NATIVE_MAX_ARGS && jumpTargets.find(*it) == jumpTargets.end())
+				{
+					--it;
+					const uint16_t bytecode(code[*it]);
+					if ((bytecode >> 12) == ASEBA_BYTECODE_SMALL_IMMEDIATE)
+						args.push_back(int16_t(bytecode << 4) >> 4);
+					else if ((bytecode >> 12) == ASEBA_BYTECODE_LARGE_IMMEDIATE)
+						args.push_back(int16_t(code[*it + 1]));
+					else
+						break;
+				}
+				return args;
+			}
+
+			//! Write a synchronisation of pc and sp before calling the runtime
+			void syncState(unsigned pc)
+			{
+				out << "\tvm->pc = " << pc << "; vm->sp = sp;\n";
+			}
+
+			void translateInstruction(unsigned pc)
+			{
+				const uint16_t bytecode(code[pc]);
+				const uint16_t operand(bytecode & 0x0fff);
+				switch (bytecode >> 12)
+				{
+					case ASEBA_BYTECODE_STOP:
+					out << "\tvm->flags &= ~ASEBA_VM_EVENT_ACTIVE_MASK;\n";
+					out << "\tASEBA_COMPILED_EXIT(" << pc << ")\n";
+					break;
+
+					case ASEBA_BYTECODE_SMALL_IMMEDIATE:
+					out << "\tS[++sp] = " << (int16_t(bytecode << 4) >> 4) << ";\n";
+					break;
+
+					case ASEBA_BYTECODE_LARGE_IMMEDIATE:
+					out << "\tS[++sp] = (int16_t)" << code[pc + 1] << "u;\n";
+					break;
+
+					case ASEBA_BYTECODE_LOAD:
+					out << "\tS[++sp] = V[" << operand << "];\n";
+					break;
+
+					case ASEBA_BYTECODE_STORE:
+					out << "\tV[" << operand << "] = S[sp--];\n";
+					break;
+
+					case ASEBA_BYTECODE_LOAD_INDIRECT:
+					out << "\t{\n";
+					out << "\t\tconst uint16_t i = (uint16_t)S[sp];\n";
+					out << "\t\tif (i >= " << code[pc + 1] << ") { vm->pc = " << pc << "; vm->sp = sp; runtime->arrayAccessOutOfBounds(vm, " << code[pc + 1] << ", i); goto leave; }\n";
+					out << "\t\tS[sp] = V[" << operand << " + i];\n";
+					out << "\t}\n";
+					break;
+
+					case ASEBA_BYTECODE_STORE_INDIRECT:
+					out << "\t{\n";
+					out << "\t\tconst uint16_t i = (uint16_t)S[sp];\n";
+					out << "\t\tif (i >= " << code[pc + 1] << ") { vm->pc = " << pc << "; vm->sp = sp; runtime->arrayAccessOutOfBounds(vm, " << code[pc + 1] << ", i); goto leave; }\n";
+					out << "\t\tV[" << operand << " + i] = S[sp - 1];\n";
+					out << "\t\tsp -= 2;\n";
+					out << "\t}\n";
+					break;
+
+					case ASEBA_BYTECODE_UNARY_ARITHMETIC:
+					out << "\t{ const int16_t a = S[sp]; S[sp] = (int16_t)(" << unaryOperationExpression(bytecode & ASEBA_UNARY_OPERATOR_MASK) << "); }\n";
+					break;
+
+					case ASEBA_BYTECODE_BINARY_ARITHMETIC:
+					out << "\t{\n";
+					out << "\t\tconst int16_t a = S[sp - 1], b = S[sp];\n";
+					if (isDivision(bytecode & ASEBA_BINARY_OPERATOR_MASK))
+					{
+						out << "\t\tint16_t r = 0;\n";
+						out << "\t\tif (b == 0) { vm->pc = " << pc << "; vm->sp = sp; runtime->divisionByZero(vm); }\n";
+						out << "\t\telse r = (int16_t)(" << binaryOperationExpression(bytecode & ASEBA_BINARY_OPERATOR_MASK) << ");\n";
+						out << "\t\tS[--sp] = r;\n";
+						out << "\t\tif (b == 0) ASEBA_COMPILED_EXIT(" << pc + 1 << ")\n";
+					}
+					else
+						out << "\t\tS[--sp] = (int16_t)(" << binaryOperationExpression(bytecode & ASEBA_BINARY_OPERATOR_MASK) << ");\n";
+					out << "\t}\n";
+					break;
+
+					case ASEBA_BYTECODE_JUMP:
+					out << "\t";
+					jumpTo(pc + (int16_t(bytecode << 4) >> 4));
+					out << "\n";
+					break;
+
+					case ASEBA_BYTECODE_CONDITIONAL_BRANCH:
+					{
+						const unsigned falseTarget(pc + int16_t(code[pc + 1]));
+						const unsigned op(bytecode & ASEBA_IF_OPERATOR_MASK);
+						const bool isWhen((bytecode >> ASEBA_IF_IS_WHEN_BIT) & 1);
+						const unsigned slot(ASEBA_IF_GET_WHEN_SLOT(bytecode));
+						out << "\t{\n";
+						out << "\t\tconst int16_t a = S[sp - 1], b = S[sp];\n";
+						out << "\t\tint16_t c = 0;\n";
+						out << "\t\tint taken;\n";
+						if (isDivision(op))
+						{
+							out << "\t\tif (b == 0) { vm->pc = " << pc << "; vm->sp = sp; runtime->divisionByZero(vm); }\n";
+							out << "\t\telse c = (int16_t)(" << binaryOperationExpression(op) << ");\n";
+						}
+						else
+							out << "\t\tc = (int16_t)(" << binaryOperationExpression(op) << ");\n";
+						out << "\t\tsp -= 2;\n";
+						if (isWhen)
+						{
+							const unsigned word(slot / 16);
+							const unsigned mask(1 << (slot % 16));
+							out << "\t\ttaken = c && !(vm->whenStates[" << word << "] & " << mask << ");\n";
+							out << "\t\tif (c) vm->whenStates[" << word << "] |= " << mask << ";\n";
+							out << "\t\telse vm->whenStates[" << word << "] &= (uint16_t)~" << mask << "u;\n";
+						}
+						else
+							out << "\t\ttaken = c != 0;\n";
+						if (isDivision(op))
+							out << "\t\tif (b == 0) ASEBA_COMPILED_EXIT(" << (falseTarget & 0xffff) << ")\n";
+						out << "\t\tif (taken) ";
+						jumpTo(pc + 2);
+						out << "\n\t\telse ";
+						jumpTo(falseTarget);
+						out << "\n\t}\n";
+					}
+					break;
+
+					case ASEBA_BYTECODE_EMIT:
+					syncState(pc);
+					out << "\truntime->emit(vm, " << operand << ", " << code[pc + 1] << ", " << code[pc + 2] << ");\n";
+					out << "\tASEBA_COMPILED_CHECK(" << pc + 3 << ")\n";
+					break;
+
+					case ASEBA_BYTECODE_NATIVE_CALL:
+					{
+						// arguments pushed as constants are resolved now, so that the native can take them directly
+						const std::vector<int16_t> args(constantNativeArgs(pc));
+						syncState(pc);
+						if (args.empty())
+							out << "\truntime->nativeCall(vm, " << operand << ");\n";
+						else
+						{
+							out << "\t{\n";
+							out << "\t\tstatic const int16_t args[] = {";
+							for (size_t i = 0; i < args.size(); ++i)
+								out << (i ? ", " : " ") << args[i];
+							out << " };\n";
+							out << "\t\truntime->nativeCallWithArgs(vm, " << operand << ", args, " << args.size() << ");\n";
+							out << "\t}\n";
+						}
+					}
+					out << "\tsp = vm->sp;\n";
+					out << "\tASEBA_COMPILED_CHECK(" << pc + 1 << ")\n";
+					break;
+
+					case ASEBA_BYTECODE_SUB_CALL:
+					// subroutines are separate functions, let the caller dispatch
+					out << "\tS[++sp] = (int16_t)" << pc + 1 << ";\n";
+					out << "\tASEBA_COMPILED_EXIT(" << operand << ")\n";
+					break;
+
+					case ASEBA_BYTECODE_SUB_RET:
+					out << "\tASEBA_COMPILED_EXIT((uint16_t)S[sp--])\n";
+					break;
+
+					default:
+					break;
+				}
+			}
+
+			static bool isDivision(unsigned op)
+			{
+				return op == ASEBA_OP_DIV || op == ASEBA_OP_MOD;
+			}
+
+		protected:
+			const std::vector<uint16_t>& code;
+			const std::set<unsigned>& jumpTargets;
+			const unsigned begin;
+			unsigned end;
+			std::ostream& out;
+			std::set<unsigned> instructions;
+		};
+	} // namespace
+
+	unsigned translateBytecodeToC(const BytecodeVector& bytecode, std::ostream& out)
+	{
+		const std::vector<uint16_t> code(bytecode.begin(), bytecode.end());
+		const unsigned eventVectorSize(code.empty() ? 0 : code[0]);
+
+		// entry points are event handlers and subroutines
+		std::set<unsigned> entries;
+		std::set<unsigned> jumpTargets;
+		for (unsigned i = 1; i + 1 < eventVectorSize && i + 1 < code.size(); i += 2)
+			if (code[i + 1] >= eventVectorSize && code[i + 1] < code.size())
+				entries.insert(code[i + 1]);
+		for (unsigned pc = eventVectorSize; pc < code.size(); pc += instructionSize(code[pc]))
+		{
+			const unsigned dest(code[pc] & 0x0fff);
+			if ((code[pc] >> 12) == ASEBA_BYTECODE_SUB_CALL && dest >= eventVectorSize && dest < code.size())
+				entries.insert(dest);
+			else if ((code[pc] >> 12) == ASEBA_BYTECODE_JUMP)
+				jumpTargets.insert((pc + (int16_t(code[pc] << 4) >> 4)) & 0xffff);
+			else if ((code[pc] >> 12) == ASEBA_BYTECODE_CONDITIONAL_BRANCH && pc + 1 < code.size())
+			{
+				jumpTargets.insert(pc + 2);
+				jumpTargets.insert((pc + int16_t(code[pc + 1])) & 0xffff);
+			}
+		}
+
+		out << "/* Aseba bytecode translated to C, generated file, do not edit */\n\n";
+		out << "#include \"vm/compiled.h\"\n\n";
+
+		// one function per region, from an entry point to the next one
+		std::vector<std::pair<unsigned, unsigned>> regions;
+		for (auto it = entries.begin(); it != entries.end(); ++it)
+		{
+			auto next(it);
+			++next;
+			RegionTranslator translator(code, jumpTargets, *it, next == entries.end() ? code.size() : *next, out);
+			if (translator.getEnd() == *it)
+				continue;
+			translator.translate();
+			regions.push_back(std::make_pair(*it, translator.getEnd()));
+		}
+
+		// reference bytecode
+		out << "static const uint16_t bytecode[] =\n{";
+		for (size_t i = 0; i < code.size(); ++i)
+			out << (i % 12 == 0 ? "\n\t" : " ") << code[i] << ",";
+		if (code.empty())
+			out << "\n\t0";
+		out << "\n};\n\n";
+
+		// region table
+		out << "static const AsebaCompiledRegion regions[] =\n{\n";
+		for (const auto& region: regions)
+			out << "\t{ " << region.first << ", " << region.second << ", region_" << region.first << " },\n";
+		if (regions.empty())
+			out << "\t{ 0, 0, 0 }\n";
+		out << "};\n\n";
+
+		out << "const AsebaCompiledProgram " << ASEBA_COMPILED_PROGRAM_SYMBOL << " =\n{\n";
+		out << "\t" << code.size() << ", bytecode, " << regions.size() << ", regions\n";
+		out << "};\n";
+
+		unsigned translated(0);
+		for (const auto& region: regions)
+			translated += region.second - region.first;
+		return translated;
+	}
+
+	CompiledBytecode::CompiledBytecode()
+	{
+	}
+
+	CompiledBytecode::~CompiledBytecode()
+	{
+		unload();
+	}
+
+	void CompiledBytecode::unload()
+	{
+		#ifndef WIN32
+		if (handle)
+			dlclose(handle);
+		#endif // WIN32
+		handle = nullptr;
+		program = nullptr;
+	}
+
+	bool CompiledBytecode::build(const BytecodeVector& bytecode, const std::string& includeDir, const std::string& compiler)
+	{
+		unload();
+		error.clear();
+
+		#ifndef WIN32
+		// work in a private temporary directory
+		char dirTemplate[] = "/tmp/asebaXXXXXX";
+		if (!mkdtemp(dirTemplate))
+		{
+			error = "Cannot create temporary directory";
+			return false;
+		}
+		const std::string dir(dirTemplate);
+		const std::string sourceName(dir + "/program.c");
+		const std::string libraryName(dir + "/program.so");
+
+		// translate
+		{
+			std::ofstream source(sourceName.c_str());
+			translateBytecodeToC(bytecode, source);
+			if (!source.good())
+			{
+				error = "Cannot write " + sourceName;
+				rmdir(dir.c_str());
+				return false;
+			}
+		}
+
+		// compile
+		std::string cc(compiler);
+		if (cc.empty())
+			cc = getenv("CC") ? getenv("CC") : "cc";
+		const std::string command(cc + " -O2 -shared -fPIC -I\"" + includeDir + "\" -o \"" + libraryName + "\" \"" + sourceName + "\"");
+		const int result(system(command.c_str()));
+
+		// load, the library stays mapped after its file is removed
+		if (result == 0)
+		{
+			handle = dlopen(libraryName.c_str(), RTLD_NOW | RTLD_LOCAL);
+			if (handle)
+			{
+				program = reinterpret_cast<const AsebaCompiledProgram*>(dlsym(handle, ASEBA_COMPILED_PROGRAM_SYMBOL));
+				if (!program)
+					error = std::string("Cannot find program in ") + libraryName;
+			}
+			else
+				error = dlerror();
+		}
+		else
+			error = "Command failed: " + command;
+
+		unlink(sourceName.c_str());
+		unlink(libraryName.c_str());
+		rmdir(dir.c_str());
+
+		if (!program)
+			unload();
+		return program != nullptr;
+
+		#else // WIN32
+		error = "Loading translated bytecode is not supported on this platform";
+		return false;
+		#endif // WIN32
+	}
+
+	/*@}*/
+
+} // namespace Aseba
@@ -0,0 +1,73 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_BYTECODE_TO_C_H
+#define ASEBA_BYTECODE_TO_C_H
+
+#include "compiler.h"
+#include "../vm/compiled.h"
+#include <ostream>
+#include <string>
+
+namespace Aseba
+{
+	/** \addtogroup compiler */
+	/*@{*/
+
+	//! Translate a linked bytecode to C, defining an AsebaCompiledProgram named ASEBA_COMPILED_PROGRAM_SYMBOL; return the number of words translated
+	unsigned translateBytecodeToC(const BytecodeVector& bytecode, std::ostream& out);
+
+	/**
+		A bytecode translated to C and built as a shared object, for host targets.
+
+		The C code includes "vm/compiled.h", so the directory containing the vm
+		and common directories of Aseba must be given as include directory.
+		The shared object is only referenced by the program it defines and
+		is unloaded on destruction.
+	*/
+	class CompiledBytecode
+	{
+	public:
+		CompiledBytecode();
+		~CompiledBytecode();
+		CompiledBytecode(const CompiledBytecode&) = delete;
+		CompiledBytecode& operator=(const CompiledBytecode&) = delete;
+
+		//! Translate, compile with compiler (from CC if empty, otherwise cc) and load bytecode; return whether it succeeded
+		bool build(const BytecodeVector& bytecode, const std::string& includeDir, const std::string& compiler = "");
+		//! Return the loaded program, or nullptr if none
+		const AsebaCompiledProgram* getProgram() const { return program; }
+		//! Return the reason why the last build failed
+		const std::string& getError() const { return error; }
+
+	protected:
+		void unload();
+
+	protected:
+		const AsebaCompiledProgram* program = nullptr;
+		void* handle = nullptr;
+		std::string error;
+	};
+
+	/*@}*/
+
+} // namespace Aseba
+
+#endif
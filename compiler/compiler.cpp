@@ -323,6 +323,13 @@ namespace Aseba
 			return false;
 		}
 		
+		// when conditions state slots
+		if (!assignWhenSlots(bytecode))
+		{
+			errorDescription = TranslatableError(SourcePos(), ERROR_TOO_MANY_WHEN).arg(ASEBA_MAX_WHEN_SLOTS).toError();
+			return false;
+		}
+		
 		if (dump)
 		{
 			*dump << "Bytecode:\n";
@@ -391,6 +398,29 @@ namespace Aseba
 		return bytecode.size() <= targetDescription->bytecodeSize;
 	}
 	
+	//! Give each when condition its own slot in the state of the VM, return false if there are too many
+	bool Compiler::assignWhenSlots(BytecodeVector& bytecode) const
+	{
+		// up to protocol version 5, the VM stores the state of when conditions in the bytecode
+		if (targetDescription->protocolVersion < 6)
+			return true;
+		
+		unsigned slot = 0;
+		for (size_t pc = 0; pc < bytecode.size();)
+		{
+			BytecodeElement &element(bytecode[pc]);
+			if ((element.bytecode >> 12 == ASEBA_BYTECODE_CONDITIONAL_BRANCH) && (element.bytecode & (1 << ASEBA_IF_IS_WHEN_BIT)))
+			{
+				if (slot >= ASEBA_MAX_WHEN_SLOTS)
+					return false;
+				element.bytecode |= ASEBA_IF_WHEN_SLOT_BITS(slot);
+				++slot;
+			}
+			pc += element.getWordSize();
+		}
+		return true;
+	}
+	
 	//! Change "stop" bytecode to "return from subroutine"
 	void BytecodeVector::changeStopToRetSub()
 	{
@@ -545,9 +575,9 @@ namespace Aseba
 				
 				case ASEBA_BYTECODE_CONDITIONAL_BRANCH:
 				dump << "CONDITIONAL_BRANCH ";
-				dump << binaryOperatorToString((AsebaBinaryOperator)(bytecode[pc] & ASEBA_BINARY_OPERATOR_MASK));
+				dump << binaryOperatorToString((AsebaBinaryOperator)(bytecode[pc] & ASEBA_IF_OPERATOR_MASK));
 				if (bytecode[pc] & (1 << ASEBA_IF_IS_WHEN_BIT))
-					dump << " (edge), ";
+					dump << " (edge, slot " << ASEBA_IF_GET_WHEN_SLOT(bytecode[pc]) << "), ";
 				else
 					dump << ", ";
 				dump << "skip " << ((signed short)bytecode[pc+1]) << " if false" << "\n";
@@ -413,6 +413,7 @@ namespace Aseba
 		void dumpTokens(std::wostream &dest) const;
 		bool verifyStackCalls(PreLinkBytecode& preLinkBytecode);
 		bool link(const PreLinkBytecode& preLinkBytecode, BytecodeVector& bytecode);
+		bool assignWhenSlots(BytecodeVector& bytecode) const;
 		void disassemble(BytecodeVector& bytecode, const PreLinkBytecode& preLinkBytecode, std::wostream& dump) const;
 		
 	protected:
@@ -36,6 +36,7 @@ namespace Aseba
 		error_map[ERROR_BROKEN_TARGET] =			L"Broken target description: not enough room for internal variables";
 		error_map[ERROR_STACK_OVERFLOW] =			L"Execution stack will overflow, check for any recursive subroutine call and cut long mathematical expressions";
 		error_map[ERROR_SCRIPT_TOO_BIG] =			L"Script too big for target bytecode size";
+		error_map[ERROR_TOO_MANY_WHEN] =			L"Too many when conditions, the target supports at most %0";
 		// identifier-lookup.cpp
 		error_map[ERROR_VARIABLE_NOT_DEFINED] =			L"%0 is not a defined variable";
 		error_map[ERROR_VARIABLE_NOT_DEFINED_GUESS] =		L"%0 is not a defined variable, do you mean %1?";
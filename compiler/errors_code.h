@@ -18,6 +18,7 @@ namespace Aseba
 		ERROR_BROKEN_TARGET = 0,
 		ERROR_STACK_OVERFLOW,
 		ERROR_SCRIPT_TOO_BIG,
+		ERROR_TOO_MANY_WHEN,
 		// identifier-lookup.cpp
 		ERROR_VARIABLE_NOT_DEFINED,
 		ERROR_VARIABLE_NOT_DEFINED_GUESS,
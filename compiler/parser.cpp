@@ -22,6 +22,7 @@
 #include "tree.h"
 #include "../common/utils/FormatableString.h"
 #include "../common/utils/utils.h"
+#include <atomic>
 #include <memory>
 #include <valarray>
 #include <iostream>
@@ -264,7 +265,7 @@ namespace Aseba
 
 	AssignmentNode* Compiler::allocateTemporaryVariable(const SourcePos varPos, Node* rValue)
 	{
-		static unsigned uid = 0;
+		static std::atomic<unsigned> uid(0); // compilers can run concurrently
 
 		// allocate the temporary variable
 		const unsigned size = rValue->getVectorSize();
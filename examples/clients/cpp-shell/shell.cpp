@@ -243,7 +243,7 @@ void Shell::processShellCmd()
 void Shell::listNodes()
 {
 	for (NodesMap::const_iterator it(nodes.begin()); it != nodes.end(); ++it)
-		wcerr << (it->second).name << endl;
+		wcerr << (it->second).getDescription().name << endl;
 }
 
 void Shell::listVariables(const strings& args)
@@ -279,7 +279,9 @@ namespace Aseba
 			wcout << L"Received description for " << getNodeName(nodeId) << endl;
 		this->nodeId = nodeId;
 		// getting variables from target, and allocate variables for BotSpeak runtime
-		variablesMap = getDescription(nodeId)->getVariablesMap(freeVariableIndex);
+		const std::shared_ptr<const SharedDescription> description(getSharedDescription(nodeId));
+		variablesMap = description->variablesMap;
+		freeVariableIndex = description->freeVariableIndex;
 		botspeakVariables.clear();
 		// Botspeak
 		defineVar(L"_currentBasicBlock", 1);
@@ -786,7 +788,7 @@ namespace Aseba
 		assert(variablesMap.find(varName) == variablesMap.end());
 		// check for freeVariableIndex overflow
 		const unsigned requiredSize(freeVariableIndex+varSize);
-		const unsigned variablesSize(nodes.at(nodeId).variablesSize);
+		const unsigned variablesSize(nodes.at(nodeId).getDescription().variablesSize);
 		if (requiredSize > variablesSize)
 			throw runtime_error(WStringToUTF8(WFormatableString(L"Error, not enough space in target for variable %0 of size %1: requiring %2 words, only %3 available").arg(varName).arg(varSize).arg(requiredSize).arg(variablesSize)));
 		// ok, allocate variable
@@ -13,6 +13,7 @@
     POST /nodes/:NODENAME/:EVENT                - call an event :EVENT
     GET  /events[/:EVENT]*                      - create SSE stream for all known nodes
     GET  /nodes/:NODENAME/events[/:EVENT]*      - create SSE stream for :NODENAME
+    GET  /metrics                               - traffic counters in the Prometheus text format
  
  Typical use: asebahttp --port 3000 --aesl vmcode.aesl ser:name=Thymio-II & After vmcode.aesl is compiled 
  and uploaded, check with curl http://127.0.0.1:3000/nodes/thymio-II
@@ -81,19 +82,13 @@
 #include <valarray>
 #include <vector>
 #include <iterator>
+#include <algorithm>
 #include "http.h"
 #include "../../common/consts.h"
 #include "../../common/types.h"
 #include "../../common/utils/utils.h"
 #include "../../transport/dashel_plugins/dashel-plugins.h"
 
-#if defined(_WIN32) && defined(__MINGW32__)
-/* This is a workaround for MinGW32, see libxml/xmlexports.h */
-#define IN_LIBXML
-#endif
-#include <libxml/parser.h>
-#include <libxml/tree.h>
-
 #if DASHEL_VERSION_INT < 10003
 #	error "You need at least Dashel version 1.0.3 to compile Http"
 #endif // DAHSEL_VERSION_INT
@@ -141,9 +136,13 @@ namespace Aseba
     nodeId(0),
     nodeDescriptionComplete(false),
     verbose(false),
-    iterations(iterations)
+    iterations(iterations),
+    aeslUnmatchedNodesCount(0)
     // created empty: pendingResponses, pendingVariables, eventSubscriptions, httpRequests, streamsToShutdown
     {
+        // events batches are unpacked in incomingData
+        announcedProtocolVersion = ASEBA_EVENTS_BATCH_PROTOCOL_VERSION;
+        
         // connect to the Aseba target
         std::cout << "HttpInterface connect asebaTarget " << asebaTarget << "\n";
         connect(asebaTarget); // triggers connectionCreated, which assigns asebaStream
@@ -158,53 +157,68 @@ namespace Aseba
     void HttpInterface::broadcastGetDescription()
     {
         GetDescription getDescription;
-        getDescription.serialize(asebaStream);
+        getDescription.version = announcedProtocolVersion;
+        const size_t size(getDescription.serialize(asebaStream));
         asebaStream->flush();
+        metrics.sent(asebaStream, getDescription, size);
     }
     
-    bool HttpInterface::run2s()
-	{
-		int timeout(2000);
-		UnifiedTime startTime;
-		while (timeout > 0)
-		{
-			if (!step(timeout))
-				return false;
-			timeout -= (Aseba::UnifiedTime() - startTime).value;
-		}
-		return true;
-	}
-    
     void HttpInterface::run()
     {
+        // wait for data until the next ping of the network, so that responses are sent
+        // as soon as the variables they wait for arrive
+        const UnifiedTime pingPeriod(2000);
+        UnifiedTime nextPing;
+        bool running(true);
         do
         {
-            sendAvailableResponses();
-			pingNetwork();
-            if (!run2s())
-				break;
-            if (verbose && streamsToShutdown.size() > 0)
+            pingNetwork();
+            nextPing += pingPeriod;
+            UnifiedTime now;
+            while (running && asebaStream != 0 && now < nextPing)
             {
-                cerr << "HttpInterface::run "<< streamsToShutdown.size() <<" streams to shut down";
-                for (std::set<Dashel::Stream*>::iterator si = streamsToShutdown.begin(); si != streamsToShutdown.end(); si++)
-                    cerr << " " << *si;
-                cerr << endl;
+                running = step(int((nextPing - now).value));
+                // events for subscribers are appended without being sent, and closing streams must not wait
+                sendAvailableResponses();
+                shutdownStreams();
+                now = UnifiedTime();
             }
-            if (!streamsToShutdown.empty())
+            // if the loop was late, do not ping several times in a row
+            if (nextPing < now)
+                nextPing = now;
+        } while (running and iterations-- != 0 and asebaStream != 0);
+        unscheduleAllStreams();
+    }
+    
+    void HttpInterface::shutdownStreams()
+    {
+        if (streamsToShutdown.empty())
+            return;
+        if (verbose)
+        {
+            cerr << "HttpInterface::shutdownStreams "<< streamsToShutdown.size() <<" streams to shut down";
+            for (std::set<Dashel::Stream*>::iterator si = streamsToShutdown.begin(); si != streamsToShutdown.end(); si++)
+                cerr << " " << *si;
+            cerr << endl;
+        }
+        // shut all of them down at once, closing a stream might change streamsToShutdown
+        std::set<Dashel::Stream*> streams;
+        streams.swap(streamsToShutdown);
+        for (std::set<Dashel::Stream*>::iterator i = streams.begin(); i != streams.end(); ++i)
+        {
+            try
             {
-                std::set<Dashel::Stream*>::iterator i = streamsToShutdown.begin();
-                Dashel::Stream* stream_to_shutdown = *i;
-                streamsToShutdown.erase(*i); // invalidates iterator
-                try
-                {
-                    if (verbose)
-                        cerr << stream_to_shutdown << " shutting down stream" << endl;
-                    shutdownStream(stream_to_shutdown);
-                }
-                catch(Dashel::DashelException& e)
-                { }
+                if (verbose)
+                    cerr << *i << " shutting down stream" << endl;
+                shutdownStream(*i);
             }
-        } while (iterations-- != 0 and asebaStream != 0);
+            catch(Dashel::DashelException& e)
+            { }
+        }
+    }
+    
+    void HttpInterface::unscheduleAllStreams()
+    {
         for (StreamResponseQueueMap::iterator i = pendingResponses.begin(); i != pendingResponses.end(); i++)
             unscheduleAllResponses(i->first);
     }
@@ -229,6 +243,7 @@ namespace Aseba
     
     void HttpInterface::connectionClosed(Stream * stream, bool abnormal)
     {
+        metrics.closed(stream);
         if (stream == asebaStream)
         {
             // first close all HTTP connections
@@ -254,14 +269,16 @@ namespace Aseba
     
     void HttpInterface::sendMessage(const Message& message)
 	{
-		message.serialize(asebaStream);
+		const size_t size(message.serialize(asebaStream));
 		asebaStream->flush();
+		metrics.sent(asebaStream, message, size);
 	}
     
     void HttpInterface::nodeDescriptionReceived(unsigned nodeId)
     {
         if (verbose)
             wcerr << this << L"Received description for " << getNodeName(nodeId) << endl;
+        variableRoutes.clear();
         if (!nodeId) return;
         this->nodeId = nodeId;
         nodeDescriptionComplete = true;
@@ -282,11 +299,16 @@ namespace Aseba
             if (verbose)
                 cerr << "incoming for asebaStream " << stream << endl;
             
-            Message *message(Message::receive(stream));
+            const Metrics::Clock::time_point received(Metrics::Clock::now());
+            size_t size;
+            Message *message(Message::receive(stream, &size));
+            metrics.received(stream, *message, size);
             
             // pass message to description manager, which builds
             // the node descriptions in background
             NodesManager::processMessage(message);
+            if (message->type == ASEBA_MESSAGE_DISCONNECTED)
+                variableRoutes.clear();
             
             // if variables, check for pending requests
             const Variables *variables(dynamic_cast<Variables *>(message));
@@ -298,7 +320,14 @@ namespace Aseba
             if (userMsg)
                 incomingUserMsg(userMsg);
             
+            // if events batch, retransmit each of its events
+            const EventsBatch *batch(dynamic_cast<EventsBatch *>(message));
+            if (batch)
+                for (const UserMessage& event: batch->events)
+                    incomingUserMsg(&event);
+            
             delete message;
+            metrics.forwarded(Metrics::Clock::now() - received);
         }
         else
         {
@@ -447,6 +476,10 @@ namespace Aseba
         {   // reset nodes
             return evReset(req, req->tokens);
         }
+        if (req->tokens[0].find("metrics")==0)
+        {   // traffic counters
+            return evMetrics(req, req->tokens);
+        }
         else
             finishResponse(req, 404, "");
     }
@@ -463,7 +496,7 @@ namespace Aseba
         for (NodesMap::iterator descIt = nodes.begin();
              descIt != nodes.end(); ++descIt)
         {
-            const Node& description(descIt->second);
+            const TargetDescription& description(descIt->second.getDescription());
             string nodeName = WStringToUTF8(description.name);
             
             json << "{";
@@ -656,15 +689,13 @@ namespace Aseba
              descIt != nodes.end(); ++descIt)
         {
             bool ok;
-            nodeId = getNodeId(descIt->second.name, 0, &ok);
+            nodeId = getNodeId(descIt->second.getDescription().name, 0, &ok);
             if (!ok)
                 continue;
-            string nodeName = WStringToUTF8(descIt->second.name);
+            string nodeName = WStringToUTF8(descIt->second.getDescription().name);
             
-            Reset(nodeId).serialize(asebaStream); // reset node
-            asebaStream->flush();
-            Run(nodeId).serialize(asebaStream);   // re-run node
-            asebaStream->flush();
+            sendMessage(Reset(nodeId)); // reset node
+            sendMessage(Run(nodeId));   // re-run node
             if (nodeName.find("thymio-II") == 0)
             {
                 strings args;
@@ -690,6 +721,33 @@ namespace Aseba
     
     //-- Sending messages on the Aseba bus -------------------------------------------------
     
+    // Handler: Traffic counters
+    
+    void HttpInterface::evMetrics(HttpRequest* req, strings& args)
+    {
+        unsigned pending(0);
+        for (StreamResponseQueueMap::const_iterator i = pendingResponses.begin(); i != pendingResponses.end(); ++i)
+            pending += i->second.size();
+        metrics.setGauge("http_pending_responses", pending);
+        metrics.setGauge("http_event_subscriptions", eventSubscriptions.size());
+        metrics.setGauge("pending_variables", pendingVariables.size());
+        const DescriptionsPool::Stats descriptions(DescriptionsPool::stats());
+        metrics.setGauge("node_descriptions", descriptions.descriptions);
+        metrics.setGauge("node_descriptions_references", descriptions.references);
+        metrics.setGauge("node_descriptions_bytes", descriptions.bytes);
+        metrics.setGauge("node_descriptions_saved_bytes", descriptions.savedBytes);
+        
+        std::stringstream text;
+        metrics.dumpText(text);
+        
+        strings headers;
+        headers.push_back("Content-Type: text/plain; version=0.0.4");
+        headers.push_back("Content-Length: " + std::to_string(text.str().size()));
+        headers.push_back("Access-Control-Allow-Origin: *");
+        addHeaders(req, headers);
+        finishResponse(req, 200, text.str());
+    }
+    
     void HttpInterface::sendEvent(const std::string nodeName, const strings& args)
     {
         size_t eventPos;
@@ -700,9 +758,7 @@ namespace Aseba
             UserMessage::DataVector data;
             for (size_t i=1; i<args.size(); ++i)
                 data.push_back(atoi(args[i].c_str()));
-            UserMessage userMessage(eventPos, data);
-            userMessage.serialize(asebaStream);
-            asebaStream->flush();
+            sendMessage(UserMessage(eventPos, data));
         }
         else if (verbose)
             cerr << "sendEvent " << nodeName << ": no event " << args[0] << endl;
@@ -727,7 +783,8 @@ namespace Aseba
                 cerr << " (" << nodePos << "," << varPos << "):" << length << "\n";
             // send the message
             GetVariables getVariables(nodePos, varPos, length);
-            getVariables.serialize(asebaStream);
+            const size_t size(getVariables.serialize(asebaStream));
+            metrics.sent(asebaStream, getVariables, size, false);
         }
         asebaStream->flush();
         return std::pair<unsigned,unsigned>(nodePos,varPos); // just last one
@@ -749,15 +806,23 @@ namespace Aseba
         SetVariables::VariablesVector data;
         for (size_t i=1; i<args.size(); ++i)
             data.push_back(atoi(args[i].c_str()));
-        SetVariables setVariables(nodePos, varPos, data);
-        setVariables.serialize(asebaStream);
-        asebaStream->flush();
+        sendMessage(SetVariables(nodePos, varPos, data));
     }
     
     // Utility: find variable address
     bool HttpInterface::getNodeAndVarPos(const string& nodeName, const string& variableName,
                                          unsigned& nodeId, unsigned& pos)
     {
+        // routes resolved by a previous request
+        const string route(nodeName + "/" + variableName);
+        const auto routeIt(variableRoutes.find(route));
+        if (routeIt != variableRoutes.end())
+        {
+            nodeId = routeIt->second.first;
+            pos = routeIt->second.second;
+            return true;
+        }
+        
         // make sure the node exists
         bool ok;
         nodeId = getNodeId(UTF8ToWString(nodeName), 0, &ok);
@@ -791,6 +856,7 @@ namespace Aseba
                 return false;
             }
         }
+        variableRoutes[route] = VariableAddress(nodeId, pos);
         return true;
     }
     
@@ -835,143 +901,74 @@ namespace Aseba
     // Load Aesl file from file
     void HttpInterface::aeslLoadFile(const std::string& filename)
     {
-        // local file or URL
-        xmlDoc *doc(xmlReadFile(filename.c_str(), nullptr, 0));
-        if (!doc)
-            wcerr << "cannot read aesl script XML from file " << UTF8ToWString(filename) << endl;
+        // local file, keeping only the code of nodes present in the network
+        AeslReader reader;
+        if (!reader.openFile(filename, aeslNodeFilter()))
+            wcerr << "cannot read aesl script XML from file " << UTF8ToWString(filename) << ": " << UTF8ToWString(reader.getError()) << endl;
         else
         {
-            aeslLoad(doc);
+            aeslLoad(reader);
             //if (verbose)
             cerr << "Loaded aesl script from " << filename.c_str() << "\n";
         }
-        xmlFreeDoc(doc);
-        xmlCleanupParser();
     }
     
     // Load Aesl file from memory
     void HttpInterface::aeslLoadMemory(const char * buffer, const int size)
     {
         // open document
-        xmlDoc *doc(xmlReadMemory(buffer, size, "vmcode.aesl", nullptr, 0));
-        if (!doc)
-            wcerr << "cannot read XML from memory " << buffer << endl;
+        AeslReader reader;
+        if (!reader.openMemory(buffer, size, aeslNodeFilter()))
+            wcerr << "cannot read XML from memory " << buffer << ": " << UTF8ToWString(reader.getError()) << endl;
         else
         {
-            aeslLoad(doc);
+            aeslLoad(reader);
             //if (verbose)
             cerr << "Loaded aesl script in-memory buffer " << buffer << "\n";
         }
-        xmlFreeDoc(doc);
-        xmlCleanupParser();
     }
     
-    // Parse Aesl program using XPath
-    void HttpInterface::aeslLoad(xmlDoc* doc)
+    // Return a filter keeping nodes entries that match a node of the network, counting the others
+    AeslReader::NodeFilter HttpInterface::aeslNodeFilter()
+    {
+        aeslUnmatchedNodesCount = 0;
+        return [this](const string& name, unsigned preferedId) {
+            // keep unnamed entries so that aeslLoad can report them
+            if (name.empty())
+                return true;
+            bool ok;
+            getNodeId(UTF8ToWString(name), preferedId, &ok);
+            if (!ok)
+                ++aeslUnmatchedNodesCount;
+            return ok;
+        };
+    }
+    
+    // Compile and send the code of an Aesl program
+    void HttpInterface::aeslLoad(const AeslReader& reader)
     {
         // clear existing data
-        commonDefinitions.events.clear();
-        commonDefinitions.constants.clear();
         allVariables.clear();
+        variableRoutes.clear();
         
-        // load new data
-        int noNodeCount(0);
+        // load new data, events and constants are validated by the reader
+        commonDefinitions = reader.getCommonDefinitions();
         bool wasError(false);
         
-        xmlXPathContextPtr context = xmlXPathNewContext(doc);
-        xmlXPathObjectPtr obj;
-        
-        // 1. Path network/event
-        if ((obj = xmlXPathEvalExpression(BAD_CAST"/network/event", context)))
-        {
-            xmlNodeSetPtr nodeset = obj->nodesetval;
-            for(int i = 0; i < (nodeset ? nodeset->nodeNr : 0); ++i)
-            {
-                xmlChar *name  (xmlGetProp(nodeset->nodeTab[i], BAD_CAST("name")));
-                xmlChar *size  (xmlGetProp(nodeset->nodeTab[i], BAD_CAST("size")));
-                if (name && size)
-                {
-                    int eventSize = atoi((const char *)size);
-                    if (eventSize > ASEBA_MAX_EVENT_ARG_SIZE)
-                    {
-                        wcerr << "Event " << name << " has a length " << eventSize << " larger than maximum"
-                              <<  ASEBA_MAX_EVENT_ARG_SIZE << endl;
-                        wasError = true;
-                        break;
-                    }
-                    else
-                        commonDefinitions.events.push_back(NamedValue(UTF8ToWString((const char *)name), eventSize));
-                }
-                xmlFree(name);
-                xmlFree(size);
-            }
-            xmlXPathFreeObject(obj); // also frees nodeset
-        }
-        // 2. Path network/constant
-        if ((obj = xmlXPathEvalExpression(BAD_CAST"/network/constant", context)))
-        {
-            xmlNodeSetPtr nodeset = obj->nodesetval;
-            for(int i = 0; i < (nodeset ? nodeset->nodeNr : 0); ++i)
-            {
-                xmlChar *name  (xmlGetProp(nodeset->nodeTab[i], BAD_CAST("name")));
-                xmlChar *value (xmlGetProp(nodeset->nodeTab[i], BAD_CAST("value")));
-                if (name && value)
-                    commonDefinitions.constants.push_back(NamedValue(UTF8ToWString((const char *)name),
-                                                                     atoi((const char *)value)));
-                xmlFree(name);  // nop if name is nullptr
-                xmlFree(value); // nop if value is nullptr
-            }
-            xmlXPathFreeObject(obj); // also frees nodeset
-        }
-        // 3. Path network/keywords
-        if ((obj = xmlXPathEvalExpression(BAD_CAST"/network/keywords", context)))
+        for (const auto& node: reader.getNodes())
         {
-            xmlNodeSetPtr nodeset = obj->nodesetval;
-            for(int i = 0; i < (nodeset ? nodeset->nodeNr : 0); ++i)
+            if (node.name.empty())
             {
-                xmlChar *flag  (xmlGetProp(nodeset->nodeTab[i], BAD_CAST("flag")));
-                // do nothing because compiler doesn't pay attention to keywords
-                xmlFree(flag);
-            }
-            xmlXPathFreeObject(obj); // also frees nodeset
-        }
-        // 4. Path network/node
-        if ((obj = xmlXPathEvalExpression(BAD_CAST"/network/node", context)))
-        {
-            xmlNodeSetPtr nodeset = obj->nodesetval;
-            for(int i = 0; i < (nodeset ? nodeset->nodeNr : 0); ++i)
-            {
-                xmlChar *name     (xmlGetProp(nodeset->nodeTab[i], BAD_CAST("name")));
-                xmlChar *storedId (xmlGetProp(nodeset->nodeTab[i], BAD_CAST("nodeId")));
-                xmlChar *text     (xmlNodeGetContent(nodeset->nodeTab[i]));
-                
-                if (!name)
-                    wcerr << "missing \"name\" attribute in \"node\" entry" << endl;
-                else if (!text)
-                    wcerr << "missing text in \"node\" entry" << endl;
-                else
-                {
-                    const string _name((const char *)name);
-                    // get the identifier of the node and compile the code
-                    unsigned preferedId = storedId ? unsigned(atoi((char*)storedId)) : 0;
-                    bool ok;
-                    unsigned nodeId(getNodeId(UTF8ToWString(_name), preferedId, &ok));
-                    if (ok)
-                        wasError = !compileAndSendCode(UTF8ToWString((const char *)text), nodeId, _name);
-                    else
-                        noNodeCount++;
-                }
-                // free attribute and content
-                xmlFree(name);     // nop if name is nullptr
-                xmlFree(storedId); // nop if name is nullptr
-                xmlFree(text);     // nop if text is nullptr
+                wcerr << "missing \"name\" attribute in \"node\" entry" << endl;
+                continue;
             }
-            xmlXPathFreeObject(obj); // also frees nodeset
+            // get the identifier of the node and compile the code
+            bool ok;
+            unsigned nodeId(getNodeId(UTF8ToWString(node.name), node.preferedId(), &ok));
+            if (ok)
+                wasError = !compileAndSendCode(node.wcode(), nodeId, node.name);
         }
         
-        // release memory
-        xmlXPathFreeContext(context);
-        
         // check if there was an error
         if (wasError)
         {
@@ -979,12 +976,13 @@ namespace Aseba
             commonDefinitions.events.clear();
             commonDefinitions.constants.clear();
             allVariables.clear();
+            variableRoutes.clear();
         }
         
         // check if there was some matching problem
-        if (noNodeCount)
+        if (aeslUnmatchedNodesCount)
         {
-            wcerr << noNodeCount << " scripts have no corresponding nodes in the current network and have not been loaded." << endl;
+            wcerr << aeslUnmatchedNodesCount << " scripts have no corresponding nodes in the current network and have not been loaded." << endl;
         }
     }
     
@@ -1007,11 +1005,10 @@ namespace Aseba
             // send bytecode
             sendBytecode(asebaStream, nodeId, std::vector<uint16_t>(bytecode.begin(), bytecode.end()));
             // run node
-            Run msg(nodeId);
-            msg.serialize(asebaStream);
-            asebaStream->flush();
+            sendMessage(Run(nodeId));
             // retrieve user-defined variables for use in get/set
             allVariables[nodeName] = *compiler.getVariablesMap();
+            variableRoutes.clear();
             return true;
         }
         else
@@ -1097,8 +1094,7 @@ namespace Aseba
                 if ( req->more )
                     break; // keep this request open
                 
-                if (req->headers["Connection"].find("close")==0 ||
-                    (req->protocol_version == "HTTP/1.0" && !(req->headers["Connection"].find("keep-alive")==0)) )
+                if (!req->isPersistent())
                 {
                     // delete all requests, including this one, and remove them from queue
                     unscheduleAllResponses(req->stream);
@@ -1192,10 +1188,21 @@ namespace Aseba
                 //                std::regex_match (header_field,field,e);
                 //                if (field.size() == 3)
                 //                    headers[field[1]] = field[2];
-                if (header_field.find("Content-Length: ",0,16)==0)
-                    headers["Content-Length"] = header_field.substr(16,term-16);
-                else if (header_field.find("Connection: ",0,12)==0)
-                    headers["Connection"] = header_field.substr(12,term-12);
+                // header names are case-insensitive, the space after the colon is optional
+                const size_t colon(header_field.find(':'));
+                if (colon != string::npos)
+                {
+                    string name(header_field.substr(0, colon));
+                    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+                    size_t valueStart(colon + 1);
+                    while (valueStart < size_t(term) && header_field[valueStart] == ' ')
+                        ++valueStart;
+                    const string value(header_field.substr(valueStart, term - valueStart));
+                    if (name == "content-length")
+                        headers["Content-Length"] = value;
+                    else if (name == "connection")
+                        headers["Connection"] = value;
+                }
             }
             else
                 headers_done = true;
@@ -1216,6 +1223,17 @@ namespace Aseba
         ready = true;
     }
     
+    // HTTP/1.1 connections stay open unless the client asks to close them, HTTP/1.0 ones only if asked to
+    bool HttpRequest::isPersistent()
+    {
+        string connection(headers["Connection"]);
+        std::transform(connection.begin(), connection.end(), connection.begin(), ::tolower);
+        if (protocol_version == "HTTP/1.1")
+            return connection.find("close") == string::npos;
+        else
+            return connection.find("keep-alive") != string::npos;
+    }
+    
     void HttpRequest::sendResponse()
     {
         if (verbose)
@@ -1253,11 +1271,14 @@ namespace Aseba
             reply << "\r\nContent-Length: " << result.size() << "\r\n";
             reply << "Content-Type: application/json\r\n"; // NO ";charset=UTF-8" cf. RFC 7159
             reply << "Access-Control-Allow-Origin: *\r\n";
-            if (headers["Connection"].find("Keep-Alive")==0)
+            if (!isPersistent())
+                reply << "Connection: close\r\n";
+            else if (protocol_version != "HTTP/1.1")
                 reply << "Connection: Keep-Alive\r\n";
         }
         else
         {
+            reply << "\r\n";
             for (strings::iterator i = outheaders.begin(); i != outheaders.end(); i++)
                 reply << *i << "\r\n";
         }
@@ -1268,7 +1289,6 @@ namespace Aseba
         memcpy(reply_str, reply.str().c_str(), reply_len);
         stream->write(reply_str, reply_len);
         free(reply_str);
-        stream->flush();
         status_sent = true;
     }
     
@@ -24,18 +24,12 @@
 #include <stdint.h>
 #include <list>
 #include <queue>
+#include <unordered_map>
 #include <dashel/dashel.h>
 #include "../../common/msg/msg.h"
 #include "../../common/msg/NodesManager.h"
-
-#if defined(_WIN32) && defined(__MINGW32__)
-/* This is a workaround for MinGW32, see libxml/xmlexports.h */
-#define IN_LIBXML
-#endif
-#include <libxml/parser.h>
-#include <libxml/tree.h>
-#include <libxml/xpath.h>
-#include <libxml/xpathInternals.h>
+#include "../../common/msg/Metrics.h"
+#include "../../common/utils/AeslReader.h"
 
 namespace Aseba
 {
@@ -77,10 +71,17 @@ namespace Aseba
         // Extract definitions from AESL file
         Aseba::CommonDefinitions commonDefinitions;
         NodeNameVariablesMap allVariables;
+        unsigned aeslUnmatchedNodesCount;
+        
+        // node id and variable position by "node/variable" route, cleared when nodes or programs change
+        std::unordered_map<std::string, VariableAddress> variableRoutes;
 
         //variable cache
         std::map<std::pair<unsigned,unsigned>, std::vector<short> > variable_cache;
         
+        // traffic counters of the Aseba target
+        Metrics metrics;
+        
     public:
         //default values needed for unit testing
         HttpInterface(const std::string& target="tcp:127.0.0.1;port=33333", const std::string& http_port="3000", const int iterations=-1);
@@ -92,6 +93,7 @@ namespace Aseba
         virtual void evSubscribe(HttpRequest* req, strings& args);
         virtual void evLoad(HttpRequest* req, strings& args);
         virtual void evReset(HttpRequest* req, strings& args);
+        virtual void evMetrics(HttpRequest* req, strings& args);
         virtual void aeslLoadFile(const std::string& filename);
         virtual void aeslLoadMemory(const char* buffer, const int size);
         virtual void updateVariables(const std::string nodeName);
@@ -116,13 +118,15 @@ namespace Aseba
         virtual void sendSetVariable(const std::string nodeName, const strings& args);
         virtual std::pair<unsigned,unsigned> sendGetVariables(const std::string nodeName, const strings& args);
         virtual bool getNodeAndVarPos(const std::string& nodeName, const std::string& variableName, unsigned& nodeId, unsigned& pos);
-        virtual void aeslLoad(xmlDoc* doc);
+        virtual void aeslLoad(const AeslReader& reader);
+        AeslReader::NodeFilter aeslNodeFilter();
         virtual void incomingVariables(const Variables *variables);
         virtual void incomingUserMsg(const UserMessage *userMsg);
         virtual void routeRequest(HttpRequest* req);
         
         // helper functions
-		bool run2s();
+        void shutdownStreams();
+        void unscheduleAllStreams();
         bool getNodeAndVarPos(const std::string& nodeName, const std::string& variableName, unsigned& nodeId, unsigned& pos) const;
         bool compileAndSendCode(const std::wstring& source, unsigned nodeId, const std::string& nodeName);
         virtual void parse_json_form(std::string content, strings& values);
@@ -157,6 +161,7 @@ namespace Aseba
         virtual bool initialize( std::string const& start_line, Dashel::Stream *stream); //
         virtual bool initialize( std::string const& method,  std::string const& uri, std::string const& _protocol_version, Dashel::Stream *stream);
         virtual void incomingData();
+        virtual bool isPersistent();
         virtual void sendResponse();
         virtual void sendStatus();
         virtual void sendPayload();
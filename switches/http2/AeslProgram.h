@@ -24,16 +24,8 @@
 #include <string>
 #include <vector>
 
-#if defined(_WIN32) && defined(__MINGW32__)
-/* This is a workaround for MinGW32, see libxml/xmlexports.h */
-#define IN_LIBXML
-#endif
-#include <libxml/parser.h>
-#include <libxml/tree.h>
-#include <libxml/xpath.h>
-#include <libxml/xpathInternals.h>
-
 #include "../../compiler/compiler.h"
+#include "../../common/utils/AeslReader.h"
 
 namespace Aseba { namespace Http
 {
@@ -62,7 +54,7 @@ namespace Aseba { namespace Http
 			virtual const CommonDefinitions& getCommonDefinitions() const { return commonDefinitions; }
 
 		protected:
-			void load(xmlDoc *doc);
+			void load(const AeslReader& reader);
 
 		private:
 			bool loaded;
@@ -18,6 +18,7 @@
 	along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <functional>
 #include <iostream>
 #include <sstream>
 #include "../../common/msg/msg.h"
@@ -43,7 +44,8 @@ HttpDashelTarget::HttpDashelTarget(HttpInterface *interface_, const std::string&
 	address(address_),
 	stream(stream_)
 {
-
+	// events batches are unpacked by HttpInterface::incomingData
+	announcedProtocolVersion = ASEBA_EVENTS_BATCH_PROTOCOL_VERSION;
 }
 
 HttpDashelTarget::~HttpDashelTarget()
@@ -193,45 +195,72 @@ bool HttpDashelTarget::compileAndRunCode(unsigned globalNodeId, const std::strin
 	Node& node = query->second;
 	assert(globalNodeId == node.globalId);
 
-	// compile code
+	BytecodeVector bytecode;
+	VariablesMap variablesMap;
+	if(!compileCode(getDescription(node.localId), &interface->getProgram().getCommonDefinitions(), code, bytecode, variablesMap, errorString)) {
+		if(interface->isVerbose()) {
+			cerr << "Target " << address << " failed to compile program for node " << globalNodeId << " (" << node.name << "): " << errorString << endl;
+		}
+		return false;
+	}
+
+	return runBytecode(globalNodeId, bytecode, variablesMap, errorString);
+}
+
+bool HttpDashelTarget::compileCode(const TargetDescription *description, const CommonDefinitions *commonDefinitions, const std::string& code, BytecodeVector& bytecode, VariablesMap& variablesMap, std::string& errorString)
+{
 	std::wistringstream is(UTF8ToWString(code));
 	Error error;
-	BytecodeVector bytecode;
 	unsigned allocatedVariablesCount;
 
 	Compiler compiler;
-	compiler.setTargetDescription(getDescription(node.localId));
-	compiler.setCommonDefinitions(&interface->getProgram().getCommonDefinitions());
+	compiler.setTargetDescription(description);
+	compiler.setCommonDefinitions(commonDefinitions);
 
 	if(compiler.compile(is, bytecode, allocatedVariablesCount, error)) {
-		try {
-			// send bytecode
-			sendBytecode(stream, node.localId, std::vector<uint16_t>(bytecode.begin(), bytecode.end()));
-
-			// run node
-			Run msg(node.localId);
-			msg.serialize(stream);
-			stream->flush();
-		} catch(Dashel::DashelException e) {
-			errorString = e.what();
-			if(interface->isVerbose()) {
-				cerr << "Target " << address << " failed to send bytecode and run message for node " << node.globalId << " (" << node.name << ") to stream: " << e.what() << endl;
-			}
-			return false;
-		}
-
-
-		// retrieve user-defined variables for use in get/set
-		node.variablesMap = *compiler.getVariablesMap();
+		variablesMap = *compiler.getVariablesMap();
 		return true;
 	} else {
 		errorString = WStringToUTF8(error.toWString());
+		return false;
+	}
+}
+
+bool HttpDashelTarget::runBytecode(unsigned globalNodeId, const BytecodeVector& bytecode, const VariablesMap& variablesMap, std::string& errorString)
+{
+	map<unsigned, Node>::iterator query = nodes.find(globalNodeId);
+	if(query == nodes.end()) {
+		errorString = "No such node";
 		if(interface->isVerbose()) {
-			cerr << "Target " << address << " failed to compile program for node " << globalNodeId << " (" << node.name << "): " << errorString << endl;
+			cerr << "Target " << address << " failed to run code for node " << globalNodeId << ": No such node" << endl;
 		}
+		return false;
+	}
 
+	Node& node = query->second;
+	assert(globalNodeId == node.globalId);
+
+	try {
+		// send bytecode
+		sendBytecode(stream, node.localId, std::vector<uint16_t>(bytecode.begin(), bytecode.end()));
+
+		// run node
+		Run msg(node.localId);
+		msg.serialize(stream);
+		stream->flush();
+	} catch(Dashel::DashelException e) {
+		errorString = e.what();
+		if(interface->isVerbose()) {
+			cerr << "Target " << address << " failed to send bytecode and run message for node " << node.globalId << " (" << node.name << ") to stream: " << e.what() << endl;
+		}
 		return false;
 	}
+
+	// retrieve user-defined variables for use in get/set
+	node.variablesMap = variablesMap;
+	node.variablesIndex.clear();
+	node.descriptionJson.clear();
+	return true;
 }
 
 bool HttpDashelTarget::removePendingVariable(unsigned globalNodeId, unsigned start)
@@ -250,6 +279,114 @@ bool HttpDashelTarget::removePendingVariable(unsigned globalNodeId, unsigned sta
 	return node.pendingVariables.erase(start) == 1;
 }
 
+namespace
+{
+	// append a JSON member "name":value, with a leading comma unless first
+	template<typename T>
+	void appendJsonMember(string& json, bool first, const string& name, const T& value)
+	{
+		if(!first) {
+			json += ',';
+		}
+		json += '"';
+		json += name;
+		json += "\":";
+		json += std::to_string(value);
+	}
+
+	void appendJsonMember(string& json, bool first, const string& name, const string& value)
+	{
+		if(!first) {
+			json += ',';
+		}
+		json += '"';
+		json += name;
+		json += "\":\"";
+		json += value;
+		json += '"';
+	}
+}
+
+const std::string *HttpDashelTarget::getNodeDescriptionJson(unsigned globalNodeId, const CommonDefinitions& commonDefinitions, size_t *hash)
+{
+	map<unsigned, Node>::iterator query = nodes.find(globalNodeId);
+	if(query == nodes.end()) {
+		return NULL;
+	}
+
+	Node& node = query->second;
+	if(node.descriptionJson.empty()) {
+		bool ok;
+		const TargetDescription *description = getDescription(node.localId, &ok);
+		if(!ok) {
+			return NULL;
+		}
+
+		// pre-size the buffer from the number of entries to avoid reallocations
+		string& json = node.descriptionJson;
+		json.reserve(256 + 32 * (node.variablesMap.size() + description->namedVariables.size() + commonDefinitions.constants.size() + commonDefinitions.events.size()) + 128 * description->localEvents.size());
+
+		json += '{';
+		appendJsonMember(json, true, "node", node.globalId);
+		appendJsonMember(json, false, "name", node.name);
+		appendJsonMember(json, false, "protocolVersion", description->protocolVersion);
+		appendJsonMember(json, false, "bytecodeSize", description->bytecodeSize);
+		appendJsonMember(json, false, "variablesSize", description->variablesSize);
+		appendJsonMember(json, false, "stackSize", description->stackSize);
+
+		// named variables
+		json += ",\"namedVariables\":{";
+		if(!node.variablesMap.empty()) {
+			for(VariablesMap::const_iterator iter = node.variablesMap.begin(); iter != node.variablesMap.end(); ++iter) {
+				appendJsonMember(json, iter == node.variablesMap.begin(), WStringToUTF8(iter->first), iter->second.second);
+			}
+		} else {
+			// failsafe: if compiler hasn't found any variables, get them from the node description
+			for(size_t i = 0; i < description->namedVariables.size(); i++) {
+				appendJsonMember(json, i == 0, WStringToUTF8(description->namedVariables[i].name), description->namedVariables[i].size);
+			}
+		}
+		json += '}';
+
+		// local events variables
+		json += ",\"localEvents\":{";
+		for(size_t i = 0; i < description->localEvents.size(); i++) {
+			appendJsonMember(json, i == 0, WStringToUTF8(description->localEvents[i].name), WStringToUTF8(description->localEvents[i].description));
+		}
+		json += '}';
+
+		// constants from introspection
+		json += ",\"constants\":{";
+		for(size_t i = 0; i < commonDefinitions.constants.size(); i++) {
+			appendJsonMember(json, i == 0, WStringToUTF8(commonDefinitions.constants[i].name), commonDefinitions.constants[i].value);
+		}
+		json += '}';
+
+		// events from introspection
+		json += ",\"events\":{";
+		for(size_t i = 0; i < commonDefinitions.events.size(); i++) {
+			appendJsonMember(json, i == 0, WStringToUTF8(commonDefinitions.events[i].name), commonDefinitions.events[i].value);
+		}
+		json += '}';
+
+		json += '}'; // end node
+
+		node.descriptionHash = std::hash<string>()(json);
+	}
+
+	if(hash) {
+		*hash = node.descriptionHash;
+	}
+	return &node.descriptionJson;
+}
+
+void HttpDashelTarget::invalidateDescriptionsJson()
+{
+	for(map<unsigned, Node>::iterator iter = nodes.begin(); iter != nodes.end(); ++iter) {
+		iter->second.descriptionJson.clear();
+	}
+}
+
 std::set<const HttpDashelTarget::Node *> HttpDashelTarget::getNodesByName(const std::string& name) const
 {
 	set<const HttpDashelTarget::Node *> result;
@@ -287,22 +424,33 @@ const HttpDashelTarget::Node *HttpDashelTarget::getNodeByLocalId(unsigned localN
 	}
 }
 
-bool HttpDashelTarget::getVariableInfo(const Node& node, const std::string& variableName, unsigned& position, unsigned& size)
+bool HttpDashelTarget::getVariableInfo(Node& node, const std::string& variableName, unsigned& position, unsigned& size)
 {
-	VariablesMap::const_iterator query = node.variablesMap.find(UTF8ToWString(variableName));
+	// variables resolved by a previous request
+	std::unordered_map< string, std::pair<unsigned, unsigned> >::const_iterator resolved = node.variablesIndex.find(variableName);
+	if(resolved != node.variablesIndex.end()) {
+		position = resolved->second.first;
+		size = resolved->second.second;
+		return true;
+	}
+
+	const std::wstring wideName = UTF8ToWString(variableName);
+	VariablesMap::const_iterator query = node.variablesMap.find(wideName);
 	if(query != node.variablesMap.end()) {
 		position = query->second.first;
 		size = query->second.second;
+		node.variablesIndex[variableName] = make_pair(position, size);
 		return true;
 	}
 
 	// if variable is not user-defined, check whether it is provided by this node
 	bool ok;
-	position = getVariablePos(node.localId, UTF8ToWString(variableName), &ok);
+	position = getVariablePos(node.localId, wideName, &ok);
 	if(ok) {
-		size = getVariableSize(node.localId, UTF8ToWString(variableName), &ok);
+		size = getVariableSize(node.localId, wideName, &ok);
 
 		if(ok) {
+			node.variablesIndex[variableName] = make_pair(position, size);
 			return true;
 		}
 	}
@@ -326,7 +474,8 @@ void HttpDashelTarget::nodeDescriptionReceived(unsigned localNodeId)
 		Node node;
 		node.localId = localNodeId;
 		node.name = WStringToUTF8(getNodeName(localNodeId));
-		node.globalId = interface->registerNode(this, localNodeId);
+		node.globalId = interface->registerNode(this, localNodeId, node.name);
+		node.descriptionHash = 0;
 		nodes[node.globalId] = node;
 		globalIds[node.localId] = node.globalId;
 
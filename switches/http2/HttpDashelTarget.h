@@ -24,6 +24,7 @@
 #include <map>
 #include <string>
 #include <set>
+#include <unordered_map>
 #include <dashel/dashel.h>
 #include "../../common/msg/NodesManager.h"
 #include "AeslProgram.h"
@@ -52,6 +53,9 @@ namespace Aseba { namespace Http
 				std::string name;
 				VariablesMap variablesMap;
 				std::map< unsigned, std::set< std::pair<Dashel::Stream *, DashelHttpRequest *> > > pendingVariables;
+				std::string descriptionJson; // cached JSON description, empty when outdated
+				size_t descriptionHash; // hash of descriptionJson, used to build entity tags
+				std::unordered_map< std::string, std::pair<unsigned, unsigned> > variablesIndex; // resolved position and size by variable name, cleared when the program changes
 			};
 
 			HttpDashelTarget(HttpInterface *interface, const std::string& address, Dashel::Stream *stream);
@@ -92,6 +96,20 @@ namespace Aseba { namespace Http
 			 */
 			virtual bool compileAndRunCode(unsigned globalNodeId, const std::string& code, std::string& errorString);
 
+			/**
+			 * Compiles code for a node with the given description and common definitions, filling bytecode and
+			 * variablesMap. This does not access any target, so it can run on any thread. In case false is returned
+			 * on failure, errorString will contain a description of the problem that has occurred.
+			 */
+			static bool compileCode(const TargetDescription *description, const CommonDefinitions *commonDefinitions, const std::string& code, BytecodeVector& bytecode, VariablesMap& variablesMap, std::string& errorString);
+
+			/**
+			 * Sends bytecode compiled by compileCode() as well as a run request to one of this target's specified
+			 * nodes, and remembers the variables of its program. In case false is returned on failure, errorString
+			 * will contain a description of the problem that has occurred.
+			 */
+			virtual bool runBytecode(unsigned globalNodeId, const BytecodeVector& bytecode, const VariablesMap& variablesMap, std::string& errorString);
+
 			/**
 			 * Remove a pending variable request from one of this target's specified nodes.
 			 *
@@ -99,6 +117,20 @@ namespace Aseba { namespace Http
 			 */
 			virtual bool removePendingVariable(unsigned globalNodeId, unsigned start);
 
+			/**
+			 * Returns the JSON description of one of this target's specified nodes, including the constants and
+			 * events of the given common definitions, and sets hash to a hash of it if not null. The description is
+			 * cached until the node's program or description changes, or invalidateDescriptionsJson() is called.
+			 *
+			 * Returns NULL if the node does not exist or its description is not complete.
+			 */
+			virtual const std::string *getNodeDescriptionJson(unsigned globalNodeId, const CommonDefinitions& commonDefinitions, size_t *hash = NULL);
+
+			/**
+			 * Discards the cached JSON descriptions of all nodes, for instance because the common definitions changed.
+			 */
+			virtual void invalidateDescriptionsJson();
+
 			virtual std::set<const Node *> getNodesByName(const std::string& name) const;
 			virtual const Node *getNodeById(unsigned globalNodeId) const;
 			virtual const Node *getNodeByLocalId(unsigned localNodeId) const;
@@ -108,7 +140,7 @@ namespace Aseba { namespace Http
 			virtual const std::map<unsigned, Node>& getNodes() const { return nodes; }
 
 		protected:
-			virtual bool getVariableInfo(const Node& node, const std::string& variableName, unsigned& position, unsigned& size);
+			virtual bool getVariableInfo(Node& node, const std::string& variableName, unsigned& position, unsigned& size);
 			virtual void sendMessage(const Message& message);
 			virtual void nodeDescriptionReceived(unsigned localNodeId);
 			
@@ -19,42 +19,64 @@
 */
 
 #include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include "HttpInterface.h"
 #include "HttpInterfaceHandlers.h"
 
 #define RECONNECT_TIMEOUT 1000
 
+using Aseba::Http::DashelHttpRequest;
 using Aseba::Http::EventsHandler;
 using Aseba::Http::HttpDashelTarget;
 using Aseba::Http::HttpInterface;
+using Aseba::Http::LatencyHandler;
+using Aseba::Http::LatencyStatistics;
 using Aseba::Http::LoadHandler;
+using Aseba::Http::MetricsHandler;
 using Aseba::Http::NodesHandler;
 using Aseba::Http::OptionsHandler;
 using Aseba::Http::ResetHandler;
+using Aseba::Http::SnapshotHandler;
+using Aseba::Http::WebSocketFrame;
+using Aseba::Http::WebSocketHandler;
+using Aseba::Http::WebSocketSession;
+using Aseba::Http::WorkerPool;
 using std::cerr;
 using std::cerr;
+using std::deque;
 using std::endl;
 using std::find;
 using std::istringstream;
+using std::list;
 using std::make_pair;
 using std::map;
+using std::min;
 using std::pair;
 using std::set;
 using std::string;
 using std::stringstream;
 using std::vector;
 
-HttpInterface::HttpInterface(const std::string& httpPort) :
+HttpInterface::HttpInterface(const std::string& httpPort, unsigned workersCount) :
 	verbose(true),
-	program(defaultProgram.c_str(), defaultProgram.size())
+	webSocketRateLimit(200),
+	workers(workersCount),
+	tracer(nullptr),
+	program(defaultProgram.c_str(), defaultProgram.size()),
+	lastRequestId(0)
 {
 	addSubhandler(new OptionsHandler());
 	addSubhandler(new LoadHandler(this));
 	addSubhandler(new NodesHandler(this));
 	addSubhandler(new EventsHandler(this));
 	addSubhandler(new ResetHandler(this));
+	addSubhandler(new WebSocketHandler(this));
+	addSubhandler(new LatencyHandler(this));
+	addSubhandler(new MetricsHandler(this));
+	addSubhandler(new SnapshotHandler(this));
 
 	// listen for incoming HTTP requests
 	httpStream = connect("tcpin:port=" + httpPort);
@@ -118,8 +140,15 @@ void HttpInterface::step()
 		}
 	}
 
+	closeIdleHttpConnections();
 	closeClosingHttpConnections();
+	workers.runCompletions();
 	sendHttpResponses();
+	stepWebSockets();
+
+	if(tracer != nullptr) {
+		tracer->tick();
+	}
 
 	Dashel::Hub::step(2);
 }
@@ -182,7 +211,23 @@ void HttpInterface::addEventSubscription(HttpRequest *request, const std::string
 	}
 }
 
-unsigned HttpInterface::registerNode(HttpDashelTarget *target, unsigned localNodeId)
+void HttpInterface::upgradeToWebSocket(HttpRequest *request)
+{
+	assert(dynamic_cast<DashelHttpRequest *>(request) != nullptr);
+	DashelHttpRequest *dashelHttpRequest = static_cast<DashelHttpRequest *>(request);
+	Dashel::Stream *stream = dashelHttpRequest->getStream();
+
+	HttpConnection& connection = httpConnections[stream];
+	if(connection.webSocket == nullptr) {
+		connection.webSocket = new WebSocketSession(webSocketRateLimit);
+	}
+
+	if(verbose) {
+		cerr << stream << " Upgraded HTTP connection to WebSocket with request " << request << endl;
+	}
+}
+
+unsigned HttpInterface::registerNode(HttpDashelTarget *target, unsigned localNodeId, const std::string& name)
 {
 	bool found = false;
 	unsigned globalNodeId = localNodeId;
@@ -197,6 +242,7 @@ unsigned HttpInterface::registerNode(HttpDashelTarget *target, unsigned localNod
 	}
 
 	nodeIds[globalNodeId] = make_pair(target, localNodeId);
+	nodeNames.insert(make_pair(name, globalNodeId));
 
 	if(verbose) {
 		cerr << "Registered node with remapped global id " << globalNodeId << " from target " << target->getAddress() << " with local id " << localNodeId << endl;
@@ -205,6 +251,17 @@ unsigned HttpInterface::registerNode(HttpDashelTarget *target, unsigned localNod
 	return globalNodeId;
 }
 
+void HttpInterface::setProgram(const AeslProgram& program)
+{
+	this->program = program;
+
+	// node descriptions contain the constants and events of the program
+	map<Dashel::Stream *, HttpDashelTarget *>::iterator end = targets.end();
+	for(map<Dashel::Stream *, HttpDashelTarget *>::iterator iter = targets.begin(); iter != end; ++iter) {
+		iter->second->invalidateDescriptionsJson();
+	}
+}
+
 bool HttpInterface::runProgram(std::string& errorString)
 {
 	const vector<AeslProgram::NodeEntry>& entries = program.getEntries();
@@ -248,20 +305,259 @@ bool HttpInterface::runProgram(std::string& errorString)
 	return true;
 }
 
+namespace Aseba { namespace Http { namespace
+{
+	// state shared by the compilation jobs of one program upload
+	struct ProgramLoad
+	{
+		ProgramLoad(DashelHttpRequest *request, const CommonDefinitions& commonDefinitions) :
+			stream(request->getStream()),
+			requestId(request->getId()),
+			commonDefinitions(commonDefinitions),
+			remainingJobs(0),
+			workersFull(false)
+		{
+		}
+
+		Dashel::Stream *stream;
+		const uint64_t requestId; // the request is only responded to if still pending on stream
+		const CommonDefinitions commonDefinitions; // copied, as the program could change during compilation
+		unsigned remainingJobs;
+		bool workersFull; // whether some jobs could not be submitted, in which case the client can retry later
+		std::string errorString;
+	};
+
+	// compile the code of a program entry for one node on a worker, then send it from the interface thread
+	class CompileJob : public WorkerPool::Job
+	{
+		public:
+			CompileJob(HttpInterface *interface, const std::shared_ptr<ProgramLoad>& load, unsigned globalNodeId, const std::shared_ptr<const SharedDescription>& description, const std::string& code) :
+				interface(interface),
+				load(load),
+				globalNodeId(globalNodeId),
+				description(description),
+				code(code),
+				compiled(false)
+			{
+			}
+
+			virtual void run()
+			{
+				compiled = HttpDashelTarget::compileCode(description.get(), &load->commonDefinitions, code, bytecode, variablesMap, errorString);
+			}
+
+			virtual void complete()
+			{
+				// the node might have disconnected during compilation
+				pair<HttpDashelTarget *, const HttpDashelTarget::Node *> nodeReference = interface->getNodeById(globalNodeId);
+				if(!compiled) {
+					if(interface->isVerbose()) {
+						cerr << "Failed to compile program for node " << globalNodeId << ": " << errorString << endl;
+					}
+				} else if(nodeReference.first == nullptr) {
+					errorString = "Node disconnected during compilation";
+				} else if(nodeReference.first->runBytecode(globalNodeId, bytecode, variablesMap, errorString)) {
+					if(interface->isVerbose()) {
+						cerr << "Compiled and sent AESL entry to node " << globalNodeId << " (" << nodeReference.second->name << ")" << endl;
+					}
+				}
+
+				if(load->errorString.empty()) {
+					load->errorString = errorString;
+				}
+
+				if(--load->remainingJobs > 0) {
+					return;
+				}
+				DashelHttpRequest *request = interface->getPendingRequest(load->stream, load->requestId);
+				if(request == nullptr) {
+					return;
+				}
+				if(load->errorString.empty()) {
+					request->respond();
+				} else {
+					request->respond().setStatus(load->workersFull ? HttpResponse::HTTP_STATUS_SERVICE_UNAVAILABLE : HttpResponse::HTTP_STATUS_BAD_REQUEST);
+					request->respond().setContent(load->errorString);
+				}
+			}
+
+		private:
+			HttpInterface *interface;
+			const std::shared_ptr<ProgramLoad> load;
+			const unsigned globalNodeId;
+			const std::shared_ptr<const SharedDescription> description; // kept alive for the worker, even if the node disconnects
+			const std::string code;
+
+			bool compiled;
+			BytecodeVector bytecode;
+			VariablesMap variablesMap;
+			std::string errorString;
+	};
+} } }
+
+void HttpInterface::runProgramAsync(HttpRequest *request)
+{
+	assert(dynamic_cast<DashelHttpRequest *>(request) != nullptr);
+	std::shared_ptr<ProgramLoad> load(new ProgramLoad(static_cast<DashelHttpRequest *>(request), program.getCommonDefinitions()));
+
+	const vector<AeslProgram::NodeEntry>& entries = program.getEntries();
+	for(int i = 0; i < (int) entries.size(); i++) {
+		const AeslProgram::NodeEntry& entry = entries[i];
+
+		set< pair<HttpDashelTarget *, const HttpDashelTarget::Node *> > matchingNodes;
+
+		if(!entry.nodeId.empty()) { // if there is a node id, both it and the name have to match exactly
+			pair<HttpDashelTarget *, const HttpDashelTarget::Node *> nodeReference = getNodeByIdString(entry.nodeId);
+
+			if(nodeReference.second != nullptr && (entry.nodeName.empty() || nodeReference.second->name == entry.nodeName)) {
+				matchingNodes.insert(nodeReference);
+			}
+		} else { // if there is only a name, multiples can match
+			matchingNodes = getNodesByName(entry.nodeName);
+		}
+
+		if(matchingNodes.empty() && verbose) {
+			cerr << "Warning: No target nodes match program entry with node name '" << entry.nodeName << "' and node id '" << entry.nodeId << "', skipping..." << endl;
+		}
+
+		set< pair<HttpDashelTarget *, const HttpDashelTarget::Node *> >::iterator end = matchingNodes.end();
+		for(set< pair<HttpDashelTarget *, const HttpDashelTarget::Node *> >::iterator iter = matchingNodes.begin(); iter != end; ++iter) {
+			HttpDashelTarget *target = iter->first;
+			const HttpDashelTarget::Node *node = iter->second;
+
+			CompileJob *job = new CompileJob(this, load, node->globalId, target->getSharedDescription(node->localId), entry.code);
+			if(workers.submit(job)) {
+				load->remainingJobs++;
+			} else {
+				delete job;
+				load->workersFull = true;
+				load->errorString = "Too many programs being compiled, try again later";
+			}
+		}
+	}
+
+	// respond immediately if there is nothing to wait for
+	if(load->remainingJobs == 0) {
+		if(load->errorString.empty()) {
+			request->respond();
+		} else {
+			request->respond().setStatus(HttpResponse::HTTP_STATUS_SERVICE_UNAVAILABLE);
+			request->respond().setContent(load->errorString);
+		}
+	}
+}
+
+DashelHttpRequest *HttpInterface::getPendingRequest(Dashel::Stream *stream, uint64_t requestId) const
+{
+	// the request can only be trusted if it is still in the queue of its connection
+	map<Dashel::Stream *, HttpConnection>::const_iterator query = httpConnections.find(stream);
+	if(query == httpConnections.end()) {
+		return nullptr;
+	}
+	const HttpConnection& connection = query->second;
+	for(deque<DashelHttpRequest *>::const_iterator iter = connection.queue.begin(); iter != connection.queue.end(); ++iter) {
+		if((*iter)->getId() == requestId) {
+			return *iter;
+		}
+	}
+	return nullptr;
+}
+
+void HttpInterface::requestSnapshot(HttpRequest *request, const std::set< std::pair<HttpDashelTarget *, const HttpDashelTarget::Node *> >& nodes, uint32_t since)
+{
+	assert(dynamic_cast<DashelHttpRequest *>(request) != nullptr);
+	DashelHttpRequest *dashelRequest = static_cast<DashelHttpRequest *>(request);
+
+	pendingSnapshots.push_back(PendingSnapshot());
+	PendingSnapshot& pending = pendingSnapshots.back();
+	pending.stream = dashelRequest->getStream();
+	pending.requestId = dashelRequest->getId();
+	pending.since = since;
+
+	set< pair<HttpDashelTarget *, const HttpDashelTarget::Node *> >::const_iterator end = nodes.end();
+	for(set< pair<HttpDashelTarget *, const HttpDashelTarget::Node *> >::const_iterator iter = nodes.begin(); iter != end; ++iter) {
+		HttpDashelTarget *target = iter->first;
+		const HttpDashelTarget::Node *node = iter->second;
+		pending.snapshot.addNode(node->globalId, *target->getDescription(node->localId), node->variablesMap);
+		pending.targets[node->globalId] = target;
+	}
+
+	// send all chunks of all nodes at once, the replies are matched by position
+	for(set< pair<HttpDashelTarget *, const HttpDashelTarget::Node *> >::const_iterator iter = nodes.begin(); iter != end; ++iter) {
+		HttpDashelTarget *target = iter->first;
+		const HttpDashelTarget::Node *node = iter->second;
+		const vector<GetVariables> requests = pending.snapshot.getRequests(node->globalId, node->localId);
+
+		try {
+			for(vector<GetVariables>::const_iterator requestIter = requests.begin(); requestIter != requests.end(); ++requestIter) {
+				requestIter->serialize(target->getStream());
+			}
+			target->getStream()->flush();
+		} catch(Dashel::DashelException e) {
+			if(verbose) {
+				cerr << "Target " << target->getAddress() << " failed to send snapshot requests for node " << node->globalId << " (" << node->name << ") to stream: " << e.what() << endl;
+			}
+			request->respond().setStatus(HttpResponse::HTTP_STATUS_INTERNAL_SERVER_ERROR);
+			pendingSnapshots.pop_back();
+			return;
+		}
+	}
+
+	// nodes without variables need no reply
+	if(pending.snapshot.isComplete()) {
+		respondSnapshot(pending);
+		pendingSnapshots.pop_back();
+	}
+}
+
+std::string HttpInterface::getLatenciesJson() const
+{
+	std::string json("{");
+	for(map<std::string, LatencyStatistics>::const_iterator iter = latencies.begin(); iter != latencies.end(); ++iter) {
+		json += "\"" + iter->first + "\":" + iter->second.toJson() + ",";
+	}
+	json += "\"worker.queue\":" + workers.getQueueLatency().toJson();
+	json += ",\"worker.run\":" + workers.getRunLatency().toJson();
+	json += "}";
+	return json;
+}
+
+std::string HttpInterface::getMetricsText()
+{
+	size_t pendingResponses = 0;
+	size_t webSockets = 0;
+	for(map<Dashel::Stream *, HttpConnection>::const_iterator iter = httpConnections.begin(); iter != httpConnections.end(); ++iter) {
+		pendingResponses += iter->second.queue.size();
+		if(iter->second.webSocket != nullptr) {
+			webSockets++;
+		}
+	}
+	metrics.setGauge("http_connections", httpConnections.size());
+	metrics.setGauge("http_pending_responses", pendingResponses);
+	metrics.setGauge("websocket_clients", webSockets);
+	metrics.setGauge("targets", targets.size());
+	const DescriptionsPool::Stats descriptions = DescriptionsPool::stats();
+	metrics.setGauge("node_descriptions", descriptions.descriptions);
+	metrics.setGauge("node_descriptions_references", descriptions.references);
+	metrics.setGauge("node_descriptions_bytes", descriptions.bytes);
+	metrics.setGauge("node_descriptions_saved_bytes", descriptions.savedBytes);
+
+	stringstream text;
+	metrics.dumpText(text);
+	return text.str();
+}
+
 std::set< std::pair<HttpDashelTarget *, const HttpDashelTarget::Node *> > HttpInterface::getNodesByName(const std::string& name)
 {
 	set< pair<HttpDashelTarget *, const HttpDashelTarget::Node *> > results;
 
-	// search by name
-	map<Dashel::Stream *, HttpDashelTarget *>::iterator end = targets.end();
-	for(map<Dashel::Stream *, HttpDashelTarget *>::iterator iter = targets.begin(); iter != end; ++iter) {
-		HttpDashelTarget *target = iter->second;
-
-		set<const HttpDashelTarget::Node *> nodes = target->getNodesByName(name);
-		set<const HttpDashelTarget::Node *>::iterator nodesEnd = nodes.end();
-		for(set<const HttpDashelTarget::Node *>::iterator nodesIter = nodes.begin(); nodesIter != nodesEnd; ++nodesIter) {
-			const HttpDashelTarget::Node *node = *nodesIter;
-			results.insert(make_pair(target, node));
+	// search by name in the index, instead of in every node of every target
+	typedef std::unordered_multimap<std::string, unsigned>::const_iterator NodeNamesIterator;
+	pair<NodeNamesIterator, NodeNamesIterator> range = nodeNames.equal_range(name);
+	for(NodeNamesIterator iter = range.first; iter != range.second; ++iter) {
+		pair<HttpDashelTarget *, const HttpDashelTarget::Node *> nodeReference = getNodeById(iter->second);
+		if(nodeReference.first != nullptr) {
+			results.insert(nodeReference);
 		}
 	}
 
@@ -317,6 +613,8 @@ void HttpInterface::connectionCreated(Dashel::Stream *stream)
 
 void HttpInterface::connectionClosed(Dashel::Stream *stream, bool abnormal)
 {
+	metrics.closed(stream);
+
 	// handle dashel target disconnection
 	map<Dashel::Stream *, HttpDashelTarget *>::iterator targetQuery = targets.find(stream);
 	if(targetQuery != targets.end()) { // target stream
@@ -329,6 +627,14 @@ void HttpInterface::connectionClosed(Dashel::Stream *stream, bool abnormal)
 
 			// free up global node id
 			nodeIds.erase(node.globalId);
+			typedef std::unordered_multimap<std::string, unsigned>::iterator NodeNamesIterator;
+			pair<NodeNamesIterator, NodeNamesIterator> range = nodeNames.equal_range(node.name);
+			for(NodeNamesIterator nameIter = range.first; nameIter != range.second; ++nameIter) {
+				if(nameIter->second == node.globalId) {
+					nodeNames.erase(nameIter);
+					break;
+				}
+			}
 
 			// cancel all pending variable requests for the disconnected node
 			map< unsigned, set< pair<Dashel::Stream *, DashelHttpRequest *> > >::const_iterator pendingVariablesEnd = node.pendingVariables.end();
@@ -353,6 +659,19 @@ void HttpInterface::connectionClosed(Dashel::Stream *stream, bool abnormal)
 				}
 			}
 
+			// cancel all snapshots including the disconnected node
+			for(list<PendingSnapshot>::iterator snapshotIter = pendingSnapshots.begin(); snapshotIter != pendingSnapshots.end();) {
+				if(snapshotIter->snapshot.contains(node.globalId)) {
+					DashelHttpRequest *request = getPendingRequest(snapshotIter->stream, snapshotIter->requestId);
+					if(request != nullptr) {
+						request->respond().setStatus(HttpResponse::HTTP_STATUS_INTERNAL_SERVER_ERROR);
+					}
+					snapshotIter = pendingSnapshots.erase(snapshotIter);
+				} else {
+					++snapshotIter;
+				}
+			}
+
 			sendHttpResponses();
 
 			// notify event subscribers about the disconnected node
@@ -389,83 +708,51 @@ void HttpInterface::connectionClosed(Dashel::Stream *stream, bool abnormal)
 
 void HttpInterface::incomingData(Dashel::Stream *stream)
 {
+	const LatencyStatistics::Clock::time_point received(LatencyStatistics::Clock::now());
+
 	map<Dashel::Stream *, HttpDashelTarget *>::iterator query = targets.find(stream);
 	if(query != targets.end()) { // target stream
 		HttpDashelTarget *target = query->second;
 
-		Message *message(Message::receive(stream));
+		size_t size;
+		Message *message(Message::receive(stream, &size));
+		metrics.received(stream, *message, size);
+		const uint64_t traceId(tracer != nullptr ? Tracer::messageId(*message) : 0);
+		if(tracer != nullptr) {
+			tracer->record(traceId, Tracer::RECEIVE, stream);
+		}
 
 		// pass message to description manager, which builds the node descriptions in background
 		// warning: do this before dynamic casts because otherwise the parsing doesn't work (why?)
 		target->processMessage(message);
 
-		// See if we know this node already or if the source is 0 (meaning coming from IDE)
-		const HttpDashelTarget::Node *node = target->getNodeByLocalId(message->source);
-		if(node != nullptr || message->source == 0) { // else if we cannot remap the source, discard the message and do not relay it
-			// remap source node to global node id if not sent from IDE
-			if (node != nullptr)
-				message->source = node->globalId;
-
-			// check for execution error messages
-			switch(message->type) {
-				case ASEBA_MESSAGE_ARRAY_ACCESS_OUT_OF_BOUNDS:
-				case ASEBA_MESSAGE_DIVISION_BY_ZERO:
-				case ASEBA_MESSAGE_EVENT_EXECUTION_KILLED:
-				case ASEBA_MESSAGE_NODE_SPECIFIC_ERROR:
-					incomingErrorMessage(target, message);
-			}
-
-			// if variables, check for pending requests
-			const Variables *variables(dynamic_cast<Variables *>(message));
-			if(variables != nullptr) {
-				incomingVariables(target, variables);
-			}
-
-			// if event, retransmit it on an HTTP SSE channel if one exists
-			const UserMessage *userMessage(dynamic_cast<UserMessage *>(message));
-			if(userMessage != nullptr) {
-				incomingUserMessage(target, userMessage);
-			}
-
-			// act like asebaswitch: rebroadcast this message to the other streams
-			CmdMessage *cmdMessage(dynamic_cast<CmdMessage *>(message));
-			if(cmdMessage != nullptr) { // targeted message, only rebroadcast to correct target with remapped destination
-				std::map< unsigned, std::pair<HttpDashelTarget *, unsigned> >::iterator query = nodeIds.find(cmdMessage->dest);
-				if(query != nodeIds.end()) { // only relay it to known targets, else if we cannot remap the target, discard the message and do not relay it
-					HttpDashelTarget *target = query->second.first;
-					unsigned localNodeId = query->second.second;
-
-					try {
-						cmdMessage->dest = localNodeId;
-						cmdMessage->serialize(target->getStream());
-						target->getStream()->flush();
-					} catch(Dashel::DashelException e) {
-						cerr << "Error while rebroadcasting to stream " << target->getStream() << " of target " << target->getAddress() << endl;
-					}
-				}
-			} else { // not a targeted message, just rebroadcast to all other targets
-				map<Dashel::Stream *, HttpDashelTarget *>::const_iterator end = targets.end();
-				for(map<Dashel::Stream *, HttpDashelTarget *>::const_iterator iter = targets.begin(); iter != targets.end(); ++iter) {
-					Dashel::Stream *outStream = iter->first;
-
-					if(outStream != stream) {
-						try {
-							message->serialize(outStream);
-							outStream->flush();
-						} catch(Dashel::DashelException e) {
-							cerr << "Error while rebroadcasting to stream " << outStream << " of target " << iter->second->getAddress() << endl;
-						}
-					}
-				}
+		// a batch carries several events, relay them one by one as the other streams might not know batches
+		const EventsBatch *batch(dynamic_cast<EventsBatch *>(message));
+		if(batch != nullptr) {
+			for(const UserMessage& event: batch->events) {
+				UserMessage eventCopy(event);
+				relayTargetMessage(target, stream, &eventCopy, Metrics::frameSize(eventCopy), traceId);
 			}
+		} else {
+			relayTargetMessage(target, stream, message, size, traceId);
 		}
 
 		delete message;
+
+		latencies["aseba.forward"].add(LatencyStatistics::Clock::now() - received);
+		metrics.forwarded(LatencyStatistics::Clock::now() - received);
 	} else { // HTTP stream
 		HttpConnection& connection = httpConnections[stream];
 		connection.stream = stream;
+		connection.lastActivity = UnifiedTime();
+
+		if(connection.webSocket != nullptr) {
+			incomingWebSocketFrame(connection);
+			latencies["websocket.frame"].add(LatencyStatistics::Clock::now() - received);
+			return;
+		}
 
-		DashelHttpRequest *request = new DashelHttpRequest(stream);
+		DashelHttpRequest *request = new DashelHttpRequest(stream, ++lastRequestId);
 
 		if(verbose) {
 			cerr << stream << " Incoming HTTP connection, creating request " << request << endl;
@@ -496,6 +783,93 @@ void HttpInterface::incomingData(Dashel::Stream *stream)
 
 		// run response queues immediately to save time
 		sendHttpResponses();
+
+		latencies["http.request"].add(LatencyStatistics::Clock::now() - received);
+	}
+}
+
+void HttpInterface::relayTargetMessage(HttpDashelTarget *target, Dashel::Stream *stream, Message *message, size_t size, uint64_t traceId)
+{
+	// See if we know this node already or if the source is 0 (meaning coming from IDE)
+	const HttpDashelTarget::Node *node = target->getNodeByLocalId(message->source);
+	if(node != nullptr || message->source == 0) { // else if we cannot remap the source, discard the message and do not relay it
+		// remap source node to global node id if not sent from IDE
+		if (node != nullptr)
+			message->source = node->globalId;
+
+		// check for execution error messages
+		switch(message->type) {
+			case ASEBA_MESSAGE_ARRAY_ACCESS_OUT_OF_BOUNDS:
+			case ASEBA_MESSAGE_DIVISION_BY_ZERO:
+			case ASEBA_MESSAGE_EVENT_EXECUTION_KILLED:
+			case ASEBA_MESSAGE_NODE_SPECIFIC_ERROR:
+				incomingErrorMessage(target, message);
+		}
+
+		// if variables, check for pending requests
+		const Variables *variables(dynamic_cast<Variables *>(message));
+		if(variables != nullptr) {
+			incomingVariables(target, variables);
+		}
+
+		// if event, retransmit it on an HTTP SSE channel if one exists
+		const UserMessage *userMessage(dynamic_cast<UserMessage *>(message));
+		if(userMessage != nullptr) {
+			incomingUserMessage(target, userMessage);
+		}
+
+		// forward events and variables to the WebSocket clients that subscribed to them
+		notifyWebSocketSubscribers(message, traceId);
+
+		// act like asebaswitch: rebroadcast this message to the other streams
+		CmdMessage *cmdMessage(dynamic_cast<CmdMessage *>(message));
+		if(cmdMessage != nullptr) { // targeted message, only rebroadcast to correct target with remapped destination
+			std::map< unsigned, std::pair<HttpDashelTarget *, unsigned> >::iterator query = nodeIds.find(cmdMessage->dest);
+			if(query != nodeIds.end()) { // only relay it to known targets, else if we cannot remap the target, discard the message and do not relay it
+				HttpDashelTarget *target = query->second.first;
+				unsigned localNodeId = query->second.second;
+
+				try {
+					cmdMessage->dest = localNodeId;
+					cmdMessage->serialize(target->getStream());
+					if(tracer != nullptr) {
+						tracer->record(traceId, Tracer::SERIALIZE, target->getStream());
+					}
+					target->getStream()->flush();
+					if(tracer != nullptr) {
+						tracer->record(traceId, Tracer::FLUSH, target->getStream(), Tracer::messageId(*cmdMessage));
+					}
+					metrics.sent(target->getStream(), *message, size);
+				} catch(Dashel::DashelException e) {
+					metrics.writeError(target->getStream());
+					cerr << "Error while rebroadcasting to stream " << target->getStream() << " of target " << target->getAddress() << endl;
+				}
+			}
+		} else { // not a targeted message, just rebroadcast to all other targets
+			// the source was remapped, so the message written differs from the one received
+			const uint64_t wireId(tracer != nullptr ? Tracer::messageId(*message) : 0);
+			map<Dashel::Stream *, HttpDashelTarget *>::const_iterator end = targets.end();
+			for(map<Dashel::Stream *, HttpDashelTarget *>::const_iterator iter = targets.begin(); iter != targets.end(); ++iter) {
+				Dashel::Stream *outStream = iter->first;
+
+				if(outStream != stream) {
+					try {
+						message->serialize(outStream);
+						if(tracer != nullptr) {
+							tracer->record(traceId, Tracer::SERIALIZE, outStream);
+						}
+						outStream->flush();
+						if(tracer != nullptr) {
+							tracer->record(traceId, Tracer::FLUSH, outStream, wireId);
+						}
+						metrics.sent(outStream, *message, size);
+					} catch(Dashel::DashelException e) {
+						metrics.writeError(outStream);
+						cerr << "Error while rebroadcasting to stream " << outStream << " of target " << iter->second->getAddress() << endl;
+					}
+				}
+			}
+		}
 	}
 }
 
@@ -518,7 +892,9 @@ void HttpInterface::sendHttpResponses()
 				break;
 			}
 
-			if(request->getHeader("Connection") == "close" || (request->getProtocol() == "HTTP/1.0" && request->getHeader("Connection") != "keep-alive")) {
+			connection.lastActivity = UnifiedTime();
+			if(!request->isPersistent()) {
+				// requests pipelined after this one are dropped with the connection
 				closingHttpConnections.insert(connection.stream);
 				break;
 			} else {
@@ -543,6 +919,24 @@ void HttpInterface::closeClosingHttpConnections()
 	closingHttpConnections.clear();
 }
 
+void HttpInterface::closeIdleHttpConnections()
+{
+	const UnifiedTime now;
+	map<Dashel::Stream *, HttpConnection>::const_iterator end = httpConnections.end();
+	for(map<Dashel::Stream *, HttpConnection>::const_iterator iter = httpConnections.begin(); iter != end; ++iter) {
+		const HttpConnection& connection = iter->second;
+
+		// connections waiting for responses, streaming events or carrying WebSocket frames are not idle
+		if(connection.queue.empty() && connection.eventSubscriptions.empty() && connection.webSocket == nullptr &&
+			(now - connection.lastActivity).value > 1000 * HttpResponse::KEEP_ALIVE_TIMEOUT) {
+			if(verbose) {
+				cerr << connection.stream << " Closing idle HTTP connection" << endl;
+			}
+			closingHttpConnections.insert(connection.stream);
+		}
+	}
+}
+
 void HttpInterface::closeHttpConnection(HttpConnection& connection)
 {
 	// delete all requests that are still in the queue
@@ -551,6 +945,9 @@ void HttpInterface::closeHttpConnection(HttpConnection& connection)
 		connection.queue.pop_front();
 	}
 
+	delete connection.webSocket;
+	connection.webSocket = nullptr;
+
 	// disconnect the stream if not yet done so
 	if(!connection.stream->failed()) {
 		try {
@@ -571,6 +968,25 @@ void HttpInterface::incomingVariables(HttpDashelTarget *target, const Variables
 		cerr << "Incoming variable for target " << target->getAddress() << endl;
 	}
 
+	// incomingData already remapped the source to a global id through the node map of this target, so a node is
+	// only found if it belongs to target; snapshots only accept replies from the target they requested the node from
+	const HttpDashelTarget::Node *node = target->getNodeById(variables->source);
+
+	// fill the snapshots waiting for these variables, and respond to the complete ones
+	bool snapshotted = false;
+	for(list<PendingSnapshot>::iterator iter = pendingSnapshots.begin(); node != nullptr && iter != pendingSnapshots.end();) {
+		map<unsigned, HttpDashelTarget *>::const_iterator requestedTarget = iter->targets.find(node->globalId);
+		if(requestedTarget != iter->targets.end() && requestedTarget->second == target && iter->snapshot.received(node->globalId, *variables)) {
+			snapshotted = true;
+			if(iter->snapshot.isComplete()) {
+				respondSnapshot(*iter);
+				iter = pendingSnapshots.erase(iter);
+				continue;
+			}
+		}
+		++iter;
+	}
+
 	// first, build result string from message
 	stringstream result;
 	result << "[";
@@ -581,8 +997,6 @@ void HttpInterface::incomingVariables(HttpDashelTarget *target, const Variables
 	result << "]";
 	string resultString = result.str();
 
-	const HttpDashelTarget::Node *node = target->getNodeById(variables->source);
-
 	if(node != nullptr) {
 		map< unsigned, set< pair<Dashel::Stream *, DashelHttpRequest *> > >::const_iterator query = node->pendingVariables.find(variables->start);
 
@@ -615,7 +1029,7 @@ void HttpInterface::incomingVariables(HttpDashelTarget *target, const Variables
 			}
 
 			target->removePendingVariable(node->globalId, variables->start);
-		} else if(verbose) {
+		} else if(verbose && !snapshotted) {
 			cerr << "Target " << target->getAddress() << " received variables for node " << node->globalId << " (" << node->name << "), but there was no pending variable request for them" << endl;
 		}
 	} else if(verbose) {
@@ -625,6 +1039,25 @@ void HttpInterface::incomingVariables(HttpDashelTarget *target, const Variables
 	sendHttpResponses();
 }
 
+void HttpInterface::respondSnapshot(PendingSnapshot& pending)
+{
+	DashelHttpRequest *request = getPendingRequest(pending.stream, pending.requestId);
+	if(request == nullptr) {
+		if(verbose) {
+			cerr << "Received a snapshot, but the originating HTTP request was discarded in the meanwhile" << endl;
+		}
+		return;
+	}
+
+	const vector<uint8_t> blob = snapshotHistory.encode(pending.snapshot, pending.since);
+
+	stringstream id;
+	id << snapshotHistory.getLastId();
+	request->respond().setHeader("Content-Type", "application/octet-stream");
+	request->respond().setHeader("X-Aseba-Snapshot-Id", id.str());
+	request->respond().setContent(string(blob.begin(), blob.end()));
+}
+
 void HttpInterface::incomingUserMessage(HttpDashelTarget *target, const UserMessage *userMessage)
 {
 	if(verbose) {
@@ -661,4 +1094,214 @@ void HttpInterface::incomingErrorMessage(HttpDashelTarget *target, const Message
 	notifyEventSubscribers(errorString);
 }
 
+void HttpInterface::incomingWebSocketFrame(HttpConnection& connection)
+{
+	WebSocketFrame frame;
+
+	try {
+		if(!frame.receive(connection.stream)) {
+			if(verbose) {
+				cerr << connection.stream << " Received malformed WebSocket frame, closing connection" << endl;
+			}
+			const uint8_t protocolError[2] = { 0x03, 0xEA }; // 1002
+			sendWebSocketFrame(connection, WebSocketFrame::OPCODE_CLOSE, protocolError, 2);
+			closingHttpConnections.insert(connection.stream);
+			return;
+		}
+	} catch(Dashel::DashelException e) {
+		if(verbose) {
+			cerr << connection.stream << " WebSocket connection unexpectedly closed: " << e.what() << endl;
+		}
+		closingHttpConnections.insert(connection.stream);
+		return;
+	}
+
+	switch(frame.opcode) {
+		case WebSocketFrame::OPCODE_TEXT:
+		case WebSocketFrame::OPCODE_BINARY:
+			if(!frame.final) {
+				// browsers do not fragment messages of the size of Aseba messages
+				const uint8_t tooBig[2] = { 0x03, 0xF1 }; // 1009
+				sendWebSocketFrame(connection, WebSocketFrame::OPCODE_CLOSE, tooBig, 2);
+				closingHttpConnections.insert(connection.stream);
+			} else if(!connection.webSocket->acceptIncoming()) {
+				if(verbose) {
+					cerr << connection.stream << " Dropped WebSocket message exceeding rate limit" << endl;
+				}
+			} else if(frame.opcode == WebSocketFrame::OPCODE_TEXT) {
+				const string reply(connection.webSocket->executeCommand(string(frame.payload.begin(), frame.payload.end())));
+				sendWebSocketFrame(connection, WebSocketFrame::OPCODE_TEXT, reinterpret_cast<const uint8_t *>(reply.c_str()), reply.size());
+			} else {
+				injectWebSocketMessage(connection, frame.payload);
+			}
+		break;
+
+		case WebSocketFrame::OPCODE_PING:
+			sendWebSocketFrame(connection, WebSocketFrame::OPCODE_PONG, frame.payload.empty() ? nullptr : &frame.payload[0], frame.payload.size());
+		break;
+
+		case WebSocketFrame::OPCODE_PONG:
+		break;
+
+		case WebSocketFrame::OPCODE_CLOSE:
+			// echo the status code, then close
+			sendWebSocketFrame(connection, WebSocketFrame::OPCODE_CLOSE, frame.payload.empty() ? nullptr : &frame.payload[0], min<size_t>(frame.payload.size(), 2));
+			closingHttpConnections.insert(connection.stream);
+		break;
+
+		default:
+			closingHttpConnections.insert(connection.stream);
+		break;
+	}
+}
+
+void HttpInterface::injectWebSocketMessage(HttpConnection& connection, std::vector<uint8_t>& frame)
+{
+	// frame is a raw Aseba message: length, source and type words followed by length bytes of payload
+	const char *error = nullptr;
+	const uint16_t length = frame.size() >= 6 ? frame[0] | (frame[1] << 8) : 0;
+	const uint16_t type = frame.size() >= 6 ? frame[4] | (frame[5] << 8) : 0;
+	const bool targeted = type >= ASEBA_MESSAGE_SET_BYTECODE && type < ASEBA_MESSAGE_LIST_NODES;
+
+	if(frame.size() < 6 || size_t(length) + 6 != frame.size() || length > ASEBA_MAX_EVENT_ARG_SIZE) {
+		error = "error malformed message";
+	} else if(!(type < 0x8000 || type == ASEBA_MESSAGE_GET_DESCRIPTION || type == ASEBA_MESSAGE_LIST_NODES || targeted)) {
+		error = "error message type not allowed";
+	} else if(targeted && length < 2) {
+		error = "error malformed message";
+	}
+
+	// messages from clients are sent on behalf of the IDE
+	if(!error) {
+		frame[2] = frame[3] = 0;
+	}
+
+	if(!error && targeted) {
+		// remap global destination node id to the local one of its target
+		const unsigned dest = frame[6] | (frame[7] << 8);
+		std::map< unsigned, std::pair<HttpDashelTarget *, unsigned> >::iterator query = nodeIds.find(dest);
+		if(query != nodeIds.end()) {
+			HttpDashelTarget *target = query->second.first;
+			const unsigned localNodeId = query->second.second;
+			frame[6] = uint8_t(localNodeId);
+			frame[7] = uint8_t(localNodeId >> 8);
+
+			try {
+				target->getStream()->write(&frame[0], frame.size());
+				target->getStream()->flush();
+			} catch(Dashel::DashelException e) {
+				cerr << "Error while sending WebSocket message to stream " << target->getStream() << " of target " << target->getAddress() << endl;
+			}
+		} else {
+			error = "error unknown node";
+		}
+	} else if(!error) {
+		map<Dashel::Stream *, HttpDashelTarget *>::const_iterator end = targets.end();
+		for(map<Dashel::Stream *, HttpDashelTarget *>::const_iterator iter = targets.begin(); iter != end; ++iter) {
+			try {
+				iter->first->write(&frame[0], frame.size());
+				iter->first->flush();
+			} catch(Dashel::DashelException e) {
+				cerr << "Error while sending WebSocket message to stream " << iter->first << " of target " << iter->second->getAddress() << endl;
+			}
+		}
+	}
+
+	if(error) {
+		if(verbose) {
+			cerr << connection.stream << " Rejected WebSocket message: " << error << endl;
+		}
+		sendWebSocketFrame(connection, WebSocketFrame::OPCODE_TEXT, reinterpret_cast<const uint8_t *>(error), strlen(error));
+	}
+}
+
+void HttpInterface::notifyWebSocketSubscribers(const Message *message, uint64_t traceId)
+{
+	// the frame is only built if at least one client wants it
+	vector<uint8_t> frame;
+
+	map<Dashel::Stream *, HttpConnection>::iterator end = httpConnections.end();
+	for(map<Dashel::Stream *, HttpConnection>::iterator iter = httpConnections.begin(); iter != end; ++iter) {
+		HttpConnection& connection = iter->second;
+
+		if(connection.webSocket != nullptr && connection.webSocket->isSubscribed(message)) {
+			if(frame.empty()) {
+				vector<uint8_t> raw;
+				message->serialize(raw);
+				WebSocketFrame::encode(frame, WebSocketFrame::OPCODE_BINARY, &raw[0], raw.size());
+			}
+			if(tracer != nullptr) {
+				tracer->record(traceId, Tracer::ENQUEUE, connection.stream);
+			}
+
+			try {
+				connection.webSocket->send(connection.stream, message, frame);
+			} catch(Dashel::DashelException e) {
+				if(verbose) {
+					cerr << connection.stream << " Failed to send WebSocket message: " << e.what() << endl;
+				}
+				closingHttpConnections.insert(connection.stream);
+			}
+		}
+	}
+}
+
+void HttpInterface::sendWebSocketFrame(HttpConnection& connection, WebSocketFrame::Opcode opcode, const uint8_t *payload, size_t length)
+{
+	vector<uint8_t> frame;
+	WebSocketFrame::encode(frame, opcode, payload, length);
+
+	try {
+		connection.stream->write(&frame[0], frame.size());
+		connection.stream->flush();
+	} catch(Dashel::DashelException e) {
+		if(verbose) {
+			cerr << connection.stream << " Failed to send WebSocket frame: " << e.what() << endl;
+		}
+		closingHttpConnections.insert(connection.stream);
+	}
+}
+
+void HttpInterface::stepWebSockets()
+{
+	const UnifiedTime now;
+
+	map<Dashel::Stream *, HttpConnection>::iterator end = httpConnections.end();
+	for(map<Dashel::Stream *, HttpConnection>::iterator iter = httpConnections.begin(); iter != end; ++iter) {
+		HttpConnection& connection = iter->second;
+		if(connection.webSocket == nullptr) {
+			continue;
+		}
+
+		// poll subscribed variables, the answers are forwarded as they arrive
+		vector<WebSocketSession::VariablesRange>& ranges = connection.webSocket->getVariablesRanges();
+		for(vector<WebSocketSession::VariablesRange>::iterator range = ranges.begin(); range != ranges.end(); ++range) {
+			if(range->period == 0 || (now - range->lastRequest).value < range->period) {
+				continue;
+			}
+			range->lastRequest = now;
+
+			std::map< unsigned, std::pair<HttpDashelTarget *, unsigned> >::iterator query = nodeIds.find(range->nodeId);
+			if(query != nodeIds.end()) {
+				HttpDashelTarget *target = query->second.first;
+				try {
+					GetVariables(query->second.second, range->start, range->length).serialize(target->getStream());
+					target->getStream()->flush();
+				} catch(Dashel::DashelException e) {
+					cerr << "Error while requesting variables from stream " << target->getStream() << " of target " << target->getAddress() << endl;
+				}
+			}
+		}
+
+		try {
+			connection.webSocket->flushPending(connection.stream);
+		} catch(Dashel::DashelException e) {
+			if(verbose) {
+				cerr << connection.stream << " Failed to send WebSocket message: " << e.what() << endl;
+			}
+			closingHttpConnections.insert(connection.stream);
+		}
+	}
+}
+
 const std::string HttpInterface::defaultProgram = "<!DOCTYPE aesl-source><network><keywords flag=\"true\"/><node nodeId=\"1\" name=\"thymio-II\"></node></network>\n";
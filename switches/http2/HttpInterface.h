@@ -22,11 +22,16 @@
 #define ASEBA_HTTP_INTERFACE
 
 #include <deque>
+#include <list>
 #include <string>
 #include <map>
 #include <set>
+#include <unordered_map>
 #include <dashel/dashel.h>
 #include "../../common/msg/NodesManager.h"
+#include "../../common/msg/Metrics.h"
+#include "../../common/msg/Snapshot.h"
+#include "../../common/msg/Tracer.h"
 #include "../../common/utils/utils.h"
 
 #include "AeslProgram.h"
@@ -34,6 +39,9 @@
 #include "HttpHandler.h"
 #include "HttpRequest.h"
 #include "HttpResponse.h"
+#include "LatencyStatistics.h"
+#include "WebSocket.h"
+#include "WorkerPool.h"
 
 namespace Aseba { namespace Http
 {
@@ -60,6 +68,14 @@ namespace Aseba { namespace Http
 	 *  - user messages: are reacted to if there were incoming HTTP requests for events
 	 *  - error messages: are reacted to if there were incoming HTTP requests for execution events (divison by zero, etc.)
 	 *
+	 * HTTP connections to /ws can be upgraded to WebSocket connections, which carry raw Aseba messages in binary frames
+	 * in both directions. Each WebSocket client subscribes to the events and variables it wants to receive, and the
+	 * rate of its messages is limited by the interface (see WebSocketSession).
+	 *
+	 * Slow request processing, such as compiling programs, is done by a pool of worker threads (see WorkerPool), so that
+	 * switching messages is not delayed by it. The duration of the processing stages is measured and reported at
+	 * /latency.
+	 *
 	 * The HTTP interface is also able to distribute an AESL program received over HTTP to its network. In that case, it
 	 * is assumed that all nodes share the AESL file and different code entries are provided for the different nodes to
 	 * be programmed.
@@ -67,13 +83,25 @@ namespace Aseba { namespace Http
 	class HttpInterface : public Dashel::Hub, public RootHttpHandler
 	{
 		public:
+			struct PendingSnapshot {
+				Dashel::Stream *stream;
+				uint64_t requestId; // id of the request to respond to, which may be gone (see getPendingRequest())
+				uint32_t since; // id of the base snapshot, 0 for a full snapshot
+				VariablesSnapshot snapshot;
+				std::map<unsigned, HttpDashelTarget *> targets; // target through which each node was requested, by global id
+			};
+
 			struct HttpConnection {
+				HttpConnection() : stream(nullptr), webSocket(nullptr) { }
+
 				Dashel::Stream *stream;
-				std::deque<DashelHttpRequest *> queue;
+				std::deque<DashelHttpRequest *> queue; // pipelined requests, answered in order
+				UnifiedTime lastActivity; // when the last request was received or the last response sent
 				std::set<std::string> eventSubscriptions;
+				WebSocketSession *webSocket; // non-null once upgraded to a WebSocket connection, owned
 			};
 
-			HttpInterface(const std::string& httpPort = "3000");
+			HttpInterface(const std::string& httpPort = "3000", unsigned workersCount = 2);
 			virtual ~HttpInterface();
 
 			/**
@@ -110,10 +138,21 @@ namespace Aseba { namespace Http
 			virtual void addEventSubscription(HttpRequest *request, const std::string& subscription);
 
 			/**
-			 * Registers a node on the HTTP interface with its target and its local node id. This method will remap the id
-			 * to a non-colliding global node id and return it.
+			 * Turns the HTTP connection of a request into a WebSocket connection, once the response to the request has
+			 * been sent. Further data on the connection are handled as WebSocket frames.
+			 */
+			virtual void upgradeToWebSocket(HttpRequest *request);
+
+			/**
+			 * Sets the maximum number of messages per second exchanged with each WebSocket client in each direction.
+			 */
+			virtual void setWebSocketRateLimit(unsigned rate) { webSocketRateLimit = rate; }
+
+			/**
+			 * Registers a node on the HTTP interface with its target, its local node id and its name. This method will
+			 * remap the id to a non-colliding global node id and return it.
 			 */
-			virtual unsigned registerNode(HttpDashelTarget *target, unsigned localNodeId);
+			virtual unsigned registerNode(HttpDashelTarget *target, unsigned localNodeId, const std::string& name);
 
 			virtual void setVerbose(bool verbose) { this->verbose = verbose; }
 			virtual bool isVerbose() const { return verbose; }
@@ -124,7 +163,43 @@ namespace Aseba { namespace Http
 			 * problem that has occurred.
 			 */
 			virtual bool runProgram(std::string& errorString);
-			virtual void setProgram(const AeslProgram& program) { this->program = program; }
+
+			/**
+			 * Like runProgram(), but compiles the code entries on the worker pool and responds to request once all
+			 * nodes have been programmed, with the description of the problem if one has occurred.
+			 */
+			virtual void runProgramAsync(HttpRequest *request);
+
+			/**
+			 * Returns the request with id that is still waiting for its response on the HTTP connection of stream, or
+			 * nullptr if the connection was closed or the request answered in the meanwhile. Matching by id rather than
+			 * by address ensures a new request allocated at the address of a discarded one is not answered instead.
+			 */
+			virtual DashelHttpRequest *getPendingRequest(Dashel::Stream *stream, uint64_t requestId) const;
+
+			/**
+			 * Requests the whole variables memory of nodes, which must have complete descriptions, and responds to
+			 * request with a binary snapshot of it once all replies have arrived (see VariablesSnapshot). If since is the
+			 * id of one of the last snapshots, only the words that changed since are sent.
+			 */
+			virtual void requestSnapshot(HttpRequest *request, const std::set< std::pair<HttpDashelTarget *, const HttpDashelTarget::Node *> >& nodes, uint32_t since);
+
+			/**
+			 * Returns the duration statistics of all processing stages, as a JSON object keyed by stage name
+			 */
+			virtual std::string getLatenciesJson() const;
+
+			/**
+			 * Records the hops of Aseba messages relayed by the interface into tracer, or stops tracing if tracer is null.
+			 */
+			virtual void setTracer(Tracer *tracer) { this->tracer = tracer; }
+
+			/**
+			 * Returns the traffic counters of the Aseba targets, the pending HTTP responses and the connected clients in
+			 * the Prometheus text format.
+			 */
+			virtual std::string getMetricsText();
+			virtual void setProgram(const AeslProgram& program);
 			virtual const AeslProgram& getProgram() const { return program; }
 
 			virtual std::set< std::pair<HttpDashelTarget *, const HttpDashelTarget::Node *> > getNodesByName(const std::string& name);
@@ -138,6 +213,12 @@ namespace Aseba { namespace Http
 			virtual void connectionClosed(Dashel::Stream *stream, bool abnormal);
 			virtual void incomingData(Dashel::Stream *stream);
 
+			/**
+			 * Handles a message received from the given target and relays it to the other streams, with its source
+			 * remapped to a global node id.
+			 */
+			virtual void relayTargetMessage(HttpDashelTarget *target, Dashel::Stream *stream, Message *message, size_t size, uint64_t traceId);
+
 			/**
 			 * Sends all queued responses for HTTP requests. This method does not actually handle the requests, it simply
 			 * sends out the responses that were queued from elsewhere.
@@ -145,22 +226,48 @@ namespace Aseba { namespace Http
 			virtual void sendHttpResponses();
 
 			virtual void closeClosingHttpConnections();
+
+			/**
+			 * Closes the persistent HTTP connections that have been idle for longer than their keep-alive timeout.
+			 */
+			virtual void closeIdleHttpConnections();
 			virtual void closeHttpConnection(HttpConnection& connection);
 
 			virtual void incomingVariables(HttpDashelTarget *target, const Variables *variables);
+			virtual void respondSnapshot(PendingSnapshot& pending);
 			virtual void incomingUserMessage(HttpDashelTarget *target, const UserMessage *userMessage);
 			virtual void incomingErrorMessage(HttpDashelTarget *target, const Message *message);
 
+			virtual void incomingWebSocketFrame(HttpConnection& connection);
+			virtual void injectWebSocketMessage(HttpConnection& connection, std::vector<uint8_t>& frame);
+			virtual void notifyWebSocketSubscribers(const Message *message, uint64_t traceId);
+			virtual void sendWebSocketFrame(HttpConnection& connection, WebSocketFrame::Opcode opcode, const uint8_t *payload, size_t length);
+
+			/**
+			 * Requests the variables WebSocket clients subscribed to periodically, and sends the messages that were
+			 * delayed by rate limiting.
+			 */
+			virtual void stepWebSockets();
+
 		private:
 			bool verbose;
+			unsigned webSocketRateLimit;
+			WorkerPool workers;
+			std::map<std::string, LatencyStatistics> latencies;
+			Tracer *tracer;
+			Metrics metrics;
 			AeslProgram program;
 			Dashel::Stream *httpStream;
 			std::map<Dashel::Stream *, HttpConnection> httpConnections;
+			uint64_t lastRequestId;
 			std::set<Dashel::Stream *> closingHttpConnections;
 			std::map<std::string, Dashel::Stream *> targetAddressStreams;
 			std::map<std::string, UnifiedTime> targetAddressReconnectionTime;
 			std::map<Dashel::Stream *, HttpDashelTarget *> targets;
 			std::map< unsigned, std::pair<HttpDashelTarget *, unsigned> > nodeIds;
+			std::unordered_multimap<std::string, unsigned> nodeNames; // global node ids by node name
+			std::list<PendingSnapshot> pendingSnapshots;
+			SnapshotHistory snapshotHistory;
 
 			static const std::string defaultProgram;
 
@@ -19,6 +19,7 @@
 */
 
 #include <algorithm>
+#include <functional>
 #include <iostream>
 #include <sstream>
 #include <map>
@@ -32,14 +33,21 @@ using Aseba::Http::EventsHandler;
 using Aseba::Http::HttpDashelTarget;
 using Aseba::Http::HttpInterface;
 using Aseba::Http::InterfaceHttpHandler;
+using Aseba::Http::LatencyHandler;
 using Aseba::Http::LoadHandler;
+using Aseba::Http::MetricsHandler;
 using Aseba::Http::NodeInfoHandler;
 using Aseba::Http::NodesHandler;
 using Aseba::Http::OptionsHandler;
 using Aseba::Http::ResetHandler;
+using Aseba::Http::SnapshotHandler;
 using Aseba::Http::VariableOrEventHandler;
+using Aseba::Http::WebSocketFrame;
+using Aseba::Http::WebSocketHandler;
 using std::cerr;
 using std::endl;
+using std::istringstream;
+using std::make_pair;
 using std::map;
 using std::pair;
 using std::set;
@@ -119,6 +127,144 @@ void EventsHandler::handleRequest(HttpRequest *request, const std::vector<std::s
 	}
 }
 
+WebSocketHandler::WebSocketHandler(HttpInterface *interface) :
+	InterfaceHttpHandler(interface)
+{
+	addToken("ws");
+}
+
+WebSocketHandler::~WebSocketHandler()
+{
+
+}
+
+void WebSocketHandler::handleRequest(HttpRequest *request, const std::vector<std::string>& tokens)
+{
+	string upgrade(request->getHeader("Upgrade"));
+	std::transform(upgrade.begin(), upgrade.end(), upgrade.begin(), ::tolower);
+	const string key(request->getHeader("Sec-WebSocket-Key"));
+
+	if(request->getMethod() != "GET" || request->getProtocol() != "HTTP/1.1" || upgrade != "websocket" || key.empty()) {
+		request->respond().setStatus(HttpResponse::HTTP_STATUS_BAD_REQUEST);
+		request->respond().setContent("Expected a WebSocket opening handshake");
+		return;
+	}
+
+	if(request->getHeader("Sec-WebSocket-Version") != "13") {
+		request->respond().setStatus(HttpResponse::HTTP_STATUS_BAD_REQUEST);
+		request->respond().setHeader("Sec-WebSocket-Version", "13");
+		return;
+	}
+
+	request->respond().setStatus(HttpResponse::HTTP_STATUS_SWITCHING_PROTOCOLS);
+	request->respond().setHeader("Upgrade", "websocket");
+	request->respond().setHeader("Connection", "Upgrade");
+	request->respond().setHeader("Sec-WebSocket-Accept", WebSocketFrame::acceptKey(key));
+
+	getInterface()->upgradeToWebSocket(request);
+}
+
+LatencyHandler::LatencyHandler(HttpInterface *interface) :
+	InterfaceHttpHandler(interface)
+{
+	addToken("latency");
+}
+
+LatencyHandler::~LatencyHandler()
+{
+
+}
+
+void LatencyHandler::handleRequest(HttpRequest *request, const std::vector<std::string>& tokens)
+{
+	request->respond().setContent(getInterface()->getLatenciesJson());
+}
+
+MetricsHandler::MetricsHandler(HttpInterface *interface) :
+	InterfaceHttpHandler(interface)
+{
+	addToken("metrics");
+}
+
+MetricsHandler::~MetricsHandler()
+{
+
+}
+
+void MetricsHandler::handleRequest(HttpRequest *request, const std::vector<std::string>& tokens)
+{
+	request->respond().setHeader("Content-Type", "text/plain; version=0.0.4");
+	request->respond().setContent(getInterface()->getMetricsText());
+}
+
+SnapshotHandler::SnapshotHandler(HttpInterface *interface) :
+	InterfaceHttpHandler(interface)
+{
+	addToken("snapshot");
+}
+
+SnapshotHandler::~SnapshotHandler()
+{
+
+}
+
+void SnapshotHandler::handleRequest(HttpRequest *request, const std::vector<std::string>& tokens)
+{
+	vector<string>::const_iterator nodesBegin = tokens.begin() + 1;
+	uint32_t since = 0;
+	if(tokens.size() >= 3 && tokens[1] == "since") {
+		istringstream sinceStream(tokens[2]);
+		if(!(sinceStream >> since)) {
+			request->respond().setStatus(HttpResponse::HTTP_STATUS_BAD_REQUEST);
+			request->respond().setContent("Invalid snapshot id " + tokens[2]);
+			return;
+		}
+		nodesBegin += 2;
+	}
+
+	set< pair<HttpDashelTarget *, const HttpDashelTarget::Node *> > nodes;
+	if(nodesBegin == tokens.end()) { // all nodes whose description is known
+		std::map<Dashel::Stream *, HttpDashelTarget *>& targets = getInterface()->getTargets();
+		std::map<Dashel::Stream *, HttpDashelTarget *>::iterator end = targets.end();
+		for(std::map<Dashel::Stream *, HttpDashelTarget *>::iterator iter = targets.begin(); iter != end; ++iter) {
+			HttpDashelTarget *target = iter->second;
+
+			const std::map<unsigned, HttpDashelTarget::Node>& targetNodes = target->getNodes();
+			std::map<unsigned, HttpDashelTarget::Node>::const_iterator nodesEnd = targetNodes.end();
+			for(std::map<unsigned, HttpDashelTarget::Node>::const_iterator nodesIter = targetNodes.begin(); nodesIter != nodesEnd; ++nodesIter) {
+				bool ok;
+				target->getDescription(nodesIter->second.localId, &ok);
+				if(ok) {
+					nodes.insert(make_pair(target, &nodesIter->second));
+				}
+			}
+		}
+	} else {
+		for(vector<string>::const_iterator i = nodesBegin; i != tokens.end(); ++i) {
+			set< pair<HttpDashelTarget *, const HttpDashelTarget::Node *> > matchingNodes = getInterface()->getNodesByNameOrId(*i);
+			if(matchingNodes.empty()) {
+				request->respond().setStatus(HttpResponse::HTTP_STATUS_NOT_FOUND);
+				request->respond().setContent("No node " + *i);
+				return;
+			}
+
+			set< pair<HttpDashelTarget *, const HttpDashelTarget::Node *> >::iterator end = matchingNodes.end();
+			for(set< pair<HttpDashelTarget *, const HttpDashelTarget::Node *> >::iterator iter = matchingNodes.begin(); iter != end; ++iter) {
+				bool ok;
+				iter->first->getDescription(iter->second->localId, &ok);
+				if(!ok) {
+					request->respond().setStatus(HttpResponse::HTTP_STATUS_INTERNAL_SERVER_ERROR);
+					request->respond().setContent("Description of node " + iter->second->name + " is not complete");
+					return;
+				}
+				nodes.insert(*iter);
+			}
+		}
+	}
+
+	getInterface()->requestSnapshot(request, nodes, since);
+}
+
 ResetHandler::ResetHandler(HttpInterface *interface) :
 	InterfaceHttpHandler(interface)
 {
@@ -217,13 +363,8 @@ void LoadHandler::handleRequest(HttpRequest *request, const std::vector<std::str
 		if(program.isLoaded()) {
 			getInterface()->setProgram(program);
 
-			std::string errorString;
-			if(getInterface()->runProgram(errorString)) {
-				request->respond();
-			} else {
-				request->respond().setStatus(HttpResponse::HTTP_STATUS_BAD_REQUEST);
-				request->respond().setContent(errorString);
-			}
+			// compiling can take long, the response is sent once all nodes are programmed
+			getInterface()->runProgramAsync(request);
 		} else {
 			request->respond().setStatus(HttpResponse::HTTP_STATUS_BAD_REQUEST);
 			request->respond().setContent("Failed to parse provided AESL file");
@@ -255,6 +396,7 @@ void NodeInfoHandler::handleRequest(HttpRequest *request, const std::vector<std:
 	int n = (int) tokens.size();
 
 	vector<string> parts;
+	string content;
 
 	if(n == 0) { // list all nodes
 		std::map<Dashel::Stream *, HttpDashelTarget *>& targets = getInterface()->getTargets();
@@ -275,21 +417,23 @@ void NodeInfoHandler::handleRequest(HttpRequest *request, const std::vector<std:
 					part << "{\"node\":" << node.globalId << ",\"name\":\"" << node.name << "\",\"protocolVersion\":" << description->protocolVersion << "}";
 					parts.push_back(part.str());
 				} else {
-					stringstream errorStream;
-					errorStream << "Target " << target->getAddress() << " failed to get description for node " << node.globalId << " (" << node.name << ")";
-
-					request->respond().setStatus(HttpResponse::HTTP_STATUS_INTERNAL_SERVER_ERROR);
-					request->respond().setContent(errorStream.str());
-
-					if(getInterface()->isVerbose()) {
-						cerr << errorStream.str() << endl;
-					}
+					reportMissingDescription(request, target, node);
 				}
 			}
 		}
+
+		content = "[" + join(parts, ",") + "]";
+		if(request->respond().getStatus() == HttpResponse::HTTP_STATUS_OK && request->respond().setEntityTag(toHexString(std::hash<string>()(content)))) {
+			return;
+		}
 	} else {
 		const CommonDefinitions& commonDefinitions = getInterface()->getProgram().getCommonDefinitions();
 
+		// descriptions are cached by their targets, only assemble them
+		vector<const string *> descriptions;
+		size_t contentSize = 2;
+		size_t entityHash = 0;
+
 		for(int i = 0; i < n; i++) {
 			set< pair<HttpDashelTarget *, const HttpDashelTarget::Node *> > matchingNodes = getInterface()->getNodesByNameOrId(tokens[i]);
 			set< pair<HttpDashelTarget *, const HttpDashelTarget::Node *> >::iterator end = matchingNodes.end();
@@ -297,78 +441,55 @@ void NodeInfoHandler::handleRequest(HttpRequest *request, const std::vector<std:
 				HttpDashelTarget *target = iter->first;
 				const HttpDashelTarget::Node& node = *(iter->second);
 
-				bool ok;
-				const TargetDescription *description = target->getDescription(node.localId, &ok);
+				size_t hash;
+				const string *description = target->getNodeDescriptionJson(node.globalId, commonDefinitions, &hash);
 
-				if(ok) {
-					std::stringstream part;
-					part << "{\"node\":" << node.globalId;
-					part << ",\"name\":\"" << node.name << "\"";
-					part << ",\"protocolVersion\":" << description->protocolVersion;
-					part << ",\"bytecodeSize\":" << description->bytecodeSize;
-					part << ",\"variablesSize\":" << description->variablesSize;
-					part << ",\"stackSize\":" << description->stackSize;
-
-					// named variables
-					part << ",\"namedVariables\":{";
-					bool seenNamedVariables = false;
-					VariablesMap::const_iterator vmEnd = node.variablesMap.end();
-					for(VariablesMap::const_iterator vmIter = node.variablesMap.begin(); vmIter != vmEnd; ++vmIter) {
-						part << (vmIter == node.variablesMap.begin() ? "" : ",") << "\"" << WStringToUTF8(vmIter->first) << "\":" << vmIter->second.second;
-						seenNamedVariables = true;
-					}
-					if(!seenNamedVariables) {
-						// failsafe: if compiler hasn't found any variables, get them from the node description
-						int numVariables = description->namedVariables.size();
-						for(int j = 0; j < numVariables; j++) {
-							part << (j == 0 ? "" : ",") << "\"" << WStringToUTF8(description->namedVariables[j].name) << "\":" << description->namedVariables[j].size;
-						}
-					}
-					part << "}";
-
-					// local events variables
-					part << ",\"localEvents\":{";
-					int numEvents = (int) description->localEvents.size();
-					for(int j = 0; j < numEvents; j++) {
-						part << (j == 0 ? "" : ",") << "\"" << WStringToUTF8(description->localEvents[j].name) << "\":" << "\"" << WStringToUTF8(description->localEvents[j].description) << "\"";
-					}
-					part << "}";
-
-					// constants from introspection
-					part << ",\"constants\":{";
-					int numConstants = (int) commonDefinitions.constants.size();
-					for(int j = 0; j < numConstants; j++) {
-						part << (j == 0 ? "" : ",") << "\"" << WStringToUTF8(commonDefinitions.constants[j].name) << "\":" << commonDefinitions.constants[j].value;
-					}
-					part << "}";
-
-					// events from introspection
-					part << ",\"events\":{";
-					int numCommonEvents = commonDefinitions.events.size();
-					for(int j = 0; j < numCommonEvents; j++) {
-						part << (j == 0 ? "" : ",") << "\"" << WStringToUTF8(commonDefinitions.events[j].name) << "\":" << commonDefinitions.events[j].value;
-					}
-					part << "}";
-
-					part << "}"; // end node
-
-					parts.push_back(part.str());
+				if(description) {
+					descriptions.push_back(description);
+					contentSize += description->size() + 1;
+					entityHash = entityHash * 31 + hash;
 				} else {
-					stringstream errorStream;
-					errorStream << "Target " << target->getAddress() << " failed to get description for node " << node.globalId << " (" << node.name << ")";
+					reportMissingDescription(request, target, node);
+				}
+			}
+		}
 
-					request->respond().setStatus(HttpResponse::HTTP_STATUS_INTERNAL_SERVER_ERROR);
-					request->respond().setContent(errorStream.str());
+		if(request->respond().getStatus() == HttpResponse::HTTP_STATUS_OK && request->respond().setEntityTag(toHexString(entityHash) + "-" + toHexString(descriptions.size()))) {
+			return;
+		}
 
-					if(getInterface()->isVerbose()) {
-						cerr << errorStream.str() << endl;
-					}
-				}
+		content.reserve(contentSize);
+		content += '[';
+		for(size_t i = 0; i < descriptions.size(); ++i) {
+			if(i != 0) {
+				content += ',';
 			}
+			content += *descriptions[i];
 		}
+		content += ']';
+	}
+
+	request->respond().setContent(content);
+}
+
+void NodeInfoHandler::reportMissingDescription(HttpRequest *request, HttpDashelTarget *target, const HttpDashelTarget::Node& node)
+{
+	stringstream errorStream;
+	errorStream << "Target " << target->getAddress() << " failed to get description for node " << node.globalId << " (" << node.name << ")";
+
+	request->respond().setStatus(HttpResponse::HTTP_STATUS_INTERNAL_SERVER_ERROR);
+	request->respond().setContent(errorStream.str());
+
+	if(getInterface()->isVerbose()) {
+		cerr << errorStream.str() << endl;
 	}
+}
 
-	request->respond().setContent("[" + join(parts, ",") + "]");
+string NodeInfoHandler::toHexString(size_t value)
+{
+	stringstream stream;
+	stream << std::hex << value;
+	return stream.str();
 }
 
 VariableOrEventHandler::VariableOrEventHandler(HttpInterface *interface) :
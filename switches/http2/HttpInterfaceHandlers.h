@@ -21,6 +21,7 @@
 #ifndef ASEBA_HTTP_INTERFACE_HANDLERS
 #define ASEBA_HTTP_INTERFACE_HANDLERS
 
+#include "HttpDashelTarget.h"
 #include "HttpHandler.h"
 
 namespace Aseba { namespace Http
@@ -54,6 +55,55 @@ namespace Aseba { namespace Http
 			virtual void handleRequest(HttpRequest *request, const std::vector<std::string>& tokens);
 	};
 
+	/**
+	 * Upgrades connections requesting /ws to WebSocket connections, see HttpInterface
+	 */
+	class WebSocketHandler : public TokenHttpHandler, public InterfaceHttpHandler
+	{
+		public:
+			WebSocketHandler(HttpInterface *interface);
+			virtual ~WebSocketHandler();
+
+			virtual void handleRequest(HttpRequest *request, const std::vector<std::string>& tokens);
+	};
+
+	/**
+	 * Reports the duration of the processing stages of the interface
+	 */
+	class LatencyHandler : public TokenHttpHandler, public InterfaceHttpHandler
+	{
+		public:
+			LatencyHandler(HttpInterface *interface);
+			virtual ~LatencyHandler();
+
+			virtual void handleRequest(HttpRequest *request, const std::vector<std::string>& tokens);
+	};
+
+	/**
+	 * Reports the traffic counters of the interface in the Prometheus text format
+	 */
+	class MetricsHandler : public TokenHttpHandler, public InterfaceHttpHandler
+	{
+		public:
+			MetricsHandler(HttpInterface *interface);
+			virtual ~MetricsHandler();
+
+			virtual void handleRequest(HttpRequest *request, const std::vector<std::string>& tokens);
+	};
+
+	/**
+	 * Responds with a binary snapshot of the memory of all nodes, or of the nodes given by name or id, optionally
+	 * as the difference from a previous snapshot: /snapshot[/since/<id>][/<node>...]
+	 */
+	class SnapshotHandler : public TokenHttpHandler, public InterfaceHttpHandler
+	{
+		public:
+			SnapshotHandler(HttpInterface *interface);
+			virtual ~SnapshotHandler();
+
+			virtual void handleRequest(HttpRequest *request, const std::vector<std::string>& tokens);
+	};
+
 	class ResetHandler : public TokenHttpHandler, public InterfaceHttpHandler
 	{
 		public:
@@ -81,6 +131,10 @@ namespace Aseba { namespace Http
 
 			virtual bool checkIfResponsible(HttpRequest *request, const std::vector<std::string>& tokens) const;
 			virtual void handleRequest(HttpRequest *request, const std::vector<std::string>& tokens);
+
+		private:
+			void reportMissingDescription(HttpRequest *request, HttpDashelTarget *target, const HttpDashelTarget::Node& node);
+			static std::string toHexString(size_t value);
 	};
 
 	class VariableOrEventHandler : public virtual WildcardHttpHandler, public virtual InterfaceHttpHandler
@@ -18,6 +18,8 @@
 	along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <cctype>
 #include <iostream>
 #include "HttpRequest.h"
 #include "HttpResponse.h"
@@ -82,6 +84,45 @@ bool HttpRequest::receive()
 	return true;
 }
 
+namespace
+{
+	// return s in lower case, header names and connection options are case-insensitive
+	string toLower(string s)
+	{
+		std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+		return s;
+	}
+}
+
+std::string HttpRequest::getHeader(const std::string& header) const
+{
+	map<string, string>::const_iterator query = headers.find(header);
+	if(query != headers.end()) {
+		return query->second;
+	}
+
+	// clients are free to choose the case of header names
+	const string lowerHeader(toLower(header));
+	map<string, string>::const_iterator end = headers.end();
+	for(query = headers.begin(); query != end; ++query) {
+		if(toLower(query->first) == lowerHeader) {
+			return query->second;
+		}
+	}
+
+	return "";
+}
+
+bool HttpRequest::isPersistent() const
+{
+	const string connection(toLower(getHeader("Connection")));
+	if(protocol == "HTTP/1.1") {
+		return connection.find("close") == string::npos;
+	} else {
+		return connection.find("keep-alive") != string::npos;
+	}
+}
+
 HttpResponse& HttpRequest::respond()
 {
 	if(response == nullptr) {
@@ -148,11 +189,11 @@ bool HttpRequest::readHeaders()
 			break;
 		}
 
-		size_t firstColon = headerLine.find(": ");
+		size_t firstColon = headerLine.find(':');
 
-		if(firstColon != string::npos) {
+		if(firstColon != string::npos && firstColon > 0) {
 			string header = headerLine.substr(0, firstColon);
-			string value = headerLine.substr(firstColon + 2);
+			string value = trim(headerLine.substr(firstColon + 1));
 
 			headers[header] = value;
 		} else {
@@ -169,7 +210,7 @@ bool HttpRequest::readHeaders()
 bool HttpRequest::readContent()
 {
 	// to make our life easier, we will require the presence of Content-Length in order to parse content
-	int contentLength = atoi(headers["Content-Length"].c_str());
+	int contentLength = atoi(getHeader("Content-Length").c_str());
 	contentLength = (contentLength > CONTENT_BYTES_LIMIT) ? CONTENT_BYTES_LIMIT : contentLength; // truncate at limit
 
 	if(contentLength > 0) {
@@ -184,8 +225,9 @@ bool HttpRequest::readContent()
 	return true;
 }
 
-DashelHttpRequest::DashelHttpRequest(Dashel::Stream *stream_) :
-	stream(stream_)
+DashelHttpRequest::DashelHttpRequest(Dashel::Stream *stream_, uint64_t id_) :
+	stream(stream_),
+	id(id_)
 {
 
 
@@ -23,6 +23,7 @@
 
 #include <map>
 #include <string>
+#include <stdint.h>
 #include <vector>
 #include <dashel/dashel.h>
 
@@ -74,15 +75,17 @@ namespace Aseba { namespace Http
 			virtual const std::map<std::string, std::string>& getHeaders() const { return headers; }
 			virtual const std::string& getContent() const { return content; }
 
-			std::string getHeader(const std::string& header) const {
-				std::map<std::string, std::string>::const_iterator query = headers.find(header);
+			/**
+			 * Returns the value of a header, whose name is matched case-insensitively, or an empty string if the
+			 * request doesn't have this header.
+			 */
+			std::string getHeader(const std::string& header) const;
 
-				if(query != headers.end()) {
-					return query->second;
-				} else {
-					return "";
-				}
-			}
+			/**
+			 * Returns whether the connection stays open after the response to this request, which is the default
+			 * for HTTP/1.1 unless the client asks to close it, and only on request for HTTP/1.0.
+			 */
+			virtual bool isPersistent() const;
 
 		protected:
 			virtual bool readRequestLine();
@@ -120,11 +123,17 @@ namespace Aseba { namespace Http
 	class DashelHttpRequest : public HttpRequest
 	{
 		public:
-    		DashelHttpRequest(Dashel::Stream *stream);
+    		DashelHttpRequest(Dashel::Stream *stream, uint64_t id = 0);
 			virtual ~DashelHttpRequest();
 
 			virtual Dashel::Stream *getStream() { return stream; }
 
+			/**
+			 * Returns the id given by the HTTP interface, which increases with every request and is never reused,
+			 * unlike the address of the request.
+			 */
+			virtual uint64_t getId() const { return id; }
+
 		protected:
 			virtual HttpResponse *createResponse();
 
@@ -133,6 +142,7 @@ namespace Aseba { namespace Http
 
 		private:
 			Dashel::Stream *stream;
+			const uint64_t id;
 	};
 } }
 
@@ -39,8 +39,12 @@ HttpResponse::HttpResponse(const HttpRequest *originatingRequest_) :
 	setHeader("Content-Type", "application/json");
 	setHeader("Access-Control-Allow-Origin", "*");
 
-	if(originatingRequest->getHeader("Connection") == "keep-alive") {
+	// HTTP/1.1 connections are persistent by default, other cases have to be told explicitly
+	if(!originatingRequest->isPersistent()) {
+		setHeader("Connection", "close");
+	} else if(originatingRequest->getProtocol() != "HTTP/1.1") {
 		setHeader("Connection", "keep-alive");
+		setHeader("Keep-Alive", "timeout=" + std::to_string(KEEP_ALIVE_TIMEOUT));
 	}
 }
 
@@ -57,17 +61,35 @@ void HttpResponse::send()
 	addStatusReply(reply);
 	addHeadersReply(reply);
 
+	// send content payload second, a not modified response has none, in the same write so that
+	// pipelined responses are not split into several packets
+	if(status != HTTP_STATUS_NOT_MODIFIED) {
+		reply << content;
+	}
+
 	std::string replyString(reply.str());
 	writeRaw(replyString.c_str(), replyString.size());
 
-	// send content payload second
-	writeRaw(content.c_str(), content.size());
-
 	if(verbose) {
 		cerr << getOriginatingRequest() << " Sent HTTP response with status " << status << " and " << content.size() << " byte(s) payload" << endl;
 	}
 }
 
+bool HttpResponse::setEntityTag(const std::string& entityTag)
+{
+	const string quotedTag("\"" + entityTag + "\"");
+	setHeader("ETag", quotedTag);
+	setHeader("Cache-Control", "no-cache"); // clients must revalidate, which is cheap
+
+	const string ifNoneMatch(originatingRequest->getHeader("If-None-Match"));
+	if(ifNoneMatch == "*" || (!ifNoneMatch.empty() && ifNoneMatch.find(quotedTag) != string::npos)) {
+		setStatus(HTTP_STATUS_NOT_MODIFIED);
+		content.clear();
+		return true;
+	}
+	return false;
+}
+
 void HttpResponse::addStatusReply(std::ostringstream& reply)
 {
 	if(originatingRequest->getProtocol() == "HTTP/1.0" || originatingRequest->getProtocol() == "HTTP/1.1") {
@@ -79,12 +101,18 @@ void HttpResponse::addStatusReply(std::ostringstream& reply)
 	reply << " " << status << " ";
 
 	switch(status) {
+		case HTTP_STATUS_SWITCHING_PROTOCOLS:
+			reply << "Switching Protocols";
+		break;
 		case HTTP_STATUS_OK:
 			reply << "OK";
 		break;
 		case HTTP_STATUS_CREATED:
 			reply << "Created";
 		break;
+		case HTTP_STATUS_NOT_MODIFIED:
+			reply << "Not Modified";
+		break;
 		case HTTP_STATUS_BAD_REQUEST:
 			reply << "Bad Request";
 		break;
@@ -119,7 +147,7 @@ void HttpResponse::addHeadersReply(std::ostringstream& reply)
 	map<string, string>::const_iterator end = headers.end();
 	for(map<string, string>::const_iterator iter = headers.begin(); iter != end; ++iter) {
 		if(iter->first == "Content-Length") { // override with actual size
-			if(getHeader("Content-Type") != "text/event-stream") { // but only if this is not an event stream
+			if(getHeader("Content-Type") != "text/event-stream" && status != HTTP_STATUS_NOT_MODIFIED && status != HTTP_STATUS_SWITCHING_PROTOCOLS) { // but only if this response has content
 				reply << iter->first << ": " << content.size() << "\r\n";
 			}
 		} else {
@@ -38,8 +38,10 @@ namespace Aseba { namespace Http
 	{
 		public:
 			typedef enum {
+				HTTP_STATUS_SWITCHING_PROTOCOLS = 101,
 				HTTP_STATUS_OK = 200,
 				HTTP_STATUS_CREATED = 201,
+				HTTP_STATUS_NOT_MODIFIED = 304,
 				HTTP_STATUS_BAD_REQUEST = 400,
 				HTTP_STATUS_FORBIDDEN = 403,
 				HTTP_STATUS_NOT_FOUND = 404,
@@ -49,6 +51,9 @@ namespace Aseba { namespace Http
 				HTTP_STATUS_SERVICE_UNAVAILABLE = 503,
 			} HttpStatus;
 
+			// how long persistent connections are kept open without requests, in seconds
+			static const int KEEP_ALIVE_TIMEOUT = 60;
+
 			HttpResponse(const HttpRequest *originatingRequest);
 			virtual ~HttpResponse();
 
@@ -67,6 +72,13 @@ namespace Aseba { namespace Http
 			virtual void setContent(const std::string& content) { this->content = content; }
 			virtual const std::string& getContent() const { return content; }
 
+			/**
+			 * Sets the entity tag of the response content. If the originating request already has this version of
+			 * the content, as told by its If-None-Match header, the status is set to 304 Not Modified, no content is
+			 * sent, and true is returned so that the caller can skip producing the content.
+			 */
+			virtual bool setEntityTag(const std::string& entityTag);
+
 			std::string getHeader(const std::string& header) const {
 				std::map<std::string, std::string>::const_iterator query = headers.find(header);
 
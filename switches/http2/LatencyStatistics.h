@@ -0,0 +1,72 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_HTTP_LATENCY_STATISTICS
+#define ASEBA_HTTP_LATENCY_STATISTICS
+
+#include <chrono>
+#include <sstream>
+#include <string>
+
+namespace Aseba { namespace Http
+{
+	/**
+	 * Count, mean and maximum of the durations of a processing stage. Not thread-safe, stages are recorded from the
+	 * thread running the interface.
+	 */
+	class LatencyStatistics
+	{
+		public:
+			typedef std::chrono::steady_clock Clock;
+
+			LatencyStatistics() : count(0), total(Clock::duration::zero()), maximum(Clock::duration::zero()) { }
+
+			void add(Clock::duration duration)
+			{
+				count++;
+				total += duration;
+				if(duration > maximum) {
+					maximum = duration;
+				}
+			}
+
+			/**
+			 * Returns {"count":n,"meanUs":mean,"maxUs":maximum}, durations in microseconds.
+			 */
+			std::string toJson() const
+			{
+				using std::chrono::duration_cast;
+				using std::chrono::microseconds;
+
+				std::ostringstream json;
+				json << "{\"count\":" << count;
+				json << ",\"meanUs\":" << (count ? duration_cast<microseconds>(total).count() / count : 0);
+				json << ",\"maxUs\":" << duration_cast<microseconds>(maximum).count() << "}";
+				return json.str();
+			}
+
+		private:
+			unsigned long long count;
+			Clock::duration total;
+			Clock::duration maximum;
+	};
+} }
+
+#endif
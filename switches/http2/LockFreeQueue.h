@@ -0,0 +1,129 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_HTTP_LOCK_FREE_QUEUE
+#define ASEBA_HTTP_LOCK_FREE_QUEUE
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+
+namespace Aseba { namespace Http
+{
+	/**
+	 * Bounded multi-producer multi-consumer queue that never blocks nor takes a lock: push() fails when the queue is
+	 * full and pop() fails when it is empty. Each cell carries a sequence number telling whether it is ready to be
+	 * written or read in the current lap around the ring, so producers and consumers only contend on one atomic
+	 * position each. Capacity must be a power of two.
+	 *
+	 * This design is free of ABA: positions only grow, and every reuse of a cell advances its sequence by a full lap.
+	 * A thread holding a stale position therefore sees a sequence that does not match and reloads the position, and
+	 * its compare-and-swap cannot succeed unless it stalled while the positions wrapped around the whole range of
+	 * size_t.
+	 */
+	template<typename T>
+	class LockFreeQueue
+	{
+		public:
+			explicit LockFreeQueue(size_t capacity) :
+				cells(new Cell[capacity]),
+				mask(capacity - 1),
+				enqueuePos(0),
+				dequeuePos(0)
+			{
+				assert(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+				for(size_t i = 0; i < capacity; ++i) {
+					cells[i].sequence.store(i, std::memory_order_relaxed);
+				}
+			}
+
+			/**
+			 * Appends value to the queue, returns false if the queue is full.
+			 */
+			bool push(const T& value)
+			{
+				size_t pos = enqueuePos.load(std::memory_order_relaxed);
+				while(true) {
+					Cell& cell = cells[pos & mask];
+					const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+					const ptrdiff_t difference = ptrdiff_t(sequence) - ptrdiff_t(pos);
+					if(difference == 0) {
+						if(enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+							cell.value = value;
+							cell.sequence.store(pos + 1, std::memory_order_release);
+							return true;
+						}
+					} else if(difference < 0) {
+						return false;
+					} else {
+						pos = enqueuePos.load(std::memory_order_relaxed);
+					}
+				}
+			}
+
+			/**
+			 * Removes the oldest value of the queue into value, returns false if the queue is empty.
+			 */
+			bool pop(T& value)
+			{
+				size_t pos = dequeuePos.load(std::memory_order_relaxed);
+				while(true) {
+					Cell& cell = cells[pos & mask];
+					const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+					const ptrdiff_t difference = ptrdiff_t(sequence) - ptrdiff_t(pos + 1);
+					if(difference == 0) {
+						if(dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+							value = cell.value;
+							cell.sequence.store(pos + mask + 1, std::memory_order_release);
+							return true;
+						}
+					} else if(difference < 0) {
+						return false;
+					} else {
+						pos = dequeuePos.load(std::memory_order_relaxed);
+					}
+				}
+			}
+
+		private:
+			struct Cell {
+				std::atomic<size_t> sequence;
+				T value;
+			};
+
+			LockFreeQueue(const LockFreeQueue&);
+			LockFreeQueue& operator=(const LockFreeQueue&);
+
+			enum { CACHE_LINE_SIZE = 64 };
+
+			const std::unique_ptr<Cell[]> cells;
+			const size_t mask;
+			// positions on separate cache lines, so that producers and consumers do not slow each other down;
+			// padded rather than aligned, so that objects holding a queue can be allocated with a plain new
+			char padding0[CACHE_LINE_SIZE];
+			std::atomic<size_t> enqueuePos;
+			char padding1[CACHE_LINE_SIZE];
+			std::atomic<size_t> dequeuePos;
+			char padding2[CACHE_LINE_SIZE];
+	};
+} }
+
+#endif
@@ -0,0 +1,312 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include "WebSocket.h"
+
+using Aseba::Http::WebSocketFrame;
+using Aseba::Http::WebSocketSession;
+using std::istringstream;
+using std::min;
+using std::string;
+using std::vector;
+
+namespace
+{
+	// SHA-1 of data, as specified by FIPS 180-4, only used for the opening handshake
+	vector<uint8_t> sha1(const string& data)
+	{
+		uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+		// pad message to a multiple of 64 bytes, with its length in bits at the end
+		vector<uint8_t> message(data.begin(), data.end());
+		const uint64_t bitLength = uint64_t(data.size()) * 8;
+		message.push_back(0x80);
+		while(message.size() % 64 != 56) {
+			message.push_back(0);
+		}
+		for(int i = 7; i >= 0; --i) {
+			message.push_back(uint8_t(bitLength >> (i * 8)));
+		}
+
+		for(size_t chunk = 0; chunk < message.size(); chunk += 64) {
+			uint32_t w[80];
+			for(int i = 0; i < 16; ++i) {
+				w[i] = (uint32_t(message[chunk + 4*i]) << 24) | (uint32_t(message[chunk + 4*i + 1]) << 16) | (uint32_t(message[chunk + 4*i + 2]) << 8) | uint32_t(message[chunk + 4*i + 3]);
+			}
+			for(int i = 16; i < 80; ++i) {
+				const uint32_t v = w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16];
+				w[i] = (v << 1) | (v >> 31);
+			}
+
+			uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+			for(int i = 0; i < 80; ++i) {
+				uint32_t f, k;
+				if(i < 20) {
+					f = (b & c) | (~b & d);
+					k = 0x5A827999;
+				} else if(i < 40) {
+					f = b ^ c ^ d;
+					k = 0x6ED9EBA1;
+				} else if(i < 60) {
+					f = (b & c) | (b & d) | (c & d);
+					k = 0x8F1BBCDC;
+				} else {
+					f = b ^ c ^ d;
+					k = 0xCA62C1D6;
+				}
+				const uint32_t temp = ((a << 5) | (a >> 27)) + f + e + k + w[i];
+				e = d;
+				d = c;
+				c = (b << 30) | (b >> 2);
+				b = a;
+				a = temp;
+			}
+			h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+		}
+
+		vector<uint8_t> digest;
+		for(int i = 0; i < 5; ++i) {
+			for(int j = 3; j >= 0; --j) {
+				digest.push_back(uint8_t(h[i] >> (j * 8)));
+			}
+		}
+		return digest;
+	}
+
+	string base64(const vector<uint8_t>& data)
+	{
+		static const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+		string result;
+		for(size_t i = 0; i < data.size(); i += 3) {
+			const uint32_t v = (uint32_t(data[i]) << 16) | (i + 1 < data.size() ? uint32_t(data[i + 1]) << 8 : 0) | (i + 2 < data.size() ? uint32_t(data[i + 2]) : 0);
+			result += alphabet[(v >> 18) & 0x3f];
+			result += alphabet[(v >> 12) & 0x3f];
+			result += i + 1 < data.size() ? alphabet[(v >> 6) & 0x3f] : '=';
+			result += i + 2 < data.size() ? alphabet[v & 0x3f] : '=';
+		}
+		return result;
+	}
+}
+
+bool WebSocketFrame::receive(Dashel::Stream *stream)
+{
+	uint8_t header[2];
+	stream->read(header, 2);
+
+	final = (header[0] & 0x80) != 0;
+	opcode = Opcode(header[0] & 0x0f);
+
+	// clients must mask their frames
+	if((header[1] & 0x80) == 0) {
+		return false;
+	}
+
+	uint64_t length = header[1] & 0x7f;
+	if(length == 126) {
+		uint8_t extended[2];
+		stream->read(extended, 2);
+		length = (uint64_t(extended[0]) << 8) | extended[1];
+	} else if(length == 127) {
+		uint8_t extended[8];
+		stream->read(extended, 8);
+		length = 0;
+		for(int i = 0; i < 8; ++i) {
+			length = (length << 8) | extended[i];
+		}
+	}
+	if(length > PAYLOAD_BYTES_LIMIT) {
+		return false;
+	}
+
+	uint8_t mask[4];
+	stream->read(mask, 4);
+
+	payload.resize(length);
+	if(length) {
+		stream->read(&payload[0], length);
+	}
+	for(size_t i = 0; i < payload.size(); ++i) {
+		payload[i] ^= mask[i % 4];
+	}
+
+	return true;
+}
+
+void WebSocketFrame::encode(std::vector<uint8_t>& buffer, Opcode opcode, const uint8_t *payload, size_t length)
+{
+	buffer.push_back(0x80 | opcode);
+	if(length < 126) {
+		buffer.push_back(uint8_t(length));
+	} else if(length <= 0xffff) {
+		buffer.push_back(126);
+		buffer.push_back(uint8_t(length >> 8));
+		buffer.push_back(uint8_t(length));
+	} else {
+		buffer.push_back(127);
+		for(int i = 7; i >= 0; --i) {
+			buffer.push_back(uint8_t(uint64_t(length) >> (i * 8)));
+		}
+	}
+	buffer.insert(buffer.end(), payload, payload + length);
+}
+
+std::string WebSocketFrame::acceptKey(const std::string& clientKey)
+{
+	return base64(sha1(clientKey + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"));
+}
+
+WebSocketSession::WebSocketSession(unsigned maxRate_) :
+	maxRate(maxRate_),
+	rate(maxRate_),
+	droppedCount(0),
+	allEvents(false)
+{
+	outgoingTokens.tokens = rate;
+	incomingTokens.tokens = rate;
+}
+
+std::string WebSocketSession::executeCommand(const std::string& command)
+{
+	istringstream is(command);
+	string verb;
+	is >> verb;
+
+	if(verb == "events") {
+		std::set<uint16_t> newEvents;
+		bool newAllEvents = false;
+		string token;
+		while(is >> token) {
+			if(token == "*") {
+				newAllEvents = true;
+			} else {
+				char *end;
+				const unsigned long id = strtoul(token.c_str(), &end, 10);
+				if(*end != 0 || id >= 0x8000) {
+					return "error invalid event id " + token;
+				}
+				newEvents.insert(uint16_t(id));
+			}
+		}
+		allEvents = newAllEvents;
+		events.swap(newEvents);
+	} else if(verb == "variables") {
+		VariablesRange range;
+		if(!(is >> range.nodeId >> range.start >> range.length) || range.length == 0) {
+			return "error expected node start length [period]";
+		}
+		range.period = 0;
+		is >> range.period;
+		range.lastRequest = UnifiedTime(0);
+		variablesRanges.push_back(range);
+	} else if(verb == "novariables") {
+		variablesRanges.clear();
+	} else if(verb == "rate") {
+		unsigned newRate;
+		if(!(is >> newRate) || newRate == 0) {
+			return "error expected a positive rate";
+		}
+		rate = min(newRate, maxRate);
+	} else {
+		return "error unknown command " + verb;
+	}
+
+	return "ok";
+}
+
+bool WebSocketSession::isSubscribed(const Message *message) const
+{
+	if(message->type < 0x8000) {
+		return allEvents || events.find(message->type) != events.end();
+	}
+
+	const Variables *variables(dynamic_cast<const Variables *>(message));
+	if(variables != nullptr) {
+		const unsigned start = variables->start;
+		const unsigned end = start + variables->variables.size();
+		for(vector<VariablesRange>::const_iterator iter = variablesRanges.begin(); iter != variablesRanges.end(); ++iter) {
+			if(iter->nodeId == variables->source && start < iter->start + iter->length && iter->start < end) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+bool WebSocketSession::acceptIncoming()
+{
+	if(consume(incomingTokens)) {
+		return true;
+	}
+
+	droppedCount++;
+	return false;
+}
+
+void WebSocketSession::send(Dashel::Stream *stream, const Message *message, const std::vector<uint8_t>& frame)
+{
+	const uint64_t key(pendingKey(message));
+
+	// keep ordering per kind of message: if one is already waiting, replace it
+	if(pending.find(key) == pending.end() && consume(outgoingTokens)) {
+		stream->write(&frame[0], frame.size());
+		stream->flush();
+	} else {
+		pending[key] = frame;
+	}
+}
+
+void WebSocketSession::flushPending(Dashel::Stream *stream)
+{
+	bool written = false;
+	while(!pending.empty() && consume(outgoingTokens)) {
+		const vector<uint8_t>& frame(pending.begin()->second);
+		stream->write(&frame[0], frame.size());
+		pending.erase(pending.begin());
+		written = true;
+	}
+	if(written) {
+		stream->flush();
+	}
+}
+
+bool WebSocketSession::consume(TokenBucket& bucket)
+{
+	// refill the bucket at rate tokens per second, allowing bursts of one second of messages
+	const UnifiedTime now;
+	bucket.tokens = min(double(rate), bucket.tokens + double((now - bucket.lastRefill).value) * rate / 1000.);
+	bucket.lastRefill = now;
+
+	if(bucket.tokens >= 1) {
+		bucket.tokens -= 1;
+		return true;
+	}
+	return false;
+}
+
+uint64_t WebSocketSession::pendingKey(const Message *message)
+{
+	const Variables *variables(dynamic_cast<const Variables *>(message));
+	const uint16_t start = variables != nullptr ? variables->start : 0;
+	return (uint64_t(message->type) << 32) | (uint64_t(message->source) << 16) | start;
+}
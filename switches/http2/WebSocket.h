@@ -0,0 +1,153 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_HTTP_WEB_SOCKET
+#define ASEBA_HTTP_WEB_SOCKET
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <dashel/dashel.h>
+#include "../../common/msg/msg.h"
+#include "../../common/utils/utils.h"
+
+namespace Aseba { namespace Http
+{
+	/**
+	 * Minimal RFC 6455 framing, enough to talk to browsers: unfragmented text and binary messages, ping, pong and
+	 * close. Frames sent by the server are never masked, frames received from clients are always unmasked.
+	 */
+	class WebSocketFrame
+	{
+		public:
+			typedef enum {
+				OPCODE_CONTINUATION = 0x0,
+				OPCODE_TEXT = 0x1,
+				OPCODE_BINARY = 0x2,
+				OPCODE_CLOSE = 0x8,
+				OPCODE_PING = 0x9,
+				OPCODE_PONG = 0xA,
+			} Opcode;
+
+			static const size_t PAYLOAD_BYTES_LIMIT = 65536;
+
+			WebSocketFrame() : final(true), opcode(OPCODE_BINARY) { }
+
+			/**
+			 * Reads one frame from stream and unmasks its payload.
+			 *
+			 * Returns false if the frame is malformed or exceeds PAYLOAD_BYTES_LIMIT.
+			 */
+			bool receive(Dashel::Stream *stream);
+
+			/**
+			 * Appends a complete unmasked frame with the given opcode and payload to buffer.
+			 */
+			static void encode(std::vector<uint8_t>& buffer, Opcode opcode, const uint8_t *payload, size_t length);
+
+			/**
+			 * Returns the Sec-WebSocket-Accept value answering a client's Sec-WebSocket-Key.
+			 */
+			static std::string acceptKey(const std::string& clientKey);
+
+			bool final;
+			Opcode opcode;
+			std::vector<uint8_t> payload;
+	};
+
+	/**
+	 * State of one WebSocket client of the HTTP interface: which Aseba messages it subscribed to, and a token bucket
+	 * limiting the rate of messages in both directions.
+	 *
+	 * Subscriptions are set by text messages from the client, each answered by "ok" or "error <reason>":
+	 *  - "events *" or "events id..." selects the user events to forward by id, "events" alone forwards none
+	 *  - "variables node start length [period]" forwards Variables messages of node overlapping this range, and if
+	 *    period (in ms) is given, requests these variables from the node at that period
+	 *  - "novariables" removes all variable ranges
+	 *  - "rate n" limits messages to n per second, within the limit of the server
+	 *
+	 * Outgoing messages exceeding the rate are not dropped, instead only the latest message of each kind (event id, or
+	 * node and variables start) is kept until the rate allows it to be sent.
+	 */
+	class WebSocketSession
+	{
+		public:
+			struct VariablesRange {
+				unsigned nodeId;
+				unsigned start;
+				unsigned length;
+				unsigned period;
+				UnifiedTime lastRequest;
+			};
+
+			WebSocketSession(unsigned maxRate);
+
+			/**
+			 * Executes a text command from the client and returns the reply to send back.
+			 */
+			std::string executeCommand(const std::string& command);
+
+			/**
+			 * Returns whether message, with its source remapped to a global node id, was subscribed to.
+			 */
+			bool isSubscribed(const Message *message) const;
+
+			/**
+			 * Consumes a token for an incoming message from the client, returns false if it must be dropped.
+			 */
+			bool acceptIncoming();
+
+			/**
+			 * Sends frame for message to stream if the rate allows it, else keeps it until flushPending() can.
+			 */
+			void send(Dashel::Stream *stream, const Message *message, const std::vector<uint8_t>& frame);
+
+			/**
+			 * Sends as many pending frames as the rate allows.
+			 */
+			void flushPending(Dashel::Stream *stream);
+
+			std::vector<VariablesRange>& getVariablesRanges() { return variablesRanges; }
+			unsigned getDroppedCount() const { return droppedCount; }
+
+		private:
+			struct TokenBucket {
+				double tokens;
+				UnifiedTime lastRefill;
+			};
+
+			bool consume(TokenBucket& bucket);
+			static uint64_t pendingKey(const Message *message);
+
+			const unsigned maxRate;
+			unsigned rate;
+			TokenBucket outgoingTokens;
+			TokenBucket incomingTokens;
+			unsigned droppedCount;
+
+			bool allEvents;
+			std::set<uint16_t> events;
+			std::vector<VariablesRange> variablesRanges;
+			std::map< uint64_t, std::vector<uint8_t> > pending;
+	};
+} }
+
+#endif
@@ -0,0 +1,131 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "WorkerPool.h"
+
+using Aseba::Http::LatencyStatistics;
+using Aseba::Http::WorkerPool;
+
+WorkerPool::WorkerPool(unsigned threadsCount, size_t capacity_) :
+	capacity(capacity_),
+	queued(capacity_),
+	finished(capacity_),
+	pendingCount(0),
+	queuedCount(0),
+	running(true)
+{
+	for(unsigned i = 0; i < threadsCount; ++i) {
+		threads.push_back(std::thread(&WorkerPool::workerLoop, this));
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(idleMutex);
+		running = false;
+	}
+	idleCondition.notify_all();
+
+	for(size_t i = 0; i < threads.size(); ++i) {
+		threads[i].join();
+	}
+
+	// discard jobs that were not completed
+	Job *job;
+	while(queued.pop(job)) {
+		delete job;
+	}
+	while(finished.pop(job)) {
+		delete job;
+	}
+}
+
+bool WorkerPool::submit(Job *job)
+{
+	// at most capacity jobs are pending, so neither queue can overflow
+	if(pendingCount.load() >= capacity) {
+		return false;
+	}
+	pendingCount++;
+
+	job->submitted = LatencyStatistics::Clock::now();
+
+	if(threads.empty()) {
+		// no worker, run immediately
+		job->started = job->submitted;
+		job->run();
+		job->finished = LatencyStatistics::Clock::now();
+		finished.push(job);
+		return true;
+	}
+
+	queued.push(job);
+	{
+		std::lock_guard<std::mutex> lock(idleMutex);
+		queuedCount++;
+	}
+	idleCondition.notify_one();
+
+	return true;
+}
+
+unsigned WorkerPool::runCompletions()
+{
+	unsigned count = 0;
+
+	Job *job;
+	while(finished.pop(job)) {
+		pendingCount--;
+		queueLatency.add(job->started - job->submitted);
+		runLatency.add(job->finished - job->started);
+
+		job->complete();
+		delete job;
+		count++;
+	}
+
+	return count;
+}
+
+void WorkerPool::workerLoop()
+{
+	while(true) {
+		{
+			std::unique_lock<std::mutex> lock(idleMutex);
+			idleCondition.wait(lock, [this] { return !running || queuedCount > 0; });
+			if(!running) {
+				return;
+			}
+			queuedCount--;
+		}
+
+		// a job counted as queued can be briefly invisible if another producer has not finished pushing before it
+		Job *job;
+		while(!queued.pop(job)) {
+			std::this_thread::yield();
+		}
+
+		job->started = LatencyStatistics::Clock::now();
+		job->run();
+		job->finished = LatencyStatistics::Clock::now();
+		finished.push(job);
+	}
+}
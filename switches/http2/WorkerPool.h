@@ -0,0 +1,104 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_HTTP_WORKER_POOL
+#define ASEBA_HTTP_WORKER_POOL
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "LatencyStatistics.h"
+#include "LockFreeQueue.h"
+
+namespace Aseba { namespace Http
+{
+	/**
+	 * A pool of threads running jobs that are too slow to be processed in the thread of the HTTP interface, such as
+	 * compiling programs, so that switching messages on the Aseba network is not delayed by them.
+	 *
+	 * Jobs are passed to the workers and back through lock-free queues. A job runs on a worker thread, and then its
+	 * completion runs on the thread calling runCompletions(), where it may safely access the interface and its streams.
+	 */
+	class WorkerPool
+	{
+		public:
+			class Job
+			{
+				public:
+					virtual ~Job() { }
+
+					//! Do the work, called on a worker thread
+					virtual void run() = 0;
+					//! Use the result of the work, called from runCompletions()
+					virtual void complete() = 0;
+
+				private:
+					friend class WorkerPool;
+					LatencyStatistics::Clock::time_point submitted;
+					LatencyStatistics::Clock::time_point started;
+					LatencyStatistics::Clock::time_point finished;
+			};
+
+			WorkerPool(unsigned threadsCount, size_t capacity = 256);
+			virtual ~WorkerPool();
+
+			/**
+			 * Queues a job and takes ownership of it.
+			 *
+			 * Returns false if too many jobs are pending, in which case the caller keeps ownership of job.
+			 */
+			virtual bool submit(Job *job);
+
+			/**
+			 * Completes and deletes the jobs that have finished running, returns their number.
+			 */
+			virtual unsigned runCompletions();
+
+			virtual unsigned getThreadsCount() const { return (unsigned) threads.size(); }
+			virtual unsigned getPendingCount() const { return pendingCount.load(); }
+			//! Time jobs spent waiting for a worker
+			virtual const LatencyStatistics& getQueueLatency() const { return queueLatency; }
+			//! Time jobs spent running on a worker
+			virtual const LatencyStatistics& getRunLatency() const { return runLatency; }
+
+		private:
+			void workerLoop();
+
+			const size_t capacity;
+			LockFreeQueue<Job *> queued;
+			LockFreeQueue<Job *> finished;
+			std::atomic<unsigned> pendingCount;
+			std::atomic<unsigned> queuedCount;
+			std::atomic<bool> running;
+
+			// only used to let idle workers sleep, jobs never go through a lock
+			std::mutex idleMutex;
+			std::condition_variable idleCondition;
+
+			std::vector<std::thread> threads;
+
+			LatencyStatistics queueLatency;
+			LatencyStatistics runLatency;
+	};
+} }
+
+#endif
@@ -37,6 +37,9 @@ void dumpHelp(std::ostream &stream, const char *programName)
 	stream << "Options:\n";
 	stream << "-v, --verbose   : makes the switch verbose\n";
 	stream << "-p, --port port : listens to incoming connection HTTP on this port\n";
+	stream << "-r, --rate n    : limits WebSocket clients to n messages per second (default: 200)\n";
+	stream << "-w, --workers n : compiles programs using n worker threads (default: 2)\n";
+	stream << "-t, --trace file: writes the latency of each Aseba message to file in Chrome trace format\n";
 	stream << "-K, --Kiter n   : run I/O loop n thousand times (for profiling)\n";
 	stream << "-h, --help      : shows this help\n";
 	stream << "-V, --version   : shows the version number\n";
@@ -61,6 +64,9 @@ int main(int argc, char *argv[])
 	std::vector < std::string > dashelTargetList;
 	bool verbose = false;
 	int Kiterations = -1; // set to > 0 to limit run time e.g. for valgrind
+	int webSocketRateLimit = 200;
+	int workersCount = 2;
+	std::string traceFileName;
 
 	// process command line
 	int argCounter = 1;
@@ -71,6 +77,9 @@ int main(int argc, char *argv[])
 		else if((strcmp(arg, "-h") == 0) || (strcmp(arg, "--help") == 0)) dumpHelp(std::cout, argv[0]), exit(1);
 		else if((strcmp(arg, "-V") == 0) || (strcmp(arg, "--version") == 0)) dumpVersion (std::cout), exit(1);
 		else if((strcmp(arg, "-p") == 0) || (strcmp(arg, "--port") == 0)) httpPort = argv[argCounter++];
+		else if((strcmp(arg, "-r") == 0) || (strcmp(arg, "--rate") == 0)) webSocketRateLimit = atoi(argv[argCounter++]);
+		else if((strcmp(arg, "-w") == 0) || (strcmp(arg, "--workers") == 0)) workersCount = atoi(argv[argCounter++]);
+		else if((strcmp(arg, "-t") == 0) || (strcmp(arg, "--trace") == 0)) traceFileName = argv[argCounter++];
 		else if((strcmp(arg, "-K") == 0) || (strcmp(arg, "--Kiter") == 0)) Kiterations = atoi(argv[argCounter++]);
 		else if(strncmp(arg, "-", 1) != 0) dashelTargetList.push_back(arg);
 	}
@@ -78,10 +87,21 @@ int main(int argc, char *argv[])
 	// initialize Dashel plugins
 	Dashel::initPlugins();
 
+	std::auto_ptr<Aseba::Tracer> tracer;
+	if(!traceFileName.empty()) {
+		tracer.reset(new Aseba::Tracer(traceFileName, "asebahttp2"));
+		if(!tracer->isOpen()) {
+			std::cerr << "Cannot open trace file " << traceFileName << std::endl;
+			return 1;
+		}
+	}
+
 	// create and run bridge, catch Dashel exceptions
 	try {
-		std::auto_ptr<Aseba::Http::HttpInterface> interface(new Aseba::Http::HttpInterface(httpPort));
+		std::auto_ptr<Aseba::Http::HttpInterface> interface(new Aseba::Http::HttpInterface(httpPort, workersCount > 0 ? workersCount : 0));
 		interface->setVerbose(verbose);
+		interface->setWebSocketRateLimit(webSocketRateLimit > 0 ? webSocketRateLimit : 1);
+		interface->setTracer(tracer.get());
 
 		int numTargets = (int) dashelTargetList.size();
 		for(int i = 0; i < numTargets; i++) {
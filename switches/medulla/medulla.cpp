@@ -27,13 +27,15 @@
 #include <valarray>
 #include <vector>
 #include <iterator>
+#include <memory>
 #include "medulla.h"
 #include "../../common/consts.h"
 #include "../../common/types.h"
 #include "../../common/utils/utils.h"
+#include "../../common/utils/AeslReader.h"
 #include "../../transport/dashel_plugins/dashel-plugins.h"
 #include <QDBusMetaType>
-#include <QtXml>
+#include <QFile>
 #include <QtDebug>
 
 #if DASHEL_VERSION_INT < 10003
@@ -112,6 +114,9 @@ namespace Aseba
 	{
 		qDBusRegisterMetaType<Values>();
 		
+		// events batches are unpacked by Hub::incomingData
+		announcedProtocolVersion = ASEBA_EVENTS_BATCH_PROTOCOL_VERSION;
+		
 		//FIXME: here no error handling is done, with system bus these calls can fail	
 		DBusConnectionBus().registerObject("/", hub);
 		DBusConnectionBus().registerService("ch.epfl.mobots.Aseba");
@@ -157,6 +162,23 @@ namespace Aseba
 					break;
 				}
 			}
+			
+			// fill the snapshots waiting for these variables, and reply with the complete ones
+			for (SnapshotRequestsList::iterator it = pendingSnapshots.begin(); it != pendingSnapshots.end();)
+			{
+				SnapshotRequestData* request(*it);
+				if (request->snapshot.received(nodeId, *variables) && request->snapshot.isComplete())
+				{
+					const std::vector<uint8_t> blob(snapshotHistory.encode(request->snapshot, request->since));
+					QDBusMessage &reply(request->reply);
+					reply << QByteArray(reinterpret_cast<const char*>(blob.data()), blob.size());
+					DBusConnectionBus().send(reply);
+					delete request;
+					it = pendingSnapshots.erase(it);
+				}
+				else
+					++it;
+			}
 		}
 		
 		delete message;
@@ -193,96 +215,67 @@ namespace Aseba
 	
 	void AsebaNetworkInterface::LoadScripts(const QString& fileName, const QDBusMessage &message)
 	{
-		QFile file(fileName);
-		if (!file.open(QFile::ReadOnly))
+		if (!QFile::exists(fileName))
 		{
 			DBusConnectionBus().send(message.createErrorReply(QDBusError::InvalidArgs, QString("file %0 does not exists").arg(fileName)));
 			return;
 		}
 		
-		QDomDocument document("aesl-source");
-		QString errorMsg;
-		int errorLine;
-		int errorColumn;
-		if (!document.setContent(&file, false, &errorMsg, &errorLine, &errorColumn))
+		// only keep the code of nodes present in the network
+		int noNodeCount = 0;
+		AeslReader reader;
+		const bool loaded(reader.openFile(QFile::encodeName(fileName).constData(), [&](const std::string& name, unsigned preferedId) {
+			bool ok;
+			getNodeId(UTF8ToWString(name), preferedId, &ok);
+			if (!ok)
+				++noNodeCount;
+			return ok;
+		}));
+		if (!loaded)
 		{
-			DBusConnectionBus().send(message.createErrorReply(QDBusError::Other, QString("Error in XML source file: %0 at line %1, column %2").arg(errorMsg).arg(errorLine).arg(errorColumn)));
+			DBusConnectionBus().send(message.createErrorReply(QDBusError::Other, QString("Error in XML source file: %0").arg(QString::fromUtf8(reader.getError().c_str()))));
 			return;
 		}
 		
-		commonDefinitions.events.clear();
-		commonDefinitions.constants.clear();
+		commonDefinitions = reader.getCommonDefinitions();
 		userDefinedVariablesMap.clear();
 		
-		int noNodeCount = 0;
-		QDomNode domNode = document.documentElement().firstChild();
-		
-		// FIXME: this code depends on event and constants being before any code
 		bool wasError = false;
-		while (!domNode.isNull())
+		for (const auto& node: reader.getNodes())
 		{
-			if (domNode.isElement())
+			bool ok;
+			const unsigned nodeId(getNodeId(UTF8ToWString(node.name), node.preferedId(), &ok));
+			if (!ok)
+				continue;
+			
+			std::wistringstream is(node.wcode());
+			Error error;
+			BytecodeVector bytecode;
+			unsigned allocatedVariablesCount;
+			
+			Compiler compiler;
+			compiler.setTargetDescription(getDescription(nodeId));
+			compiler.setCommonDefinitions(&commonDefinitions);
+			bool result = compiler.compile(is, bytecode, allocatedVariablesCount, error);
+			
+			if (result)
 			{
-				QDomElement element = domNode.toElement();
-				if (element.tagName() == "node")
-				{
-					bool ok;
-					const unsigned nodeId(getNodeId(element.attribute("name").toStdWString(), element.attribute("nodeId", 0).toUInt(), &ok));
-					if (ok)
-					{
-						std::wistringstream is(element.firstChild().toText().data().toStdWString());
-						Error error;
-						BytecodeVector bytecode;
-						unsigned allocatedVariablesCount;
-						
-						Compiler compiler;
-						compiler.setTargetDescription(getDescription(nodeId));
-						compiler.setCommonDefinitions(&commonDefinitions);
-						bool result = compiler.compile(is, bytecode, allocatedVariablesCount, error);
-						
-						if (result)
-						{
-							typedef std::vector<std::unique_ptr<Message>> MessageVector;
-							MessageVector messages;
-							sendBytecode(messages, nodeId, std::vector<uint16_t>(bytecode.begin(), bytecode.end()));
-							for (const auto& message: messages)
-								hub->sendMessage(*message);
-							Run msg(nodeId);
-							hub->sendMessage(msg);
-						}
-						else
-						{
-							DBusConnectionBus().send(message.createErrorReply(QDBusError::Failed, QString::fromStdWString(error.toWString())));
-							wasError = true;
-							break;
-						}
-						// retrieve user-defined variables for use in get/set
-						userDefinedVariablesMap[element.attribute("name")] = *compiler.getVariablesMap();
-					}
-					else
-						noNodeCount++;
-				}
-				else if (element.tagName() == "event")
-				{
-					const QString eventName(element.attribute("name"));
-					const unsigned eventSize(element.attribute("size").toUInt());
-					if (eventSize > ASEBA_MAX_EVENT_ARG_SIZE)
-					{
-						DBusConnectionBus().send(message.createErrorReply(QDBusError::Failed, QString("Event %1 has a length %2 larger than maximum %3").arg(eventName).arg(eventSize).arg(ASEBA_MAX_EVENT_ARG_SIZE)));
-						wasError = true;
-						break;
-					}
-					else
-					{
-						commonDefinitions.events.push_back(NamedValue(eventName.toStdWString(), eventSize));
-					}
-				}
-				else if (element.tagName() == "constant")
-				{
-					commonDefinitions.constants.push_back(NamedValue(element.attribute("name").toStdWString(), element.attribute("value").toInt()));
-				}
+				typedef std::vector<std::unique_ptr<Message>> MessageVector;
+				MessageVector messages;
+				sendBytecode(messages, nodeId, std::vector<uint16_t>(bytecode.begin(), bytecode.end()));
+				for (const auto& message: messages)
+					hub->sendMessage(*message);
+				Run msg(nodeId);
+				hub->sendMessage(msg);
 			}
-			domNode = domNode.nextSibling();
+			else
+			{
+				DBusConnectionBus().send(message.createErrorReply(QDBusError::Failed, QString::fromStdWString(error.toWString())));
+				wasError = true;
+				break;
+			}
+			// retrieve user-defined variables for use in get/set
+			userDefinedVariablesMap[QString::fromUtf8(node.name.c_str())] = *compiler.getVariablesMap();
 		}
 		
 		// check if there was an error
@@ -353,7 +346,7 @@ namespace Aseba
 			// node defined variables
 			const unsigned nodeId(it.value());
 			const NodesMap::const_iterator descIt(nodes.find(nodeId));
-			const Node& description(descIt->second);
+			const TargetDescription& description(descIt->second.getDescription());
 			QStringList list;
 			for (size_t i = 0; i < description.namedVariables.size(); ++i)
 			{
@@ -477,6 +470,65 @@ namespace Aseba
 		return Values();
 	}
 	
+	//! Reply with a binary snapshot of the memory of nodes, or of all nodes if empty, as the difference from snapshot since if it is known
+	QByteArray AsebaNetworkInterface::GetSnapshot(const QStringList& nodeNames, const uint since, const QDBusMessage &message)
+	{
+		// by default, all connected nodes
+		QStringList names(nodeNames);
+		if (names.isEmpty())
+		{
+			for (NodesNamesMap::const_iterator it = nodesNames.begin(); it != nodesNames.end(); ++it)
+				if (nodes.find(it.value())->second.connected)
+					names.push_back(it.key());
+		}
+		
+		// make sure all nodes exist and are fully known
+		SnapshotRequestData *request = new SnapshotRequestData;
+		request->since = since;
+		for (int i = 0; i < names.size(); ++i)
+		{
+			const QString& node(names.at(i));
+			NodesNamesMap::const_iterator nodeIt(nodesNames.find(node));
+			bool ok(false);
+			const TargetDescription* description(0);
+			if (nodeIt != nodesNames.end())
+				description = getDescription(nodeIt.value(), &ok);
+			if (!ok)
+			{
+				DBusConnectionBus().send(message.createErrorReply(QDBusError::InvalidArgs, QString("node %0 does not exists").arg(node)));
+				delete request;
+				return QByteArray();
+			}
+			
+			// user-defined variables include the ones of the node
+			const UserDefinedVariablesMap::const_iterator userVarMapIt(userDefinedVariablesMap.find(node));
+			request->snapshot.addNode(nodeIt.value(), *description, userVarMapIt != userDefinedVariablesMap.end() ? userVarMapIt.value() : VariablesMap());
+		}
+		
+		// send all requests to aseba network at once
+		for (int i = 0; i < names.size(); ++i)
+		{
+			const std::vector<GetVariables> requests(request->snapshot.getRequests(nodesNames.value(names.at(i))));
+			for (size_t j = 0; j < requests.size(); ++j)
+				hub->sendMessage(requests[j]);
+		}
+		
+		// nodes without variables need no reply
+		if (request->snapshot.isComplete())
+		{
+			const std::vector<uint8_t> blob(snapshotHistory.encode(request->snapshot, since));
+			delete request;
+			return QByteArray(reinterpret_cast<const char*>(blob.data()), blob.size());
+		}
+		
+		// build bookkeeping for async reply
+		message.setDelayedReply(true);
+		request->reply = message.createReply();
+		request->errorReply = message.createErrorReply(QDBusError::Failed, "a node disconnected before its memory was received");
+		pendingSnapshots.push_back(request);
+		return QByteArray();
+	}
+	
 	void AsebaNetworkInterface::SendEvent(const uint16_t event, const Values& data)
 	{
 		// send event to DBus listeners
@@ -513,9 +565,26 @@ namespace Aseba
 		hub->sendMessage(message);
 	}
 	
+	void AsebaNetworkInterface::nodeDisconnected(unsigned nodeId)
+	{
+		// the snapshots including this node will never complete, fail them
+		for (SnapshotRequestsList::iterator it = pendingSnapshots.begin(); it != pendingSnapshots.end();)
+		{
+			SnapshotRequestData* request(*it);
+			if (request->snapshot.contains(nodeId))
+			{
+				DBusConnectionBus().send(request->errorReply);
+				delete request;
+				it = pendingSnapshots.erase(it);
+			}
+			else
+				++it;
+		}
+	}
+	
 	void AsebaNetworkInterface::nodeDescriptionReceived(unsigned nodeId)
 	{
-		nodesNames[QString::fromStdWString(nodes[nodeId].name)] = nodeId;
+		nodesNames[QString::fromStdWString(nodes[nodeId].getDescription().name)] = nodeId;
 	}
 
 	inline QDBusConnection AsebaNetworkInterface::DBusConnectionBus() const
@@ -535,7 +604,10 @@ namespace Aseba
 		verbose(verbose),
 		dump(dump),
 		forward(forward),
-		rawTime(rawTime)
+		rawTime(rawTime),
+		tracer(0),
+		capture(0),
+		statsInterval(0)
 	{
 		// TODO: work in progress to remove ugly delay
 		AsebaNetworkInterface* network(new AsebaNetworkInterface(this, systemBus));
@@ -557,6 +629,11 @@ namespace Aseba
 		
 		// Called from the dbus thread, not the Hub thread, need to lock	
 		lock();
+		
+		if (capture)
+			capture->capture(*message, sourceStream);
+		
+		const uint64_t traceId(tracer ? Tracer::messageId(*message) : 0);
 
 		// write on all connected streams
 		for (StreamsSet::iterator it = dataStreams.begin(); it != dataStreams.end();++it)
@@ -568,15 +645,25 @@ namespace Aseba
 			
 			try
 			{
-				message->serialize(destStream);
+				const size_t size(message->serialize(destStream));
+				if (tracer)
+					tracer->record(traceId, Tracer::SERIALIZE, destStream);
 				destStream->flush();
+				if (tracer)
+					tracer->record(traceId, Tracer::FLUSH, destStream);
+				metrics.sent(destStream, *message, size);
 			}
 			catch (DashelException e)
 			{
 				// if this stream has a problem, ignore it for now, and let Hub call connectionClosed later.
 				std::cerr << "error while writing message" << std::endl;
+				metrics.writeError(destStream);
 			}
 		}
+		
+		if (tracer)
+			tracer->tick();
+		metrics.tick(cout, statsInterval);
 
 		unlock();
 	}
@@ -602,7 +689,12 @@ namespace Aseba
 		Message *message(0);
 		try
 		{
-			message = Message::receive(stream);
+			size_t size;
+			message = Message::receive(stream, &size);
+			if (tracer)
+				tracer->record(*message, Tracer::RECEIVE, stream);
+			metrics.received(stream, *message, size);
+			metrics.tick(cout, statsInterval);
 		}
 		catch (DashelException e)
 		{
@@ -610,6 +702,16 @@ namespace Aseba
 			std::cerr << "error while reading message" << std::endl;
 		}
 		
+		// a batch carries several events, send them one by one as the peers might not know batches
+		const EventsBatch *batch(dynamic_cast<const EventsBatch *>(message));
+		if (batch)
+		{
+			for (const UserMessage& event: batch->events)
+				emit messageAvailable(new UserMessage(event), stream);
+			delete message;
+			return;
+		}
+		
 		// send on DBus, the receiver can delete it
 		emit messageAvailable(message, stream);
 	}
@@ -625,6 +727,9 @@ namespace Aseba
 	
 	void Hub::connectionClosed(Stream* stream, bool abnormal)
 	{
+		metrics.closed(stream);
+		if (capture)
+			capture->closed(stream);
 		if (verbose)
 		{
 			dumpTime(cout);
@@ -650,6 +755,9 @@ void dumpHelp(std::ostream &stream, const char *programName)
 	stream << "-p port         : listens to incoming connection on this port\n";
 	stream << "--rawtime       : shows time in the form of sec:usec since 1970\n";
 	stream << "--system        : connects medulla to the system d-bus bus\n";	
+	stream << "--trace file    : writes the latency of each message to file in Chrome trace format\n";
+	stream << "--stats t       : prints a summary of the traffic every t seconds\n";
+	stream << "--capture file  : captures all messages to file, to be decoded later with asebadump --decode\n";
 	stream << "-h, --help      : shows this help\n";
 	stream << "-V, --version   : shows the version number\n";
 	stream << "Additional targets are any valid Dashel targets." << std::endl;
@@ -675,6 +783,9 @@ int main(int argc, char *argv[])
 	bool forward = true;
 	bool rawTime = false;
 	bool systemBus = false;
+	std::string traceFileName;
+	unsigned statsInterval = 0;
+	std::string captureFileName;
 	std::vector<std::string> additionalTargets;
 	
 	int argCounter = 1;
@@ -708,6 +819,21 @@ int main(int argc, char *argv[])
 		{
 			systemBus = true;
 		}
+		else if (strcmp(arg, "--trace") == 0)
+		{
+			arg = argv[++argCounter];
+			traceFileName = arg;
+		}
+		else if (strcmp(arg, "--stats") == 0)
+		{
+			arg = argv[++argCounter];
+			statsInterval = atoi(arg);
+		}
+		else if (strcmp(arg, "--capture") == 0)
+		{
+			arg = argv[++argCounter];
+			captureFileName = arg;
+		}
 		else if ((strcmp(arg, "-h") == 0) || (strcmp(arg, "--help") == 0))
 		{
 			dumpHelp(std::cout, argv[0]);
@@ -725,7 +851,32 @@ int main(int argc, char *argv[])
 		argCounter++;
 	}
 	
+	std::unique_ptr<Aseba::Tracer> tracer;
+	if (!traceFileName.empty())
+	{
+		tracer.reset(new Aseba::Tracer(traceFileName, "asebamedulla"));
+		if (!tracer->isOpen())
+		{
+			std::cerr << "cannot open trace file " << traceFileName << std::endl;
+			return 1;
+		}
+	}
+	
+	std::unique_ptr<Aseba::MessageCapture> capture;
+	if (!captureFileName.empty())
+	{
+		capture.reset(new Aseba::MessageCapture(captureFileName));
+		if (!capture->isOpen())
+		{
+			std::cerr << "cannot open capture file " << captureFileName << std::endl;
+			return 1;
+		}
+	}
+	
 	Aseba::Hub hub(port, verbose, dump, forward, rawTime, systemBus);
+	hub.setTracer(tracer.get());
+	hub.setStatsInterval(statsInterval);
+	hub.setCapture(capture.get());
 	
 	try
 	{
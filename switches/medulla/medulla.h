@@ -32,6 +32,10 @@
 #include <QList>
 #include "../../common/msg/msg.h"
 #include "../../common/msg/NodesManager.h"
+#include "../../common/msg/Tracer.h"
+#include "../../common/msg/Metrics.h"
+#include "../../common/msg/Capture.h"
+#include "../../common/msg/Snapshot.h"
 
 typedef QList<qint16> Values;
 
@@ -89,6 +93,14 @@ namespace Aseba
 				QDBusMessage reply;
 			};
 			
+			struct SnapshotRequestData
+			{
+				VariablesSnapshot snapshot;
+				uint32_t since;
+				QDBusMessage reply;
+				QDBusMessage errorReply; //!< sent if a node disconnects before the snapshot is complete
+			};
+			
 		public:
 			AsebaNetworkInterface(Hub* hub, bool systemBus);
 		
@@ -110,6 +122,7 @@ namespace Aseba
 			QStringList GetVariablesList(const QString& node) const;
 			Q_NOREPLY void SetVariable(const QString& node, const QString& variable, const Values& data, const QDBusMessage &message) const;
 			Values GetVariable(const QString& node, const QString& variable, const QDBusMessage &message);
+			QByteArray GetSnapshot(const QStringList& nodeNames, const uint since, const QDBusMessage &message);
 			Q_NOREPLY void SendEvent(const uint16_t event, const Values& data);
 			Q_NOREPLY void SendEventName(const QString& name, const Values& data, const QDBusMessage &message);
 			QDBusObjectPath CreateEventFilter();
@@ -118,6 +131,7 @@ namespace Aseba
 		protected:
 			virtual void sendMessage(const Message& message);
 			virtual void nodeDescriptionReceived(unsigned nodeId);
+			virtual void nodeDisconnected(unsigned nodeId);
 			QDBusConnection DBusConnectionBus() const;
 			
 		protected:
@@ -129,6 +143,9 @@ namespace Aseba
 			UserDefinedVariablesMap userDefinedVariablesMap;
 			typedef QList<RequestData*> RequestsList;
 			RequestsList pendingReads;
+			typedef QList<SnapshotRequestData*> SnapshotRequestsList;
+			SnapshotRequestsList pendingSnapshots;
+			SnapshotHistory snapshotHistory;
 			typedef QMultiMap<uint16_t, EventFilterInterface*> EventsFiltersMap;
 			EventsFiltersMap eventsFilters;
 			bool systemBus;
@@ -167,6 +184,21 @@ namespace Aseba
 			*/
 			void sendMessage(const Message& message, const Dashel::Stream* sourceStream = 0);
 			
+			/*! Records the latency of messages through the hub into tracer, or stops tracing if tracer is 0.
+				Must be called before the hub is started.
+			*/
+			void setTracer(Tracer* tracer) { this->tracer = tracer; }
+			
+			/*! Captures the messages sent to Dashel peers in binary form into capture, or stops capturing if capture is 0.
+				Must be called before the hub is started.
+			*/
+			void setCapture(MessageCapture* capture) { this->capture = capture; }
+			
+			/*! Prints a summary of the traffic every interval seconds, or never if interval is 0.
+				Must be called before the hub is started.
+			*/
+			void setStatsInterval(unsigned interval) { statsInterval = interval; }
+			
 		signals:
 			void messageAvailable(Message *message, const Dashel::Stream* sourceStream);
 		
@@ -181,6 +213,10 @@ namespace Aseba
 			bool dump; //!< should we dump content of CAN messages
 			bool forward; //!< should we only forward messages instead of transmit them back to the sender
 			bool rawTime; //!< should displayed timestamps be of the form sec:usec since 1970
+			Tracer* tracer; //!< if set, latency tracer of messages, only used with the hub locked
+			Metrics metrics; //!< traffic counters, only used with the hub locked
+			MessageCapture* capture; //!< if set, binary capture of messages, only used with the hub locked
+			unsigned statsInterval; //!< period in s of the traffic summary, 0 to disable it
 	};
 	
 	/*@}*/
@@ -26,6 +26,7 @@
 #include <valarray>
 #include <vector>
 #include <iterator>
+#include <memory>
 #include "switch.h"
 #include "../../transport/dashel_plugins/dashel-plugins.h"
 #include "../../common/consts.h"
@@ -42,14 +43,19 @@ namespace Aseba
 	/*@{*/
 
 	//! Broadcast messages form any data stream to all others data streams including itself.
-	Switch::Switch(unsigned port, bool verbose, bool dump, bool forward, bool rawTime) :
+	Switch::Switch(unsigned port, bool verbose, bool dump, bool forward, bool rawTime, size_t linkMtu, unsigned linkLatency) :
 		#ifdef DASHEL_VERSION_INT
 		Dashel::Hub(verbose || dump),
 		#endif // DASHEL_VERSION_INT
 		verbose(verbose),
 		dump(dump),
 		forward(forward),
-		rawTime(rawTime)
+		rawTime(rawTime),
+		batchSerial(linkMtu != 0),
+		linkLayer(linkMtu, linkLatency),
+		tracer(0),
+		capture(0),
+		statsInterval(0)
 	{
 		ostringstream oss;
 		oss << "tcpin:port=" << port;
@@ -63,11 +69,22 @@ namespace Aseba
 			dumpTime(cout, rawTime);
 			cout << "* Incoming connection from " << stream->getTargetName() << endl;
 		}
+		if (batchSerial && isSerialTarget(stream->getTargetName()))
+		{
+			linkLayer.attach(stream);
+			if (verbose)
+				cout << "* Batching frames to " << stream->getTargetName() << endl;
+		}
 	}
 	
 	void Switch::incomingData(Stream *stream)
 	{
-		Message* message(Message::receive(stream));
+		const Metrics::Clock::time_point received(Metrics::Clock::now());
+		size_t size;
+		Message* message(Message::receive(stream, &size));
+		if (tracer)
+			tracer->record(*message, Tracer::RECEIVE, stream);
+		metrics.received(stream, *message, size);
 		
 		// remap source
 		{
@@ -78,7 +95,9 @@ namespace Aseba
 				message->source = remapIt->second.first;
 		}
 		
-		// if requested, dump
+		// if requested, capture or dump
+		if (capture)
+			capture->capture(*message, stream);
 		if (dump)
 		{
 			dumpTime(cout, rawTime);
@@ -87,13 +106,33 @@ namespace Aseba
 			std::wcout << std::endl;
 		}
 		
-		// write on all connected streams
+		// write on all connected streams, the events of a batch one by one as clients might not know batches
+		const EventsBatch* batch(dynamic_cast<EventsBatch*>(message));
+		if (batch)
+		{
+			for (const UserMessage& event: batch->events)
+			{
+				UserMessage eventCopy(event);
+				eventCopy.source = message->source;
+				forwardMessage(&eventCopy, stream, Metrics::frameSize(eventCopy));
+			}
+		}
+		else
+			forwardMessage(message, stream, size);
+		
+		delete message;
+		
+		metrics.forwarded(Metrics::Clock::now() - received);
+	}
+	
+	void Switch::forwardMessage(Message* message, Stream* sourceStream, size_t size)
+	{
 		CmdMessage* cmdMessage(dynamic_cast<CmdMessage*>(message));
 		for (StreamsSet::iterator it = dataStreams.begin(); it != dataStreams.end();++it)
 		{
 			Stream* destStream = *it;
 			
-			if ((forward) && (destStream == stream))
+			if ((forward) && (destStream == sourceStream))
 				continue;
 			
 			try
@@ -106,24 +145,24 @@ namespace Aseba
 					{
 						const uint16_t oldDest(cmdMessage->dest);
 						cmdMessage->dest = remapIt->second.second;
-						message->serialize(destStream);
+						linkLayer.send(*message, destStream);
+						metrics.sent(destStream, *message, size, !linkLayer.isAttached(destStream));
 						cmdMessage->dest = oldDest;
 					}
 				}
 				else
 				{
-					message->serialize(destStream);
+					linkLayer.send(*message, destStream);
+					metrics.sent(destStream, *message, size, !linkLayer.isAttached(destStream));
 				}
-				destStream->flush();
 			}
 			catch (DashelException e)
 			{
 				// if this stream has a problem, ignore it for now, and let Hub call connectionClosed later.
 				std::cerr << "error while writing" << std::endl;
+				metrics.writeError(destStream);
 			}
 		}
-		
-		delete message;
 	}
 	
 	void Switch::connectionClosed(Stream *stream, bool abnormal)
@@ -135,7 +174,44 @@ namespace Aseba
 				cout << "* Abnormal connection closed to " << stream->getTargetName() << " : " << stream->getFailReason() << endl;
 			else
 				cout << "* Normal connection closed to " << stream->getTargetName() << endl;
+			if (linkLayer.isAttached(stream))
+			{
+				cout << "* Link statistics: ";
+				linkLayer.getStatistics(stream).dump(cout);
+				cout << endl;
+			}
 		}
+		linkLayer.detach(stream);
+		metrics.closed(stream);
+		if (capture)
+			capture->closed(stream);
+	}
+	
+	void Switch::run()
+	{
+		while (true)
+		{
+			int timeout(linkLayer.timeout());
+			// when tracing or printing statistics, wake up at least every second
+			if ((tracer || statsInterval) && (timeout < 0 || timeout > 1000))
+				timeout = 1000;
+			if (!step(timeout))
+				break;
+			linkLayer.flushDue();
+			if (tracer)
+				tracer->tick();
+			if (statsInterval)
+			{
+				metrics.setGauge("link_queue_bytes", linkLayer.queueDepth());
+				metrics.tick(cout, statsInterval);
+			}
+		}
+	}
+	
+	void Switch::setTracer(Tracer* tracer)
+	{
+		this->tracer = tracer;
+		linkLayer.setTracer(tracer);
 	}
 	
 	void Switch::broadcastDummyUserMessage()
@@ -169,6 +245,11 @@ void dumpHelp(std::ostream &stream, const char *programName)
 	stream << "-l, --loop      : makes the switch transmit messages back to the send, not only forward them.\n";
 	stream << "-p port         : listens to incoming connection on this port\n";
 	stream << "--rawtime       : shows time in the form of sec:usec since 1970\n";
+	stream << "--link-mtu n    : batches frames to serial targets into writes of n bytes (e.g. 64 for USB)\n";
+	stream << "--link-latency t: frames to serial targets wait at most t ms in a batch (default: 2)\n";
+	stream << "--trace file    : writes the latency of each message to file in Chrome trace format\n";
+	stream << "--stats t       : prints a summary of the traffic every t seconds\n";
+	stream << "--capture file  : captures all messages to file, to be decoded later with asebadump --decode\n";
 	stream << "-h, --help      : shows this help\n";
 	stream << "-V, --version   : shows the version number\n";
 	stream << "Additional targets are any valid Dashel targets." << std::endl;
@@ -191,6 +272,11 @@ int main(int argc, char *argv[])
 	bool dump = false;
 	bool forward = true;
 	bool rawTime = false;
+	size_t linkMtu = 0;
+	unsigned linkLatency = 2;
+	std::string traceFileName;
+	unsigned statsInterval = 0;
+	std::string captureFileName;
 	std::vector<std::string> additionalTargets;
 	
 	int argCounter = 1;
@@ -226,6 +312,54 @@ int main(int argc, char *argv[])
 		{
 			rawTime = true;
 		}
+		else if (strcmp(arg, "--link-mtu") == 0)
+		{
+			if (argCounter + 1 >= argc)
+			{
+				std::cerr << "link MTU value needed" << std::endl;
+				return 1;
+			}
+			arg = argv[++argCounter];
+			linkMtu = atoi(arg);
+		}
+		else if (strcmp(arg, "--link-latency") == 0)
+		{
+			if (argCounter + 1 >= argc)
+			{
+				std::cerr << "link latency value needed" << std::endl;
+				return 1;
+			}
+			arg = argv[++argCounter];
+			linkLatency = atoi(arg);
+		}
+		else if (strcmp(arg, "--trace") == 0)
+		{
+			if (argCounter + 1 >= argc)
+			{
+				std::cerr << "trace file name needed" << std::endl;
+				return 1;
+			}
+			traceFileName = argv[++argCounter];
+		}
+		else if (strcmp(arg, "--stats") == 0)
+		{
+			if (argCounter + 1 >= argc)
+			{
+				std::cerr << "statistics interval needed" << std::endl;
+				return 1;
+			}
+			arg = argv[++argCounter];
+			statsInterval = atoi(arg);
+		}
+		else if (strcmp(arg, "--capture") == 0)
+		{
+			if (argCounter + 1 >= argc)
+			{
+				std::cerr << "capture file name needed" << std::endl;
+				return 1;
+			}
+			captureFileName = argv[++argCounter];
+		}
 		else if ((strcmp(arg, "-h") == 0) || (strcmp(arg, "--help") == 0))
 		{
 			dumpHelp(std::cout, argv[0]);
@@ -243,9 +377,34 @@ int main(int argc, char *argv[])
 		argCounter++;
 	}
 	
+	std::unique_ptr<Aseba::Tracer> tracer;
+	if (!traceFileName.empty())
+	{
+		tracer.reset(new Aseba::Tracer(traceFileName, "asebaswitch"));
+		if (!tracer->isOpen())
+		{
+			std::cerr << "cannot open trace file " << traceFileName << std::endl;
+			return 1;
+		}
+	}
+	
+	std::unique_ptr<Aseba::MessageCapture> capture;
+	if (!captureFileName.empty())
+	{
+		capture.reset(new Aseba::MessageCapture(captureFileName));
+		if (!capture->isOpen())
+		{
+			std::cerr << "cannot open capture file " << captureFileName << std::endl;
+			return 1;
+		}
+	}
+	
 	try
 	{
-		Aseba::Switch aswitch(port, verbose, dump, forward, rawTime);
+		Aseba::Switch aswitch(port, verbose, dump, forward, rawTime, linkMtu, linkLatency);
+		aswitch.setTracer(tracer.get());
+		aswitch.setStatsInterval(statsInterval);
+		aswitch.setCapture(capture.get());
 		for (size_t i = 0; i < additionalTargets.size(); i++)
 		{
 			const std::string& target(additionalTargets[i]);
@@ -24,6 +24,10 @@
 #include <dashel/dashel.h>
 #include <map>
 #include "../../common/types.h"
+#include "../../common/msg/LinkLayer.h"
+#include "../../common/msg/Tracer.h"
+#include "../../common/msg/Metrics.h"
+#include "../../common/msg/Capture.h"
 
 namespace Aseba
 {
@@ -42,8 +46,25 @@ namespace Aseba
 				@param verbose should we print a notification on each message
 				@param dump should we dump content of each message
 				@param forward should we only forward messages instead of transmit them back to the sender
+				@param linkMtu if non-zero, batch frames sent to serial targets into writes of this size
+				@param linkLatency maximum time in ms a frame to a serial target can wait in the batch
 			*/
-			Switch(unsigned port, bool verbose, bool dump, bool forward, bool rawTime);
+			Switch(unsigned port, bool verbose, bool dump, bool forward, bool rawTime, size_t linkMtu = 0, unsigned linkLatency = 2);
+			
+			/*! Run the switch, writing batched frames when their latency bound expires. */
+			void run();
+			
+			/*! Record the latency of messages through the switch into tracer, or stop tracing if tracer is 0. */
+			void setTracer(Tracer* tracer);
+			
+			/*! Capture all messages in binary form into capture, or stop capturing if capture is 0. */
+			void setCapture(MessageCapture* capture) { this->capture = capture; }
+			
+			/*! Print a summary of the traffic every interval seconds, or never if interval is 0. */
+			void setStatsInterval(unsigned interval) { statsInterval = interval; }
+			
+			/*! Return the traffic metrics of the switch. */
+			Metrics& getMetrics() { return metrics; }
 			
 			/*! Forwards the data received for a connections to the other ones.
 				If forward is false, transmit it back to the sender too.
@@ -65,12 +86,21 @@ namespace Aseba
 			virtual void connectionCreated(Dashel::Stream *stream);
 			virtual void incomingData(Dashel::Stream *stream);
 			virtual void connectionClosed(Dashel::Stream *stream, bool abnormal);
+			//! Write message, of size bytes on the wire, on all connected streams, except sourceStream if forwarding
+			void forwardMessage(Message* message, Dashel::Stream* sourceStream, size_t size);
 
 		private:
 			bool verbose; //!< should we print a notification on each message
 			bool dump; //!< should we dump content of CAN messages
 			bool forward; //!< should we only forward messages instead of transmit them back to the sender
 			bool rawTime; //!< should displayed timestamps be of the form sec:usec since 1970
+			bool batchSerial; //!< should frames to serial targets be batched
+			
+			LinkLayer linkLayer; //!< batching of frames sent to serial targets
+			Tracer* tracer; //!< if set, latency tracer of messages
+			Metrics metrics; //!< traffic counters
+			MessageCapture* capture; //!< if set, binary capture of messages
+			unsigned statsInterval; //!< period in s of the traffic summary, 0 to disable it
 			
 			//! A pair of id: local, target
 			typedef std::pair<uint16_t, uint16_t> IdPair;
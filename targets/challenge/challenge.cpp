@@ -273,7 +273,7 @@ namespace Enki
 			{
 				this->stream = 0;
 				// clear breakpoints
-				vm.breakpointsCount = 0;
+				AsebaVMClearBreakpoints(&vm);
 			}
 			if (abnormal)
 				qDebug() << this << " : Client has disconnected unexpectedly.";
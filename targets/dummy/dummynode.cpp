@@ -27,13 +27,23 @@
 #include "../../common/productids.h"
 #include "../../common/consts.h"
 #include "../../common/utils/utils.h"
+#include "../../common/utils/VMSnapshot.h"
 #include "../../transport/buffer/vm-buffer.h"
+#ifdef ASEBA_DUMMYNODE_AOT
+#include "../../vm/compiled.h"
+#include "../../compiler/bytecode-to-c.h"
+#endif // ASEBA_DUMMYNODE_AOT
+#ifdef ASEBA_DUMMYNODE_JIT
+#include "../../vm/jit.h"
+#endif // ASEBA_DUMMYNODE_JIT
 #include <dashel/dashel.h>
 #include <iostream>
 #include <sstream>
 #include <valarray>
 #include <cassert>
 #include <cstring>
+#include <vector>
+#include <algorithm>
 
 extern AsebaVMDescription nodeDescription;
 
@@ -53,6 +63,14 @@ private:
 		int16_t user[1024];
 	} variables;
 	char mutableName[12];
+#ifdef ASEBA_DUMMYNODE_AOT
+	// bytecode last translated to C, and the result, empty if building it failed
+	std::vector<uint16_t> compiledBytecode;
+	Aseba::CompiledBytecode compiled;
+#endif // ASEBA_DUMMYNODE_AOT
+#ifdef ASEBA_DUMMYNODE_JIT
+	AsebaJit* jit;
+#endif // ASEBA_DUMMYNODE_JIT
 	
 public:
 	// public because accessed from a glue function
@@ -62,6 +80,10 @@ public:
 	Dashel::Stream* stream;
 	// all streams that must be disconnected at next step
 	std::vector<Dashel::Stream*> toDisconnect;
+	// if not empty, file to restore the VM from at startup
+	std::string loadStateFileName;
+	// if not empty, file to save the VM to when the client disconnects
+	std::string saveStateFileName;
 	
 public:
 	
@@ -80,7 +102,19 @@ public:
 		
 		vm.variables = reinterpret_cast<int16_t *>(&variables);
 		vm.variablesSize = sizeof(variables) / sizeof(int16_t);
+		
+#ifdef ASEBA_DUMMYNODE_JIT
+		// compile a region once it has been entered 10 times
+		jit = AsebaJitCreate(10);
+#endif // ASEBA_DUMMYNODE_JIT
+	}
+	
+#ifdef ASEBA_DUMMYNODE_JIT
+	~AsebaNode()
+	{
+		AsebaJitDestroy(jit);
 	}
+#endif // ASEBA_DUMMYNODE_JIT
 	
 	Dashel::Stream* listen(const int port, const int deltaNodeId)
 	{
@@ -105,11 +139,61 @@ public:
 
 		// init VM
 		AsebaVMInit(&vm);
+		if (!loadStateFileName.empty())
+			loadState();
 
 		// return stream
 		return listen_stream;
 	}
 	
+	void loadState()
+	{
+		Aseba::VMSnapshot snapshot;
+		if (!snapshot.load(loadStateFileName) || snapshot.nodes.empty() || !snapshot.nodes[0].restoreVM(&vm))
+			std::cerr << "Cannot restore VM state from " << loadStateFileName << std::endl;
+#ifdef ASEBA_DUMMYNODE_JIT
+		AsebaJitInvalidate(jit);
+#endif // ASEBA_DUMMYNODE_JIT
+	}
+	
+	void saveState() const
+	{
+		// the timer runs on real time, so the glue has no state of its own
+		Aseba::VMSnapshot snapshot;
+		snapshot.nodes.resize(1);
+		snapshot.nodes[0].saveVM(&vm);
+		if (!snapshot.save(saveStateFileName))
+			std::cerr << "Cannot save VM state to " << saveStateFileName << std::endl;
+	}
+	
+#ifdef ASEBA_DUMMYNODE_AOT
+	//! Translate the bytecode to C and build it if it changed since last time
+	void updateCompiled()
+	{
+		if (compiledBytecode.size() == bytecode.size() && std::equal(compiledBytecode.begin(), compiledBytecode.end(), &bytecode[0]))
+			return;
+		compiledBytecode.assign(&bytecode[0], &bytecode[0] + bytecode.size());
+		Aseba::BytecodeVector code;
+		code.insert(code.end(), compiledBytecode.begin(), compiledBytecode.end());
+		if (!compiled.build(code, ASEBA_DUMMYNODE_AOT_INCLUDE_DIR))
+			std::cerr << "Cannot translate bytecode to C, interpreting it: " << compiled.getError() << std::endl;
+	}
+#endif // ASEBA_DUMMYNODE_AOT
+	
+	//! Run the VM, then send the events it emitted
+	void runVM()
+	{
+#if defined(ASEBA_DUMMYNODE_AOT)
+		updateCompiled();
+		AsebaVMRunCompiled(&vm, compiled.getProgram(), 1000);
+#elif defined(ASEBA_DUMMYNODE_JIT)
+		AsebaVMRunJit(&vm, jit, 1000);
+#else
+		AsebaVMRun(&vm, 1000);
+#endif
+		AsebaFlushEvents(&vm);
+	}
+	
 	virtual void connectionCreated(Dashel::Stream *stream)
 	{
 		std::string targetName = stream->getTargetName();
@@ -129,7 +213,10 @@ public:
 	{
 		this->stream = 0;
 		// clear breakpoints
-		vm.breakpointsCount = 0;
+		AsebaVMClearBreakpoints(&vm);
+		
+		if (!saveStateFileName.empty())
+			saveState();
 		
 		if (abnormal)
 			std::cerr << this << " : Client has disconnected unexpectedly." << std::endl;
@@ -154,9 +241,15 @@ public:
 		stream->read(&lastMessageData[0], lastMessageData.size());
 		
 		AsebaProcessIncomingEvents(&vm);
+#ifdef ASEBA_DUMMYNODE_JIT
+		// messages are processed by vm-buffer, so discard machine code here when they set bytecode
+		memcpy(&temp, &lastMessageData[0], 2);
+		if (bswap16(temp) == ASEBA_MESSAGE_SET_BYTECODE)
+			AsebaJitInvalidate(jit);
+#endif // ASEBA_DUMMYNODE_JIT
 		
 		// run VM
-		AsebaVMRun(&vm, 1000);
+		runVM();
 	}
 	
 	void run()
@@ -175,7 +268,7 @@ public:
 						AsebaVMSetupEvent(&vm, ASEBA_EVENT_LOCAL_EVENTS_START-0);
 					
 					// run VM
-					AsebaVMRun(&vm, 1000);
+					runVM();
 					
 					// save current time for next iteration
 					Aseba::UnifiedTime currentTime;
@@ -313,12 +406,14 @@ extern "C" void AsebaAssert(AsebaVMState *vm, AsebaAssertReason reason)
 
 int usage(char* program)
 {
-	std::cerr << "Usage: " << program << " [--port|-p PORT] [ID, from 0 to 9]" << std::endl;
+	std::cerr << "Usage: " << program << " [--port|-p PORT] [--load-state FILE] [--save-state FILE] [ID, from 0 to 9]" << std::endl;
 	std::cerr << "Usage: " << program << " --help|-h" << std::endl;
 	std::cerr << "Creates one node dummynode-ID with node id ID+1 listening on port:" << std::endl;
 	std::cerr << " - a dynamically chosen port, if PORT == 0" << std::endl;
 	std::cerr << " - PORT, if PORT != 0 and PORT is available" << std::endl;
 	std::cerr << " - 33333+ID, if PORT is not set and 33333+ID is available." << std::endl;
+	std::cerr << "The VM is restored from FILE at startup with --load-state," << std::endl;
+	std::cerr << "and saved to FILE each time a client disconnects with --save-state." << std::endl;
 	std::cerr << "The Dashel target is printed on stdout." << std::endl;
 	return 1;
 }
@@ -335,6 +430,10 @@ int main(int argc, char* argv[])
 		const char *arg = argv[argCounter++];
 		if ((strcmp(arg, "-p") == 0) || (strcmp(arg, "--port") == 0))
 			do_delta = false, port = atoi(argv[argCounter++]);
+		else if (strcmp(arg, "--load-state") == 0 && argCounter < argc)
+			node.loadStateFileName = argv[argCounter++];
+		else if (strcmp(arg, "--save-state") == 0 && argCounter < argc)
+			node.saveStateFileName = argv[argCounter++];
 		else if ((strcmp(arg, "-h") == 0) || (strcmp(arg, "--help") == 0))
 			return usage(argv[0]);
 		else
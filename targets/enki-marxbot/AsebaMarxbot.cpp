@@ -385,7 +385,7 @@ namespace Enki
 			this->stream = 0;
 			// clear breakpoints
 			for (size_t i = 0; i < modules.size(); i++)
-				(modules[i]->vm).breakpointsCount = 0;
+				AsebaVMClearBreakpoints(&(modules[i]->vm));
 		}
 		if (abnormal)
 			qDebug() << this << " : Client has disconnected unexpectedly.";
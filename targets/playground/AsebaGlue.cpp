@@ -37,6 +37,34 @@ namespace Aseba
 	// Mapping so that Aseba C callbacks can dispatch to the right objects
 	VMStateToEnvironment vmStateToEnvironment;
 	
+	// SingleVMNodeGlue
+	
+	void SingleVMNodeGlue::saveState(VMSnapshot::Node& node) const
+	{
+		node.saveVM(&vm);
+		node.glue.clear();
+		SnapshotWriter writer(node.glue);
+		saveGlueState(writer);
+	}
+	
+	bool SingleVMNodeGlue::restoreState(const VMSnapshot::Node& node)
+	{
+		// keep the current glue state, in case the VM state does not fit
+		std::vector<uint8_t> previousGlue;
+		SnapshotWriter writer(previousGlue);
+		saveGlueState(writer);
+		
+		SnapshotReader reader(node.glue);
+		if (!restoreGlueState(reader))
+			return false;
+		if (reader.isComplete() && node.restoreVM(&vm))
+			return true;
+		
+		SnapshotReader previousReader(previousGlue);
+		restoreGlueState(previousReader);
+		return false;
+	}
+	
 	// RecvBufferNodeConnection
 
 	uint16_t RecvBufferNodeConnection::getBuffer(uint8_t* data, uint16_t maxLength, uint16_t* source)
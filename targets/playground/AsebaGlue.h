@@ -24,6 +24,7 @@
 #include "../../common/types.h"
 #include "../../common/consts.h"
 #include "../../vm/natives.h"
+#include "../../common/utils/VMSnapshot.h"
 #include <valarray>
 #include <vector>
 #include <map>
@@ -50,6 +51,21 @@ namespace Aseba
 		AsebaVMState vm;
 		std::valarray<unsigned short> bytecode;
 		std::valarray<signed short> stack;
+		
+		// snapshots
+		
+		//! Save the state of the VM and of the glue to node
+		void saveState(VMSnapshot::Node& node) const;
+		//! Restore the state saved by saveState, return false and leave this unchanged if it does not fit this node
+		bool restoreState(const VMSnapshot::Node& node);
+		
+	protected:
+		// to be implemented by robots having state outside the VM, such as timers or motion
+		
+		//! Save the state that is not in the VM
+		virtual void saveGlueState(SnapshotWriter& writer) const {}
+		//! Restore the state saved by saveGlueState, return false and leave this unchanged if reader does not hold it
+		virtual bool restoreGlueState(SnapshotReader& reader) { return true; }
 	};
 
 	struct AbstractNodeConnection
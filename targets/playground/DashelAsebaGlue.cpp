@@ -120,7 +120,7 @@ namespace Aseba
 			for (auto vmStateToEnvironmentKV: vmStateToEnvironment)
 			{
 				if (vmStateToEnvironmentKV.second.second == this)
-					vmStateToEnvironmentKV.first->breakpointsCount = 0;
+					AsebaVMClearBreakpoints(vmStateToEnvironmentKV.first);
 			}
 		}
 		SEND_NOTIFICATION(LOG_INFO, "client disconnected properly", stream->getTargetName());
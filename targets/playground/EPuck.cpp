@@ -21,6 +21,7 @@
 #include "EPuck.h"
 #include "Parameters.h"
 #include "PlaygroundViewer.h"
+#include "EnkiGlue.h"
 #include "../../common/productids.h"
 #include "../../common/utils/utils.h"
 
@@ -163,6 +164,12 @@ namespace Enki
 	
 	// AsebaFeedableEPuck
 	
+	// standard natives are called directly by the VM, the others through callNativeFunction
+	static const AsebaNativeDispatchEntry nativeDispatch[] =
+	{
+		ASEBA_NATIVES_STD_DISPATCH
+	};
+	
 	AsebaFeedableEPuck::AsebaFeedableEPuck(int id)
 	{
 		vm.nodeId = id;
@@ -179,6 +186,8 @@ namespace Enki
 		vm.variablesSize = sizeof(variables) / sizeof(int16_t);
 		
 		AsebaVMInit(&vm);
+		vm.nativeDispatch = nativeDispatch;
+		vm.nativeDispatchSize = ASEBA_NATIVES_STD_COUNT;
 		
 		variables.id = id;
 		variables.productId = ASEBA_PID_PLAYGROUND_EPUCK;
@@ -296,4 +305,31 @@ namespace Enki
 		nativeFunctions[id](&vm);
 	}
 	
+	void AsebaFeedableEPuck::saveGlueState(Aseba::SnapshotWriter& writer) const
+	{
+		writer.write(energy);
+		writer.write(score);
+		writer.write(int32_t(diedAnimation));
+		RobotMotion::of(*this).write(writer);
+	}
+	
+	bool AsebaFeedableEPuck::restoreGlueState(Aseba::SnapshotReader& reader)
+	{
+		// read everything before changing anything
+		double savedEnergy, savedScore;
+		int32_t savedDiedAnimation;
+		RobotMotion motion;
+		reader.read(savedEnergy);
+		reader.read(savedScore);
+		reader.read(savedDiedAnimation);
+		if (!motion.read(reader))
+			return false;
+		
+		energy = savedEnergy;
+		score = savedScore;
+		diedAnimation = savedDiedAnimation;
+		motion.apply(*this);
+		return true;
+	}
+	
 } // Enki
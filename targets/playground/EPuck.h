@@ -109,6 +109,12 @@ namespace Enki
 		virtual const AsebaLocalEventDescription * getLocalEventsDescriptions() const;
 		virtual const AsebaNativeFunctionDescription * const * getNativeFunctionsDescriptions() const;
 		virtual void callNativeFunction(uint16_t id);
+		
+	protected:
+		// from SingleVMNodeGlue
+		
+		virtual void saveGlueState(Aseba::SnapshotWriter& writer) const;
+		virtual bool restoreGlueState(Aseba::SnapshotReader& reader);
 	};
 } // Enki
 
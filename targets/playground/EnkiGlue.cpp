@@ -19,6 +19,8 @@
 */
 
 #include "EnkiGlue.h"
+#include "AsebaGlue.h"
+#include "EPuck.h"
 
 namespace Enki
 {
@@ -26,4 +28,86 @@ namespace Enki
 	
 	NotifyEnvironment notifyEnvironment;
 	
+	RobotMotion RobotMotion::of(const DifferentialWheeled& robot)
+	{
+		RobotMotion motion;
+		motion.pos = robot.pos;
+		motion.angle = robot.angle;
+		motion.speed = robot.speed;
+		motion.angSpeed = robot.angSpeed;
+		motion.leftSpeed = robot.leftSpeed;
+		motion.rightSpeed = robot.rightSpeed;
+		return motion;
+	}
+	
+	void RobotMotion::apply(DifferentialWheeled& robot) const
+	{
+		robot.pos = pos;
+		robot.angle = angle;
+		robot.speed = speed;
+		robot.angSpeed = angSpeed;
+		robot.leftSpeed = leftSpeed;
+		robot.rightSpeed = rightSpeed;
+	}
+	
+	void RobotMotion::write(Aseba::SnapshotWriter& writer) const
+	{
+		writer.write(pos.x);
+		writer.write(pos.y);
+		writer.write(angle);
+		writer.write(speed.x);
+		writer.write(speed.y);
+		writer.write(angSpeed);
+		writer.write(leftSpeed);
+		writer.write(rightSpeed);
+	}
+	
+	bool RobotMotion::read(Aseba::SnapshotReader& reader)
+	{
+		reader.read(pos.x);
+		reader.read(pos.y);
+		reader.read(angle);
+		reader.read(speed.x);
+		reader.read(speed.y);
+		reader.read(angSpeed);
+		reader.read(leftSpeed);
+		return reader.read(rightSpeed);
+	}
+	
+	Aseba::VMSnapshot saveWorld(const NodeGlues& nodes)
+	{
+		Aseba::VMSnapshot snapshot;
+		Aseba::SnapshotWriter writer(snapshot.world);
+		writer.write(uint32_t(energyPool));
+		snapshot.nodes.resize(nodes.size());
+		for (size_t i = 0; i < nodes.size(); ++i)
+			nodes[i]->saveState(snapshot.nodes[i]);
+		return snapshot;
+	}
+	
+	bool restoreWorld(const NodeGlues& nodes, const Aseba::VMSnapshot& snapshot)
+	{
+		if (snapshot.nodes.size() != nodes.size())
+			return false;
+		uint32_t savedEnergyPool;
+		Aseba::SnapshotReader reader(snapshot.world);
+		reader.read(savedEnergyPool);
+		if (!reader.isComplete())
+			return false;
+		
+		// keep the current state, to roll back if a node does not fit
+		const Aseba::VMSnapshot previous(saveWorld(nodes));
+		for (size_t i = 0; i < nodes.size(); ++i)
+		{
+			if (!nodes[i]->restoreState(snapshot.nodes[i]))
+			{
+				for (size_t j = 0; j < i; ++j)
+					nodes[j]->restoreState(previous.nodes[j]);
+				return false;
+			}
+		}
+		energyPool = savedEnergyPool;
+		return true;
+	}
+	
 } // namespace Enki
@@ -25,8 +25,15 @@
 #include <string>
 #include <vector>
 #include <enki/PhysicalEngine.h>
+#include <enki/robots/DifferentialWheeled.h>
 #include "../../vm/vm.h"
 #include "../../common/utils/utils.h"
+#include "../../common/utils/VMSnapshot.h"
+
+namespace Aseba
+{
+	class SingleVMNodeGlue;
+}
 
 namespace Enki
 {
@@ -77,6 +84,36 @@ namespace Enki
 		return nullptr;
 	}
 	
+	//! The motion of a differential wheeled robot, for snapshots
+	struct RobotMotion
+	{
+		Point pos;
+		double angle;
+		Vector speed;
+		double angSpeed;
+		double leftSpeed;
+		double rightSpeed;
+		
+		//! Return the current motion of robot
+		static RobotMotion of(const DifferentialWheeled& robot);
+		//! Set this motion to robot
+		void apply(DifferentialWheeled& robot) const;
+		//! Save this motion
+		void write(Aseba::SnapshotWriter& writer) const;
+		//! Read a motion saved by write, return false if reader does not hold one
+		bool read(Aseba::SnapshotReader& reader);
+	};
+	
+	// Snapshot of a whole simulation
+	
+	//! A vector of nodes, in the order in which the scenario creates them
+	typedef std::vector<Aseba::SingleVMNodeGlue*> NodeGlues;
+	
+	//! Save the state of the world that is not created by the scenario, and the state of nodes, in their order
+	Aseba::VMSnapshot saveWorld(const NodeGlues& nodes);
+	//! Restore a snapshot saved by saveWorld() with nodes created in the same order, return false and keep the current state if it does not fit
+	bool restoreWorld(const NodeGlues& nodes, const Aseba::VMSnapshot& snapshot);
+	
 } // namespace Enki
 
 #endif // __PLAYGROUND_ENKI_GLUE_H
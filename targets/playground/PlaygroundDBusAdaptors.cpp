@@ -193,6 +193,17 @@ namespace Enki
 		return QDBusObjectPath("/");
 	}
 	
+	bool EnkiWorldInterface::SaveSnapshot(QString fileName) const
+	{
+		return saveWorld(playground->asebaNodes).save(fileName.toStdString());
+	}
+	
+	bool EnkiWorldInterface::LoadSnapshot(QString fileName)
+	{
+		Aseba::VMSnapshot snapshot;
+		return snapshot.load(fileName.toStdString()) && restoreWorld(playground->asebaNodes, snapshot);
+	}
+	
 	bool EnkiWorldInterface::isPointerValid(Enki::PhysicalObject* physicalObject) const
 	{
 		const World* world(playground->getWorld());
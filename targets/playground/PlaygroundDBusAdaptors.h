@@ -103,6 +103,8 @@ namespace Enki
 		QStringList PhysicalObjectsByType(QString type) const;
 		QStringList AllPhysicalObjects() const;
 		QDBusObjectPath PhysicalObject(QString number, const QDBusMessage &message);
+		bool SaveSnapshot(QString fileName) const;
+		bool LoadSnapshot(QString fileName);
 		
 	protected:
 		friend class PhysicalObjectInterface;
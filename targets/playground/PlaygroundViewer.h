@@ -51,6 +51,7 @@ namespace Enki
 		bool energyScoringSystemEnabled;
 		unsigned logPos;
 		unsigned energyPool;
+		NodeGlues asebaNodes; //!< Aseba nodes, in the order of the scenario, for snapshots
 		
 	public:
 		PlaygroundViewer(World* world, bool energyScoringSystemEnabled = false);
@@ -19,6 +19,7 @@
 */
 
 #include "Thymio2.h"
+#include "EnkiGlue.h"
 #include "Thymio2-natives.h"
 #include "Parameters.h"
 #include "../../common/productids.h"
@@ -29,6 +30,12 @@ namespace Enki
 	using namespace std;
 	using namespace Aseba;
 	
+	// standard natives are called directly by the VM, the others through callNativeFunction
+	static const AsebaNativeDispatchEntry nativeDispatch[] =
+	{
+		ASEBA_NATIVES_STD_DISPATCH
+	};
+	
 	AsebaThymio2::AsebaThymio2():
 		timer0(bind(&AsebaThymio2::timer0Timeout, this), 0),
 		timer1(bind(&AsebaThymio2::timer1Timeout, this), 0),
@@ -54,6 +61,8 @@ namespace Enki
 		vm.variablesSize = sizeof(variables) / sizeof(int16_t);
 		
 		AsebaVMInit(&vm);
+		vm.nativeDispatch = nativeDispatch;
+		vm.nativeDispatchSize = ASEBA_NATIVES_STD_COUNT;
 		
 		variables.id = vm.nodeId;
 		variables.fwversion[0] = 10; // this simulated Thymio complies with firmware 10 public API
@@ -260,6 +269,56 @@ namespace Enki
 	}
 	
 	
+	void AsebaThymio2::saveGlueState(Aseba::SnapshotWriter& writer) const
+	{
+		for (const Aseba::SoftTimer* timer: { &timer0, &timer1, &timer100Hz })
+		{
+			writer.write(timer->period);
+			writer.write(timer->getLeft());
+		}
+		writer.write(oldTimerPeriod[0]);
+		writer.write(oldTimerPeriod[1]);
+		writer.write(uint32_t(counter100Hz));
+		writer.write(lastStepCollided);
+		writer.write(thisStepCollided);
+		RobotMotion::of(*this).write(writer);
+	}
+	
+	bool AsebaThymio2::restoreGlueState(Aseba::SnapshotReader& reader)
+	{
+		// read everything before changing anything
+		double timersState[3][2];
+		int16_t savedOldTimerPeriod[2];
+		uint32_t savedCounter100Hz;
+		bool savedLastStepCollided, savedThisStepCollided;
+		RobotMotion motion;
+		for (auto& timerState: timersState)
+		{
+			reader.read(timerState[0]);
+			reader.read(timerState[1]);
+		}
+		reader.read(savedOldTimerPeriod[0]);
+		reader.read(savedOldTimerPeriod[1]);
+		reader.read(savedCounter100Hz);
+		reader.read(savedLastStepCollided);
+		reader.read(savedThisStepCollided);
+		if (!motion.read(reader))
+			return false;
+		if (timersState[0][0] < 0 || timersState[1][0] < 0 || timersState[2][0] < 0)
+			return false;
+		
+		timer0.setState(timersState[0][0], timersState[0][1]);
+		timer1.setState(timersState[1][0], timersState[1][1]);
+		timer100Hz.setState(timersState[2][0], timersState[2][1]);
+		oldTimerPeriod[0] = savedOldTimerPeriod[0];
+		oldTimerPeriod[1] = savedOldTimerPeriod[1];
+		counter100Hz = savedCounter100Hz;
+		lastStepCollided = savedLastStepCollided;
+		thisStepCollided = savedThisStepCollided;
+		motion.apply(*this);
+		return true;
+	}
+	
 	void AsebaThymio2::timer0Timeout()
 	{
 		execLocalEvent(EVENT_TIMER0);
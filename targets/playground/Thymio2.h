@@ -130,6 +130,13 @@ namespace Enki
 		virtual const AsebaNativeFunctionDescription * const * getNativeFunctionsDescriptions() const;
 		virtual void callNativeFunction(uint16_t id);
 		
+	protected:
+		
+		// from SingleVMNodeGlue
+		
+		virtual void saveGlueState(Aseba::SnapshotWriter& writer) const;
+		virtual bool restoreGlueState(Aseba::SnapshotReader& reader);
+		
 	protected:
 		
 		void timer0Timeout();
@@ -65,6 +65,9 @@ int main(int argc, char *argv[])
 		fileName = argv[1];
 		ask = false;
 	}
+	QString snapshotFileName;
+	if (argc > 2)
+		snapshotFileName = argv[2];
 	
 	// Try to load xml config file
 	do
@@ -338,6 +341,7 @@ int main(int argc, char *argv[])
 		epuck->pos.y = ePuckE.attribute("y").toDouble();
 		epuck->angle = ePuckE.attribute("angle").toDouble();
 		world.addObject(epuck);
+		viewer.asebaNodes.push_back(epuck);
 		viewer.log(app.tr("New e-puck on port %0").arg(port), Qt::white);
 		ePuckE = ePuckE.nextSiblingElement ("e-puck");
 	}
@@ -353,10 +357,21 @@ int main(int argc, char *argv[])
 		thymio->pos.y = thymioE.attribute("y").toDouble();
 		thymio->angle = thymioE.attribute("angle").toDouble();
 		world.addObject(thymio);
+		viewer.asebaNodes.push_back(thymio);
 		viewer.log(app.tr("New Thymio II on port %0").arg(port), Qt::white);
 		thymioE = thymioE.nextSiblingElement ("thymio2");
 	}
 	
+	// Restore snapshot, if any
+	if (!snapshotFileName.isEmpty())
+	{
+		Aseba::VMSnapshot snapshot;
+		if (snapshot.load(snapshotFileName.toStdString()) && Enki::restoreWorld(viewer.asebaNodes, snapshot))
+			viewer.log(app.tr("Restored snapshot %0").arg(snapshotFileName), Qt::white);
+		else
+			viewer.log(app.tr("Snapshot %0 does not match this scenario").arg(snapshotFileName), Qt::red);
+	}
+	
 	// Scan for external processes
 	QList<QProcess*> processes;
 	QDomElement procssE(domDocument.documentElement().firstChildElement("process"));
@@ -0,0 +1,40 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_TEST_CHECK_H
+#define ASEBA_TEST_CHECK_H
+
+#include <iostream>
+#include <stdexcept>
+
+namespace Aseba
+{
+	//! If condition is false, print what failed and throw, so that the test fails
+	inline void check(bool condition, const char* what)
+	{
+		if (!condition)
+		{
+			std::cerr << "Test failed: " << what << std::endl;
+			throw std::logic_error(what);
+		}
+	}
+} // namespace Aseba
+
+#endif // ASEBA_TEST_CHECK_H
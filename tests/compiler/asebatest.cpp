@@ -35,6 +35,11 @@ extern "C" const AsebaNativeFunctionDescription * const * AsebaGetNativeFunction
 	return nativeFunctionsDescriptions;
 }
 
+static const AsebaNativeDispatchEntry nativeDispatch[] =
+{
+	ASEBA_NATIVES_STD_DISPATCH
+};
+
 // helper function
 std::wstring read_source(const std::string& filename);
 void dump_source(const std::wstring& source);
@@ -103,6 +108,8 @@ struct AsebaNode
 		vm.variablesSize = sizeof(variables) / sizeof(int16_t);
 		
 		AsebaVMInit(&vm);
+		vm.nativeDispatch = nativeDispatch;
+		vm.nativeDispatchSize = ASEBA_NATIVES_STD_COUNT;
 		
 		// fill description accordingly
 		d.name = L"testvm";
@@ -0,0 +1,914 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+	Batch version of asebatest: compiles and runs many programs in a single
+	process, in parallel, and writes a JUnit and/or JSON report.
+
+	Each worker thread owns a compiler and a VM that are reused from one
+	program to the next. The VM callbacks are therefore thread-safe, unlike
+	those of asebavmdummycallbacks, and record errors in the current worker.
+*/
+
+// Aseba
+#include "../../compiler/compiler.h"
+#include "../../vm/vm.h"
+#include "../../vm/natives.h"
+#include "../../common/consts.h"
+#include "../../common/utils/utils.h"
+#include "../../common/utils/AeslReader.h"
+using namespace Aseba;
+
+// C++
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <locale>
+
+// C
+#include <getopt.h>		// getopt_long()
+#include <stdlib.h>		// exit()
+#include <dirent.h>		// opendir()
+#include <sys/stat.h>	// stat()
+
+using namespace std;
+
+// defines
+#define DEFAULT_STEPS	1000
+
+typedef chrono::steady_clock Clock;
+
+//! Return the duration between two time points in ms
+static double msBetween(const Clock::time_point& begin, const Clock::time_point& end)
+{
+	return chrono::duration<double, milli>(end - begin).count();
+}
+
+static const AsebaNativeFunctionDescription* nativeFunctionsDescriptions[] =
+{
+	ASEBA_NATIVES_STD_DESCRIPTIONS,
+	0
+};
+
+static const AsebaNativeDispatchEntry nativeDispatch[] =
+{
+	ASEBA_NATIVES_STD_DISPATCH
+};
+
+static AsebaNativeFunctionPointer nativeFunctions[] =
+{
+	ASEBA_NATIVES_STD_FUNCTIONS,
+};
+
+//! A target description, and the file it was read from, if any
+struct Target
+{
+	TargetDescription description;
+	string fileName;
+};
+
+//! What is expected from a program, as given by the asebatest options in a manifest
+struct Expectations
+{
+	bool compilationFails = false;
+	bool executionFails = false;
+	bool postExecutionFails = false;
+	bool memcmpFails = false;
+	bool event = false; //!< generate one local event after the init code
+	unsigned steps = DEFAULT_STEPS; //!< steps limit for each event, 0 for no limit
+	string memcmpFileName; //!< dump to compare the memory with, if not empty
+	wstring targetName; //!< only run on targets of this name, if not empty
+
+	bool anyFails() const { return compilationFails || executionFails || postExecutionFails || memcmpFails; }
+};
+
+//! A program to compile and run on a target
+struct Job
+{
+	string fileName;
+	string nodeName; //!< name of the node for .aesl files, empty for plain sources
+	size_t nodeIndex = 0; //!< index of the node for .aesl files
+	const CommonDefinitions* definitions = nullptr;
+	size_t target = 0;
+	Expectations expectations;
+};
+
+//! The outcome of a job
+struct Result
+{
+	bool passed = false;
+	string stage; //!< the stage that failed (compilation, load, execution, post-execution, memcmp), empty if none
+	string message;
+	double compileTime = 0; //!< in ms
+	double runTime = 0; //!< in ms
+	size_t bytecodeSize = 0; //!< in words
+	unsigned variablesCount = 0; //!< allocated variables, in words
+	unsigned steps = 0; //!< steps executed, for all events
+	bool stillRunning = false;
+};
+
+//! Compiles and runs jobs, reusing its compiler and VM
+class Worker
+{
+public:
+	bool executionError = false;
+
+	Result run(const Job& job, const Target& target);
+
+protected:
+	void setTarget(const Target& target);
+	unsigned execute(uint16_t event, unsigned stepsLimit);
+	bool compareMemory(const string& fileName, string& message) const;
+
+protected:
+	Compiler compiler;
+	const Target* currentTarget = nullptr;
+	AsebaVMState vm;
+	vector<uint16_t> bytecode;
+	vector<int16_t> variables;
+	vector<int16_t> stack;
+};
+
+//! The worker running on this thread, for the VM callbacks
+static thread_local Worker* currentWorker = nullptr;
+
+extern "C" void AsebaSendMessage(AsebaVMState *vm, uint16_t type, const void *data, uint16_t size)
+{
+	if (type == ASEBA_MESSAGE_DIVISION_BY_ZERO || type == ASEBA_MESSAGE_ARRAY_ACCESS_OUT_OF_BOUNDS)
+		currentWorker->executionError = true;
+}
+
+#ifdef __BIG_ENDIAN__
+extern "C" void AsebaSendMessageWords(AsebaVMState *vm, uint16_t type, const uint16_t* data, uint16_t count)
+{
+	AsebaSendMessage(vm, type, data, count*2);
+}
+#endif
+
+extern "C" void AsebaSendVariables(AsebaVMState *vm, uint16_t start, uint16_t length) {}
+extern "C" void AsebaSendDescription(AsebaVMState *vm) {}
+extern "C" void AsebaPutVmToSleep(AsebaVMState *vm) {}
+extern "C" void AsebaWriteBytecode(AsebaVMState *vm) {}
+extern "C" void AsebaResetIntoBootloader(AsebaVMState *vm) {}
+
+extern "C" void AsebaNativeFunction(AsebaVMState *vm, uint16_t id)
+{
+	nativeFunctions[id](vm);
+}
+
+extern "C" const AsebaNativeFunctionDescription * const * AsebaGetNativeFunctionsDescriptions(AsebaVMState *vm)
+{
+	return nativeFunctionsDescriptions;
+}
+
+extern "C" void AsebaAssert(AsebaVMState *vm, AsebaAssertReason reason)
+{
+	// stop the program, the worker reports the error
+	currentWorker->executionError = true;
+	vm->flags = 0;
+}
+
+//! Add the standard natives, which are the ones the VM of the workers provides, to description
+static void addStdNatives(TargetDescription& description)
+{
+	for (const AsebaNativeFunctionDescription* const* nativeDescs(nativeFunctionsDescriptions); *nativeDescs; ++nativeDescs)
+	{
+		const AsebaNativeFunctionDescription* nativeDesc(*nativeDescs);
+		TargetDescription::NativeFunction native{ UTF8ToWString(nativeDesc->name), UTF8ToWString(nativeDesc->doc) };
+		for (const AsebaNativeFunctionArgumentDescription* params(nativeDesc->arguments); params->size; ++params)
+			native.parameters.push_back(TargetDescription::NativeFunctionParameter(UTF8ToWString(params->name), params->size));
+		description.nativeFunctions.push_back(native);
+	}
+}
+
+//! Return the description used by asebatest
+static Target testTarget()
+{
+	Target target;
+	TargetDescription& d(target.description);
+	d.name = L"testvm";
+	d.protocolVersion = ASEBA_PROTOCOL_VERSION;
+	d.bytecodeSize = 512;
+	d.variablesSize = 256;
+	d.stackSize = 64;
+	addStdNatives(d);
+	TargetDescription::LocalEvent testLocalEvent;
+	testLocalEvent.name = L"test";
+	testLocalEvent.description = L"test local event";
+	d.localEvents.push_back(testLocalEvent);
+	return target;
+}
+
+/*
+	Read a target description from a text file with one property per line:
+		name <name>
+		bytecode <size>
+		variables <size>
+		stack <size>
+		variable <name> <size>
+		localevent <name> [description]
+	Lines starting with # are ignored. The standard natives are always available.
+*/
+static bool readTarget(const string& fileName, Target& target, string& error)
+{
+	ifstream ifs(fileName.c_str());
+	if (!ifs.is_open())
+	{
+		error = "cannot open target description " + fileName;
+		return false;
+	}
+
+	target.fileName = fileName;
+	TargetDescription& d(target.description);
+	d.protocolVersion = ASEBA_PROTOCOL_VERSION;
+	string line;
+	for (unsigned lineNumber = 1; getline(ifs, line); ++lineNumber)
+	{
+		istringstream iss(line);
+		string key, name;
+		unsigned size(0);
+		if (!(iss >> key) || key[0] == '#')
+			continue;
+		if (key == "name" && (iss >> name))
+			d.name = UTF8ToWString(name);
+		else if (key == "bytecode" && (iss >> size) && size > 0 && size <= 65535)
+			d.bytecodeSize = size;
+		else if (key == "variables" && (iss >> size) && size > 0 && size <= 65535)
+			d.variablesSize = size;
+		else if (key == "stack" && (iss >> size) && size > 0 && size <= 65535)
+			d.stackSize = size;
+		else if (key == "variable" && (iss >> name >> size))
+			d.namedVariables.push_back(TargetDescription::NamedVariable(UTF8ToWString(name), size));
+		else if (key == "localevent" && (iss >> name))
+		{
+			string description;
+			getline(iss >> ws, description);
+			TargetDescription::LocalEvent localEvent;
+			localEvent.name = UTF8ToWString(name);
+			localEvent.description = UTF8ToWString(description);
+			d.localEvents.push_back(localEvent);
+		}
+		else
+		{
+			ostringstream oss;
+			oss << fileName << ":" << lineNumber << ": invalid line";
+			error = oss.str();
+			return false;
+		}
+	}
+	if (d.name.empty() || d.bytecodeSize == 0 || d.variablesSize == 0 || d.stackSize == 0)
+	{
+		error = "target description " + fileName + " lacks a name or a size";
+		return false;
+	}
+	addStdNatives(d);
+	return true;
+}
+
+// read source code to a string
+static bool readSource(const string& fileName, wstring& source)
+{
+	ifstream ifs(fileName.c_str(), ifstream::binary);
+	if (!ifs.is_open())
+		return false;
+	ostringstream utf8Source;
+	utf8Source << ifs.rdbuf();
+	source = UTF8ToWString(utf8Source.str());
+	return true;
+}
+
+void Worker::setTarget(const Target& target)
+{
+	if (currentTarget == &target)
+		return;
+	currentTarget = &target;
+	compiler.setTargetDescription(&target.description);
+	bytecode.assign(target.description.bytecodeSize, 0);
+	variables.assign(target.description.variablesSize, 0);
+	stack.assign(target.description.stackSize, 0);
+}
+
+//! Run event until it terminates or stepsLimit steps were executed, return the number of steps executed
+unsigned Worker::execute(uint16_t event, unsigned stepsLimit)
+{
+	if (AsebaVMSetupEvent(&vm, event) == 0)
+		return 0;
+	// one step at a time, to count them
+	unsigned steps(0);
+	while ((stepsLimit == 0 || steps < stepsLimit) && AsebaVMRun(&vm, 1))
+		++steps;
+	return steps;
+}
+
+//! Compare the memory of the VM with the dump in fileName, set message and return false if they differ
+bool Worker::compareMemory(const string& fileName, string& message) const
+{
+	ifstream ifs(fileName.c_str());
+	if (!ifs.is_open())
+	{
+		message = "cannot open mem dump file " + fileName;
+		return false;
+	}
+	int v;
+	for (size_t i = 0; i < variables.size() && (ifs >> v); ++i)
+	{
+		if (variables[i] != v)
+		{
+			ostringstream oss;
+			oss << "VM variable value at pos " << i << " after execution differs from dump; expected: " << v << ", found: " << variables[i];
+			message = oss.str();
+			return false;
+		}
+	}
+	return true;
+}
+
+Result Worker::run(const Job& job, const Target& target)
+{
+	Result result;
+	currentWorker = this;
+	setTarget(target);
+
+	// read source
+	wstring source;
+	if (job.nodeName.empty())
+	{
+		if (!readSource(job.fileName, source))
+		{
+			result.stage = "load";
+			result.message = "cannot open source file " + job.fileName;
+			return result;
+		}
+	}
+	else
+	{
+		AeslReader reader;
+		if (!reader.openFile(job.fileName) || job.nodeIndex >= reader.getNodes().size())
+		{
+			result.stage = "load";
+			result.message = "cannot read node " + job.nodeName + " from " + job.fileName;
+			return result;
+		}
+		source = reader.getNodes()[job.nodeIndex].wcode();
+	}
+
+	// compile
+	wistringstream ifs(source);
+	BytecodeVector compiled;
+	Error error;
+	compiler.setCommonDefinitions(job.definitions);
+	const Clock::time_point compileStart(Clock::now());
+	const bool success(compiler.compile(ifs, compiled, result.variablesCount, error));
+	result.compileTime = msBetween(compileStart, Clock::now());
+	result.bytecodeSize = compiled.size();
+
+	if (!success)
+	{
+		result.stage = "compilation";
+		result.message = WStringToUTF8(error.toWString());
+	}
+	else if (compiled.size() > bytecode.size())
+	{
+		result.stage = "load";
+		result.message = "load bytecode failure";
+	}
+	else
+	{
+		// reset the VM and load the program
+		vm.nodeId = 0;
+		vm.bytecode = &bytecode[0];
+		vm.bytecodeSize = bytecode.size();
+		vm.variables = &variables[0];
+		vm.variablesSize = variables.size();
+		vm.stack = &stack[0];
+		vm.stackSize = stack.size();
+		AsebaVMInit(&vm);
+		vm.nativeDispatch = nativeDispatch;
+		vm.nativeDispatchSize = ASEBA_NATIVES_STD_COUNT;
+		fill(bytecode.begin(), bytecode.end(), 0);
+		for (size_t i = 0; i < compiled.size(); ++i)
+			bytecode[i] = compiled[i].bytecode;
+		executionError = false;
+
+		// run
+		const Expectations& expectations(job.expectations);
+		const Clock::time_point runStart(Clock::now());
+		result.steps = execute(ASEBA_EVENT_INIT, expectations.steps);
+		if (expectations.event)
+			result.steps += execute(ASEBA_EVENT_LOCAL_EVENTS_START-0, expectations.steps);
+		result.runTime = msBetween(runStart, Clock::now());
+		result.stillRunning = AsebaMaskIsSet(vm.flags, ASEBA_VM_EVENT_ACTIVE_MASK);
+
+		if (executionError)
+		{
+			result.stage = "execution";
+			result.message = "execution error";
+		}
+		else if (result.stillRunning)
+		{
+			ostringstream oss;
+			oss << "VM was still running after " << expectations.steps << " steps";
+			result.stage = "post-execution";
+			result.message = oss.str();
+		}
+		else if (!expectations.memcmpFileName.empty() && !compareMemory(expectations.memcmpFileName, result.message))
+			result.stage = "memcmp";
+	}
+
+	// same rules as asebatest: the first failing stage decides
+	const Expectations& e(job.expectations);
+	if (result.stage.empty())
+	{
+		result.passed = !e.anyFails();
+		if (!result.passed)
+			result.message = "all stages passed successfully, but failure was expected";
+	}
+	else
+	{
+		result.passed =
+			(result.stage == "compilation" && e.compilationFails) ||
+			(result.stage == "execution" && e.executionFails) ||
+			(result.stage == "post-execution" && e.postExecutionFails) ||
+			(result.stage == "memcmp" && e.memcmpFails);
+	}
+	return result;
+}
+
+//! Return whether fileName is a directory
+static bool isDirectory(const string& fileName)
+{
+	struct stat s;
+	return stat(fileName.c_str(), &s) == 0 && S_ISDIR(s.st_mode);
+}
+
+//! Return whether fileName ends with suffix
+static bool endsWith(const string& fileName, const string& suffix)
+{
+	return fileName.size() >= suffix.size() && fileName.compare(fileName.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+//! Return path relative to the directory of fileName, unless it is absolute
+static string relativeTo(const string& fileName, const string& path)
+{
+	const size_t slash(fileName.rfind('/'));
+	if (path.empty() || path[0] == '/' || slash == string::npos)
+		return path;
+	return fileName.substr(0, slash + 1) + path;
+}
+
+//! Parse the asebatest options of a manifest line into expectations, return false on unknown options
+static bool parseExpectations(istream& is, const string& manifestName, Expectations& e, string& error)
+{
+	string option;
+	while (is >> option)
+	{
+		if (option == "--fail")
+			e.compilationFails = e.executionFails = e.postExecutionFails = e.memcmpFails = true;
+		else if (option == "--comp_fail")
+			e.compilationFails = true;
+		else if (option == "--exec_fail")
+			e.executionFails = true;
+		else if (option == "--post_fail")
+			e.postExecutionFails = true;
+		else if (option == "--memcmp_fail")
+			e.memcmpFails = true;
+		else if (option == "--event")
+			e.event = true;
+		else if (option == "--memcmp" && (is >> e.memcmpFileName))
+			e.memcmpFileName = relativeTo(manifestName, e.memcmpFileName);
+		else if (option == "--steps" && (is >> e.steps))
+			;
+		else if (option == "--target" && (is >> option))
+			e.targetName = UTF8ToWString(option);
+		else
+		{
+			error = "invalid option " + option;
+			return false;
+		}
+	}
+	return true;
+}
+
+//! Builds the list of jobs from directories and manifests
+class JobsBuilder
+{
+public:
+	vector<Job> jobs;
+	string error;
+
+	JobsBuilder(const vector<Target>& targets, unsigned defaultSteps):
+		targets(targets)
+	{
+		defaults.steps = defaultSteps;
+		// the definitions asebatest uses for plain sources
+		testDefinitions.events.push_back(NamedValue(L"event1", 0));
+		testDefinitions.events.push_back(NamedValue(L"event2", 3));
+		testDefinitions.constants.push_back(NamedValue(L"FOO", 2));
+	}
+	JobsBuilder(const JobsBuilder&) = delete;
+
+	//! Add all .txt and .aesl programs of a directory, expected to succeed, in name order
+	bool addDirectory(const string& directory)
+	{
+		DIR* dir(opendir(directory.c_str()));
+		if (!dir)
+		{
+			error = "cannot open directory " + directory;
+			return false;
+		}
+		vector<string> fileNames;
+		while (struct dirent* entry = readdir(dir))
+		{
+			const string name(entry->d_name);
+			if (isProgram(name))
+				fileNames.push_back(directory + "/" + name);
+		}
+		closedir(dir);
+		sort(fileNames.begin(), fileNames.end());
+		for (const auto& fileName: fileNames)
+			if (!addProgram(fileName))
+				return false;
+		return true;
+	}
+
+	//! Add a .txt or .aesl program, expected to succeed
+	bool addProgram(const string& fileName)
+	{
+		return addProgram(fileName, defaults);
+	}
+
+	//! Return whether fileName is a program rather than a manifest
+	static bool isProgram(const string& fileName)
+	{
+		return endsWith(fileName, ".txt") || endsWith(fileName, ".aesl");
+	}
+
+	//! Add the programs of a manifest, one per line followed by asebatest options, relative to the manifest
+	bool addManifest(const string& manifest)
+	{
+		ifstream ifs(manifest.c_str());
+		if (!ifs.is_open())
+		{
+			error = "cannot open manifest " + manifest;
+			return false;
+		}
+		string line;
+		for (unsigned lineNumber = 1; getline(ifs, line); ++lineNumber)
+		{
+			istringstream iss(line);
+			string fileName;
+			if (!(iss >> fileName) || fileName[0] == '#')
+				continue;
+			Expectations expectations(defaults);
+			if (!parseExpectations(iss, manifest, expectations, error))
+			{
+				ostringstream oss;
+				oss << manifest << ":" << lineNumber << ": " << error;
+				error = oss.str();
+				return false;
+			}
+			if (!addProgram(relativeTo(manifest, fileName), expectations))
+				return false;
+		}
+		return true;
+	}
+
+protected:
+	//! Add one job per node and target
+	bool addProgram(const string& fileName, const Expectations& expectations)
+	{
+		Job job;
+		job.fileName = fileName;
+		job.expectations = expectations;
+		job.definitions = &testDefinitions;
+
+		vector<string> nodeNames(1);
+		if (endsWith(fileName, ".aesl"))
+		{
+			// the definitions are shared by the nodes, only scan the file once here
+			readers.emplace_back(new AeslReader);
+			AeslReader& reader(*readers.back());
+			if (!reader.openFile(fileName))
+			{
+				error = fileName + ": " + reader.getError();
+				return false;
+			}
+			job.definitions = &reader.getCommonDefinitions();
+			nodeNames.clear();
+			for (const auto& node: reader.getNodes())
+				nodeNames.push_back(node.name.empty() ? string("node") : node.name);
+		}
+
+		for (size_t n = 0; n < nodeNames.size(); ++n)
+		{
+			job.nodeName = nodeNames[n];
+			job.nodeIndex = n;
+			for (size_t t = 0; t < targets.size(); ++t)
+			{
+				if (!expectations.targetName.empty() && targets[t].description.name != expectations.targetName)
+					continue;
+				job.target = t;
+				jobs.push_back(job);
+			}
+		}
+		return true;
+	}
+
+protected:
+	const vector<Target>& targets;
+	Expectations defaults;
+	CommonDefinitions testDefinitions;
+	vector<unique_ptr<AeslReader> > readers;
+};
+
+//! Return the name of a job in reports
+static string jobName(const Job& job)
+{
+	return job.nodeName.empty() ? job.fileName : job.fileName + ":" + job.nodeName;
+}
+
+//! Escape s for a XML attribute
+static string xmlEscape(const string& s)
+{
+	string escaped;
+	for (const char c: s)
+	{
+		switch (c)
+		{
+			case '&': escaped += "&amp;"; break;
+			case '<': escaped += "&lt;"; break;
+			case '>': escaped += "&gt;"; break;
+			case '"': escaped += "&quot;"; break;
+			case '\n': escaped += "&#10;"; break;
+			default: escaped += c; break;
+		}
+	}
+	return escaped;
+}
+
+//! Return s as a JSON string
+static string jsonString(const string& s)
+{
+	ostringstream oss;
+	oss << '"';
+	for (const char c: s)
+	{
+		if (c == '"' || c == '\\')
+			oss << '\\' << c;
+		else if (c == '\n')
+			oss << "\\n";
+		else if ((unsigned char)c < 0x20)
+			oss << "\\u" << hex << setw(4) << setfill('0') << int(c) << dec;
+		else
+			oss << c;
+	}
+	oss << '"';
+	return oss.str();
+}
+
+//! Write a JUnit report, one test case per job, with the statistics as properties
+static void writeJUnit(ostream& os, const vector<Job>& jobs, const vector<Result>& results, const vector<Target>& targets, size_t failures, double totalTime)
+{
+	os << fixed << setprecision(6);
+	os << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+	os << "<testsuites tests=\"" << jobs.size() << "\" failures=\"" << failures << "\" time=\"" << totalTime / 1000. << "\">\n";
+	os << "\t<testsuite name=\"asebatestbatch\" tests=\"" << jobs.size() << "\" failures=\"" << failures << "\" time=\"" << totalTime / 1000. << "\">\n";
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		const Result& r(results[i]);
+		os << "\t\t<testcase classname=\"" << xmlEscape(WStringToUTF8(targets[jobs[i].target].description.name)) << "\"";
+		os << " name=\"" << xmlEscape(jobName(jobs[i])) << "\" time=\"" << (r.compileTime + r.runTime) / 1000. << "\">\n";
+		os << "\t\t\t<properties>\n";
+		os << "\t\t\t\t<property name=\"compile_ms\" value=\"" << r.compileTime << "\"/>\n";
+		os << "\t\t\t\t<property name=\"run_ms\" value=\"" << r.runTime << "\"/>\n";
+		os << "\t\t\t\t<property name=\"bytecode_size\" value=\"" << r.bytecodeSize << "\"/>\n";
+		os << "\t\t\t\t<property name=\"variables\" value=\"" << r.variablesCount << "\"/>\n";
+		os << "\t\t\t\t<property name=\"steps\" value=\"" << r.steps << "\"/>\n";
+		if (!r.stage.empty())
+			os << "\t\t\t\t<property name=\"failed_stage\" value=\"" << r.stage << "\"/>\n";
+		os << "\t\t\t</properties>\n";
+		if (!r.passed)
+			os << "\t\t\t<failure message=\"" << xmlEscape(r.message) << "\" type=\"" << (r.stage.empty() ? "unexpected-success" : r.stage) << "\"/>\n";
+		os << "\t\t</testcase>\n";
+	}
+	os << "\t</testsuite>\n";
+	os << "</testsuites>\n";
+}
+
+//! Write a JSON report, one object per job
+static void writeJSON(ostream& os, const vector<Job>& jobs, const vector<Result>& results, const vector<Target>& targets, size_t failures, double totalTime)
+{
+	os << fixed << setprecision(3);
+	os << "{\n";
+	os << "\t\"programs\": " << jobs.size() << ",\n";
+	os << "\t\"failures\": " << failures << ",\n";
+	os << "\t\"time_ms\": " << totalTime << ",\n";
+	os << "\t\"results\": [";
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		const Job& job(jobs[i]);
+		const Result& r(results[i]);
+		os << (i ? ",\n" : "\n") << "\t\t{ ";
+		os << "\"file\": " << jsonString(job.fileName) << ", ";
+		os << "\"node\": " << (job.nodeName.empty() ? string("null") : jsonString(job.nodeName)) << ", ";
+		os << "\"target\": " << jsonString(WStringToUTF8(targets[job.target].description.name)) << ", ";
+		os << "\"passed\": " << (r.passed ? "true" : "false") << ", ";
+		os << "\"failed_stage\": " << (r.stage.empty() ? string("null") : jsonString(r.stage)) << ", ";
+		os << "\"message\": " << jsonString(r.message) << ", ";
+		os << "\"compile_ms\": " << r.compileTime << ", ";
+		os << "\"run_ms\": " << r.runTime << ", ";
+		os << "\"bytecode_size\": " << r.bytecodeSize << ", ";
+		os << "\"variables\": " << r.variablesCount << ", ";
+		os << "\"steps\": " << r.steps << ", ";
+		os << "\"still_running\": " << (r.stillRunning ? "true" : "false") << " }";
+	}
+	os << "\n\t]\n";
+	os << "}\n";
+}
+
+//! Write a report to fileName using writer, return false if the file cannot be written
+template<typename Writer>
+static bool writeReport(const string& fileName, Writer writer, const vector<Job>& jobs, const vector<Result>& results, const vector<Target>& targets, size_t failures, double totalTime)
+{
+	ofstream ofs(fileName.c_str());
+	if (!ofs.is_open())
+	{
+		cerr << "Cannot write report " << fileName << endl;
+		return false;
+	}
+	writer(ofs, jobs, results, targets, failures, totalTime);
+	return bool(ofs);
+}
+
+static const char short_options [] = "j:t:i:qh";
+static const struct option long_options[] = {
+	{ "jobs",		required_argument,	nullptr,	'j'},
+	{ "target",		required_argument,	nullptr,	't'},
+	{ "steps",		required_argument,	nullptr,	'i'},
+	{ "junit",		required_argument,	nullptr,	'J'},
+	{ "json",		required_argument,	nullptr,	'S'},
+	{ "quiet",		no_argument,		nullptr,	'q'},
+	{ "help",		no_argument,		nullptr,	'h'},
+	{ 0, 0, 0, 0 }
+};
+
+static void usage(int argc, char** argv)
+{
+	cerr	<< "Usage: " << argv[0] << " [options] (directory | manifest | program)..." << endl << endl
+			<< "Compiles and runs many programs in parallel, like asebatest does for one." << endl
+			<< "A directory adds all its .txt and .aesl programs, which are expected to succeed" << endl
+			<< "like programs given directly." << endl
+			<< "A manifest lists one program per line, followed by asebatest options:" << endl
+			<< "--fail, --comp_fail, --exec_fail, --post_fail, --memcmp_fail, --event," << endl
+			<< "--memcmp file, --steps n, and --target name to restrict it to one target." << endl
+			<< "Paths in a manifest are relative to it. Each node of an .aesl file is a program." << endl << endl
+			<< "Options:" << endl
+			<< "    -j | --jobs n       Number of worker threads (default: number of cores)" << endl
+			<< "    -t | --target file  Run on the target described in file, can be repeated" << endl
+			<< "                        (default: the target of asebatest)" << endl
+			<< "    -i | --steps n      Default number of VM execution steps (default: " << DEFAULT_STEPS << ")" << endl
+			<< "    --junit file        Write a JUnit report to file" << endl
+			<< "    --json file         Write a JSON report to file" << endl
+			<< "    -q | --quiet        Only print the summary" << endl;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned jobsCount(thread::hardware_concurrency());
+	unsigned defaultSteps(DEFAULT_STEPS);
+	bool quiet(false);
+	vector<string> targetFileNames;
+	string junitFileName, jsonFileName;
+
+	locale::global(locale(""));
+
+	for (;;)
+	{
+		int index;
+		const int c(getopt_long(argc, argv, short_options, long_options, &index));
+		if (c == -1)
+			break;
+
+		switch (c)
+		{
+			case 'j': jobsCount = atoi(optarg); break;
+			case 't': targetFileNames.push_back(optarg); break;
+			case 'i': defaultSteps = atoi(optarg); break;
+			case 'J': junitFileName = optarg; break;
+			case 'S': jsonFileName = optarg; break;
+			case 'q': quiet = true; break;
+			default:
+				usage(argc, argv);
+				exit(EXIT_FAILURE);
+		}
+	}
+	if (optind == argc)
+	{
+		usage(argc, argv);
+		exit(EXIT_FAILURE);
+	}
+	if (jobsCount == 0)
+		jobsCount = 1;
+
+	// targets
+	vector<Target> targets;
+	for (const auto& fileName: targetFileNames)
+	{
+		Target target;
+		string error;
+		if (!readTarget(fileName, target, error))
+		{
+			cerr << error << endl;
+			exit(EXIT_FAILURE);
+		}
+		targets.push_back(target);
+	}
+	if (targets.empty())
+		targets.push_back(testTarget());
+
+	// jobs
+	JobsBuilder builder(targets, defaultSteps);
+	for (int i = optind; i < argc; ++i)
+	{
+		const string input(argv[i]);
+		bool added;
+		if (isDirectory(input))
+			added = builder.addDirectory(input);
+		else if (JobsBuilder::isProgram(input))
+			added = builder.addProgram(input);
+		else
+			added = builder.addManifest(input);
+		if (!added)
+		{
+			cerr << builder.error << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+	const vector<Job>& jobs(builder.jobs);
+
+	// run, each worker taking the next job
+	vector<Result> results(jobs.size());
+	atomic<size_t> nextJob(0);
+	mutex outputMutex;
+	const Clock::time_point start(Clock::now());
+	auto workerMain = [&]()
+	{
+		Worker worker;
+		for (size_t i = nextJob++; i < jobs.size(); i = nextJob++)
+		{
+			results[i] = worker.run(jobs[i], targets[jobs[i].target]);
+			if (!quiet && !results[i].passed)
+			{
+				lock_guard<mutex> lock(outputMutex);
+				cerr << jobName(jobs[i]) << " on " << WStringToUTF8(targets[jobs[i].target].description.name) << ": FAILED";
+				if (!results[i].stage.empty())
+					cerr << " in " << results[i].stage;
+				cerr << ": " << results[i].message << endl;
+			}
+		}
+	};
+	vector<thread> threads;
+	for (unsigned i = 1; i < min<size_t>(jobsCount, jobs.size()); ++i)
+		threads.push_back(thread(workerMain));
+	workerMain();
+	for (auto& t: threads)
+		t.join();
+	const double totalTime(msBetween(start, Clock::now()));
+
+	// report
+	const size_t failures(count_if(results.begin(), results.end(), [](const Result& r) { return !r.passed; }));
+	bool ok(failures == 0);
+	if (!junitFileName.empty())
+		ok = writeReport(junitFileName, writeJUnit, jobs, results, targets, failures, totalTime) && ok;
+	if (!jsonFileName.empty())
+		ok = writeReport(jsonFileName, writeJSON, jobs, results, targets, failures, totalTime) && ok;
+	cout << jobs.size() << " programs, " << failures << " failures, " << fixed << setprecision(1) << totalTime << " ms" << endl;
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,111 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../../common/msg/msg.h"
+#include "../../common/msg/Capture.h"
+#include "../../common/utils/utils.h"
+#include "../TestCheck.h"
+#include <dashel/dashel.h>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+using namespace Aseba;
+using namespace std;
+
+//! A stream that is never read nor written, only used for its name
+class NamedStream: public Dashel::Stream
+{
+public:
+	NamedStream(): Dashel::Stream("memory") {}
+	virtual void write(const void *ptr, const size_t size) {}
+	virtual void flush() {}
+	virtual void read(void *ptr, size_t size) { throw runtime_error("Cannot read from named stream"); }
+};
+
+//! Return whether s ends with suffix
+bool endsWith(const wstring& s, const wstring& suffix)
+{
+	return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main()
+{
+	const char* fileName("aseba-test-capture.bin");
+	NamedStream stream;
+	
+	// capture a few messages, from a stream and from nowhere
+	vector<unique_ptr<Message> > messages;
+	messages.push_back(unique_ptr<Message>(new UserMessage(3, UserMessage::DataVector{1, -2, 3})));
+	messages.push_back(unique_ptr<Message>(new GetDescription()));
+	messages.push_back(unique_ptr<Message>(new SetVariables(2, 10, SetVariables::VariablesVector{4, 5})));
+	messages.push_back(unique_ptr<Message>(new Reset(7)));
+	{
+		MessageCapture capture(fileName);
+		check(capture.isOpen(), "cannot open capture file");
+		for (size_t i = 0; i < messages.size(); ++i)
+			capture.capture(*messages[i], i % 2 ? 0 : &stream);
+		check(capture.getDroppedCount() == 0, "messages dropped with a large ring");
+	}
+	
+	// the decoded text is the one dumped by the switches, after the time stamp
+	{
+		ifstream input(fileName, ios::binary);
+		wostringstream output;
+		check(MessageCapture::decode(input, output), "cannot decode capture");
+		wistringstream lines(output.str());
+		wstring line;
+		for (size_t i = 0; i < messages.size(); ++i)
+		{
+			check(bool(getline(lines, line)), "missing decoded message");
+			wostringstream expected;
+			if (i % 2 == 0)
+				expected << UTF8ToWString(stream.getTargetName()) << L" ";
+			messages[i]->dump(expected);
+			check(endsWith(line, expected.str()), "decoded message differs from dump");
+		}
+		check(!getline(lines, line), "too many decoded messages");
+	}
+	
+	// with a ring too small for any frame, all messages are dropped and counted
+	{
+		MessageCapture capture(fileName, 16);
+		for (size_t i = 0; i < messages.size(); ++i)
+			capture.capture(*messages[i]);
+		check(capture.getDroppedCount() == messages.size(), "messages not dropped with a tiny ring");
+	}
+	{
+		ifstream input(fileName, ios::binary);
+		wostringstream output;
+		check(MessageCapture::decode(input, output), "cannot decode capture with dropped messages");
+		check(output.str() == L"4 messages dropped by capture\n", "dropped messages not recorded");
+	}
+	
+	// truncated captures are rejected
+	{
+		istringstream input("ASEBA");
+		wostringstream output;
+		check(!MessageCapture::decode(input, output), "truncated capture accepted");
+	}
+	
+	return 0;
+}
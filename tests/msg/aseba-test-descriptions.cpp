@@ -0,0 +1,145 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../../common/msg/msg.h"
+#include "../../common/msg/NodesManager.h"
+#include "../TestCheck.h"
+#include <iostream>
+
+using namespace Aseba;
+using namespace std;
+
+//! A manager of the nodes of a network that does not send anything
+struct TestNodesManager: NodesManager
+{
+	vector<unsigned> receivedDescriptions;
+	
+	using NodesManager::getSharedDescription;
+	
+	virtual void sendMessage(const Message& message) {}
+	virtual void nodeDescriptionReceived(unsigned nodeId) { receivedDescriptions.push_back(nodeId); }
+	
+	//! Receive the description of node nodeId in parts, as sent by the node
+	void receiveDescription(unsigned nodeId, const TargetDescription& target)
+	{
+		Description description;
+		static_cast<TargetDescription&>(description) = target;
+		description.source = nodeId;
+		processMessage(&description);
+		for (const auto& variable: target.namedVariables)
+		{
+			NamedVariableDescription message;
+			static_cast<TargetDescription::NamedVariable&>(message) = variable;
+			message.source = nodeId;
+			processMessage(&message);
+		}
+		for (const auto& event: target.localEvents)
+		{
+			LocalEventDescription message;
+			static_cast<TargetDescription::LocalEvent&>(message) = event;
+			message.source = nodeId;
+			processMessage(&message);
+		}
+		for (const auto& function: target.nativeFunctions)
+		{
+			NativeFunctionDescription message;
+			static_cast<TargetDescription::NativeFunction&>(message) = function;
+			message.source = nodeId;
+			processMessage(&message);
+		}
+	}
+};
+
+//! A description as sent by a robot
+TargetDescription robotDescription(const wstring& eventDocumentation)
+{
+	TargetDescription description;
+	description.name = L"robot";
+	description.protocolVersion = ASEBA_PROTOCOL_VERSION;
+	description.bytecodeSize = 1024;
+	description.variablesSize = 256;
+	description.stackSize = 32;
+	description.namedVariables.push_back(TargetDescription::NamedVariable(L"id", 1));
+	description.namedVariables.push_back(TargetDescription::NamedVariable(L"motors", 2));
+	description.namedVariables.push_back(TargetDescription::NamedVariable(L"id", 3));
+	TargetDescription::LocalEvent event;
+	event.name = L"button";
+	event.description = eventDocumentation;
+	description.localEvents.push_back(event);
+	TargetDescription::NativeFunction function;
+	function.name = L"math.fill";
+	function.description = L"fill an array";
+	function.parameters.push_back(TargetDescription::NativeFunctionParameter(L"dest", -1));
+	function.parameters.push_back(TargetDescription::NativeFunctionParameter(L"value", 1));
+	description.nativeFunctions.push_back(function);
+	return description;
+}
+
+int main()
+{
+	const TargetDescription robot(robotDescription(L"button pressed"));
+	const TargetDescription otherRobot(robotDescription(L"button released"));
+	check(DescriptionsPool::stats().descriptions == 0, "descriptions in use before any node");
+	
+	{
+		// identical nodes share their description, in all managers
+		TestNodesManager network1, network2;
+		network1.receiveDescription(1, robot);
+		network1.receiveDescription(2, robot);
+		network2.receiveDescription(1, robot);
+		network2.receiveDescription(2, otherRobot);
+		check(network1.receivedDescriptions.size() == 2 && network2.receivedDescriptions.size() == 2, "descriptions not completed");
+		
+		const auto shared(network1.getSharedDescription(1));
+		check(shared != nullptr, "complete description not shared");
+		check(shared == network1.getSharedDescription(2) && shared == network2.getSharedDescription(1), "identical descriptions not shared");
+		check(shared != network2.getSharedDescription(2), "descriptions differing by documentation shared");
+		check(network1.getDescription(1) == shared.get(), "description differs from shared one");
+		check(DescriptionsPool::equal(*shared, robot), "shared description differs from received one");
+		
+		// maps are those of the compiler, and the first variable of a name is found
+		check(shared->variablesMap.at(L"motors") == make_pair(1u, 2u) && shared->variablesMap.at(L"id") == make_pair(3u, 3u), "wrong variables map");
+		check(shared->freeVariableIndex == 6, "wrong free variable index");
+		check(shared->functionsMap.at(L"math.fill") == 0, "wrong functions map");
+		check(network1.getVariablePos(2, L"id") == 0 && network1.getVariableSize(2, L"motors") == 2, "wrong variable lookup");
+		
+		// a node whose description is being received has none to share
+		Description partial;
+		static_cast<TargetDescription&>(partial) = robot;
+		partial.source = 3;
+		network1.processMessage(&partial);
+		check(network1.getSharedDescription(3) == nullptr, "partial description shared");
+		check(network1.getDescription(3) != 0 && network1.getDescription(3)->name == L"robot", "partial description not available");
+		
+		// the saving is that of the copies
+		const DescriptionsPool::Stats stats(DescriptionsPool::stats());
+		check(stats.descriptions == 2, "wrong number of descriptions");
+		check(stats.references == 4 + 1, "wrong number of references");
+		check(stats.bytes > 2 * sizeof(SharedDescription), "description memory not counted");
+		check(stats.savedBytes == 3 * shared->memoryUsage, "wrong saved memory");
+		
+		// descriptions stay in use as long as a node has them
+		network2.reset();
+		check(DescriptionsPool::stats().descriptions == 1, "unused description kept");
+	}
+	check(DescriptionsPool::stats().descriptions == 0, "descriptions kept after their nodes");
+	
+	return 0;
+}
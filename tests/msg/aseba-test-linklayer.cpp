@@ -0,0 +1,180 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../../common/msg/msg.h"
+#include "../../common/msg/LinkLayer.h"
+#include "../TestCheck.h"
+#include <dashel/dashel.h>
+#include <iostream>
+#include <thread>
+#include <cstring>
+#include <stdexcept>
+
+using namespace Aseba;
+using namespace std;
+
+//! A stream recording the size of each write, and readable back
+class MemoryStream: public Dashel::Stream
+{
+public:
+	vector<uint8_t> data;
+	vector<size_t> writes;
+	size_t pendingWrite = 0;
+	size_t readPos = 0;
+	
+	MemoryStream(): Dashel::Stream("memory") {}
+	
+	virtual void write(const void *ptr, const size_t size)
+	{
+		const uint8_t* bytes(reinterpret_cast<const uint8_t*>(ptr));
+		data.insert(data.end(), bytes, bytes + size);
+		pendingWrite += size;
+	}
+	virtual void flush()
+	{
+		if (pendingWrite)
+			writes.push_back(pendingWrite);
+		pendingWrite = 0;
+	}
+	virtual void read(void *ptr, size_t size)
+	{
+		if (readPos + size > data.size())
+			throw runtime_error("Read past end of memory stream");
+		memcpy(ptr, &data[readPos], size);
+		readPos += size;
+	}
+};
+
+//! A stream that fails on write, as a disconnected link
+class FailingStream: public Dashel::Stream
+{
+public:
+	FailingStream(): Dashel::Stream("failing") {}
+	
+	virtual void write(const void *ptr, const size_t size) { fail(Dashel::DashelException::ConnectionLost, 0, "Link lost"); }
+	virtual void flush() {}
+	virtual void read(void *ptr, size_t size) { fail(Dashel::DashelException::ConnectionLost, 0, "Link lost"); }
+};
+
+//! A tracer giving access to link ids
+class LinkTracer: public Tracer
+{
+public:
+	LinkTracer(const string& fileName): Tracer(fileName, "aseba-test-linklayer") {}
+	using Tracer::linkId;
+};
+
+int main()
+{
+	const size_t mtu(64);
+	LinkLayer linkLayer(mtu, 5);
+	MemoryStream batched, direct;
+	linkLayer.attach(&batched);
+	Tracer tracer("aseba-test-linklayer.trace.json", "aseba-test-linklayer");
+	linkLayer.setTracer(&tracer);
+	
+	// a user message with 2 words of payload takes 10 bytes
+	const unsigned frameCount(20);
+	for (unsigned i = 0; i < frameCount; ++i)
+	{
+		const UserMessage message(i, UserMessage::DataVector{int16_t(i), int16_t(-int(i))});
+		linkLayer.send(message, &batched);
+		linkLayer.send(message, &direct);
+	}
+	
+	// non-attached streams see one flushed write per frame
+	check(direct.writes.size() == frameCount, "direct stream did not get one write per frame");
+	
+	// attached streams only see MTU-sized writes, the remainder waits for its deadline
+	check(!batched.writes.empty(), "batched stream got no write");
+	for (const size_t size: batched.writes)
+		check(size % mtu == 0, "batched write is not a multiple of the MTU");
+	check(linkLayer.timeout() >= 0, "pending data has no deadline");
+	check(batched.data.size() + linkLayer.getStatistics(&batched).queueDepth == direct.data.size(), "batched data size mismatch");
+	
+	// traced frames are flushed once their last byte is written, 19 of 20 frames fit in 3 chunks of 64 bytes
+	check(tracer.getHistogram(Tracer::ENQUEUE).count == 2 * frameCount, "not all frames were traced when enqueued");
+	check(tracer.getHistogram(Tracer::FLUSH).count == 2 * frameCount - 1, "frames traced as flushed before being written");
+	
+	// once the latency bound expired, the remainder is written
+	this_thread::sleep_for(chrono::milliseconds(10));
+	linkLayer.flushDue();
+	check(linkLayer.timeout() == -1, "data still pending after deadline");
+	check(batched.data == direct.data, "batched and direct byte streams differ");
+	check(linkLayer.getStatistics(&batched).latencyFlushes == 1, "unexpected number of latency flushes");
+	check(linkLayer.getStatistics(&batched).framesPerWrite() > 1, "batching did not group frames");
+	check(tracer.getHistogram(Tracer::FLUSH).count == 2 * frameCount, "written frames were not traced as flushed");
+	
+	// messages from different nodes or to different nodes have different trace ids
+	check(Tracer::messageId(GetVariables(1, 2, 3)) != Tracer::messageId(GetVariables(4, 2, 3)), "trace id ignores destination");
+	GetVariables otherSource(1, 2, 3);
+	otherSource.source = 5;
+	check(Tracer::messageId(GetVariables(1, 2, 3)) != Tracer::messageId(otherSource), "trace id ignores source");
+	check(Tracer::messageId(GetVariables(1, 2, 3)) != Tracer::messageId(GetVariables(1, 2, 4)), "trace id ignores payload");
+	
+	// both ends of a stream give the same link ids to repeated identical messages, and distinct ones to each repetition
+	LinkTracer sender("aseba-test-linklayer-sender.trace.json"), receiver("aseba-test-linklayer-receiver.trace.json");
+	const uint64_t id(Tracer::messageId(GetVariables(1, 2, 3)));
+	const Tracer::Clock::time_point now(Tracer::Clock::now());
+	const uint64_t firstLink(sender.linkId(id, &direct, true, now));
+	check(receiver.linkId(id, &batched, false, now) == firstLink, "ends of a stream disagree on link id");
+	const uint64_t secondLink(sender.linkId(id, &direct, true, now));
+	check(receiver.linkId(id, &batched, false, now) == secondLink, "ends of a stream disagree on link id of repeated message");
+	check(firstLink != secondLink, "repeated messages share a link id");
+	check(sender.linkId(id, &direct, true, now + chrono::seconds(2)) == firstLink, "link ids do not restart after idle time");
+	
+	// stages not related to a stream are traced on the local thread
+	tracer.record(id, Tracer::ENQUEUE);
+	tracer.record(id, Tracer::FLUSH);
+	
+	// and frames decode back unchanged
+	for (unsigned i = 0; i < frameCount; ++i)
+	{
+		unique_ptr<Message> message(Message::receive(&batched));
+		const UserMessage* userMessage(dynamic_cast<UserMessage*>(message.get()));
+		check(userMessage && userMessage->type == i && userMessage->data.size() == 2 && userMessage->data[1] == -int(i), "frame did not decode back");
+	}
+	
+	// a stream failing to write drops its queue, from send as from flushes
+	FailingStream failing;
+	linkLayer.attach(&failing);
+	bool thrown(false);
+	try
+	{
+		for (unsigned i = 0; i < frameCount; ++i)
+			linkLayer.send(UserMessage(i), &failing);
+	}
+	catch (const Dashel::DashelException&)
+	{
+		thrown = true;
+	}
+	check(thrown, "write error was not reported by send");
+	check(linkLayer.queueDepth() == 0 && linkLayer.getStatistics(&failing).queueDepth == 0, "failed send left data queued");
+	linkLayer.send(UserMessage(0), &failing);
+	linkLayer.flushAll();
+	check(linkLayer.queueDepth() == 0 && linkLayer.timeout() == -1, "failed flush left data queued");
+	linkLayer.detach(&failing);
+	
+	linkLayer.getStatistics(&batched).dump(cout);
+	cout << endl;
+	tracer.dumpHistograms(cout);
+	
+	return 0;
+}
@@ -165,6 +165,16 @@ int main()
 		}
 	);
 	
+	testMessage<EventsBatch>(
+		[](EventsBatch& m) { m.events = { UserMessage(0, UserMessage::DataVector{1, 2}), UserMessage(1), UserMessage(2, UserMessage::DataVector{3}) }; },
+		{
+			[](EventsBatch& m) { m.events[0].type = 3; },
+			[](EventsBatch& m) { m.events[1].data.push_back(4); },
+			[](EventsBatch& m) { m.events[2].data[0] = 5; },
+			[](EventsBatch& m) { m.events.pop_back(); }
+		}
+	);
+	
 	testMessageNoInit<GetDescription>(
 		{
 			[](GetDescription& m) { m.version = 1; }
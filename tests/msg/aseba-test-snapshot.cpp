@@ -0,0 +1,114 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../../common/msg/msg.h"
+#include "../../common/msg/Snapshot.h"
+#include "../TestCheck.h"
+#include <iostream>
+
+using namespace Aseba;
+using namespace std;
+
+//! Reply to request with the content of memory, as a node would
+Variables reply(const GetVariables& request, const vector<int16_t>& memory)
+{
+	Variables variables;
+	variables.source = request.dest;
+	variables.start = request.start;
+	variables.variables.assign(memory.begin() + request.start, memory.begin() + request.start + request.length);
+	return variables;
+}
+
+int main()
+{
+	// two nodes, one larger than a single reply
+	const unsigned largeSize(2 * VariablesSnapshot::CHUNK_SIZE + 10);
+	vector<int16_t> memory1(largeSize), memory2(20);
+	for (size_t i = 0; i < memory1.size(); ++i)
+		memory1[i] = int16_t(i * 3 - 100);
+	for (size_t i = 0; i < memory2.size(); ++i)
+		memory2[i] = int16_t(-i);
+	VariablesMap layout1, layout2;
+	layout1[L"id"] = make_pair(0u, 1u);
+	layout1[L"buffer"] = make_pair(1u, largeSize - 1);
+	layout2[L"x"] = make_pair(0u, 20u);
+	
+	VariablesSnapshot snapshot;
+	snapshot.addNode(1, largeSize, layout1);
+	snapshot.addNode(2, 20, layout2);
+	
+	// the minimal number of requests, addressed to the given destination
+	const vector<GetVariables> requests1(snapshot.getRequests(1, 5));
+	const vector<GetVariables> requests2(snapshot.getRequests(2));
+	check(requests1.size() == 3, "wrong number of requests for a large node");
+	check(requests2.size() == 1, "wrong number of requests for a small node");
+	check(requests1[0].dest == 5 && requests2[0].dest == 2, "wrong request destination");
+	check(requests1[2].start == 2 * VariablesSnapshot::CHUNK_SIZE && requests1[2].length == 10, "wrong last chunk");
+	
+	// replies in any order, unrelated ones are ignored
+	Variables unrelated;
+	unrelated.source = 1;
+	unrelated.start = 3;
+	unrelated.variables.assign(2, 0);
+	check(!snapshot.received(1, unrelated), "unrelated reply accepted");
+	check(!snapshot.received(3, reply(requests2[0], memory2)), "reply from an unknown node accepted");
+	check(snapshot.received(2, reply(requests2[0], memory2)), "reply rejected");
+	check(!snapshot.received(2, reply(requests2[0], vector<int16_t>(20, 7))), "second reply to the same request accepted");
+	for (size_t i = requests1.size(); i > 0; --i)
+	{
+		check(!snapshot.isComplete(), "snapshot complete too early");
+		check(snapshot.received(1, reply(requests1[i - 1], memory1)), "reply rejected");
+	}
+	check(snapshot.isComplete(), "snapshot not complete");
+	
+	// a full snapshot decodes to the same memory and layout
+	SnapshotHistory history;
+	const vector<uint8_t> full(history.encode(snapshot));
+	VariablesSnapshot decoded;
+	uint32_t id;
+	check(decoded.decode(full, &id), "cannot decode full snapshot");
+	check(id == history.getLastId(), "wrong snapshot id");
+	check(decoded.getNodes().at(1).data == memory1 && decoded.getNodes().at(2).data == memory2, "decoded memory differs");
+	check(decoded.getNodes().at(1).layout == layout1, "decoded layout differs");
+	
+	// a delta only holds the changed words and applies to the previous snapshot
+	memory1[7] = 1000;
+	memory1[9] = 1001;
+	memory1[largeSize - 1] = 1002;
+	VariablesSnapshot next;
+	next.addNode(1, largeSize, layout1);
+	next.addNode(2, 20, layout2);
+	for (const GetVariables& request: next.getRequests(1))
+		next.received(1, reply(request, memory1));
+	for (const GetVariables& request: next.getRequests(2))
+		next.received(2, reply(request, memory2));
+	check(next.isComplete(), "next snapshot not complete");
+	const vector<uint8_t> delta(history.encode(next, id));
+	check(delta.size() < full.size() / 4, "delta is not compact");
+	check(decoded.decode(delta), "cannot decode delta snapshot");
+	check(decoded.getNodes().at(1).data == memory1 && decoded.getNodes().at(2).data == memory2, "memory differs after delta");
+	
+	// unknown bases give full snapshots, truncated blobs are rejected
+	check(history.encode(next, id + 1000).size() == full.size(), "unknown base not encoded in full");
+	vector<uint8_t> truncated(delta.begin(), delta.end() - 1);
+	check(!decoded.decode(truncated), "truncated snapshot accepted");
+	
+	return 0;
+}
@@ -8,6 +8,7 @@
  1. Aseba::HttpRequest object
  2. Aseba::HttpInterface hub -- "asebadummynode 0" must be running
  3. JSON parsing for integer arrays
+ 4. Aseba::Http::HttpRequest and HttpResponse objects of asebahttp2
 */
 
 #define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
@@ -17,6 +18,8 @@
 #undef ERROR_STACK_OVERFLOW
 #endif
 #include "../switches/http/http.h"
+#include "../switches/http2/HttpRequest.h"
+#include "../switches/http2/HttpResponse.h"
 
 class Dummy: public Dashel::Hub
 {
@@ -25,11 +28,12 @@ public:
     {
         instream = connect("file:name=testdata-HttpRequest.txt;mode=read");
         outstream = connect("stdout:");
+        http2stream = connect("file:name=testdata-HttpRequest.txt;mode=read");
     }
     void connectionCreated(Dashel::Stream *stream) {};
     void connectionClosed(Dashel::Stream *stream, bool abnormal) {};
     void incomingData(Dashel::Stream *stream) {};
-    Dashel::Stream *instream, *outstream;
+    Dashel::Stream *instream, *outstream, *http2stream;
 };
 
 Dummy* dummy;
@@ -103,13 +107,159 @@ SCENARIO( "HttpRequests should be read from file", "[read]" ) {
     }
 };
 
+SCENARIO( "HttpRequests should follow header case and persistence rules", "[read]" ) {
+    GIVEN( "Requests 1 and 2 were read" ) {
+        REQUIRE( dummy->instream != nullptr );
+        WHEN( "read request 3 with mixed-case headers from file" ) {
+            req.initialize(dummy->instream);
+            req.incomingData(); // from dummy->instream
+            THEN( "headers are matched case-insensitively and the connection closes" ) {
+                REQUIRE( req.ready );
+                REQUIRE( req.method.find("POST")==0 );
+                REQUIRE( req.headers["Content-Length"].find("9")==0 );
+                REQUIRE( req.headers["Connection"] == "Close" );
+                REQUIRE( req.content == "[1,2,3]\r\n" );
+                REQUIRE( ! req.isPersistent() );
+            }
+        }
+        AND_WHEN( "read request 4, HTTP/1.0 with keep-alive, from file" ) {
+            req.initialize(dummy->instream);
+            req.incomingData(); // from dummy->instream
+            THEN( "the connection is kept alive" ) {
+                REQUIRE( req.ready );
+                REQUIRE( req.protocol_version == "HTTP/1.0" );
+                REQUIRE( req.content.size()==0 );
+                REQUIRE( req.isPersistent() );
+            }
+        }
+        AND_WHEN( "read request 5, HTTP/1.0 without keep-alive, from file" ) {
+            req.initialize(dummy->instream);
+            req.incomingData(); // from dummy->instream
+            THEN( "the connection closes" ) {
+                REQUIRE( req.ready );
+                REQUIRE( req.protocol_version == "HTTP/1.0" );
+                REQUIRE( ! req.isPersistent() );
+            }
+        }
+    }
+};
+
+/*
+  asebahttp2 requests read from the same file, with responses recorded instead of written to a stream
+*/
+
+class RecordingHttpResponse: public Aseba::Http::HttpResponse
+{
+public:
+    RecordingHttpResponse(const Aseba::Http::HttpRequest *originatingRequest):
+        Aseba::Http::HttpResponse(originatingRequest),
+        writes(0)
+    {}
+    std::string written;
+    int writes;
+protected:
+    virtual void writeRaw(const char *buffer, int length)
+    {
+        written.append(buffer, length);
+        ++writes;
+    }
+};
+
+class RecordingHttpRequest: public Aseba::Http::DashelHttpRequest
+{
+public:
+    RecordingHttpRequest(Dashel::Stream *stream): Aseba::Http::DashelHttpRequest(stream) {}
+    //! Send a 200 response with content and return it
+    RecordingHttpResponse& sendResponse(const std::string& content)
+    {
+        respond().setContent(content);
+        respond().send();
+        return static_cast<RecordingHttpResponse&>(respond());
+    }
+protected:
+    virtual Aseba::Http::HttpResponse *createResponse() { return new RecordingHttpResponse(this); }
+};
+
+//! Return whether s ends with suffix
+bool endsWith(const std::string& s, const std::string& suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+SCENARIO( "asebahttp2 HttpRequests should be read from file and answered in a single write", "[http2]" ) {
+    GIVEN( "Stream was initialized" ) {
+        REQUIRE( dummy->http2stream != nullptr );
+        WHEN( "read request 1 from file" ) {
+            RecordingHttpRequest request(dummy->http2stream);
+            REQUIRE( request.receive() );
+            THEN( "HttpRequest is correct" ) {
+                REQUIRE( request.getMethod() == "GET" );
+                REQUIRE( request.getUri() == "/uri/a/b/c" );
+                REQUIRE( request.getHeader("content-length") == "19" );
+                REQUIRE( request.getContent() == "payload uri a b c\r\n" );
+            }
+        }
+        AND_WHEN( "read request 2, HTTP/1.1 without Connection header, from file" ) {
+            RecordingHttpRequest request(dummy->http2stream);
+            REQUIRE( request.receive() );
+            THEN( "the connection is kept alive and the response is framed in one write" ) {
+                REQUIRE( request.isPersistent() );
+                RecordingHttpResponse& response(request.sendResponse("[]"));
+                REQUIRE( response.writes == 1 );
+                REQUIRE( response.written.find("HTTP/1.1 200 OK\r\n")==0 );
+                REQUIRE( response.written.find("Content-Length: 2\r\n") != std::string::npos );
+                REQUIRE( response.written.find("Connection") == std::string::npos );
+                REQUIRE( endsWith(response.written, "\r\n\r\n[]") );
+            }
+        }
+        AND_WHEN( "read request 3 with mixed-case headers from file" ) {
+            RecordingHttpRequest request(dummy->http2stream);
+            REQUIRE( request.receive() );
+            THEN( "headers are matched case-insensitively and the response closes the connection" ) {
+                REQUIRE( request.getMethod() == "POST" );
+                REQUIRE( request.getHeader("Content-Length") == "9" );
+                REQUIRE( request.getHeader("Connection") == "Close" );
+                REQUIRE( request.getHeader("host") == "localhost" );
+                REQUIRE( request.getContent() == "[1,2,3]\r\n" );
+                REQUIRE( ! request.isPersistent() );
+                RecordingHttpResponse& response(request.sendResponse("[1,2,3]"));
+                REQUIRE( response.writes == 1 );
+                REQUIRE( response.written.find("Connection: close\r\n") != std::string::npos );
+                REQUIRE( endsWith(response.written, "\r\n\r\n[1,2,3]") );
+            }
+        }
+        AND_WHEN( "read request 4, HTTP/1.0 with keep-alive, from file" ) {
+            RecordingHttpRequest request(dummy->http2stream);
+            REQUIRE( request.receive() );
+            THEN( "the response keeps the connection alive and advertises its timeout" ) {
+                REQUIRE( request.isPersistent() );
+                RecordingHttpResponse& response(request.sendResponse("[]"));
+                REQUIRE( response.writes == 1 );
+                REQUIRE( response.written.find("HTTP/1.0 200 OK\r\n")==0 );
+                REQUIRE( response.written.find("Connection: keep-alive\r\n") != std::string::npos );
+                REQUIRE( response.written.find("Keep-Alive: timeout=60\r\n") != std::string::npos );
+            }
+        }
+        AND_WHEN( "read request 5, HTTP/1.0 without keep-alive, from file" ) {
+            RecordingHttpRequest request(dummy->http2stream);
+            REQUIRE( request.receive() );
+            THEN( "the response closes the connection" ) {
+                REQUIRE( ! request.isPersistent() );
+                RecordingHttpResponse& response(request.sendResponse("[]"));
+                REQUIRE( response.writes == 1 );
+                REQUIRE( response.written.find("Connection: close\r\n") != std::string::npos );
+            }
+        }
+    }
+};
+
 TEST_CASE_METHOD(Aseba::HttpInterface, "Aseba::HttpInterface should be initialized", "[create]") {
     REQUIRE( this != nullptr );
     for (int i = 50; --i; )
         this->step(20);
     REQUIRE( asebaStream != nullptr );
-    REQUIRE( ! nodesDescriptions.empty() );
-    REQUIRE( nodesDescriptions[1].name.size() != 0 );
+    REQUIRE( ! nodes.empty() );
+    REQUIRE( nodes.begin()->second.getDescription().name.size() != 0 );
 };
 
 TEST_CASE_METHOD(Aseba::HttpInterface, "StreamResponseQueueMap should manage pending responses" ) {
@@ -0,0 +1,90 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../../common/utils/AeslReader.h"
+#include "../TestCheck.h"
+#include <iostream>
+#include <cstring>
+
+using namespace Aseba;
+using namespace std;
+
+static const char* project =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<!DOCTYPE aesl-source>\n"
+	"<network>\n"
+	"<!--list of global events-->\n"
+	"<event size=\"2\" name=\"ping\"/>\n"
+	"<!--list of constants-->\n"
+	"<constant value=\"-4\" name=\"LIMIT\"/>\n"
+	"<keywords flag=\"true\"/>\n"
+	"<node nodeId=\"2\" name=\"thymio-II\">var a = 1\r\nif a &lt; LIMIT then\n\temit ping [a, 2]\nend</node>\n"
+	"<node name=\"other\"><![CDATA[var b = 3 < 4]]> # &#233;</node>\n"
+	"<toolsPlugins><ThymioVisualProgramming><vplroot/></ThymioVisualProgramming></toolsPlugins>\n"
+	"</network>\n";
+
+int main(int argc, char* argv[])
+{
+	// parse from memory
+	{
+		AeslReader reader;
+		check(reader.openMemory(project, strlen(project)), "valid project did not load");
+		const CommonDefinitions& definitions(reader.getCommonDefinitions());
+		check(definitions.events.size() == 1 && definitions.events[0].name == L"ping" && definitions.events[0].value == 2, "event not read");
+		check(definitions.constants.size() == 1 && definitions.constants[0].name == L"LIMIT" && definitions.constants[0].value == -4, "constant not read");
+		const AeslReader::Nodes& nodes(reader.getNodes());
+		check(nodes.size() == 2, "wrong number of nodes");
+		check(nodes[0].name == "thymio-II" && nodes[0].preferedId() == 2, "first node attributes not read");
+		check(nodes[0].code() == "var a = 1\nif a < LIMIT then\n\temit ping [a, 2]\nend", "first node code not decoded");
+		check(nodes[1].name == "other" && nodes[1].nodeId.empty() && nodes[1].preferedId() == 0, "second node attributes not read");
+		check(nodes[1].code() == "var b = 3 < 4 # \xc3\xa9", "second node code not decoded");
+		check(nodes[1].wcode() == L"var b = 3 < 4 # é", "second node wide code not decoded");
+	}
+	
+	// filter nodes
+	{
+		AeslReader reader;
+		check(reader.openMemory(project, strlen(project), [](const string& name, unsigned) { return name == "other"; }), "filtered project did not load");
+		check(reader.getNodes().size() == 1 && reader.getNodes()[0].name == "other", "filter not applied");
+	}
+	
+	// reject invalid projects
+	{
+		const char* tooLarge = "<network><event size=\"600\" name=\"big\"/></network>";
+		const char* truncated = "<network><node name=\"a\">var a";
+		const char* wrongRoot = "<project></project>";
+		AeslReader reader;
+		check(!reader.openMemory(tooLarge, strlen(tooLarge)) && !reader.getError().empty(), "too large event accepted");
+		check(reader.getCommonDefinitions().events.empty(), "definitions kept after error");
+		check(!reader.openMemory(truncated, strlen(truncated)), "truncated project accepted");
+		check(!reader.openMemory(wrongRoot, strlen(wrongRoot)), "wrong root accepted");
+	}
+	
+	// map files given on the command line
+	for (int i = 1; i < argc; ++i)
+	{
+		AeslReader reader;
+		check(reader.openFile(argv[i]), "file did not load");
+		check(!reader.getNodes().empty(), "file has no node");
+		check(!reader.openFile(string(argv[i]) + ".missing"), "missing file loaded");
+	}
+	
+	return 0;
+}
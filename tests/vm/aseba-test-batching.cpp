@@ -0,0 +1,282 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../../compiler/compiler.h"
+#include "../../vm/vm.h"
+#include "../../transport/buffer/vm-buffer.h"
+#include "../../common/consts.h"
+#include "../../common/msg/msg.h"
+#include "../TestCheck.h"
+#include <dashel/dashel.h>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+using namespace Aseba;
+using namespace std;
+
+//! Frames sent by the VM, without source nor length
+static vector<vector<uint8_t> > sentFrames;
+//! Frames to be read by the VM, with their source
+static deque<pair<uint16_t, vector<uint8_t> > > incomingFrames;
+
+extern "C" void AsebaSendBuffer(AsebaVMState *vm, const uint8_t* data, uint16_t length)
+{
+	sentFrames.push_back(vector<uint8_t>(data, data + length));
+}
+
+extern "C" uint16_t AsebaGetBuffer(AsebaVMState *vm, uint8_t* data, uint16_t maxLength, uint16_t* source)
+{
+	if (incomingFrames.empty())
+		return 0;
+	const vector<uint8_t> frame(incomingFrames.front().second);
+	*source = incomingFrames.front().first;
+	incomingFrames.pop_front();
+	memcpy(data, &frame[0], frame.size());
+	return frame.size();
+}
+
+static AsebaVMDescription vmDescription =
+{
+	"testvm",
+	{
+		{ 1, "_id" },
+		{ 1, "event.source" },
+		{ 32, "event.args" },
+		{ 0, 0 }
+	}
+};
+
+static const AsebaLocalEventDescription localEvents[] = { { 0, 0 } };
+static const AsebaNativeFunctionDescription* nativeFunctionsDescriptions[] = { 0 };
+
+extern "C" const AsebaVMDescription* AsebaGetVMDescription(AsebaVMState *vm) { return &vmDescription; }
+extern "C" const AsebaLocalEventDescription * AsebaGetLocalEventsDescriptions(AsebaVMState *vm) { return localEvents; }
+extern "C" const AsebaNativeFunctionDescription * const * AsebaGetNativeFunctionsDescriptions(AsebaVMState *vm) { return nativeFunctionsDescriptions; }
+extern "C" void AsebaNativeFunction(AsebaVMState *vm, uint16_t id) {}
+extern "C" void AsebaPutVmToSleep(AsebaVMState *vm) {}
+extern "C" void AsebaWriteBytecode(AsebaVMState *vm) {}
+extern "C" void AsebaResetIntoBootloader(AsebaVMState *vm) {}
+
+extern "C" void AsebaAssert(AsebaVMState *vm, AsebaAssertReason reason)
+{
+	cerr << "Internal VM exception " << reason << " at pc " << vm->pc << endl;
+	throw runtime_error("VM assertion");
+}
+
+//! A stream readable from the frames sent by the VM
+class MemoryStream: public Dashel::Stream
+{
+public:
+	vector<uint8_t> data;
+	size_t readPos = 0;
+
+	MemoryStream(): Dashel::Stream("memory") {}
+
+	virtual void write(const void *ptr, const size_t size) {}
+	virtual void flush() {}
+	virtual void read(void *ptr, size_t size)
+	{
+		if (readPos + size > data.size())
+			throw runtime_error("Read past end of memory stream");
+		memcpy(ptr, &data[readPos], size);
+		readPos += size;
+	}
+
+	//! Append a frame sent by the VM, with its length and source
+	void append(const vector<uint8_t>& frame, uint16_t source)
+	{
+		const uint16_t len(frame.size() - 2);
+		data.push_back(len & 0xff);
+		data.push_back(len >> 8);
+		data.push_back(source & 0xff);
+		data.push_back(source >> 8);
+		data.insert(data.end(), frame.begin(), frame.end());
+	}
+};
+
+//! Return the type of a frame sent by the VM
+uint16_t frameType(const vector<uint8_t>& frame)
+{
+	return frame[0] | (frame[1] << 8);
+}
+
+//! Queue a message for the VM, as if it was sent by a host
+void receiveFromHost(const Message& message)
+{
+	vector<uint8_t> frame;
+	message.serialize(frame);
+	// skip length and source
+	incomingFrames.push_back(make_pair(message.source, vector<uint8_t>(frame.begin() + 4, frame.end())));
+}
+
+//! Queue a description request from a host using protocol version
+void descriptionRequest(uint16_t version)
+{
+	GetDescription request;
+	request.version = version;
+	receiveFromHost(request);
+}
+
+//! Trigger event go and run it to completion
+void runGo(AsebaVMState* vm, uint16_t goId)
+{
+	receiveFromHost(UserMessage(goId));
+	AsebaProcessIncomingEvents(vm);
+	AsebaVMRun(vm, 1000);
+	AsebaFlushEvents(vm);
+}
+
+//! Check that frames decode back to the events emitted by the program, in order
+void checkEvents(const vector<vector<uint8_t> >& frames, uint16_t nodeId)
+{
+	MemoryStream stream;
+	for (const auto& frame: frames)
+		stream.append(frame, nodeId);
+
+	// unpack the batches as hosts do
+	vector<UserMessage> events;
+	while (stream.readPos < stream.data.size())
+	{
+		unique_ptr<Message> message(Message::receive(&stream));
+		const UserMessage* userMessage(dynamic_cast<UserMessage*>(message.get()));
+		const EventsBatch* batch(dynamic_cast<EventsBatch*>(message.get()));
+		check(userMessage != nullptr || batch != nullptr, "frame did not decode to events");
+		if (userMessage)
+			events.push_back(*userMessage);
+		else
+			events.insert(events.end(), batch->events.begin(), batch->events.end());
+	}
+
+	const UserMessage expected[] = {
+		UserMessage(0, UserMessage::DataVector{1, 2}),
+		UserMessage(1, UserMessage::DataVector{3}),
+		UserMessage(0, UserMessage::DataVector{4, -5}),
+		UserMessage(2)
+	};
+	check(events.size() == sizeof(expected) / sizeof(expected[0]), "wrong number of events");
+	for (size_t i = 0; i < events.size(); ++i)
+	{
+		check(events[i].source == nodeId, "event has wrong source");
+		check(events[i].type == expected[i].type && events[i].data == expected[i].data, "event differs");
+	}
+}
+
+int main()
+{
+	// compile the program
+	TargetDescription description;
+	description.name = L"testvm";
+	description.protocolVersion = ASEBA_PROTOCOL_VERSION;
+	description.bytecodeSize = 256;
+	description.variablesSize = 64;
+	description.stackSize = 32;
+	description.namedVariables.push_back(TargetDescription::NamedVariable(L"_id", 1));
+	description.namedVariables.push_back(TargetDescription::NamedVariable(L"event.source", 1));
+	description.namedVariables.push_back(TargetDescription::NamedVariable(L"event.args", 32));
+	CommonDefinitions definitions;
+	definitions.events.push_back(NamedValue(L"a", 2));
+	definitions.events.push_back(NamedValue(L"b", 1));
+	definitions.events.push_back(NamedValue(L"c", 0));
+	definitions.events.push_back(NamedValue(L"go", 0));
+	const uint16_t goId(3);
+	Compiler compiler;
+	compiler.setTargetDescription(&description);
+	compiler.setCommonDefinitions(&definitions);
+	wistringstream source(
+		L"onevent go\n"
+		L"\temit a [1, 2]\n"
+		L"\temit b 3\n"
+		L"\temit a [4, -5]\n"
+		L"\temit c\n"
+	);
+	BytecodeVector bytecode;
+	unsigned allocatedVariablesCount;
+	Error error;
+	check(compiler.compile(source, bytecode, allocatedVariablesCount, error), "program does not compile");
+
+	// create the VM
+	vector<uint16_t> vmBytecode(description.bytecodeSize);
+	vector<int16_t> vmVariables(description.variablesSize);
+	vector<int16_t> vmStack(description.stackSize);
+	AsebaVMState vm;
+	vm.nodeId = 5;
+	vm.bytecode = &vmBytecode[0];
+	vm.bytecodeSize = vmBytecode.size();
+	vm.variables = &vmVariables[0];
+	vm.variablesSize = vmVariables.size();
+	vm.stack = &vmStack[0];
+	vm.stackSize = vmStack.size();
+	AsebaVMInit(&vm);
+	copy(bytecode.begin(), bytecode.end(), vmBytecode.begin());
+	vm.flags = 0;
+
+	// without a host announcing batching support, events are sent one by one
+	runGo(&vm, goId);
+	check(sentFrames.size() == 4, "events were not sent one by one");
+	checkEvents(sentFrames, vm.nodeId);
+
+	// a host unpacking batches enables batching, events are sent in a single frame when the glue code flushes them
+	descriptionRequest(ASEBA_EVENTS_BATCH_PROTOCOL_VERSION);
+	AsebaProcessIncomingEvents(&vm);
+	sentFrames.clear();
+	runGo(&vm, goId);
+	check(sentFrames.size() == 1, "events were not batched");
+	check(frameType(sentFrames[0]) == ASEBA_MESSAGE_EVENTS_BATCH, "batch has wrong type");
+	checkEvents(sentFrames, vm.nodeId);
+
+	// other messages are not held back, and the events before them are sent first
+	sentFrames.clear();
+	receiveFromHost(UserMessage(goId));
+	AsebaProcessIncomingEvents(&vm);
+	unsigned emitted(0);
+	while (emitted < 2)
+	{
+		if ((vm.bytecode[vm.pc] >> 12) == ASEBA_BYTECODE_EMIT)
+			++emitted;
+		AsebaVMRun(&vm, 1);
+	}
+	check(sentFrames.empty(), "events of an unfinished handler were sent");
+	uint16_t getVariables[] = { vm.nodeId, 0, 1 };
+	AsebaVMDebugMessage(&vm, ASEBA_MESSAGE_GET_VARIABLES, getVariables, 3);
+	check(sentFrames.size() == 2, "events were not sent before variables");
+	check(frameType(sentFrames[0]) == ASEBA_MESSAGE_EVENTS_BATCH && frameType(sentFrames[1]) == ASEBA_MESSAGE_VARIABLES, "events were not sent before variables");
+	AsebaVMRun(&vm, 1000);
+	AsebaFlushEvents(&vm);
+	check(sentFrames.size() == 3 && frameType(sentFrames[2]) == ASEBA_MESSAGE_EVENTS_BATCH, "remaining events were not batched");
+	sentFrames.erase(sentFrames.begin() + 1);
+	checkEvents(sentFrames, vm.nodeId);
+
+	// a host not unpacking batches disables batching for good
+	descriptionRequest(ASEBA_PROTOCOL_VERSION);
+	AsebaProcessIncomingEvents(&vm);
+	descriptionRequest(ASEBA_EVENTS_BATCH_PROTOCOL_VERSION);
+	AsebaProcessIncomingEvents(&vm);
+	sentFrames.clear();
+	runGo(&vm, goId);
+	check(sentFrames.size() == 4, "batching was not disabled by a host not unpacking batches");
+	checkEvents(sentFrames, vm.nodeId);
+
+	return 0;
+}
@@ -0,0 +1,391 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Differential test of bytecode translated to C or to machine code against the interpreter
+
+#include "../../compiler/compiler.h"
+#include "../../compiler/bytecode-to-c.h"
+#include "../../vm/vm.h"
+#include "../../vm/natives.h"
+#include "../../vm/compiled.h"
+#include "../../vm/jit.h"
+#include "../../common/consts.h"
+#include "../../common/utils/utils.h"
+
+// C++
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <memory>
+
+using namespace Aseba;
+using namespace std;
+
+// messages sent by each VM, as type followed by payload
+static map<const AsebaVMState*, vector<uint16_t>> sentMessages;
+
+extern "C" void AsebaSendMessage(AsebaVMState *vm, uint16_t type, const void *data, uint16_t size)
+{
+	vector<uint16_t>& log(sentMessages[vm]);
+	log.push_back(type);
+	const uint8_t* bytes(reinterpret_cast<const uint8_t*>(data));
+	for (uint16_t i = 0; i < size; ++i)
+		log.push_back(bytes[i]);
+}
+
+#ifdef __BIG_ENDIAN__
+extern "C" void AsebaSendMessageWords(AsebaVMState *vm, uint16_t type, const uint16_t* data, uint16_t count)
+{
+	AsebaSendMessage(vm, type, data, count*2);
+}
+#endif
+
+extern "C" void AsebaSendVariables(AsebaVMState *vm, uint16_t start, uint16_t length) {}
+extern "C" void AsebaSendDescription(AsebaVMState *vm) {}
+extern "C" void AsebaPutVmToSleep(AsebaVMState *vm) {}
+extern "C" void AsebaWriteBytecode(AsebaVMState *vm) {}
+extern "C" void AsebaResetIntoBootloader(AsebaVMState *vm) {}
+
+static bool asserted(false);
+
+extern "C" void AsebaAssert(AsebaVMState *vm, AsebaAssertReason reason)
+{
+	cerr << "Internal VM exception " << reason << " at pc " << vm->pc << endl;
+	asserted = true;
+	AsebaVMInit(vm);
+}
+
+static AsebaNativeFunctionPointer nativeFunctions[] =
+{
+	ASEBA_NATIVES_STD_FUNCTIONS,
+};
+
+static const AsebaNativeFunctionDescription* nativeFunctionsDescriptions[] =
+{
+	ASEBA_NATIVES_STD_DESCRIPTIONS,
+	0
+};
+
+static const AsebaNativeDispatchEntry nativeDispatch[] =
+{
+	ASEBA_NATIVES_STD_DISPATCH
+};
+
+extern "C" void AsebaNativeFunction(AsebaVMState *vm, uint16_t id)
+{
+	nativeFunctions[id](vm);
+}
+
+extern "C" const AsebaNativeFunctionDescription * const * AsebaGetNativeFunctionsDescriptions(AsebaVMState *vm)
+{
+	return nativeFunctionsDescriptions;
+}
+
+//! A node with the same memory layout as the one of asebatest, calling natives directly if withDispatch is true
+struct TestNode
+{
+	AsebaVMState vm;
+	vector<uint16_t> bytecode;
+	vector<int16_t> stack;
+	vector<int16_t> variables;
+
+	TestNode(bool withDispatch = false):
+		bytecode(512),
+		stack(64),
+		variables(256)
+	{
+		vm.nodeId = 0;
+		vm.bytecode = &bytecode[0];
+		vm.bytecodeSize = bytecode.size();
+		vm.stack = &stack[0];
+		vm.stackSize = stack.size();
+		vm.variables = &variables[0];
+		vm.variablesSize = variables.size();
+		AsebaVMInit(&vm);
+		if (withDispatch)
+		{
+			vm.nativeDispatch = nativeDispatch;
+			vm.nativeDispatchSize = ASEBA_NATIVES_STD_COUNT;
+		}
+	}
+
+	void load(const BytecodeVector& code)
+	{
+		copy(code.begin(), code.end(), bytecode.begin());
+	}
+};
+
+TargetDescription targetDescription()
+{
+	TargetDescription d;
+	d.name = L"testvm";
+	d.protocolVersion = ASEBA_PROTOCOL_VERSION;
+	d.bytecodeSize = 512;
+	d.variablesSize = 256;
+	d.stackSize = 64;
+	for (const AsebaNativeFunctionDescription* const* desc(nativeFunctionsDescriptions); *desc; ++desc)
+	{
+		TargetDescription::NativeFunction native{ UTF8ToWString((*desc)->name), UTF8ToWString((*desc)->doc) };
+		for (const AsebaNativeFunctionArgumentDescription* param((*desc)->arguments); param->size; ++param)
+			native.parameters.push_back(TargetDescription::NativeFunctionParameter(UTF8ToWString(param->name), param->size));
+		d.nativeFunctions.push_back(native);
+	}
+	TargetDescription::LocalEvent testLocalEvent;
+	testLocalEvent.name = L"test";
+	testLocalEvent.description = L"test local event";
+	d.localEvents.push_back(testLocalEvent);
+	return d;
+}
+
+//! Return an empty string if both nodes are in the same state, a description of the first difference otherwise
+string compare(const TestNode& interpreted, const TestNode& compiled)
+{
+	if (interpreted.vm.pc != compiled.vm.pc)
+		return FormatableString("pc differs: %0 vs %1").arg(interpreted.vm.pc).arg(compiled.vm.pc);
+	if (interpreted.vm.sp != compiled.vm.sp)
+		return FormatableString("sp differs: %0 vs %1").arg(interpreted.vm.sp).arg(compiled.vm.sp);
+	if (interpreted.vm.flags != compiled.vm.flags)
+		return FormatableString("flags differ: %0 vs %1").arg(interpreted.vm.flags).arg(compiled.vm.flags);
+	for (size_t i = 0; i < interpreted.variables.size(); ++i)
+		if (interpreted.variables[i] != compiled.variables[i])
+			return FormatableString("variable %0 differs: %1 vs %2").arg(i).arg(interpreted.variables[i]).arg(compiled.variables[i]);
+	for (int i = 0; i <= interpreted.vm.sp && i < int(interpreted.stack.size()); ++i)
+		if (interpreted.stack[i] != compiled.stack[i])
+			return FormatableString("stack %0 differs: %1 vs %2").arg(i).arg(interpreted.stack[i]).arg(compiled.stack[i]);
+	for (size_t i = 0; i < ASEBA_MAX_WHEN_SLOTS / 16; ++i)
+		if (interpreted.vm.whenStates[i] != compiled.vm.whenStates[i])
+			return FormatableString("when states %0 differ: %1 vs %2").arg(i).arg(interpreted.vm.whenStates[i]).arg(compiled.vm.whenStates[i]);
+	if (interpreted.bytecode != compiled.bytecode)
+		return "bytecode differs";
+	if (sentMessages[&interpreted.vm] != sentMessages[&compiled.vm])
+		return "sent messages differ";
+	return "";
+}
+
+//! A way to execute bytecode, compared to the interpreter
+struct Engine
+{
+	virtual ~Engine() {}
+	//! Prepare to run bytecode, return false on failure
+	virtual bool prepare(const BytecodeVector& bytecode) { return true; }
+	//! Deliver a debug message to node
+	virtual void debugMessage(TestNode& node, uint16_t id, vector<uint16_t> data) { AsebaVMDebugMessage(&node.vm, id, &data[0], data.size()); }
+	//! Run node for at most steps
+	virtual void run(TestNode& node, unsigned steps) { AsebaVMRun(&node.vm, steps); }
+	//! Called once the program was executed
+	virtual void finish() {}
+};
+
+//! Bytecode translated to C and loaded as a shared object
+struct AotEngine: Engine
+{
+	string includeDir;
+	unique_ptr<CompiledBytecode> compiled;
+
+	AotEngine(const string& includeDir): includeDir(includeDir) {}
+
+	bool prepare(const BytecodeVector& bytecode) override
+	{
+		compiled.reset(new CompiledBytecode);
+		if (!compiled->build(bytecode, includeDir))
+		{
+			cerr << compiled->getError() << endl;
+			return false;
+		}
+		return true;
+	}
+
+	void run(TestNode& node, unsigned steps) override
+	{
+		if (!AsebaVMCompiledProgramMatches(&node.vm, compiled->getProgram()))
+			cerr << "translated program does not match bytecode" << endl;
+		AsebaVMRunCompiled(&node.vm, compiled->getProgram(), steps);
+	}
+};
+
+//! Tiered JIT, shared by all programs so that invalidation is tested
+struct JitEngine: Engine
+{
+	AsebaJit* jit;
+	unsigned compiledCount = 0;
+
+	JitEngine(uint16_t threshold): jit(AsebaJitCreate(threshold)) {}
+	~JitEngine() { AsebaJitDestroy(jit); }
+
+	void debugMessage(TestNode& node, uint16_t id, vector<uint16_t> data) override
+	{
+		AsebaJitDebugMessage(&node.vm, jit, id, &data[0], data.size());
+	}
+
+	void run(TestNode& node, unsigned steps) override
+	{
+		AsebaVMRunJit(&node.vm, jit, steps);
+	}
+
+	void finish() override
+	{
+		AsebaJitStatistics statistics;
+		AsebaJitGetStatistics(jit, &statistics);
+		compiledCount += statistics.compiledCount;
+	}
+};
+
+//! Load bytecode into node through debug messages, as a host would
+void load(Engine& engine, TestNode& node, const BytecodeVector& bytecode)
+{
+	vector<uint16_t> data{ bswap16(node.vm.nodeId), 0 };
+	for (const BytecodeElement& element: bytecode)
+		data.push_back(bswap16(element.bytecode));
+	engine.debugMessage(node, ASEBA_MESSAGE_SET_BYTECODE, data);
+	engine.debugMessage(node, ASEBA_MESSAGE_RUN, { bswap16(node.vm.nodeId) });
+}
+
+//! Setup event on both nodes and run them until completion or stepsLimit steps, in chunks of chunkSize steps if not 0
+string runBoth(Engine& engine, TestNode& interpreted, TestNode& compiled, uint16_t event, unsigned stepsLimit, unsigned chunkSize)
+{
+	AsebaVMSetupEvent(&interpreted.vm, event);
+	AsebaVMSetupEvent(&compiled.vm, event);
+	const unsigned chunk(chunkSize ? chunkSize : stepsLimit);
+	for (unsigned steps = 0; steps < stepsLimit; steps += chunk)
+	{
+		AsebaVMRun(&interpreted.vm, chunk);
+		engine.run(compiled, chunk);
+		const string difference(compare(interpreted, compiled));
+		if (!difference.empty())
+			return FormatableString("%0 after %1 steps").arg(difference).arg(steps + chunk);
+		if (AsebaMaskIsClear(interpreted.vm.flags, ASEBA_VM_EVENT_ACTIVE_MASK))
+			break;
+	}
+	return "";
+}
+
+string readFile(const string& fileName)
+{
+	ifstream ifs(fileName.c_str(), ifstream::binary);
+	ostringstream oss;
+	oss << ifs.rdbuf();
+	return oss.str();
+}
+
+//! Test one program, return false on difference
+bool testProgram(Engine& engine, const string& fileName, unsigned& tested)
+{
+	// compile, skipping programs that are not meant to compile
+	const TargetDescription description(targetDescription());
+	CommonDefinitions definitions;
+	definitions.events.push_back(NamedValue(L"event1", 0));
+	definitions.events.push_back(NamedValue(L"event2", 3));
+	definitions.constants.push_back(NamedValue(L"FOO", 2));
+	Compiler compiler;
+	compiler.setTargetDescription(&description);
+	compiler.setCommonDefinitions(&definitions);
+	wistringstream source(UTF8ToWString(readFile(fileName)));
+	BytecodeVector bytecode;
+	unsigned varCount;
+	Error error;
+	if (!compiler.compile(source, bytecode, varCount, error))
+		return true;
+
+	if (!engine.prepare(bytecode))
+	{
+		cerr << fileName << ": cannot prepare execution" << endl;
+		return false;
+	}
+
+	// run every event of the program several times, at once and by small chunks of steps
+	const BytecodeVector::EventAddressesToIdsMap events(bytecode.getEventAddressesToIds());
+	Engine interpreter;
+	for (const unsigned chunkSize: { 0u, 1u, 7u })
+	{
+		TestNode interpretedNode, compiledNode(true);
+		load(interpreter, interpretedNode, bytecode);
+		load(engine, compiledNode, bytecode);
+		for (int repeat = 0; repeat < 3; ++repeat)
+		{
+			for (const auto& event: events)
+			{
+				const string difference(runBoth(engine, interpretedNode, compiledNode, event.second, 1000, chunkSize));
+				if (!difference.empty())
+				{
+					cerr << fileName << ": event " << event.second << ", chunks of " << chunkSize << ": " << difference << endl;
+					return false;
+				}
+			}
+		}
+		engine.finish();
+	}
+
+	// stop at a breakpoint in each event handler in turn; the handler holding the breakpoint is interpreted,
+	// but the other handlers keep running translated code, so breakpoints do not make the whole VM fall back
+	for (const auto& breakpointEvent: events)
+	{
+		const uint16_t breakpoint(breakpointEvent.first + bytecode[breakpointEvent.first].getWordSize());
+		TestNode interpretedNode, compiledNode(true);
+		load(interpreter, interpretedNode, bytecode);
+		load(engine, compiledNode, bytecode);
+		interpreter.debugMessage(interpretedNode, ASEBA_MESSAGE_BREAKPOINT_SET, { bswap16(interpretedNode.vm.nodeId), bswap16(breakpoint) });
+		engine.debugMessage(compiledNode, ASEBA_MESSAGE_BREAKPOINT_SET, { bswap16(compiledNode.vm.nodeId), bswap16(breakpoint) });
+		for (const auto& event: events)
+		{
+			const string difference(runBoth(engine, interpretedNode, compiledNode, event.second, 1000, 0));
+			if (!difference.empty())
+			{
+				cerr << fileName << ": event " << event.second << ", breakpoint at " << breakpoint << ": " << difference << endl;
+				return false;
+			}
+		}
+		engine.finish();
+	}
+	++tested;
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	unique_ptr<Engine> engine;
+	JitEngine* jitEngine(nullptr);
+	if (argc >= 4 && string(argv[1]) == "--aot")
+		engine.reset(new AotEngine(argv[2]));
+	else if (argc >= 4 && string(argv[1]) == "--jit")
+		engine.reset(jitEngine = new JitEngine(atoi(argv[2])));
+	else
+	{
+		cerr << "Usage: " << argv[0] << " (--aot includeDir | --jit threshold) source..." << endl;
+		return 1;
+	}
+
+	unsigned tested(0);
+	bool ok(true);
+	for (int i = 3; i < argc; ++i)
+		ok = testProgram(*engine, argv[i], tested) && ok;
+	cout << "Compared " << tested << " programs" << endl;
+	if (jitEngine)
+	{
+		cout << "Compiled " << jitEngine->compiledCount << " regions to machine code" << endl;
+		if (AsebaJitIsSupported() && jitEngine->compiledCount == 0)
+			return 1;
+	}
+	if (asserted)
+		return 1;
+	return ok && tested > 0 ? 0 : 1;
+}
@@ -9,14 +9,35 @@ static AsebaNativeFunctionPointer nativeFunctions[] =
 	ASEBA_NATIVES_STD_FUNCTIONS,
 };
 
+static const AsebaNativeDispatchEntry nativeDispatch[] =
+{
+	ASEBA_NATIVES_STD_DISPATCH
+};
+
+static const AsebaNativeFunctionDescription* nativeFunctionsDescriptions[] =
+{
+	ASEBA_NATIVES_STD_DESCRIPTIONS
+};
+
 int main(int argc, char*argv[])
 {
 	size_t nativesCount = (sizeof(nativeFunctions)/sizeof(AsebaNativeFunctionPointer));
 	ASEBA_UNUSED(nativeFunctions);
 	if (nativesCount != ASEBA_NATIVES_STD_COUNT)
 		return 1;
-	else
-		return 0;
+	if (sizeof(nativeDispatch)/sizeof(AsebaNativeDispatchEntry) != ASEBA_NATIVES_STD_COUNT)
+		return 1;
+	
+	// the dispatch entries must take from the stack what the compiler pushes
+	for (size_t i = 0; i < ASEBA_NATIVES_STD_COUNT; ++i)
+	{
+		if (nativeDispatch[i].argsCount != AsebaNativeArgsCount(nativeFunctionsDescriptions[i]))
+		{
+			std::cerr << nativeFunctionsDescriptions[i]->name << " takes " << AsebaNativeArgsCount(nativeFunctionsDescriptions[i]) << " words but its dispatch entry " << nativeDispatch[i].argsCount << std::endl;
+			return 1;
+		}
+	}
+	return 0;
 }
 
 
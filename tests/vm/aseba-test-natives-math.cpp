@@ -0,0 +1,179 @@
+#include "../../vm/natives.h"
+#include "../../common/consts.h"
+
+// C++
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstring>
+
+using namespace std;
+
+typedef int16_t (*ScalarFunction)(int16_t);
+typedef void (*ArrayFunction)(int16_t*, const int16_t*, uint16_t);
+
+//! Array lengths that do not match the SIMD width, so that the scalar tails are checked too
+static const uint16_t CHUNK_SIZE = 1003;
+
+//! All 16 bits values, from -32768 to 32767
+static vector<int16_t> allValues()
+{
+	vector<int16_t> values(65536);
+	for (size_t i = 0; i < values.size(); ++i)
+		values[i] = int16_t(i - 32768);
+	return values;
+}
+
+//! Apply function to values by chunks of CHUNK_SIZE
+static vector<int16_t> applyByChunks(ArrayFunction function, const vector<int16_t>& values)
+{
+	vector<int16_t> results(values.size());
+	for (size_t start = 0; start < values.size(); start += CHUNK_SIZE)
+		function(&results[start], &values[start], uint16_t(min<size_t>(CHUNK_SIZE, values.size() - start)));
+	return results;
+}
+
+//! Check that arrayFunction gives the same results as scalarFunction on all inputs, in place as well
+static bool checkEquivalence(const char* name, ScalarFunction scalarFunction, ArrayFunction arrayFunction)
+{
+	const vector<int16_t> inputs(allValues());
+	const vector<int16_t> results(applyByChunks(arrayFunction, inputs));
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		const int16_t expected(scalarFunction(inputs[i]));
+		if (results[i] != expected)
+		{
+			cerr << name << "(" << inputs[i] << ") is " << results[i] << " instead of " << expected << endl;
+			return false;
+		}
+	}
+
+	vector<int16_t> inPlace(inputs);
+	for (size_t start = 0; start < inPlace.size(); start += CHUNK_SIZE)
+		arrayFunction(&inPlace[start], &inPlace[start], uint16_t(min<size_t>(CHUNK_SIZE, inPlace.size() - start)));
+	if (inPlace != results)
+	{
+		cerr << name << " differs when computed in place" << endl;
+		return false;
+	}
+	return true;
+}
+
+//! Check atan2 with each argument taking all values, against a set of values for the other one
+static bool checkAtan2Equivalence()
+{
+	const vector<int16_t> values(allValues());
+	vector<int16_t> others = { -32768, -32767, -16384, -256, -1, 0, 1, 255, 16384, 32767 };
+	for (int other = -32768 + 97; other < 32768; other += 257)
+		others.push_back(int16_t(other));
+
+	vector<int16_t> results(values.size());
+	for (const int16_t other: others)
+	{
+		const vector<int16_t> constant(values.size(), other);
+		for (int yVaries = 0; yVaries < 2; ++yVaries)
+		{
+			const vector<int16_t>& y(yVaries ? values : constant);
+			const vector<int16_t>& x(yVaries ? constant : values);
+			for (size_t start = 0; start < values.size(); start += CHUNK_SIZE)
+				aseba_atan2_array(&results[start], &y[start], &x[start], uint16_t(min<size_t>(CHUNK_SIZE, values.size() - start)));
+			for (size_t i = 0; i < values.size(); ++i)
+			{
+				const int16_t expected(aseba_atan2(y[i], x[i]));
+				if (results[i] != expected)
+				{
+					cerr << "atan2(" << y[i] << ", " << x[i] << ") is " << results[i] << " instead of " << expected << endl;
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+//! Check that natives reading elements they wrote before behave as element by element
+static bool checkOverlappingNative()
+{
+	vector<int16_t> variables(64), expected(64);
+	for (size_t i = 0; i < variables.size(); ++i)
+		variables[i] = int16_t(i * 1021);
+	expected = variables;
+	for (size_t i = 0; i < 40; ++i)
+		expected[i + 1] = aseba_sin(expected[i]);
+
+	AsebaVMState vm;
+	memset(&vm, 0, sizeof(vm));
+	vm.variables = &variables[0];
+	vm.variablesSize = variables.size();
+	const int16_t args[] = { 1, 0, 40 };
+	AsebaNativeArgs_mathsin(&vm, args);
+	if (variables != expected)
+	{
+		cerr << "math.sin differs when its destination overlaps its source" << endl;
+		return false;
+	}
+	return true;
+}
+
+//! Print the time per element of scalarFunction and arrayFunction
+static void benchmark(const char* name, ScalarFunction scalarFunction, ArrayFunction arrayFunction)
+{
+	typedef chrono::high_resolution_clock Clock;
+	const unsigned repetitions(2000);
+	const vector<int16_t> values(allValues());
+	const vector<int16_t> inputs(values.begin() + 32768, values.begin() + 32768 + 4096);
+	vector<int16_t> results(inputs.size());
+	volatile int16_t sink(0);
+
+	const Clock::time_point scalarStart(Clock::now());
+	for (unsigned r = 0; r < repetitions; ++r)
+	{
+		for (size_t i = 0; i < inputs.size(); ++i)
+			results[i] = scalarFunction(inputs[i]);
+		sink = sink + results[r % results.size()];
+	}
+	const Clock::time_point arrayStart(Clock::now());
+	for (unsigned r = 0; r < repetitions; ++r)
+	{
+		arrayFunction(&results[0], &inputs[0], uint16_t(inputs.size()));
+		sink = sink + results[r % results.size()];
+	}
+	const Clock::time_point end(Clock::now());
+
+	const double elements(double(repetitions) * inputs.size());
+	const double scalarTime(chrono::duration<double, nano>(arrayStart - scalarStart).count() / elements);
+	const double arrayTime(chrono::duration<double, nano>(end - arrayStart).count() / elements);
+	cout << name << ": " << scalarTime << " ns per element scalar, " << arrayTime << " ns per element array, " << scalarTime / arrayTime << "x" << endl;
+}
+
+//! Adapters so that atan2 can be benchmarked like the other functions, with x = 1000
+static int16_t atan2OfThousand(int16_t y) { return aseba_atan2(y, 1000); }
+static void atan2ArrayOfThousand(int16_t* dest, const int16_t* y, uint16_t length)
+{
+	static const vector<int16_t> x(65535, 1000);
+	aseba_atan2_array(dest, y, &x[0], length);
+}
+
+int main(int argc, char*argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+	{
+		benchmark("sin", aseba_sin, aseba_sin_array);
+		benchmark("cos", aseba_cos, aseba_cos_array);
+		benchmark("sqrt", aseba_sqrt, aseba_sqrt_array);
+		benchmark("atan2", atan2OfThousand, atan2ArrayOfThousand);
+		return 0;
+	}
+
+	if (!checkEquivalence("sin", aseba_sin, aseba_sin_array))
+		return 1;
+	if (!checkEquivalence("cos", aseba_cos, aseba_cos_array))
+		return 1;
+	if (!checkEquivalence("sqrt", aseba_sqrt, aseba_sqrt_array))
+		return 1;
+	if (!checkAtan2Equivalence())
+		return 1;
+	if (!checkOverlappingNative())
+		return 1;
+	return 0;
+}
@@ -0,0 +1,143 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../../compiler/compiler.h"
+#include "../../vm/vm.h"
+#include "../../common/consts.h"
+#include "../../common/utils/VMSnapshot.h"
+#include "../TestCheck.h"
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <cstdio>
+#include <algorithm>
+
+using namespace Aseba;
+using namespace std;
+
+//! A VM with its own memory
+struct TestVM
+{
+	AsebaVMState vm;
+	vector<uint16_t> bytecode;
+	vector<int16_t> variables;
+	vector<int16_t> stack;
+
+	TestVM(const TargetDescription& description):
+		bytecode(description.bytecodeSize),
+		variables(description.variablesSize),
+		stack(description.stackSize)
+	{
+		vm.nodeId = 1;
+		vm.bytecode = &bytecode[0];
+		vm.bytecodeSize = bytecode.size();
+		vm.variables = &variables[0];
+		vm.variablesSize = variables.size();
+		vm.stack = &stack[0];
+		vm.stackSize = stack.size();
+		AsebaVMInit(&vm);
+	}
+};
+
+//! Run vm until its event terminates
+void runToEnd(AsebaVMState* vm)
+{
+	while (AsebaMaskIsSet(vm->flags, ASEBA_VM_EVENT_ACTIVE_MASK))
+		AsebaVMRun(vm, 1000);
+}
+
+int main()
+{
+	// compile a program that runs for a few thousand steps
+	TargetDescription description;
+	description.name = L"testvm";
+	description.protocolVersion = ASEBA_PROTOCOL_VERSION;
+	description.bytecodeSize = 256;
+	description.variablesSize = 128;
+	description.stackSize = 32;
+	description.namedVariables.push_back(TargetDescription::NamedVariable(L"id", 1));
+	CommonDefinitions definitions;
+	Compiler compiler;
+	compiler.setTargetDescription(&description);
+	compiler.setCommonDefinitions(&definitions);
+	wistringstream source(
+		L"var i = 0\n"
+		L"var acc[4]\n"
+		L"while i < 300 do\n"
+		L"\tacc[i % 4] = acc[i % 4] + i * 3\n"
+		L"\ti++\n"
+		L"end\n"
+	);
+	BytecodeVector bytecode;
+	unsigned allocatedVariablesCount;
+	Error error;
+	check(compiler.compile(source, bytecode, allocatedVariablesCount, error), "program does not compile");
+
+	// run it partly, with a breakpoint set, and save its state
+	TestVM reference(description);
+	for (size_t i = 0; i < bytecode.size(); ++i)
+		reference.bytecode[i] = bytecode[i].bytecode;
+	AsebaVMSetBreakpoint(&reference.vm, 200);
+	AsebaVMSetupEvent(&reference.vm, ASEBA_EVENT_INIT);
+	AsebaVMRun(&reference.vm, 777);
+	check(AsebaMaskIsSet(reference.vm.flags, ASEBA_VM_EVENT_ACTIVE_MASK), "program terminated too early");
+	VMSnapshot snapshot;
+	snapshot.nodes.resize(1);
+	snapshot.nodes[0].saveVM(&reference.vm);
+	check(snapshot.nodes[0].vm.size() == AsebaVMGetStateSize(&reference.vm), "saved state has wrong size");
+	check(snapshot.nodes[0].vm.size() < bytecode.size() + 32, "unused memory was saved");
+
+	// a state for a VM of different size is rejected and leaves the VM untouched
+	TargetDescription smallDescription(description);
+	smallDescription.variablesSize = 64;
+	TestVM small(smallDescription);
+	small.bytecode[1] = 0xdead;
+	check(!snapshot.nodes[0].restoreVM(&small.vm), "state restored into a VM of different size");
+	check(small.bytecode[1] == 0xdead && small.vm.pc == 0, "failed restore changed the VM");
+
+	// going through a file, a restored VM finishes like the original one
+	const char* fileName("aseba-test-vm-state.snapshot");
+	check(snapshot.save(fileName), "cannot save snapshot");
+	VMSnapshot loaded;
+	check(loaded.load(fileName), "cannot load snapshot");
+	remove(fileName);
+	TestVM restored(description);
+	fill(restored.bytecode.begin(), restored.bytecode.end(), 0xdead);
+	check(loaded.nodes.size() == 1 && loaded.nodes[0].restoreVM(&restored.vm), "cannot restore state");
+	check(restored.vm.pc == reference.vm.pc && restored.vm.sp == reference.vm.sp, "pc or sp differ");
+	check(restored.vm.breakpointsCount == 1 && restored.vm.breakpointsBitmap[200 / 16] == 1 << (200 % 16), "breakpoints differ");
+	check(restored.bytecode == reference.bytecode, "bytecode differs");
+	check(restored.vm.breakpoints[0] == 200, "breakpoints differ");
+	runToEnd(&reference.vm);
+	runToEnd(&restored.vm);
+	check(restored.variables == reference.variables, "variables differ after running to the end");
+	check(reference.variables[1] == 300, "program did not run to the end");
+
+	// corrupted snapshots are rejected
+	vector<uint8_t> blob(snapshot.serialize());
+	VMSnapshot decoded;
+	check(decoded.deserialize(blob), "cannot deserialize snapshot");
+	blob.pop_back();
+	check(!decoded.deserialize(blob), "truncated snapshot accepted");
+	snapshot.nodes[0].vm.pop_back();
+	check(!snapshot.nodes[0].restoreVM(&restored.vm), "truncated state accepted");
+
+	return 0;
+}
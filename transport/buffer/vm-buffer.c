@@ -67,12 +67,98 @@ static void buffer_add_string(const char* s)
 		buffer_add_uint8(*s++);
 }
 
+#ifdef ASEBA_EVENT_BATCHING
+
+/*
+	Events emitted by a handler are held back in a batch frame, made of the type
+	ASEBA_MESSAGE_EVENTS_BATCH followed, for each event, by its length in bytes, its type
+	and its arguments. The batch is sent when full, when the glue code calls
+	AsebaFlushEvents(), and before any other message so that the order of messages
+	is kept. A batch holding a single event is sent as this event alone.
+*/
+
+static unsigned char batch[ASEBA_MAX_INNER_PACKET_SIZE];
+static unsigned batch_pos = 2;
+static unsigned batch_count;
+static AsebaVMState *batch_vm;
+
+/* batching is used once a host announced ASEBA_EVENTS_BATCH_PROTOCOL_VERSION, and never after another host showed up */
+static enum
+{
+	BATCHING_UNKNOWN = 0,
+	BATCHING_ENABLED,
+	BATCHING_DISABLED
+} batching_state;
+
+static void batch_add_uint16(const uint16_t value)
+{
+	const uint16_t temp = bswap16(value);
+	memcpy(batch + batch_pos, &temp, 2);
+	batch_pos += 2;
+}
+
+static void batch_host_version(uint16_t version)
+{
+	if (version < ASEBA_EVENTS_BATCH_PROTOCOL_VERSION)
+		batching_state = BATCHING_DISABLED;
+	else if (batching_state == BATCHING_UNKNOWN)
+		batching_state = BATCHING_ENABLED;
+}
+
+/* start an event of size bytes of arguments in the batch, return 0 if it must be sent on its own */
+static uint8_t batch_start(AsebaVMState *vm, uint16_t type, uint16_t size)
+{
+	if (batching_state != BATCHING_ENABLED || type >= 0x8000 || 2 + 4 + size > ASEBA_MAX_INNER_PACKET_SIZE)
+		return 0;
+	
+	if (vm != batch_vm || batch_pos + 4 + size > ASEBA_MAX_INNER_PACKET_SIZE)
+		AsebaFlushEvents(batch_vm);
+	batch_vm = vm;
+	batch_add_uint16(size);
+	batch_add_uint16(type);
+	batch_count++;
+	return 1;
+}
+
+#endif /* ASEBA_EVENT_BATCHING */
+
+void AsebaFlushEvents(AsebaVMState *vm)
+{
+#ifdef ASEBA_EVENT_BATCHING
+	const uint16_t type = bswap16(ASEBA_MESSAGE_EVENTS_BATCH);
+	
+	if (batch_count == 1)
+	{
+		// skip the batch type and the length of the event
+		AsebaSendBuffer(batch_vm, batch + 4, batch_pos - 4);
+	}
+	else if (batch_count > 1)
+	{
+		memcpy(batch, &type, 2);
+		AsebaSendBuffer(batch_vm, batch, batch_pos);
+	}
+	batch_pos = 2;
+	batch_count = 0;
+#endif /* ASEBA_EVENT_BATCHING */
+	ASEBA_UNUSED(vm);
+}
+
 /* implementation of vm hooks */
 
 void AsebaSendMessage(AsebaVMState *vm, uint16_t type, const void *data, uint16_t size)
 {
 	uint16_t i;
 
+#ifdef ASEBA_EVENT_BATCHING
+	if (batch_start(vm, type, size))
+	{
+		memcpy(batch + batch_pos, data, size);
+		batch_pos += size;
+		return;
+	}
+	AsebaFlushEvents(vm);
+#endif /* ASEBA_EVENT_BATCHING */
+
 	buffer_pos = 0;
 	buffer_add_uint16(type);
 	for (i = 0; i < size; i++)
@@ -86,6 +172,16 @@ void AsebaSendMessageWords(AsebaVMState *vm, uint16_t type, const uint16_t* data
 {
 	uint16_t i;
 	
+#ifdef ASEBA_EVENT_BATCHING
+	if (batch_start(vm, type, count * 2))
+	{
+		for (i = 0; i < count; i++)
+			batch_add_uint16(data[i]);
+		return;
+	}
+	AsebaFlushEvents(vm);
+#endif /* ASEBA_EVENT_BATCHING */
+	
 	buffer_pos = 0;
 	buffer_add_uint16(type);
 	for (i = 0; i < count; i++)
@@ -98,6 +194,7 @@ void AsebaSendMessageWords(AsebaVMState *vm, uint16_t type, const uint16_t* data
 void AsebaSendVariables(AsebaVMState *vm, uint16_t start, uint16_t length)
 {
 	uint16_t i;
+	AsebaFlushEvents(vm);
 #ifndef ASEBA_LIMITED_MESSAGE_SIZE  //This is usefull with device that cannot send big packets like Thymio Wireless module.
 	buffer_pos = 0;
 	buffer_add_uint16(ASEBA_MESSAGE_VARIABLES);
@@ -136,6 +233,7 @@ void AsebaSendDescription(AsebaVMState *vm)
 	const AsebaLocalEventDescription* localEvents = AsebaGetLocalEventsDescriptions(vm);
 	
 	uint16_t i = 0;
+	AsebaFlushEvents(vm);
 	buffer_pos = 0;
 	
 	buffer_add_uint16(ASEBA_MESSAGE_DESCRIPTION);
@@ -224,8 +322,12 @@ void AsebaProcessIncomingEvents(AsebaVMState *vm)
 {
 	uint16_t source;
 	const AsebaVMDescription *desc = AsebaGetVMDescription(vm);
+	uint16_t amount;
+	
+	// the previous handler is over, do not hold its events any longer
+	AsebaFlushEvents(vm);
 	
-	uint16_t amount = AsebaGetBuffer(vm, buffer, ASEBA_MAX_INNER_PACKET_SIZE, &source);
+	amount = AsebaGetBuffer(vm, buffer, ASEBA_MAX_INNER_PACKET_SIZE, &source);
 
 	if (amount > 0)
 	{
@@ -250,6 +352,13 @@ void AsebaProcessIncomingEvents(AsebaVMState *vm)
 		}
 		else
 		{
+#ifdef ASEBA_EVENT_BATCHING
+			// hosts announce their protocol version when asking for descriptions
+			if ((type == ASEBA_MESSAGE_GET_DESCRIPTION || type == ASEBA_MESSAGE_LIST_NODES) && payloadSize >= 1)
+				batch_host_version(bswap16(payload[0]));
+			else if (type == ASEBA_MESSAGE_GET_NODE_DESCRIPTION && payloadSize >= 2 && bswap16(payload[0]) == vm->nodeId)
+				batch_host_version(bswap16(payload[1]));
+#endif /* ASEBA_EVENT_BATCHING */
 			// debug message
 			AsebaVMDebugMessage(vm, type, payload, payloadSize);
 		}
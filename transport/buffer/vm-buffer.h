@@ -39,6 +39,13 @@ extern "C" {
 	
 	This helper provides to the glue code:
 	* AsebaProcessIncomingEvents()
+	* AsebaFlushEvents()
+	
+	If ASEBA_EVENT_BATCHING is defined, the events emitted by a handler are sent
+	together in a single frame, once a host announced ASEBA_EVENTS_BATCH_PROTOCOL_VERSION
+	in its description request, as long as no host announced another version. The glue
+	code must then call AsebaFlushEvents() after running the VM, for instance after each
+	AsebaVMRun(), to send them; without ASEBA_EVENT_BATCHING this call does nothing.
 	
 	This helper requires from the lower level transport layer:
 	* AsebaSendBuffer()
@@ -59,6 +66,9 @@ extern "C" {
 /*! Read messages and process messages from transport layer, if any */
 void AsebaProcessIncomingEvents(AsebaVMState *vm);
 
+/*! Send the events held back for batching, if any */
+void AsebaFlushEvents(AsebaVMState *vm);
+
 // functions this helper needs
 
 extern void AsebaSendBuffer(AsebaVMState *vm, const uint8_t* data, uint16_t length);
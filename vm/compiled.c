@@ -0,0 +1,165 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../common/consts.h"
+#include "../common/types.h"
+#include "vm.h"
+#include "compiled.h"
+
+/**
+	\file compiled.c
+	Execution of bytecode translated ahead-of-time to C
+*/
+
+/** \addtogroup vm */
+/*@{*/
+
+void AsebaVMStep(AsebaVMState *vm);
+
+// the services below reproduce exactly what AsebaVMStep does in the same situations
+
+static void AsebaCompiledDivisionByZero(AsebaVMState *vm)
+{
+	if(AsebaVMErrorCB)
+		AsebaVMErrorCB(vm,NULL);
+	vm->flags = ASEBA_VM_STEP_BY_STEP_MASK;
+	AsebaSendMessageWords(vm, ASEBA_MESSAGE_DIVISION_BY_ZERO, &vm->pc, 1);
+}
+
+static void AsebaCompiledArrayAccessOutOfBounds(AsebaVMState *vm, uint16_t size, uint16_t index)
+{
+	uint16_t buffer[3];
+	buffer[0] = vm->pc;
+	buffer[1] = size;
+	buffer[2] = index;
+	vm->flags = ASEBA_VM_STEP_BY_STEP_MASK;
+	AsebaSendMessageWords(vm, ASEBA_MESSAGE_ARRAY_ACCESS_OUT_OF_BOUNDS, buffer, 3);
+	if(AsebaVMErrorCB)
+		AsebaVMErrorCB(vm,NULL);
+}
+
+static void AsebaCompiledNativeCall(AsebaVMState *vm, uint16_t id)
+{
+	AsebaVMCallNative(vm, id);
+}
+
+static void AsebaCompiledEmit(AsebaVMState *vm, uint16_t id, uint16_t start, uint16_t length)
+{
+	#ifdef ASEBA_ASSERT
+	if (length > ASEBA_MAX_EVENT_ARG_SIZE)
+		AsebaAssert(vm, ASEBA_ASSERT_EMIT_BUFFER_TOO_LONG);
+	#endif
+	AsebaSendMessageWords(vm, id, vm->variables + start, length);
+}
+
+static const AsebaCompiledRuntime asebaCompiledRuntime =
+{
+	AsebaCompiledDivisionByZero,
+	AsebaCompiledArrayAccessOutOfBounds,
+	AsebaCompiledNativeCall,
+	AsebaCompiledEmit,
+	AsebaVMCallNativeWithArgs
+};
+
+const AsebaCompiledRuntime* AsebaVMGetCompiledRuntime(void)
+{
+	return &asebaCompiledRuntime;
+}
+
+uint16_t AsebaVMCompiledProgramMatches(const AsebaVMState *vm, const AsebaCompiledProgram *program)
+{
+	uint16_t i;
+	if (program->bytecodeSize > vm->bytecodeSize)
+		return 0;
+	for (i = 0; i < program->bytecodeSize; i++)
+		if (vm->bytecode[i] != program->bytecode[i])
+			return 0;
+	return 1;
+}
+
+/*! Return the region of program containing pc, or NULL if pc is not translated */
+static const AsebaCompiledRegion* AsebaCompiledFindRegion(const AsebaCompiledProgram *program, uint16_t pc)
+{
+	uint16_t first = 0;
+	uint16_t last = program->regionsCount;
+	while (first < last)
+	{
+		const uint16_t middle = first + (last - first) / 2;
+		const AsebaCompiledRegion* region = &program->regions[middle];
+		if (pc < region->begin)
+			last = middle;
+		else if (pc >= region->end)
+			first = middle + 1;
+		else
+			return region;
+	}
+	return 0;
+}
+
+uint16_t AsebaVMRunCompiled(AsebaVMState *vm, const AsebaCompiledProgram *program, uint16_t stepsLimit)
+{
+	uint16_t steps = stepsLimit;
+	uint16_t *stepsLeft = stepsLimit > 0 ? &steps : 0;
+
+	if (!program)
+		return AsebaVMRun(vm, stepsLimit);
+
+	// if there is nothing to execute, just return
+	if (AsebaMaskIsClear(vm->flags, ASEBA_VM_EVENT_ACTIVE_MASK))
+		return 0;
+
+	// if we are running step by step, just return either
+	if (AsebaMaskIsSet(vm->flags, ASEBA_VM_STEP_BY_STEP_MASK))
+		return 0;
+
+	AsebaMaskSet(vm->flags, ASEBA_VM_EVENT_RUNNING_MASK);
+
+	// dispatch to the translated function of the current address, or step the interpreter
+	while (AsebaMaskIsSet(vm->flags, ASEBA_VM_EVENT_ACTIVE_MASK) &&
+		AsebaMaskIsSet(vm->flags, ASEBA_VM_EVENT_RUNNING_MASK) &&
+		(!stepsLeft || steps)
+	)
+	{
+		const AsebaCompiledRegion* region = AsebaCompiledFindRegion(program, vm->pc);
+		// translated code does not check breakpoints, the interpreter runs the regions that have some
+		if (vm->breakpointsCount)
+		{
+			if (AsebaVMStopAtBreakpoint(vm))
+				break;
+			if (region && AsebaVMHasBreakpointIn(vm, region->begin, region->end))
+				region = 0;
+		}
+		if (!region || !region->function(vm, stepsLeft, &asebaCompiledRuntime))
+		{
+			AsebaVMStep(vm);
+			if (stepsLeft)
+				steps--;
+		}
+	}
+
+	AsebaMaskClear(vm->flags, ASEBA_VM_EVENT_RUNNING_MASK);
+
+	if (AsebaMaskIsClear(vm->flags, ASEBA_VM_EVENT_ACTIVE_MASK) && AsebaVMEventFinishedCB)
+		AsebaVMEventFinishedCB(vm);
+
+	return 1;
+}
+
+/*@}*/
@@ -0,0 +1,116 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ASEBA_VM_COMPILED_H
+#define __ASEBA_VM_COMPILED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "../common/types.h"
+#include "../common/consts.h"
+#include "vm.h"
+
+/**
+	\file compiled.h
+	Execution of bytecode translated ahead-of-time to C, for host targets
+*/
+
+/** \addtogroup vm */
+/*@{*/
+
+/*! Services of the VM used by translated code.
+	Translated code does not reference any symbol of the VM directly,
+	so that it can be built as a self-contained shared object.
+	Before calling any of these, translated code writes back vm->pc and vm->sp. */
+typedef struct
+{
+	//! Stop the VM and report a division by zero at vm->pc
+	void (*divisionByZero)(AsebaVMState *vm);
+	//! Stop the VM and report an out-of-bounds array access at vm->pc
+	void (*arrayAccessOutOfBounds)(AsebaVMState *vm, uint16_t size, uint16_t index);
+	//! Call native function id, through AsebaVMCallNative
+	void (*nativeCall)(AsebaVMState *vm, uint16_t id);
+	//! Emit event id with length variables starting at start
+	void (*emit)(AsebaVMState *vm, uint16_t id, uint16_t start, uint16_t length);
+	//! Call native function id, whose last argsAvailable words on the stack are the constants args, through AsebaVMCallNativeWithArgs
+	void (*nativeCallWithArgs)(AsebaVMState *vm, uint16_t id, const int16_t *args, uint16_t argsAvailable);
+} AsebaCompiledRuntime;
+
+/*! Translated code for an event handler or a subroutine.
+	Run from vm->pc until execution leaves the function, stops, fails,
+	gets interrupted or exhausts *stepsLeft (if stepsLeft is not NULL).
+	Return 0 if vm->pc is not the address of an instruction of this function, 1 otherwise. */
+typedef uint16_t (*AsebaCompiledFunction)(AsebaVMState *vm, uint16_t *stepsLeft, const AsebaCompiledRuntime *runtime);
+
+/*! A contiguous part of bytecode, [begin, end[, handled by a translated function */
+typedef struct
+{
+	uint16_t begin;
+	uint16_t end;
+	AsebaCompiledFunction function;
+} AsebaCompiledRegion;
+
+/*! A bytecode translated to C.
+	The bytecode it was translated from is kept to check that it matches the one of the VM. */
+typedef struct
+{
+	uint16_t bytecodeSize; /*!< amount of bytecode translated */
+	const uint16_t *bytecode; /*!< bytecode translated */
+	uint16_t regionsCount; /*!< number of regions */
+	const AsebaCompiledRegion *regions; /*!< regions, sorted by address */
+} AsebaCompiledProgram;
+
+/*! Return the services used by translated code, which behave as AsebaVMStep */
+const AsebaCompiledRuntime* AsebaVMGetCompiledRuntime(void);
+
+/*! Name of the symbol holding the AsebaCompiledProgram in translated code */
+#define ASEBA_COMPILED_PROGRAM_SYMBOL "asebaCompiledProgram"
+
+/*! Return non-zero if program was translated from the bytecode currently in vm */
+uint16_t AsebaVMCompiledProgramMatches(const AsebaVMState *vm, const AsebaCompiledProgram *program);
+
+/*! Like AsebaVMRun, but execute translated code when available.
+	Bytecode not covered by program, or in a region with breakpoints, is interpreted.
+	If program is NULL, this is equivalent to AsebaVMRun.
+	The caller must ensure that program matches the bytecode of vm. */
+uint16_t AsebaVMRunCompiled(AsebaVMState *vm, const AsebaCompiledProgram *program, uint16_t stepsLimit);
+
+// Helpers for translated code
+
+//! Account for one step before executing the instruction at addr, leave if no steps are left
+#define ASEBA_COMPILED_STEP(addr) \
+	if (stepsLeft) { if (steps == 0) { vm->pc = (addr); goto leave; } --steps; }
+//! Leave the translated function, execution continues at addr
+#define ASEBA_COMPILED_EXIT(addr) \
+	{ vm->pc = (addr); goto leave; }
+//! Leave the translated function if the VM was stopped or interrupted, execution continues at addr
+#define ASEBA_COMPILED_CHECK(addr) \
+	if ((vm->flags & (ASEBA_VM_EVENT_ACTIVE_MASK|ASEBA_VM_EVENT_RUNNING_MASK)) != (ASEBA_VM_EVENT_ACTIVE_MASK|ASEBA_VM_EVENT_RUNNING_MASK)) \
+		ASEBA_COMPILED_EXIT(addr)
+
+/*@}*/
+
+#ifdef __cplusplus
+} /* closing brace for extern "C" */
+#endif
+
+#endif
@@ -0,0 +1,1006 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../common/consts.h"
+#include "../common/types.h"
+#include "vm.h"
+#include "compiled.h"
+#include "jit.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+	#define ASEBA_JIT_X86_64
+	#include <sys/mman.h>
+#endif
+
+/**
+	\file jit.c
+	Tiered baseline JIT for the Aseba VM
+*/
+
+/** \addtogroup vm */
+/*@{*/
+
+void AsebaVMStep(AsebaVMState *vm);
+
+enum
+{
+	ASEBA_JIT_INTERPRETED = 0,
+	ASEBA_JIT_COMPILED,
+	ASEBA_JIT_REJECTED
+};
+
+#define ASEBA_JIT_NO_OFFSET 0xffffffff
+
+/*! An event handler or subroutine, from an entry point to the next one */
+typedef struct
+{
+	uint16_t begin;
+	uint16_t end;
+	uint16_t state;
+	uint32_t executions; /*!< number of times execution entered the region at begin, while interpreted */
+	uint8_t *code; /*!< executable machine code, starting with the prologue */
+	size_t codeSize;
+	uint32_t *offsets; /*!< offset in code of each bytecode address in [begin, end[, or ASEBA_JIT_NO_OFFSET */
+} AsebaJitRegion;
+
+struct AsebaJit
+{
+	uint32_t threshold;
+	uint16_t analyzed;
+	uint16_t regionsCount;
+	AsebaJitRegion *regions;
+	AsebaJitStatistics statistics;
+};
+
+/*! Entry point of compiled regions: run from entry, using and updating *budget */
+typedef void (*AsebaJitFunction)(AsebaVMState *vm, int64_t *budget, const uint8_t *entry);
+
+//! Return the size in words of the instruction starting with bytecode
+static uint16_t AsebaJitInstructionSize(uint16_t bytecode)
+{
+	switch (bytecode >> 12)
+	{
+		case ASEBA_BYTECODE_LARGE_IMMEDIATE:
+		case ASEBA_BYTECODE_LOAD_INDIRECT:
+		case ASEBA_BYTECODE_STORE_INDIRECT:
+		case ASEBA_BYTECODE_CONDITIONAL_BRANCH:
+		return 2;
+
+		case ASEBA_BYTECODE_EMIT:
+		return 3;
+
+		default:
+		return 1;
+	}
+}
+
+static void AsebaJitFreeRegions(AsebaJit *jit)
+{
+	uint16_t i;
+	for (i = 0; i < jit->regionsCount; i++)
+	{
+		#ifdef ASEBA_JIT_X86_64
+		if (jit->regions[i].code)
+			munmap(jit->regions[i].code, jit->regions[i].codeSize);
+		#endif // ASEBA_JIT_X86_64
+		free(jit->regions[i].offsets);
+	}
+	free(jit->regions);
+	jit->regions = 0;
+	jit->regionsCount = 0;
+	jit->analyzed = 0;
+	jit->statistics.regionsCount = 0;
+	jit->statistics.compiledCount = 0;
+	jit->statistics.rejectedCount = 0;
+	jit->statistics.codeSize = 0;
+}
+
+/*! Split bytecode into regions starting at event handlers and subroutines */
+static void AsebaJitAnalyze(AsebaJit *jit, const AsebaVMState *vm)
+{
+	const uint16_t *bytecode = vm->bytecode;
+	const uint16_t eventVectorSize = bytecode[0];
+	uint8_t *isEntry;
+	uint16_t pc, i, count = 0;
+
+	jit->analyzed = 1;
+	if (eventVectorSize >= vm->bytecodeSize)
+		return;
+
+	// mark entry points
+	isEntry = (uint8_t*)calloc(vm->bytecodeSize, 1);
+	if (!isEntry)
+		return;
+	for (i = 1; i + 1 < eventVectorSize; i += 2)
+		if (bytecode[i + 1] >= eventVectorSize && bytecode[i + 1] < vm->bytecodeSize)
+			isEntry[bytecode[i + 1]] = 1;
+	for (pc = eventVectorSize; pc < vm->bytecodeSize; pc += AsebaJitInstructionSize(bytecode[pc]))
+	{
+		const uint16_t dest = bytecode[pc] & 0x0fff;
+		if ((bytecode[pc] >> 12) == ASEBA_BYTECODE_SUB_CALL && dest >= eventVectorSize && dest < vm->bytecodeSize)
+			isEntry[dest] = 1;
+	}
+	for (pc = eventVectorSize; pc < vm->bytecodeSize; pc++)
+		count += isEntry[pc];
+
+	// build regions
+	jit->regions = (AsebaJitRegion*)calloc(count ? count : 1, sizeof(AsebaJitRegion));
+	if (jit->regions)
+	{
+		for (pc = eventVectorSize; pc < vm->bytecodeSize; pc++)
+		{
+			if (isEntry[pc])
+			{
+				if (jit->regionsCount)
+					jit->regions[jit->regionsCount - 1].end = pc;
+				jit->regions[jit->regionsCount].begin = pc;
+				jit->regions[jit->regionsCount].end = vm->bytecodeSize;
+				jit->regionsCount++;
+			}
+		}
+	}
+	jit->statistics.regionsCount = jit->regionsCount;
+	free(isEntry);
+}
+
+/*! Return the region containing pc, or NULL */
+static AsebaJitRegion* AsebaJitFindRegion(AsebaJit *jit, uint16_t pc)
+{
+	uint16_t first = 0;
+	uint16_t last = jit->regionsCount;
+	while (first < last)
+	{
+		const uint16_t middle = first + (last - first) / 2;
+		AsebaJitRegion* region = &jit->regions[middle];
+		if (pc < region->begin)
+			last = middle;
+		else if (pc >= region->end)
+			first = middle + 1;
+		else
+			return region;
+	}
+	return 0;
+}
+
+#ifdef ASEBA_JIT_X86_64
+
+/*
+	Machine code templates, for the System V x86-64 ABI.
+	While in compiled code, registers hold:
+	r14: vm, rbx: vm->variables, r12: vm->stack, r13: vm->sp, r15: remaining steps.
+	eax, ecx and edx are scratch, rsp is kept 16 bytes aligned for calls.
+	Holes are zero in templates and patched after copy.
+*/
+
+// prologue(vm: rdi, budget: rsi, entry: rdx): save registers, load state and jump to entry
+static const uint8_t tplPrologue[] = {
+	0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57, // push rbx, rbp, r12-r15
+	0x48, 0x83, 0xEC, 0x08, // sub rsp, 8
+	0x49, 0x89, 0xFE, // mov r14, rdi
+	0x48, 0x89, 0x34, 0x24, // mov [rsp], rsi
+	0x48, 0x8B, 0x9F, 0, 0, 0, 0, // mov rbx, [rdi + variables]
+	0x4C, 0x8B, 0xA7, 0, 0, 0, 0, // mov r12, [rdi + stack]
+	0x4C, 0x0F, 0xBF, 0xAF, 0, 0, 0, 0, // movsx r13, word [rdi + sp]
+	0x4C, 0x8B, 0x3E, // mov r15, [rsi]
+	0xFF, 0xE2 // jmp rdx
+};
+// epilogue: write back sp and budget, restore registers
+static const uint8_t tplEpilogue[] = {
+	0x66, 0x45, 0x89, 0xAE, 0, 0, 0, 0, // mov [r14 + sp], r13w
+	0x48, 0x8B, 0x04, 0x24, // mov rax, [rsp]
+	0x4C, 0x89, 0x38, // mov [rax], r15
+	0x48, 0x83, 0xC4, 0x08, // add rsp, 8
+	0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, // pop r15-r12, rbp, rbx
+	0xC3 // ret
+};
+// account for one step, leave if none is left
+static const uint8_t tplStep[] = { 0x49, 0xFF, 0xCF, 0x0F, 0x88, 0, 0, 0, 0 }; // dec r15; js stub
+// push an immediate
+static const uint8_t tplPushImmediate[] = { 0x49, 0xFF, 0xC5, 0x66, 0x43, 0xC7, 0x04, 0x6C, 0, 0 }; // inc r13; mov word [r12+r13*2], imm16
+// push a variable
+static const uint8_t tplLoad[] = {
+	0x49, 0xFF, 0xC5, // inc r13
+	0x0F, 0xB7, 0x83, 0, 0, 0, 0, // movzx eax, word [rbx + disp32]
+	0x66, 0x43, 0x89, 0x04, 0x6C // mov [r12+r13*2], ax
+};
+// pop to a variable
+static const uint8_t tplStore[] = {
+	0x43, 0x0F, 0xB7, 0x04, 0x6C, // movzx eax, word [r12+r13*2]
+	0x49, 0xFF, 0xCD, // dec r13
+	0x66, 0x89, 0x83, 0, 0, 0, 0 // mov [rbx + disp32], ax
+};
+// replace top by an array element, leave through a stub if index is out of bounds
+static const uint8_t tplLoadIndirect[] = {
+	0x43, 0x0F, 0xB7, 0x04, 0x6C, // movzx eax, word [r12+r13*2]
+	0x3D, 0, 0, 0, 0, // cmp eax, size
+	0x0F, 0x83, 0, 0, 0, 0, // jae stub
+	0x0F, 0xB7, 0x8C, 0x43, 0, 0, 0, 0, // movzx ecx, word [rbx + rax*2 + disp32]
+	0x66, 0x43, 0x89, 0x0C, 0x6C // mov [r12+r13*2], cx
+};
+// pop an index and a value to an array element, leave through a stub if index is out of bounds
+static const uint8_t tplStoreIndirect[] = {
+	0x43, 0x0F, 0xB7, 0x04, 0x6C, // movzx eax, word [r12+r13*2]
+	0x3D, 0, 0, 0, 0, // cmp eax, size
+	0x0F, 0x83, 0, 0, 0, 0, // jae stub
+	0x43, 0x0F, 0xB7, 0x4C, 0x6C, 0xFE, // movzx ecx, word [r12+r13*2-2]
+	0x66, 0x89, 0x8C, 0x43, 0, 0, 0, 0, // mov [rbx + rax*2 + disp32], cx
+	0x49, 0x83, 0xED, 0x02 // sub r13, 2
+};
+// unary operations on top
+static const uint8_t tplNeg[] = { 0x66, 0x43, 0xF7, 0x1C, 0x6C }; // neg word [r12+r13*2]
+static const uint8_t tplNot[] = { 0x66, 0x43, 0xF7, 0x14, 0x6C }; // not word [r12+r13*2]
+static const uint8_t tplAbs[] = {
+	0x43, 0x0F, 0xBF, 0x04, 0x6C, // movsx eax, word [r12+r13*2]
+	0x89, 0xC1, 0xF7, 0xD9, 0x85, 0xC0, 0x0F, 0x48, 0xC1, // mov ecx, eax; neg ecx; test eax, eax; cmovs eax, ecx
+	0x66, 0x43, 0x89, 0x04, 0x6C // mov [r12+r13*2], ax
+};
+static const uint8_t tplZero[] = { 0x66, 0x43, 0xC7, 0x04, 0x6C, 0x00, 0x00 }; // mov word [r12+r13*2], 0
+// binary operations: load operands to eax and ecx, compute in eax, store result
+static const uint8_t tplBinaryLoad[] = {
+	0x43, 0x0F, 0xBF, 0x44, 0x6C, 0xFE, // movsx eax, word [r12+r13*2-2]
+	0x43, 0x0F, 0xBF, 0x0C, 0x6C // movsx ecx, word [r12+r13*2]
+};
+static const uint8_t tplBinaryStore[] = { 0x49, 0xFF, 0xCD, 0x66, 0x43, 0x89, 0x04, 0x6C }; // dec r13; mov [r12+r13*2], ax
+static const uint8_t tplAdd[] = { 0x01, 0xC8 };
+static const uint8_t tplSub[] = { 0x29, 0xC8 };
+static const uint8_t tplMult[] = { 0x0F, 0xAF, 0xC1 };
+static const uint8_t tplBitOr[] = { 0x09, 0xC8 };
+static const uint8_t tplBitXor[] = { 0x31, 0xC8 };
+static const uint8_t tplBitAnd[] = { 0x21, 0xC8 };
+static const uint8_t tplShiftLeft[] = { 0xD3, 0xE0 };
+static const uint8_t tplShiftRight[] = { 0xD3, 0xF8 };
+static const uint8_t tplDivisionCheck[] = { 0x85, 0xC9, 0x0F, 0x84, 0, 0, 0, 0 }; // test ecx, ecx; jz stub
+static const uint8_t tplClearResult[] = { 0x31, 0xC0 }; // xor eax, eax
+static const uint8_t tplDiv[] = { 0x99, 0xF7, 0xF9 }; // cdq; idiv ecx
+static const uint8_t tplMod[] = { 0x99, 0xF7, 0xF9, 0x89, 0xD0 }; // cdq; idiv ecx; mov eax, edx
+static const uint8_t tplCompare[] = { 0x39, 0xC8, 0x0F, 0x00, 0xC0, 0x0F, 0xB6, 0xC0 }; // cmp eax, ecx; setcc al; movzx eax, al
+static const uint8_t tplOr[] = { 0x85, 0xC0, 0x0F, 0x95, 0xC0, 0x85, 0xC9, 0x0F, 0x95, 0xC1, 0x08, 0xC8, 0x0F, 0xB6, 0xC0 };
+static const uint8_t tplAnd[] = { 0x85, 0xC0, 0x0F, 0x95, 0xC0, 0x85, 0xC9, 0x0F, 0x95, 0xC1, 0x20, 0xC8, 0x0F, 0xB6, 0xC0 };
+// control flow
+static const uint8_t tplJump[] = { 0xE9, 0, 0, 0, 0 }; // jmp rel32
+static const uint8_t tplBranchPrepare[] = { 0x49, 0x83, 0xED, 0x02 }; // sub r13, 2
+static const uint8_t tplLoadWhenFlag[] = { 0x41, 0x0F, 0xB7, 0x8E, 0, 0, 0, 0 }; // movzx ecx, word [r14 + disp32]
+static const uint8_t tplBranchTest[] = { 0x66, 0x85, 0xC0, 0x0F, 0x84, 0, 0, 0, 0 }; // test ax, ax; jz false
+static const uint8_t tplSetWhenFlag[] = { 0x66, 0x41, 0x81, 0x8E, 0, 0, 0, 0, 0, 0 }; // or word [r14 + disp32], imm16
+static const uint8_t tplTestWhenFlag[] = { 0xF7, 0xC1, 0, 0, 0, 0, 0x0F, 0x85, 0, 0, 0, 0 }; // test ecx, imm32; jnz false
+static const uint8_t tplClearWhenFlag[] = { 0x66, 0x41, 0x81, 0xA6, 0, 0, 0, 0, 0, 0 }; // and word [r14 + disp32], imm16
+// state synchronisation and calls to the runtime
+static const uint8_t tplSetPc[] = { 0x66, 0x41, 0xC7, 0x86, 0, 0, 0, 0, 0, 0 }; // mov word [r14 + pc], imm16
+static const uint8_t tplSyncSp[] = { 0x66, 0x45, 0x89, 0xAE, 0, 0, 0, 0 }; // mov [r14 + sp], r13w
+static const uint8_t tplReloadSp[] = { 0x4D, 0x0F, 0xBF, 0xAE, 0, 0, 0, 0 }; // movsx r13, word [r14 + sp]
+static const uint8_t tplArgVm[] = { 0x4C, 0x89, 0xF7 }; // mov rdi, r14
+static const uint8_t tplArgSecond[] = { 0xBE, 0, 0, 0, 0 }; // mov esi, imm32
+static const uint8_t tplArgThird[] = { 0xBA, 0, 0, 0, 0 }; // mov edx, imm32
+static const uint8_t tplArgThirdFromEax[] = { 0x89, 0xC2 }; // mov edx, eax
+static const uint8_t tplArgFourth[] = { 0xB9, 0, 0, 0, 0 }; // mov ecx, imm32
+static const uint8_t tplArgThirdAddress[] = { 0x48, 0x8D, 0x15, 0, 0, 0, 0 }; // lea rdx, [rip + rel32]
+static const uint8_t tplCall[] = { 0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xD0 }; // movabs rax, imm64; call rax
+static const uint8_t tplCheckFlags[] = {
+	0x41, 0x0F, 0xB7, 0x86, 0, 0, 0, 0, // movzx eax, word [r14 + flags]
+	0x83, 0xE0, ASEBA_VM_EVENT_ACTIVE_MASK|ASEBA_VM_EVENT_RUNNING_MASK, // and eax, mask
+	0x83, 0xF8, ASEBA_VM_EVENT_ACTIVE_MASK|ASEBA_VM_EVENT_RUNNING_MASK, // cmp eax, mask
+	0x0F, 0x85, 0, 0, 0, 0 // jne stub
+};
+static const uint8_t tplStop[] = { 0x66, 0x41, 0x83, 0xA6, 0, 0, 0, 0, 0xFE }; // and word [r14 + flags], ~ASEBA_VM_EVENT_ACTIVE_MASK
+static const uint8_t tplReturn[] = {
+	0x43, 0x0F, 0xB7, 0x04, 0x6C, // movzx eax, word [r12+r13*2]
+	0x49, 0xFF, 0xCD, // dec r13
+	0x66, 0x41, 0x89, 0x86, 0, 0, 0, 0 // mov [r14 + pc], ax
+};
+static const uint8_t tplClearBudget[] = { 0x45, 0x31, 0xFF }; // xor r15d, r15d
+
+/*! A jump to patch once the position of its destination is known */
+typedef struct
+{
+	uint32_t position; /*!< position of the rel32 field */
+	uint16_t kind; /*!< what the destination is */
+	uint16_t pc; /*!< address in bytecode the destination depends on */
+} AsebaJitFixup;
+
+enum
+{
+	ASEBA_JIT_TO_INSTRUCTION = 0, //!< translated instruction at pc
+	ASEBA_JIT_TO_EXIT, //!< leave with vm->pc = pc
+	ASEBA_JIT_TO_BUDGET_STUB, //!< no steps left before instruction at pc
+	ASEBA_JIT_TO_BOUNDS_STUB, //!< out-of-bounds array access at pc
+	ASEBA_JIT_TO_DIVISION_STUB, //!< division by zero at pc
+	ASEBA_JIT_TO_EPILOGUE, //!< leave, vm->pc being already set
+	ASEBA_JIT_TO_NATIVE_ARGS //!< constant arguments of the native call at pc
+};
+
+/*! Machine code being generated */
+typedef struct
+{
+	uint8_t *data;
+	uint32_t size;
+	uint32_t capacity;
+	AsebaJitFixup *fixups;
+	uint32_t fixupsCount;
+	uint32_t fixupsCapacity;
+	uint16_t failed;
+} AsebaJitBuffer;
+
+static void AsebaJitReserve(AsebaJitBuffer *buffer, uint32_t size)
+{
+	if (buffer->failed || buffer->size + size <= buffer->capacity)
+		return;
+	{
+		uint32_t capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+		uint8_t *data;
+		while (capacity < buffer->size + size)
+			capacity *= 2;
+		data = (uint8_t*)realloc(buffer->data, capacity);
+		if (!data)
+		{
+			buffer->failed = 1;
+			return;
+		}
+		buffer->data = data;
+		buffer->capacity = capacity;
+	}
+}
+
+/*! Copy a template, return its position */
+static uint32_t AsebaJitCopy(AsebaJitBuffer *buffer, const uint8_t *tpl, uint32_t size)
+{
+	const uint32_t position = buffer->size;
+	AsebaJitReserve(buffer, size);
+	if (buffer->failed)
+		return position;
+	memcpy(buffer->data + buffer->size, tpl, size);
+	buffer->size += size;
+	return position;
+}
+
+#define ASEBA_JIT_COPY(buffer, tpl) AsebaJitCopy(buffer, tpl, sizeof(tpl))
+
+static void AsebaJitPatch16(AsebaJitBuffer *buffer, uint32_t position, uint16_t value)
+{
+	if (!buffer->failed)
+		memcpy(buffer->data + position, &value, 2);
+}
+
+static void AsebaJitPatch32(AsebaJitBuffer *buffer, uint32_t position, uint32_t value)
+{
+	if (!buffer->failed)
+		memcpy(buffer->data + position, &value, 4);
+}
+
+static void AsebaJitPatch64(AsebaJitBuffer *buffer, uint32_t position, uint64_t value)
+{
+	if (!buffer->failed)
+		memcpy(buffer->data + position, &value, 8);
+}
+
+/*! Record that the rel32 at position must jump to the destination of kind and pc */
+static void AsebaJitAddFixup(AsebaJitBuffer *buffer, uint32_t position, uint16_t kind, uint16_t pc)
+{
+	if (buffer->failed)
+		return;
+	if (buffer->fixupsCount == buffer->fixupsCapacity)
+	{
+		const uint32_t capacity = buffer->fixupsCapacity ? buffer->fixupsCapacity * 2 : 256;
+		AsebaJitFixup *fixups = (AsebaJitFixup*)realloc(buffer->fixups, capacity * sizeof(AsebaJitFixup));
+		if (!fixups)
+		{
+			buffer->failed = 1;
+			return;
+		}
+		buffer->fixups = fixups;
+		buffer->fixupsCapacity = capacity;
+	}
+	buffer->fixups[buffer->fixupsCount].position = position;
+	buffer->fixups[buffer->fixupsCount].kind = kind;
+	buffer->fixups[buffer->fixupsCount].pc = pc;
+	buffer->fixupsCount++;
+}
+
+/*! Write the rel32 at position so that it jumps to target */
+static void AsebaJitPatchRelative(AsebaJitBuffer *buffer, uint32_t position, uint32_t target)
+{
+	AsebaJitPatch32(buffer, position, (uint32_t)((int32_t)target - (int32_t)(position + 4)));
+}
+
+static void AsebaJitSetPc(AsebaJitBuffer *buffer, uint16_t pc)
+{
+	const uint32_t p = ASEBA_JIT_COPY(buffer, tplSetPc);
+	AsebaJitPatch32(buffer, p + 4, offsetof(AsebaVMState, pc));
+	AsebaJitPatch16(buffer, p + 8, pc);
+}
+
+static void AsebaJitSyncSp(AsebaJitBuffer *buffer)
+{
+	const uint32_t p = ASEBA_JIT_COPY(buffer, tplSyncSp);
+	AsebaJitPatch32(buffer, p + 4, offsetof(AsebaVMState, sp));
+}
+
+static void AsebaJitJump(AsebaJitBuffer *buffer, uint16_t kind, uint16_t pc)
+{
+	const uint32_t p = ASEBA_JIT_COPY(buffer, tplJump);
+	AsebaJitAddFixup(buffer, p + 1, kind, pc);
+}
+
+/*! Jump to the translation of target if it is in [begin, end[, leave otherwise */
+static void AsebaJitJumpTo(AsebaJitBuffer *buffer, const uint32_t *offsets, uint16_t begin, uint16_t end, uint16_t target)
+{
+	if (target >= begin && target < end && offsets[target - begin] != ASEBA_JIT_NO_OFFSET)
+		AsebaJitJump(buffer, ASEBA_JIT_TO_INSTRUCTION, target);
+	else
+		AsebaJitJump(buffer, ASEBA_JIT_TO_EXIT, target);
+}
+
+static void AsebaJitCall(AsebaJitBuffer *buffer, const void *function)
+{
+	const uint32_t p = ASEBA_JIT_COPY(buffer, tplCall);
+	AsebaJitPatch64(buffer, p + 2, (uint64_t)(uintptr_t)function);
+}
+
+static void AsebaJitCallArgument(AsebaJitBuffer *buffer, const uint8_t *tpl, uint32_t size, uint32_t value)
+{
+	const uint32_t p = AsebaJitCopy(buffer, tpl, size);
+	AsebaJitPatch32(buffer, p + 1, value);
+}
+
+/*! Emit code computing binary operation op on eax and ecx into eax; return 0 if op is not supported */
+static uint16_t AsebaJitBinaryOperation(AsebaJitBuffer *buffer, uint16_t op, uint16_t pc)
+{
+	static const uint8_t conditionCodes[] = { 0x94, 0x95, 0x9F, 0x9D, 0x9C, 0x9E }; // sete, setne, setg, setge, setl, setle
+	switch (op)
+	{
+		case ASEBA_OP_SHIFT_LEFT: ASEBA_JIT_COPY(buffer, tplShiftLeft); return 1;
+		case ASEBA_OP_SHIFT_RIGHT: ASEBA_JIT_COPY(buffer, tplShiftRight); return 1;
+		case ASEBA_OP_ADD: ASEBA_JIT_COPY(buffer, tplAdd); return 1;
+		case ASEBA_OP_SUB: ASEBA_JIT_COPY(buffer, tplSub); return 1;
+		case ASEBA_OP_MULT: ASEBA_JIT_COPY(buffer, tplMult); return 1;
+		case ASEBA_OP_DIV:
+		case ASEBA_OP_MOD:
+		{
+			const uint32_t p = ASEBA_JIT_COPY(buffer, tplDivisionCheck);
+			AsebaJitAddFixup(buffer, p + 4, ASEBA_JIT_TO_DIVISION_STUB, pc);
+			if (op == ASEBA_OP_DIV)
+				ASEBA_JIT_COPY(buffer, tplDiv);
+			else
+				ASEBA_JIT_COPY(buffer, tplMod);
+		}
+		return 1;
+		case ASEBA_OP_BIT_OR: ASEBA_JIT_COPY(buffer, tplBitOr); return 1;
+		case ASEBA_OP_BIT_XOR: ASEBA_JIT_COPY(buffer, tplBitXor); return 1;
+		case ASEBA_OP_BIT_AND: ASEBA_JIT_COPY(buffer, tplBitAnd); return 1;
+		case ASEBA_OP_EQUAL:
+		case ASEBA_OP_NOT_EQUAL:
+		case ASEBA_OP_BIGGER_THAN:
+		case ASEBA_OP_BIGGER_EQUAL_THAN:
+		case ASEBA_OP_SMALLER_THAN:
+		case ASEBA_OP_SMALLER_EQUAL_THAN:
+		{
+			const uint32_t p = ASEBA_JIT_COPY(buffer, tplCompare);
+			if (!buffer->failed)
+				buffer->data[p + 3] = conditionCodes[op - ASEBA_OP_EQUAL];
+		}
+		return 1;
+		case ASEBA_OP_OR: ASEBA_JIT_COPY(buffer, tplOr); return 1;
+		case ASEBA_OP_AND: ASEBA_JIT_COPY(buffer, tplAnd); return 1;
+		default: return 0;
+	}
+}
+
+/*! Emit code for the instruction at pc; return 0 if it cannot be compiled */
+/*! Fill args with the constants pushed right before the native call at pc, top of stack first, and return their count.
+	Stop at jump targets, as the stack might hold other values when reaching them. */
+static uint16_t AsebaJitConstantNativeArgs(const AsebaVMState *vm, const uint32_t *offsets, const uint8_t *isJumpTarget, uint16_t begin, uint16_t pc, int16_t *args)
+{
+	uint16_t count = 0;
+	while (pc != begin && count < ASEBA_NATIVE_MAX_ARGS && !isJumpTarget[pc - begin])
+	{
+		uint16_t bytecode;
+		do
+			pc--;
+		while (offsets[pc - begin] == ASEBA_JIT_NO_OFFSET);
+		bytecode = vm->bytecode[pc];
+		if ((bytecode >> 12) == ASEBA_BYTECODE_SMALL_IMMEDIATE)
+			args[count++] = (int16_t)(bytecode << 4) >> 4;
+		else if ((bytecode >> 12) == ASEBA_BYTECODE_LARGE_IMMEDIATE)
+			args[count++] = (int16_t)vm->bytecode[pc + 1];
+		else
+			break;
+	}
+	return count;
+}
+
+static uint16_t AsebaJitInstruction(AsebaJitBuffer *buffer, const AsebaVMState *vm, const uint32_t *offsets, const uint8_t *isJumpTarget, uint16_t begin, uint16_t end, uint16_t pc)
+{
+	const uint16_t bytecode = vm->bytecode[pc];
+	const uint16_t operand = bytecode & 0x0fff;
+	const AsebaCompiledRuntime *runtime = AsebaVMGetCompiledRuntime();
+	uint32_t p;
+
+	p = ASEBA_JIT_COPY(buffer, tplStep);
+	AsebaJitAddFixup(buffer, p + 5, ASEBA_JIT_TO_BUDGET_STUB, pc);
+
+	switch (bytecode >> 12)
+	{
+		case ASEBA_BYTECODE_STOP:
+		p = ASEBA_JIT_COPY(buffer, tplStop);
+		AsebaJitPatch32(buffer, p + 4, offsetof(AsebaVMState, flags));
+		AsebaJitJump(buffer, ASEBA_JIT_TO_EXIT, pc);
+		break;
+
+		case ASEBA_BYTECODE_SMALL_IMMEDIATE:
+		p = ASEBA_JIT_COPY(buffer, tplPushImmediate);
+		AsebaJitPatch16(buffer, p + 8, (uint16_t)(((int16_t)(bytecode << 4)) >> 4));
+		break;
+
+		case ASEBA_BYTECODE_LARGE_IMMEDIATE:
+		p = ASEBA_JIT_COPY(buffer, tplPushImmediate);
+		AsebaJitPatch16(buffer, p + 8, vm->bytecode[pc + 1]);
+		break;
+
+		case ASEBA_BYTECODE_LOAD:
+		p = ASEBA_JIT_COPY(buffer, tplLoad);
+		AsebaJitPatch32(buffer, p + 6, operand * 2);
+		break;
+
+		case ASEBA_BYTECODE_STORE:
+		p = ASEBA_JIT_COPY(buffer, tplStore);
+		AsebaJitPatch32(buffer, p + 11, operand * 2);
+		break;
+
+		case ASEBA_BYTECODE_LOAD_INDIRECT:
+		p = ASEBA_JIT_COPY(buffer, tplLoadIndirect);
+		AsebaJitPatch32(buffer, p + 6, vm->bytecode[pc + 1]);
+		AsebaJitAddFixup(buffer, p + 12, ASEBA_JIT_TO_BOUNDS_STUB, pc);
+		AsebaJitPatch32(buffer, p + 20, operand * 2);
+		break;
+
+		case ASEBA_BYTECODE_STORE_INDIRECT:
+		p = ASEBA_JIT_COPY(buffer, tplStoreIndirect);
+		AsebaJitPatch32(buffer, p + 6, vm->bytecode[pc + 1]);
+		AsebaJitAddFixup(buffer, p + 12, ASEBA_JIT_TO_BOUNDS_STUB, pc);
+		AsebaJitPatch32(buffer, p + 26, operand * 2);
+		break;
+
+		case ASEBA_BYTECODE_UNARY_ARITHMETIC:
+		switch (bytecode & ASEBA_UNARY_OPERATOR_MASK)
+		{
+			case ASEBA_UNARY_OP_SUB: ASEBA_JIT_COPY(buffer, tplNeg); break;
+			case ASEBA_UNARY_OP_ABS: ASEBA_JIT_COPY(buffer, tplAbs); break;
+			case ASEBA_UNARY_OP_BIT_NOT: ASEBA_JIT_COPY(buffer, tplNot); break;
+			default: ASEBA_JIT_COPY(buffer, tplZero); break;
+		}
+		break;
+
+		case ASEBA_BYTECODE_BINARY_ARITHMETIC:
+		ASEBA_JIT_COPY(buffer, tplBinaryLoad);
+		if (!AsebaJitBinaryOperation(buffer, bytecode & ASEBA_BINARY_OPERATOR_MASK, pc))
+			return 0;
+		ASEBA_JIT_COPY(buffer, tplBinaryStore);
+		break;
+
+		case ASEBA_BYTECODE_JUMP:
+		AsebaJitJumpTo(buffer, offsets, begin, end, pc + (((int16_t)(bytecode << 4)) >> 4));
+		break;
+
+		case ASEBA_BYTECODE_CONDITIONAL_BRANCH:
+		{
+			const uint16_t op = bytecode & ASEBA_IF_OPERATOR_MASK;
+			const uint16_t isWhen = (bytecode >> ASEBA_IF_IS_WHEN_BIT) & 1;
+			const uint16_t slot = ASEBA_IF_GET_WHEN_SLOT(bytecode);
+			const uint32_t flagOffset = offsetof(AsebaVMState, whenStates) + (slot / 16) * 2;
+			const uint16_t flagMask = 1 << (slot % 16);
+			const uint16_t falseTarget = pc + (int16_t)vm->bytecode[pc + 1];
+			uint32_t toFalse;
+			// errors in conditions are left to the interpreter
+			if (op == ASEBA_OP_DIV || op == ASEBA_OP_MOD)
+				return 0;
+			ASEBA_JIT_COPY(buffer, tplBinaryLoad);
+			if (!AsebaJitBinaryOperation(buffer, op, pc))
+				return 0;
+			ASEBA_JIT_COPY(buffer, tplBranchPrepare);
+			if (isWhen)
+			{
+				p = ASEBA_JIT_COPY(buffer, tplLoadWhenFlag);
+				AsebaJitPatch32(buffer, p + 4, flagOffset);
+				toFalse = ASEBA_JIT_COPY(buffer, tplBranchTest) + 5;
+				// condition is true, remember it
+				p = ASEBA_JIT_COPY(buffer, tplSetWhenFlag);
+				AsebaJitPatch32(buffer, p + 4, flagOffset);
+				AsebaJitPatch16(buffer, p + 8, flagMask);
+				// it was already true, do not execute the block again
+				p = ASEBA_JIT_COPY(buffer, tplTestWhenFlag);
+				AsebaJitPatch32(buffer, p + 2, flagMask);
+				AsebaJitJumpTo(buffer, offsets, begin, end, pc + 2);
+				AsebaJitPatchRelative(buffer, p + 8, buffer->size);
+				AsebaJitJumpTo(buffer, offsets, begin, end, falseTarget);
+				// condition is false, remember it
+				AsebaJitPatchRelative(buffer, toFalse, buffer->size);
+				p = ASEBA_JIT_COPY(buffer, tplClearWhenFlag);
+				AsebaJitPatch32(buffer, p + 4, flagOffset);
+				AsebaJitPatch16(buffer, p + 8, (uint16_t)~flagMask);
+			}
+			else
+			{
+				toFalse = ASEBA_JIT_COPY(buffer, tplBranchTest) + 5;
+				AsebaJitJumpTo(buffer, offsets, begin, end, pc + 2);
+				AsebaJitPatchRelative(buffer, toFalse, buffer->size);
+			}
+			AsebaJitJumpTo(buffer, offsets, begin, end, falseTarget);
+		}
+		break;
+
+		case ASEBA_BYTECODE_EMIT:
+		AsebaJitSetPc(buffer, pc);
+		AsebaJitSyncSp(buffer);
+		ASEBA_JIT_COPY(buffer, tplArgVm);
+		AsebaJitCallArgument(buffer, tplArgSecond, sizeof(tplArgSecond), operand);
+		AsebaJitCallArgument(buffer, tplArgThird, sizeof(tplArgThird), vm->bytecode[pc + 1]);
+		AsebaJitCallArgument(buffer, tplArgFourth, sizeof(tplArgFourth), vm->bytecode[pc + 2]);
+		AsebaJitCall(buffer, (const void*)runtime->emit);
+		p = ASEBA_JIT_COPY(buffer, tplCheckFlags);
+		AsebaJitPatch32(buffer, p + 4, offsetof(AsebaVMState, flags));
+		AsebaJitAddFixup(buffer, p + 16, ASEBA_JIT_TO_EXIT, pc + 3);
+		break;
+
+		case ASEBA_BYTECODE_NATIVE_CALL:
+		{
+			// arguments pushed as constants are resolved now, and placed after the code
+			int16_t args[ASEBA_NATIVE_MAX_ARGS];
+			const uint16_t argsCount = AsebaJitConstantNativeArgs(vm, offsets, isJumpTarget, begin, pc, args);
+			AsebaJitSetPc(buffer, pc);
+			AsebaJitSyncSp(buffer);
+			ASEBA_JIT_COPY(buffer, tplArgVm);
+			AsebaJitCallArgument(buffer, tplArgSecond, sizeof(tplArgSecond), operand);
+			if (argsCount)
+			{
+				p = ASEBA_JIT_COPY(buffer, tplArgThirdAddress);
+				AsebaJitAddFixup(buffer, p + 3, ASEBA_JIT_TO_NATIVE_ARGS, pc);
+				AsebaJitCallArgument(buffer, tplArgFourth, sizeof(tplArgFourth), argsCount);
+				AsebaJitCall(buffer, (const void*)runtime->nativeCallWithArgs);
+			}
+			else
+				AsebaJitCall(buffer, (const void*)runtime->nativeCall);
+		}
+		p = ASEBA_JIT_COPY(buffer, tplReloadSp);
+		AsebaJitPatch32(buffer, p + 4, offsetof(AsebaVMState, sp));
+		p = ASEBA_JIT_COPY(buffer, tplCheckFlags);
+		AsebaJitPatch32(buffer, p + 4, offsetof(AsebaVMState, flags));
+		AsebaJitAddFixup(buffer, p + 16, ASEBA_JIT_TO_EXIT, pc + 1);
+		break;
+
+		case ASEBA_BYTECODE_SUB_CALL:
+		// subroutines are separate regions, let the dispatcher enter them
+		p = ASEBA_JIT_COPY(buffer, tplPushImmediate);
+		AsebaJitPatch16(buffer, p + 8, pc + 1);
+		AsebaJitJump(buffer, ASEBA_JIT_TO_EXIT, operand);
+		break;
+
+		case ASEBA_BYTECODE_SUB_RET:
+		p = ASEBA_JIT_COPY(buffer, tplReturn);
+		AsebaJitPatch32(buffer, p + 12, offsetof(AsebaVMState, pc));
+		AsebaJitJump(buffer, ASEBA_JIT_TO_EPILOGUE, 0);
+		break;
+
+		default:
+		return 0;
+	}
+	return 1;
+}
+
+/*! Compile region to machine code, or mark it as rejected */
+static void AsebaJitCompile(AsebaJit *jit, const AsebaVMState *vm, AsebaJitRegion *region)
+{
+	const AsebaCompiledRuntime *runtime = AsebaVMGetCompiledRuntime();
+	const uint16_t begin = region->begin;
+	uint16_t end = region->begin;
+	uint16_t pc;
+	uint32_t i, p, epilogue;
+	uint32_t *budgetStubs = 0, *boundsStubs = 0, *divisionStubs = 0;
+	uint8_t *isJumpTarget = 0;
+	AsebaJitBuffer buffer;
+	void *code;
+
+	memset(&buffer, 0, sizeof(buffer));
+	region->state = ASEBA_JIT_REJECTED;
+
+	// find instructions, stopping at the first one that does not fit in the region
+	region->offsets = (uint32_t*)malloc((region->end - begin) * sizeof(uint32_t));
+	if (!region->offsets)
+		goto done;
+	for (pc = begin; pc < region->end; pc++)
+		region->offsets[pc - begin] = ASEBA_JIT_NO_OFFSET;
+	for (pc = begin; pc < region->end && (vm->bytecode[pc] >> 12) <= ASEBA_BYTECODE_SUB_RET && pc + AsebaJitInstructionSize(vm->bytecode[pc]) <= region->end; pc += AsebaJitInstructionSize(vm->bytecode[pc]))
+		region->offsets[pc - begin] = 0;
+	end = pc;
+	if (end == begin)
+		goto done;
+
+	// find jump targets, the constants pushed before them are not known when native calls are translated
+	isJumpTarget = (uint8_t*)calloc(end - begin, 1);
+	if (!isJumpTarget)
+		goto done;
+	for (pc = vm->bytecode[0]; pc < vm->bytecodeSize; pc += AsebaJitInstructionSize(vm->bytecode[pc]))
+	{
+		const uint16_t bytecode = vm->bytecode[pc];
+		uint16_t target;
+		if ((bytecode >> 12) == ASEBA_BYTECODE_JUMP)
+			target = pc + ((int16_t)(bytecode << 4) >> 4);
+		else if ((bytecode >> 12) == ASEBA_BYTECODE_CONDITIONAL_BRANCH && pc + 1 < vm->bytecodeSize)
+			target = pc + (int16_t)vm->bytecode[pc + 1];
+		else
+			continue;
+		if (target >= begin && target < end)
+			isJumpTarget[target - begin] = 1;
+	}
+
+	// prologue
+	p = ASEBA_JIT_COPY(&buffer, tplPrologue);
+	AsebaJitPatch32(&buffer, p + 24, offsetof(AsebaVMState, variables));
+	AsebaJitPatch32(&buffer, p + 31, offsetof(AsebaVMState, stack));
+	AsebaJitPatch32(&buffer, p + 39, offsetof(AsebaVMState, sp));
+
+	// body
+	for (pc = begin; pc < end; pc += AsebaJitInstructionSize(vm->bytecode[pc]))
+	{
+		region->offsets[pc - begin] = buffer.size;
+		if (!AsebaJitInstruction(&buffer, vm, region->offsets, isJumpTarget, begin, end, pc))
+			goto done;
+	}
+	// falling out of the region
+	AsebaJitJump(&buffer, ASEBA_JIT_TO_EXIT, end);
+
+	// epilogue
+	epilogue = ASEBA_JIT_COPY(&buffer, tplEpilogue);
+	AsebaJitPatch32(&buffer, epilogue + 4, offsetof(AsebaVMState, sp));
+
+	// stubs, one per instruction needing them
+	budgetStubs = (uint32_t*)calloc(end - begin, sizeof(uint32_t));
+	boundsStubs = (uint32_t*)calloc(end - begin, sizeof(uint32_t));
+	divisionStubs = (uint32_t*)calloc(end - begin, sizeof(uint32_t));
+	if (!budgetStubs || !boundsStubs || !divisionStubs)
+		goto done;
+	for (i = 0; i < buffer.fixupsCount; i++)
+	{
+		const AsebaJitFixup fixup = buffer.fixups[i];
+		const uint16_t index = fixup.pc - begin;
+		uint32_t target = 0;
+		switch (fixup.kind)
+		{
+			case ASEBA_JIT_TO_INSTRUCTION:
+			target = region->offsets[index];
+			break;
+
+			case ASEBA_JIT_TO_EXIT:
+			// leave with pc set
+			target = buffer.size;
+			AsebaJitSetPc(&buffer, fixup.pc);
+			AsebaJitJump(&buffer, ASEBA_JIT_TO_EPILOGUE, 0);
+			break;
+
+			case ASEBA_JIT_TO_EPILOGUE:
+			target = epilogue;
+			break;
+
+			case ASEBA_JIT_TO_BUDGET_STUB:
+			if (!budgetStubs[index])
+			{
+				// no steps left, r15 went to -1
+				budgetStubs[index] = buffer.size;
+				AsebaJitSetPc(&buffer, fixup.pc);
+				ASEBA_JIT_COPY(&buffer, tplClearBudget);
+				AsebaJitJump(&buffer, ASEBA_JIT_TO_EPILOGUE, 0);
+			}
+			target = budgetStubs[index];
+			break;
+
+			case ASEBA_JIT_TO_BOUNDS_STUB:
+			if (!boundsStubs[index])
+			{
+				// index is in eax
+				boundsStubs[index] = buffer.size;
+				AsebaJitSetPc(&buffer, fixup.pc);
+				AsebaJitSyncSp(&buffer);
+				ASEBA_JIT_COPY(&buffer, tplArgThirdFromEax);
+				ASEBA_JIT_COPY(&buffer, tplArgVm);
+				AsebaJitCallArgument(&buffer, tplArgSecond, sizeof(tplArgSecond), vm->bytecode[fixup.pc + 1]);
+				AsebaJitCall(&buffer, (const void*)runtime->arrayAccessOutOfBounds);
+				AsebaJitJump(&buffer, ASEBA_JIT_TO_EPILOGUE, 0);
+			}
+			target = boundsStubs[index];
+			break;
+
+			case ASEBA_JIT_TO_DIVISION_STUB:
+			if (!divisionStubs[index])
+			{
+				// as the interpreter, report, then store 0 as result and go to next instruction
+				divisionStubs[index] = buffer.size;
+				AsebaJitSetPc(&buffer, fixup.pc);
+				AsebaJitSyncSp(&buffer);
+				ASEBA_JIT_COPY(&buffer, tplArgVm);
+				AsebaJitCall(&buffer, (const void*)runtime->divisionByZero);
+				ASEBA_JIT_COPY(&buffer, tplClearResult);
+				ASEBA_JIT_COPY(&buffer, tplBinaryStore);
+				AsebaJitSetPc(&buffer, fixup.pc + 1);
+				AsebaJitJump(&buffer, ASEBA_JIT_TO_EPILOGUE, 0);
+			}
+			target = divisionStubs[index];
+			break;
+
+			case ASEBA_JIT_TO_NATIVE_ARGS:
+			{
+				int16_t args[ASEBA_NATIVE_MAX_ARGS];
+				const uint16_t argsCount = AsebaJitConstantNativeArgs(vm, region->offsets, isJumpTarget, begin, fixup.pc, args);
+				target = buffer.size;
+				AsebaJitCopy(&buffer, (const uint8_t*)args, argsCount * sizeof(int16_t));
+			}
+			break;
+
+			default:
+			continue;
+		}
+		AsebaJitPatchRelative(&buffer, fixup.position, target);
+	}
+	if (buffer.failed)
+		goto done;
+
+	// install code, writable then executable
+	code = mmap(0, buffer.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (code == MAP_FAILED)
+		goto done;
+	memcpy(code, buffer.data, buffer.size);
+	if (mprotect(code, buffer.size, PROT_READ | PROT_EXEC) != 0)
+	{
+		munmap(code, buffer.size);
+		goto done;
+	}
+	region->code = (uint8_t*)code;
+	region->codeSize = buffer.size;
+	region->end = end;
+	region->state = ASEBA_JIT_COMPILED;
+	jit->statistics.compiledCount++;
+	jit->statistics.codeSize += buffer.size;
+
+	done:
+	if (region->state == ASEBA_JIT_REJECTED)
+		jit->statistics.rejectedCount++;
+	free(budgetStubs);
+	free(boundsStubs);
+	free(divisionStubs);
+	free(isJumpTarget);
+	free(buffer.data);
+	free(buffer.fixups);
+}
+
+#endif // ASEBA_JIT_X86_64
+
+AsebaJit* AsebaJitCreate(uint16_t threshold)
+{
+	AsebaJit *jit = (AsebaJit*)calloc(1, sizeof(AsebaJit));
+	if (jit)
+		jit->threshold = threshold ? threshold : 1;
+	return jit;
+}
+
+void AsebaJitDestroy(AsebaJit *jit)
+{
+	if (!jit)
+		return;
+	AsebaJitFreeRegions(jit);
+	free(jit);
+}
+
+void AsebaJitInvalidate(AsebaJit *jit)
+{
+	AsebaJitFreeRegions(jit);
+	jit->statistics.invalidationsCount++;
+}
+
+uint16_t AsebaJitIsSupported(void)
+{
+	#ifdef ASEBA_JIT_X86_64
+	return 1;
+	#else
+	return 0;
+	#endif
+}
+
+void AsebaJitGetStatistics(const AsebaJit *jit, AsebaJitStatistics *statistics)
+{
+	*statistics = jit->statistics;
+}
+
+uint16_t AsebaVMRunJit(AsebaVMState *vm, AsebaJit *jit, uint16_t stepsLimit)
+{
+	int64_t budget = stepsLimit > 0 ? stepsLimit : INT64_MAX;
+
+	// machine code is only generated for x86-64, let the interpreter handle other hosts
+	if (!jit || !AsebaJitIsSupported())
+		return AsebaVMRun(vm, stepsLimit);
+
+	// if there is nothing to execute, just return
+	if (AsebaMaskIsClear(vm->flags, ASEBA_VM_EVENT_ACTIVE_MASK))
+		return 0;
+
+	// if we are running step by step, just return either
+	if (AsebaMaskIsSet(vm->flags, ASEBA_VM_STEP_BY_STEP_MASK))
+		return 0;
+
+	if (!jit->analyzed)
+		AsebaJitAnalyze(jit, vm);
+
+	AsebaMaskSet(vm->flags, ASEBA_VM_EVENT_RUNNING_MASK);
+
+	while (AsebaMaskIsSet(vm->flags, ASEBA_VM_EVENT_ACTIVE_MASK) &&
+		AsebaMaskIsSet(vm->flags, ASEBA_VM_EVENT_RUNNING_MASK) &&
+		budget > 0
+	)
+	{
+		AsebaJitRegion *region = AsebaJitFindRegion(jit, vm->pc);
+		/*
+			Machine code does not check breakpoints. While some are set, the regions that
+			contain one are interpreted one step at a time and stop at them as AsebaVMRun
+			does, but the other regions keep running as machine code. This is correct as
+			machine code leaves to this loop whenever execution leaves its region.
+		*/
+		const uint16_t breakpoints = vm->breakpointsCount != 0;
+		if (breakpoints && AsebaVMStopAtBreakpoint(vm))
+			break;
+		#ifdef ASEBA_JIT_X86_64
+		// only count entries of the event handler or subroutine, not resumptions in its middle
+		if (region && region->state == ASEBA_JIT_INTERPRETED && vm->pc == region->begin && ++region->executions >= jit->threshold)
+			AsebaJitCompile(jit, vm, region);
+		if (region && region->state == ASEBA_JIT_COMPILED && vm->pc < region->end && region->offsets[vm->pc - region->begin] != ASEBA_JIT_NO_OFFSET &&
+			!(breakpoints && AsebaVMHasBreakpointIn(vm, region->begin, region->end)))
+		{
+			((AsebaJitFunction)region->code)(vm, &budget, region->code + region->offsets[vm->pc - region->begin]);
+			continue;
+		}
+		#endif // ASEBA_JIT_X86_64
+		// interpret, until leaving the region when in one
+		do
+		{
+			AsebaVMStep(vm);
+			budget--;
+		}
+		while (!breakpoints && region && region->state == ASEBA_JIT_INTERPRETED &&
+			vm->pc >= region->begin && vm->pc < region->end &&
+			AsebaMaskIsSet(vm->flags, ASEBA_VM_EVENT_ACTIVE_MASK) &&
+			AsebaMaskIsSet(vm->flags, ASEBA_VM_EVENT_RUNNING_MASK) &&
+			budget > 0
+		);
+	}
+
+	AsebaMaskClear(vm->flags, ASEBA_VM_EVENT_RUNNING_MASK);
+
+	if (AsebaMaskIsClear(vm->flags, ASEBA_VM_EVENT_ACTIVE_MASK) && AsebaVMEventFinishedCB)
+		AsebaVMEventFinishedCB(vm);
+
+	return 1;
+}
+
+void AsebaJitDebugMessage(AsebaVMState *vm, AsebaJit *jit, uint16_t id, uint16_t *data, uint16_t dataLength)
+{
+	if (id == ASEBA_MESSAGE_SET_BYTECODE && jit)
+		AsebaJitInvalidate(jit);
+	AsebaVMDebugMessage(vm, id, data, dataLength);
+}
+
+/*@}*/
@@ -0,0 +1,91 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2016:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ASEBA_VM_JIT_H
+#define __ASEBA_VM_JIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "../common/types.h"
+#include "vm.h"
+
+/**
+	\file jit.h
+	Tiered baseline JIT for the Aseba VM, for host targets.
+
+	Event handlers and subroutines are interpreted until they have been entered
+	a given number of times, and are then compiled to machine code by copying
+	and patching a template per instruction. Translated code has the same
+	semantics as AsebaVMStep, including steps limits and execution errors.
+	Natives in the dispatch table of the VM get the constants pushed right
+	before their call through AsebaVMCallNativeWithArgs, resolved when the
+	region is compiled, so compiled code must be discarded when bytecode changes.
+
+	Machine code generation is only available on x86-64 Linux; elsewhere,
+	AsebaVMRunJit() is AsebaVMRun(). While breakpoints are set, the regions
+	containing one are interpreted and the others still run as machine code.
+*/
+
+/** \addtogroup vm */
+/*@{*/
+
+/*! Opaque JIT state, one per VM */
+typedef struct AsebaJit AsebaJit;
+
+/*! Statistics about a JIT */
+typedef struct
+{
+	uint32_t regionsCount; /*!< number of event handlers and subroutines found in bytecode */
+	uint32_t compiledCount; /*!< number of regions compiled to machine code */
+	uint32_t rejectedCount; /*!< number of regions that cannot be compiled */
+	uint32_t codeSize; /*!< bytes of machine code generated */
+	uint32_t invalidationsCount; /*!< number of times the code was discarded */
+} AsebaJitStatistics;
+
+/*! Create a JIT that compiles regions after threshold entries (at least 1) */
+AsebaJit* AsebaJitCreate(uint16_t threshold);
+
+/*! Destroy a JIT and free its machine code */
+void AsebaJitDestroy(AsebaJit *jit);
+
+/*! Discard all machine code, must be called whenever the bytecode of the VM is changed outside AsebaJitDebugMessage() */
+void AsebaJitInvalidate(AsebaJit *jit);
+
+/*! Return whether machine code generation is supported on this host */
+uint16_t AsebaJitIsSupported(void);
+
+/*! Fill statistics with the current state of jit */
+void AsebaJitGetStatistics(const AsebaJit *jit, AsebaJitStatistics *statistics);
+
+/*! Like AsebaVMRun, but tier up hot regions to machine code */
+uint16_t AsebaVMRunJit(AsebaVMState *vm, AsebaJit *jit, uint16_t stepsLimit);
+
+/*! Like AsebaVMDebugMessage, but invalidate machine code when bytecode is set */
+void AsebaJitDebugMessage(AsebaVMState *vm, AsebaJit *jit, uint16_t id, uint16_t *data, uint16_t dataLength);
+
+/*@}*/
+
+#ifdef __cplusplus
+} /* closing brace for extern "C" */
+#endif
+
+#endif
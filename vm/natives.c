@@ -25,6 +25,10 @@
 
 #include <assert.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #if defined(__dsPIC30F__)
 #include <p30Fxxxx.h>
 #define DSP_AVAILABLE
@@ -65,6 +69,29 @@ for (int i = 0; i < 20; i++)
 */
 
 
+#ifndef __C30__
+// interpolate atan of value, a 16.16 fixed point ratio whose first bit at one is fb1, in the table
+static int16_t aseba_atan_interpolate(int32_t value, int16_t fb1)
+{
+	// we only keep 4 bits of precision below comma as atan(x) is like x near 0
+	int16_t index = fb1 - 12;
+	if (index < 0)
+	{
+		// value is smaller than 2e-4
+		return (int16_t)(((int32_t)aseba_atan_table[0] * value) >> 12);
+	}
+	else
+	{
+		int32_t subprecision_rest = value - (((int32_t) 1) << fb1);
+		int16_t to_shift = fb1 - 8; // fb1 >= 12 otherwise index would have been < 0
+		int16_t subprecision_index = (int16_t)(subprecision_rest >> to_shift);
+		int16_t bin = subprecision_index >> 5;
+		int16_t delta = subprecision_index & 0x1f;
+		return (int16_t)(((int32_t)aseba_atan_table[index*8 + bin] * (int32_t)(32 - delta) + (int32_t)aseba_atan_table[index*8 + bin + 1] * (int32_t)delta) >> 5);
+	}
+}
+#endif
+
 // atan2, do y/x and return an "aseba" angle that spans the whole 16 bits range
 int16_t aseba_atan2(int16_t y, int16_t x)
 {
@@ -134,22 +161,7 @@ int16_t aseba_atan2(int16_t y, int16_t x)
 					fb1 = fb1_counter;
 						
 			{
-				// we only keep 4 bits of precision below comma as atan(x) is like x near 0
-				int16_t index = fb1 - 12;
-				if (index < 0)
-				{
-					// value is smaller than 2e-4
-					res = (int16_t)(((int32_t)aseba_atan_table[0] * value) >> 12);
-				}
-				else
-				{
-					int32_t subprecision_rest = value - (((int32_t) 1) << fb1);
-					int16_t to_shift = fb1 - 8; // fb1 >= 12 otherwise index would have been < 0
-					int16_t subprecision_index = (int16_t)(subprecision_rest >> to_shift);
-					int16_t bin = subprecision_index >> 5;
-					int16_t delta = subprecision_index & 0x1f;
-					res = (int16_t)(((int32_t)aseba_atan_table[index*8 + bin] * (int32_t)(32 - delta) + (int32_t)aseba_atan_table[index*8 + bin + 1] * (int32_t)delta) >> 5);
-				}
+				res = aseba_atan_interpolate(value, fb1);
 #endif
 				// do pi - value if x negative
 				if (x < 0)
@@ -230,6 +242,10 @@ int16_t aseba_sqrt(int16_t num)
 	int16_t res = 0;
 	int16_t one = 1 << 14;
 	
+	// negative numbers have no root, and would never leave the loop below
+	if (num < 0)
+		return 0;
+	
 	while(one > op)
 		one >>= 2;
 		
@@ -249,6 +265,141 @@ int16_t aseba_sqrt(int16_t num)
 	return res;
 }
 
+// The functions below apply the ones above to whole arrays, faster on hosts but with exactly the same results
+
+#ifndef __C30__
+// return the index of the first bit at one from the left in value, 31 if value is negative and 0 if it is 0,
+// as the loop of aseba_atan2 does
+static int16_t aseba_first_bit(int32_t value)
+{
+	if (value <= 0)
+		return value ? 31 : 0;
+#ifdef __GNUC__
+	return 31 - __builtin_clz((uint32_t)value);
+#else
+	{
+		int16_t fb1 = 0;
+		if (value >> 16) { value >>= 16; fb1 += 16; }
+		if (value >> 8) { value >>= 8; fb1 += 8; }
+		if (value >> 4) { value >>= 4; fb1 += 4; }
+		if (value >> 2) { value >>= 2; fb1 += 2; }
+		if (value >> 1) { fb1 += 1; }
+		return fb1;
+	}
+#endif
+}
+
+// same as aseba_atan2, without looping to find the first bit at one
+static int16_t aseba_atan2_fast(int16_t y, int16_t x)
+{
+	int16_t res;
+	if (y == 0)
+		return x >= 0 ? 0 : -32768;
+	if (x == 0)
+		res = 16384;
+	else
+	{
+		int16_t ax = abs(x);
+		int16_t ay = abs(y);
+		int32_t value = (((int32_t)ay << 16)/(int32_t)(ax));
+		res = aseba_atan_interpolate(value, aseba_first_bit(value));
+		if (x < 0)
+			res = 32768 - res;
+	}
+	if (y > 0)
+		return res;
+	else
+		return -res;
+}
+#endif // __C30__
+
+#ifdef __SSE2__
+// sinus of 8 angles, the lookup and the interpolation of aseba_sin without branches
+static __m128i aseba_sin_sse2(__m128i angle)
+{
+	int16_t indices[8];
+	int32_t pairs[8];
+	int16_t i;
+	__m128i sign, absAngle, fromQuarter, lookupAngle, index, subIndex, currentWeight, sumLo, sumHi, result;
+	
+	// the lookup angle, 0 to 16384, is 16384 - ||angle| - 16384|, with |-32768| being 32768 as unsigned
+	sign = _mm_srai_epi16(angle, 15);
+	absAngle = _mm_sub_epi16(_mm_xor_si128(angle, sign), sign);
+	fromQuarter = _mm_sub_epi16(absAngle, _mm_set1_epi16(16384));
+	fromQuarter = _mm_max_epi16(fromQuarter, _mm_sub_epi16(_mm_setzero_si128(), fromQuarter));
+	lookupAngle = _mm_sub_epi16(_mm_set1_epi16(16384), fromQuarter);
+	
+	// 16384 is read as the end of the last bin, so that the next entry is always in the table
+	index = _mm_min_epi16(_mm_srli_epi16(lookupAngle, 7), _mm_set1_epi16(127));
+	subIndex = _mm_sub_epi16(lookupAngle, _mm_slli_epi16(index, 7));
+	
+	// SSE2 cannot gather, read each entry along with the next one as a single 32 bits word
+	_mm_storeu_si128((__m128i*)indices, index);
+	for (i = 0; i < 8; i++)
+		memcpy(&pairs[i], &aseba_sin_table[indices[i]], sizeof(int32_t));
+	
+	// table[index] * (128-subIndex) + table[index+1] * subIndex, by pairs of 16 bits products
+	currentWeight = _mm_sub_epi16(_mm_set1_epi16(128), subIndex);
+	sumLo = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)pairs), _mm_unpacklo_epi16(currentWeight, subIndex));
+	sumHi = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(pairs + 4)), _mm_unpackhi_epi16(currentWeight, subIndex));
+	result = _mm_packs_epi32(_mm_srai_epi32(sumLo, 7), _mm_srai_epi32(sumHi, 7));
+	
+	// negative angles have negative sinus
+	return _mm_sub_epi16(_mm_xor_si128(result, sign), sign);
+}
+#endif // __SSE2__
+
+void aseba_sin_array(int16_t* dest, const int16_t* angles, uint16_t length)
+{
+	uint16_t i = 0;
+#ifdef __SSE2__
+	for (; i + 8 <= length; i += 8)
+		_mm_storeu_si128((__m128i*)(dest + i), aseba_sin_sse2(_mm_loadu_si128((const __m128i*)(angles + i))));
+#endif
+	for (; i < length; i++)
+		dest[i] = aseba_sin(angles[i]);
+}
+
+void aseba_cos_array(int16_t* dest, const int16_t* angles, uint16_t length)
+{
+	uint16_t i = 0;
+#ifdef __SSE2__
+	const __m128i quarter = _mm_set1_epi16(16384);
+	for (; i + 8 <= length; i += 8)
+		_mm_storeu_si128((__m128i*)(dest + i), aseba_sin_sse2(_mm_add_epi16(_mm_loadu_si128((const __m128i*)(angles + i)), quarter)));
+#endif
+	for (; i < length; i++)
+		dest[i] = aseba_cos(angles[i]);
+}
+
+void aseba_atan2_array(int16_t* dest, const int16_t* y, const int16_t* x, uint16_t length)
+{
+	uint16_t i;
+	for (i = 0; i < length; i++)
+#ifdef __C30__
+		dest[i] = aseba_atan2(y[i], x[i]);
+#else
+		dest[i] = aseba_atan2_fast(y[i], x[i]);
+#endif
+}
+
+void aseba_sqrt_array(int16_t* dest, const int16_t* values, uint16_t length)
+{
+	uint16_t i = 0;
+#ifdef __SSE2__
+	// single precision square roots are correctly rounded, so truncating them is exact for 15 bits integers
+	for (; i + 8 <= length; i += 8)
+	{
+		const __m128i value = _mm_max_epi16(_mm_loadu_si128((const __m128i*)(values + i)), _mm_setzero_si128());
+		const __m128i lo = _mm_cvttps_epi32(_mm_sqrt_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(value, _mm_setzero_si128()))));
+		const __m128i hi = _mm_cvttps_epi32(_mm_sqrt_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(value, _mm_setzero_si128()))));
+		_mm_storeu_si128((__m128i*)(dest + i), _mm_packs_epi32(lo, hi));
+	}
+#endif
+	for (; i < length; i++)
+		dest[i] = aseba_sqrt(values[i]);
+}
+
 // comb sort ( from Wikipedia )
 void aseba_comb_sort(int16_t* input, uint16_t size)
 {
@@ -283,16 +434,39 @@ void aseba_comb_sort(int16_t* input, uint16_t size)
 }
 
 
+// support functions
+
+uint16_t AsebaNativeArgsCount(const AsebaNativeFunctionDescription *description)
+{
+	// one word per argument, plus one per template parameter, numbered from -1
+	uint16_t argumentsCount = 0;
+	uint16_t templatesCount = 0;
+	const AsebaNativeFunctionArgumentDescription *argument;
+	for (argument = description->arguments; argument->size != 0; argument++)
+	{
+		argumentsCount++;
+		if (argument->size < 0 && (uint16_t)(-argument->size) > templatesCount)
+			templatesCount = -argument->size;
+	}
+	return argumentsCount + templatesCount;
+}
+
+// whether writing length elements from destIndex on changes elements from srcIndex on before they are read
+static int AsebaNativeOverwritesAhead(uint16_t destIndex, uint16_t srcIndex, uint16_t length)
+{
+	return destIndex > srcIndex && destIndex < (uint32_t)srcIndex + length;
+}
+
 // standard natives functions
 
-void AsebaNative_veccopy(AsebaVMState *vm)
+void AsebaNativeArgs_veccopy(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t dest = AsebaNativePopArg(vm);
-	uint16_t src = AsebaNativePopArg(vm);
+	uint16_t dest = args[0];
+	uint16_t src = args[1];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[2];
 	
 	uint16_t i;
 	
@@ -302,6 +476,11 @@ void AsebaNative_veccopy(AsebaVMState *vm)
 	}
 }
 
+void AsebaNative_veccopy(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_veccopy, 3);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_veccopy =
 {
 	"math.copy",
@@ -314,14 +493,14 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_veccopy =
 };
 
 
-void AsebaNative_vecfill(AsebaVMState *vm)
+void AsebaNativeArgs_vecfill(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t dest = AsebaNativePopArg(vm);
-	uint16_t value = AsebaNativePopArg(vm);
+	uint16_t dest = args[0];
+	uint16_t value = args[1];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[2];
 	
 	uint16_t i;
 	
@@ -331,6 +510,11 @@ void AsebaNative_vecfill(AsebaVMState *vm)
 	}
 }
 
+void AsebaNative_vecfill(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_vecfill, 3);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_vecfill =
 {
 	"math.fill",
@@ -343,15 +527,15 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_vecfill =
 };
 
 
-void AsebaNative_vecaddscalar(AsebaVMState *vm)
+void AsebaNativeArgs_vecaddscalar(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t dest = AsebaNativePopArg(vm);
-	uint16_t src = AsebaNativePopArg(vm);
-	uint16_t scalar = AsebaNativePopArg(vm);
+	uint16_t dest = args[0];
+	uint16_t src = args[1];
+	uint16_t scalar = args[2];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[3];
 	
 	const int16_t scalarValue = vm->variables[scalar];
 	uint16_t i;
@@ -361,6 +545,11 @@ void AsebaNative_vecaddscalar(AsebaVMState *vm)
 	}
 }
 
+void AsebaNative_vecaddscalar(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_vecaddscalar, 4);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_vecaddscalar =
 {
 	"math.addscalar",
@@ -374,15 +563,15 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_vecaddscalar =
 };
 
 
-void AsebaNative_vecadd(AsebaVMState *vm)
+void AsebaNativeArgs_vecadd(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t dest = AsebaNativePopArg(vm);
-	uint16_t src1 = AsebaNativePopArg(vm);
-	uint16_t src2 = AsebaNativePopArg(vm);
+	uint16_t dest = args[0];
+	uint16_t src1 = args[1];
+	uint16_t src2 = args[2];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[3];
 	
 	uint16_t i;
 	for (i = 0; i < length; i++)
@@ -391,6 +580,11 @@ void AsebaNative_vecadd(AsebaVMState *vm)
 	}
 }
 
+void AsebaNative_vecadd(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_vecadd, 4);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_vecadd =
 {
 	"math.add",
@@ -404,15 +598,15 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_vecadd =
 };
 
 
-void AsebaNative_vecsub(AsebaVMState *vm)
+void AsebaNativeArgs_vecsub(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t dest = AsebaNativePopArg(vm);
-	uint16_t src1 = AsebaNativePopArg(vm);
-	uint16_t src2 = AsebaNativePopArg(vm);
+	uint16_t dest = args[0];
+	uint16_t src1 = args[1];
+	uint16_t src2 = args[2];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[3];
 	
 	uint16_t i;
 	for (i = 0; i < length; i++)
@@ -421,6 +615,11 @@ void AsebaNative_vecsub(AsebaVMState *vm)
 	}
 }
 
+void AsebaNative_vecsub(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_vecsub, 4);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_vecsub =
 {
 	"math.sub",
@@ -434,15 +633,15 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_vecsub =
 };
 
 
-void AsebaNative_vecmul(AsebaVMState *vm)
+void AsebaNativeArgs_vecmul(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t dest = AsebaNativePopArg(vm);
-	uint16_t src1 = AsebaNativePopArg(vm);
-	uint16_t src2 = AsebaNativePopArg(vm);
+	uint16_t dest = args[0];
+	uint16_t src1 = args[1];
+	uint16_t src2 = args[2];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[3];
 	
 	uint16_t i;
 	for (i = 0; i < length; i++)
@@ -451,6 +650,11 @@ void AsebaNative_vecmul(AsebaVMState *vm)
 	}
 }
 
+void AsebaNative_vecmul(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_vecmul, 4);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_vecmul =
 {
 	"math.mul",
@@ -464,15 +668,15 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_vecmul =
 };
 
 
-void AsebaNative_vecdiv(AsebaVMState *vm)
+void AsebaNativeArgs_vecdiv(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t dest = AsebaNativePopArg(vm);
-	uint16_t src1 = AsebaNativePopArg(vm);
-	uint16_t src2 = AsebaNativePopArg(vm);
+	uint16_t dest = args[0];
+	uint16_t src1 = args[1];
+	uint16_t src2 = args[2];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[3];
 	
 	uint16_t i;
 	for (i = 0; i < length; i++)
@@ -493,6 +697,11 @@ void AsebaNative_vecdiv(AsebaVMState *vm)
 	}
 }
 
+void AsebaNative_vecdiv(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_vecdiv, 4);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_vecdiv =
 {
 	"math.div",
@@ -506,15 +715,15 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_vecdiv =
 };
 
 
-void AsebaNative_vecmin(AsebaVMState *vm)
+void AsebaNativeArgs_vecmin(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t dest = AsebaNativePopArg(vm);
-	uint16_t src1 = AsebaNativePopArg(vm);
-	uint16_t src2 = AsebaNativePopArg(vm);
+	uint16_t dest = args[0];
+	uint16_t src1 = args[1];
+	uint16_t src2 = args[2];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[3];
 	
 	uint16_t i;
 	for (i = 0; i < length; i++)
@@ -526,6 +735,11 @@ void AsebaNative_vecmin(AsebaVMState *vm)
 	}
 }
 
+void AsebaNative_vecmin(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_vecmin, 4);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_vecmin =
 {
 	"math.min",
@@ -539,15 +753,15 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_vecmin =
 };
 
 
-void AsebaNative_vecmax(AsebaVMState *vm)
+void AsebaNativeArgs_vecmax(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t dest = AsebaNativePopArg(vm);
-	uint16_t src1 = AsebaNativePopArg(vm);
-	uint16_t src2 = AsebaNativePopArg(vm);
+	uint16_t dest = args[0];
+	uint16_t src1 = args[1];
+	uint16_t src2 = args[2];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[3];
 	
 	uint16_t i;
 	for (i = 0; i < length; i++)
@@ -559,6 +773,11 @@ void AsebaNative_vecmax(AsebaVMState *vm)
 	}
 }
 
+void AsebaNative_vecmax(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_vecmax, 4);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_vecmax =
 {
 	"math.max",
@@ -571,16 +790,16 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_vecmax =
 	}
 };
 
-void AsebaNative_vecclamp(AsebaVMState *vm)
+void AsebaNativeArgs_vecclamp(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t dest = AsebaNativePopArg(vm);
-	uint16_t src = AsebaNativePopArg(vm);
-	uint16_t low = AsebaNativePopArg(vm);
-	uint16_t high = AsebaNativePopArg(vm);
+	uint16_t dest = args[0];
+	uint16_t src = args[1];
+	uint16_t low = args[2];
+	uint16_t high = args[3];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[4];
 	
 	uint16_t i;
 	for (i = 0; i < length; i++)
@@ -593,6 +812,11 @@ void AsebaNative_vecclamp(AsebaVMState *vm)
 	}
 }
 
+void AsebaNative_vecclamp(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_vecclamp, 5);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_vecclamp =
 {
 	"math.clamp",
@@ -606,16 +830,16 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_vecclamp =
 	}
 };
 
-void AsebaNative_vecdot(AsebaVMState *vm)
+void AsebaNativeArgs_vecdot(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t dest = AsebaNativePopArg(vm);
-	uint16_t src1 = AsebaNativePopArg(vm);
-	uint16_t src2 = AsebaNativePopArg(vm);
-	int16_t shift = vm->variables[AsebaNativePopArg(vm)];
+	uint16_t dest = args[0];
+	uint16_t src1 = args[1];
+	uint16_t src2 = args[2];
+	int16_t shift = vm->variables[args[3]];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[4];
 	int32_t res = 0;
 	uint16_t i;
 	
@@ -668,6 +892,11 @@ void AsebaNative_vecdot(AsebaVMState *vm)
 #endif
 }
 
+void AsebaNative_vecdot(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_vecdot, 5);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_vecdot =
 {
 	"math.dot",
@@ -682,16 +911,16 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_vecdot =
 };
 
 
-void AsebaNative_vecstat(AsebaVMState *vm)
+void AsebaNativeArgs_vecstat(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t src = AsebaNativePopArg(vm);
-	uint16_t min = AsebaNativePopArg(vm);
-	uint16_t max = AsebaNativePopArg(vm);
-	uint16_t mean = AsebaNativePopArg(vm);
+	uint16_t src = args[0];
+	uint16_t min = args[1];
+	uint16_t max = args[2];
+	uint16_t mean = args[3];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[4];
 	int16_t val;
 	int32_t acc;
 	uint16_t i;
@@ -717,6 +946,11 @@ void AsebaNative_vecstat(AsebaVMState *vm)
 	}
 }
 
+void AsebaNative_vecstat(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_vecstat, 5);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_vecstat =
 {
 	"math.stat",
@@ -731,15 +965,15 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_vecstat =
 };
 
 
-void AsebaNative_vecargbounds(AsebaVMState *vm)
+void AsebaNativeArgs_vecargbounds(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t src = AsebaNativePopArg(vm);
-	uint16_t argmin = AsebaNativePopArg(vm);
-	uint16_t argmax = AsebaNativePopArg(vm);
+	uint16_t src = args[0];
+	uint16_t argmin = args[1];
+	uint16_t argmax = args[2];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[3];
 	int16_t min = 32767;
 	int16_t max = -32768;
 	int16_t val;
@@ -764,6 +998,11 @@ void AsebaNative_vecargbounds(AsebaVMState *vm)
 	}
 }
 
+void AsebaNative_vecargbounds(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_vecargbounds, 4);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_vecargbounds =
 {
 	"math.argbounds",
@@ -777,17 +1016,22 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_vecargbounds =
 };
 
 
-void AsebaNative_vecsort(AsebaVMState *vm)
+void AsebaNativeArgs_vecsort(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t src = AsebaNativePopArg(vm);
+	uint16_t src = args[0];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[1];
 	
 	aseba_comb_sort(&vm->variables[src], length);
 }
 
+void AsebaNative_vecsort(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_vecsort, 2);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_vecsort =
 {
 	"math.sort",
@@ -799,16 +1043,16 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_vecsort =
 };
 
 
-void AsebaNative_mathmuldiv(AsebaVMState *vm)
+void AsebaNativeArgs_mathmuldiv(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t destIndex = AsebaNativePopArg(vm);
-	uint16_t aIndex = AsebaNativePopArg(vm);
-	uint16_t bIndex = AsebaNativePopArg(vm);
-	uint16_t cIndex = AsebaNativePopArg(vm);
+	uint16_t destIndex = args[0];
+	uint16_t aIndex = args[1];
+	uint16_t bIndex = args[2];
+	uint16_t cIndex = args[3];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[4];
 	
 	uint16_t i;
 	for (i = 0; i < length; i++)
@@ -829,6 +1073,11 @@ void AsebaNative_mathmuldiv(AsebaVMState *vm)
 	}
 }
 
+void AsebaNative_mathmuldiv(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_mathmuldiv, 5);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_mathmuldiv =
 {
 	"math.muldiv",
@@ -842,17 +1091,22 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_mathmuldiv =
 	}
 };
 
-void AsebaNative_mathatan2(AsebaVMState *vm)
+void AsebaNativeArgs_mathatan2(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t destIndex = AsebaNativePopArg(vm);
-	int16_t yIndex = AsebaNativePopArg(vm);
-	int16_t xIndex = AsebaNativePopArg(vm);
+	uint16_t destIndex = args[0];
+	int16_t yIndex = args[1];
+	int16_t xIndex = args[2];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[3];
 	
 	uint16_t i;
+	if (!AsebaNativeOverwritesAhead(destIndex, yIndex, length) && !AsebaNativeOverwritesAhead(destIndex, xIndex, length))
+	{
+		aseba_atan2_array(vm->variables + destIndex, vm->variables + yIndex, vm->variables + xIndex, length);
+		return;
+	}
 	for (i = 0; i < length; i++)
 	{
 		int16_t y = vm->variables[yIndex++];
@@ -861,6 +1115,11 @@ void AsebaNative_mathatan2(AsebaVMState *vm)
 	}
 }
 
+void AsebaNative_mathatan2(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_mathatan2, 4);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_mathatan2 =
 {
 	"math.atan2",
@@ -873,16 +1132,21 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_mathatan2 =
 	}
 };
 
-void AsebaNative_mathsin(AsebaVMState *vm)
+void AsebaNativeArgs_mathsin(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t destIndex = AsebaNativePopArg(vm);
-	int16_t xIndex = AsebaNativePopArg(vm);
+	uint16_t destIndex = args[0];
+	int16_t xIndex = args[1];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[2];
 	
 	uint16_t i;
+	if (!AsebaNativeOverwritesAhead(destIndex, xIndex, length))
+	{
+		aseba_sin_array(vm->variables + destIndex, vm->variables + xIndex, length);
+		return;
+	}
 	for (i = 0; i < length; i++)
 	{
 		int16_t x = vm->variables[xIndex++];
@@ -890,6 +1154,11 @@ void AsebaNative_mathsin(AsebaVMState *vm)
 	}
 }
 
+void AsebaNative_mathsin(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_mathsin, 3);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_mathsin =
 {
 	"math.sin",
@@ -901,16 +1170,21 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_mathsin =
 	}
 };
 
-void AsebaNative_mathcos(AsebaVMState *vm)
+void AsebaNativeArgs_mathcos(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t destIndex = AsebaNativePopArg(vm);
-	int16_t xIndex = AsebaNativePopArg(vm);
+	uint16_t destIndex = args[0];
+	int16_t xIndex = args[1];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[2];
 	
 	uint16_t i;
+	if (!AsebaNativeOverwritesAhead(destIndex, xIndex, length))
+	{
+		aseba_cos_array(vm->variables + destIndex, vm->variables + xIndex, length);
+		return;
+	}
 	for (i = 0; i < length; i++)
 	{
 		int16_t x = vm->variables[xIndex++];
@@ -918,6 +1192,11 @@ void AsebaNative_mathcos(AsebaVMState *vm)
 	}
 }
 
+void AsebaNative_mathcos(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_mathcos, 3);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_mathcos =
 {
 	"math.cos",
@@ -929,12 +1208,12 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_mathcos =
 	}
 };
 
-void AsebaNative_mathrot2(AsebaVMState *vm)
+void AsebaNativeArgs_mathrot2(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t vectOutIndex = AsebaNativePopArg(vm);
-	uint16_t vecInIndex = AsebaNativePopArg(vm);
-	uint16_t angleIndex = AsebaNativePopArg(vm);
+	uint16_t vectOutIndex = args[0];
+	uint16_t vecInIndex = args[1];
+	uint16_t angleIndex = args[2];
 	
 	// variables
 	int16_t x = vm->variables[vecInIndex];
@@ -951,6 +1230,11 @@ void AsebaNative_mathrot2(AsebaVMState *vm)
 	vm->variables[vectOutIndex+1] = yp;
 }
 
+void AsebaNative_mathrot2(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_mathrot2, 3);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_mathrot2 =
 {
 	"math.rot2",
@@ -963,16 +1247,21 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_mathrot2 =
 	}
 };
 
-void AsebaNative_mathsqrt(AsebaVMState *vm)
+void AsebaNativeArgs_mathsqrt(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t destIndex = AsebaNativePopArg(vm);
-	int16_t xIndex = AsebaNativePopArg(vm);
+	uint16_t destIndex = args[0];
+	int16_t xIndex = args[1];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[2];
 	
 	uint16_t i;
+	if (!AsebaNativeOverwritesAhead(destIndex, xIndex, length))
+	{
+		aseba_sqrt_array(vm->variables + destIndex, vm->variables + xIndex, length);
+		return;
+	}
 	for (i = 0; i < length; i++)
 	{
 		int16_t x = vm->variables[xIndex++];
@@ -980,6 +1269,11 @@ void AsebaNative_mathsqrt(AsebaVMState *vm)
 	}
 }
 
+void AsebaNative_mathsqrt(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_mathsqrt, 3);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_mathsqrt =
 {
 	"math.sqrt",
@@ -991,15 +1285,15 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_mathsqrt =
 	}
 };
 
-void AsebaNative_vecnonzerosequence(AsebaVMState *vm)
+void AsebaNativeArgs_vecnonzerosequence(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t dest = AsebaNativePopArg(vm); // output value index
-	uint16_t src = AsebaNativePopArg(vm); // input vector index
-	uint16_t length = AsebaNativePopArg(vm); // length threshold index
+	uint16_t dest = args[0]; // output value index
+	uint16_t src = args[1]; // input vector index
+	uint16_t length = args[2]; // length threshold index
 	
 	// variable size
-	uint16_t inputLength = AsebaNativePopArg(vm);
+	uint16_t inputLength = args[3];
 	int16_t minLength = vm->variables[length]; // length threshold 
 	
 	// work variables
@@ -1087,6 +1381,11 @@ doubleBreak:
 	}
 }
 
+void AsebaNative_vecnonzerosequence(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_vecnonzerosequence, 4);
+}
+
 
 const AsebaNativeFunctionDescription AsebaNativeDescription_vecnonzerosequence =
 {
@@ -1113,13 +1412,13 @@ uint16_t AsebaGetRandom()
 	return rnd_state;
 }
 
-void AsebaNative_rand(AsebaVMState *vm)
+void AsebaNativeArgs_rand(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t destIndex = AsebaNativePopArg(vm);
+	uint16_t destIndex = args[0];
 	
 	// variable size
-	uint16_t length = AsebaNativePopArg(vm);
+	uint16_t length = args[1];
 	
 	uint16_t i;
 	for (i = 0; i < length; i++)
@@ -1128,6 +1427,11 @@ void AsebaNative_rand(AsebaVMState *vm)
 	}
 }
 
+void AsebaNative_rand(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_rand, 2);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_rand =
 {
 	"math.rand",
@@ -1184,18 +1488,23 @@ static void deque_throw_exception(AsebaVMState *vm)
 	return;
 }
 
-void AsebaNative_deqsize(AsebaVMState *vm)
+void AsebaNativeArgs_deqsize(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t deque = AsebaNativePopArg(vm);
-	uint16_t size = AsebaNativePopArg(vm);
+	uint16_t deque = args[0];
+	uint16_t size = args[1];
 	
 	// variable size
-	(void)/* uint16_t deque_length = */ AsebaNativePopArg(vm);
+	(void)/* uint16_t deque_length = */ args[2];
 
 	vm->variables[size++] = vm->variables[deque++];
 }
 
+void AsebaNative_deqsize(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_deqsize, 3);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_deqsize =
 {
 	"deque.size",
@@ -1227,17 +1536,17 @@ static void _AsebaNative_deqget(AsebaVMState *vm, uint16_t dest, uint16_t deque,
 	}
 }
 
-void AsebaNative_deqget(AsebaVMState *vm)
+void AsebaNativeArgs_deqget(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-    uint16_t deque = AsebaNativePopArg(vm);
-	uint16_t dest = AsebaNativePopArg(vm);
-	uint16_t index = AsebaNativePopArg(vm);
+    uint16_t deque = args[0];
+	uint16_t dest = args[1];
+	uint16_t index = args[2];
 	uint16_t index_val = vm->variables[index];
 	
 	// variable size
-	uint16_t deque_length = AsebaNativePopArg(vm);
-	uint16_t dest_length = AsebaNativePopArg(vm);
+	uint16_t deque_length = args[3];
+	uint16_t dest_length = args[4];
 	
 	// Check for parameter range exception
 	if (vm->variables[index] < 0 || vm->variables[index] > deque_length - 2 - 1)
@@ -1246,6 +1555,11 @@ void AsebaNative_deqget(AsebaVMState *vm)
 	// Do it
 	_AsebaNative_deqget(vm, dest, deque, index_val, dest_length, deque_length);
 }
+
+void AsebaNative_deqget(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_deqget, 5);
+}
 	
 const AsebaNativeFunctionDescription AsebaNativeDescription_deqget =
 {
@@ -1259,17 +1573,17 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_deqget =
 	}
 };
 
-void AsebaNative_deqset(AsebaVMState *vm)
+void AsebaNativeArgs_deqset(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t deque = AsebaNativePopArg(vm);
-	uint16_t src = AsebaNativePopArg(vm);
-	uint16_t index = AsebaNativePopArg(vm);
+	uint16_t deque = args[0];
+	uint16_t src = args[1];
+	uint16_t index = args[2];
 	uint16_t index_val = vm->variables[index];
 	
 	// variable size
-	uint16_t deque_length = AsebaNativePopArg(vm);
-	uint16_t src_length = AsebaNativePopArg(vm);
+	uint16_t deque_length = args[3];
+	uint16_t src_length = args[4];
 
 	// Infer deque parameters
 	uint16_t dq_size = vm->variables[deque];
@@ -1292,6 +1606,11 @@ void AsebaNative_deqset(AsebaVMState *vm)
 	}
 }
 
+void AsebaNative_deqset(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_deqset, 5);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_deqset =
 {
 	"deque.set",
@@ -1340,17 +1659,17 @@ static void _AsebaNative_deqinsert(AsebaVMState *vm, uint16_t deque, uint16_t sr
 	vm->variables[deque] = dq_size = dq_size + src_length;
 }
 
-void AsebaNative_deqinsert(AsebaVMState *vm)
+void AsebaNativeArgs_deqinsert(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t deque = AsebaNativePopArg(vm);
-	uint16_t src = AsebaNativePopArg(vm);
-	uint16_t index = AsebaNativePopArg(vm);
+	uint16_t deque = args[0];
+	uint16_t src = args[1];
+	uint16_t index = args[2];
 	uint16_t index_val = vm->variables[index];
 	
 	// variable size
-	uint16_t deque_length = AsebaNativePopArg(vm);
-	uint16_t src_length = AsebaNativePopArg(vm);
+	uint16_t deque_length = args[3];
+	uint16_t src_length = args[4];
 	
 	// Check for parameter range exception
 	if (vm->variables[index] < 0 || index_val > deque_length - 2 - 1)
@@ -1360,6 +1679,11 @@ void AsebaNative_deqinsert(AsebaVMState *vm)
 	_AsebaNative_deqinsert(vm, deque, src, index_val, deque_length, src_length);
 }
 
+void AsebaNative_deqinsert(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_deqinsert, 5);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_deqinsert =
 {
 	"deque.insert",
@@ -1404,17 +1728,17 @@ static void _AsebaNative_deqerase(AsebaVMState *vm, uint16_t deque, uint16_t ind
 	vm->variables[deque] = dq_size = dq_size - len_val;
 }
 
-void AsebaNative_deqerase(AsebaVMState *vm)
+void AsebaNativeArgs_deqerase(AsebaVMState *vm, const int16_t *args)
 {
 	// variable pos
-	uint16_t deque = AsebaNativePopArg(vm);
-	uint16_t index = AsebaNativePopArg(vm);
-	uint16_t len = AsebaNativePopArg(vm);
+	uint16_t deque = args[0];
+	uint16_t index = args[1];
+	uint16_t len = args[2];
 	uint16_t index_val = vm->variables[index];
 	uint16_t len_val = vm->variables[len];
 	
 	// variable size
-	uint16_t deque_length = AsebaNativePopArg(vm);
+	uint16_t deque_length = args[3];
 	
 	// Check for parameter range exception
 	if (vm->variables[index] < 0 || index_val > deque_length - 2 - 1)
@@ -1424,6 +1748,11 @@ void AsebaNative_deqerase(AsebaVMState *vm)
 	_AsebaNative_deqerase(vm, deque, index_val, len_val, deque_length);
 }
 
+void AsebaNative_deqerase(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_deqerase, 4);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_deqerase =
 {
 	"deque.erase",
@@ -1436,19 +1765,24 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_deqerase =
 	}
 };
 
-void AsebaNative_deqpushfront(AsebaVMState *vm)
+void AsebaNativeArgs_deqpushfront(AsebaVMState *vm, const int16_t *args)
 {
 	// Pop arguments off
-	uint16_t deque = AsebaNativePopArg(vm);
-	uint16_t src = AsebaNativePopArg(vm);
-	uint16_t deque_length = AsebaNativePopArg(vm);
-	uint16_t src_length = AsebaNativePopArg(vm);
+	uint16_t deque = args[0];
+	uint16_t src = args[1];
+	uint16_t deque_length = args[2];
+	uint16_t src_length = args[3];
 
 	// Now call insert with proper arguments
 	// Low-level function will check capacity and raise exception if necessary
 	_AsebaNative_deqinsert(vm, deque, src, 0, deque_length, src_length);
 }
 
+void AsebaNative_deqpushfront(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_deqpushfront, 4);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_deqpushfront =
 {
 	"deque.push_front",
@@ -1460,13 +1794,13 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_deqpushfront =
 	}
 };
 
-void AsebaNative_deqpushback(AsebaVMState *vm)
+void AsebaNativeArgs_deqpushback(AsebaVMState *vm, const int16_t *args)
 {
 	// Pop arguments off
-	uint16_t deque = AsebaNativePopArg(vm);
-	uint16_t src = AsebaNativePopArg(vm);
-	uint16_t deque_length = AsebaNativePopArg(vm);
-	uint16_t src_length = AsebaNativePopArg(vm);
+	uint16_t deque = args[0];
+	uint16_t src = args[1];
+	uint16_t deque_length = args[2];
+	uint16_t src_length = args[3];
     
 	uint16_t index_val = vm->variables[deque]; // length of deque is index value
 	
@@ -1475,6 +1809,11 @@ void AsebaNative_deqpushback(AsebaVMState *vm)
 	_AsebaNative_deqinsert(vm, deque, src, index_val, deque_length, src_length);
 }
 
+void AsebaNative_deqpushback(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_deqpushback, 4);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_deqpushback =
 {
 	"deque.push_back",
@@ -1486,13 +1825,13 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_deqpushback =
 	}
 };
 
-void AsebaNative_deqpopfront(AsebaVMState *vm)
+void AsebaNativeArgs_deqpopfront(AsebaVMState *vm, const int16_t *args)
 {
 	// Pop arguments off
-    uint16_t deque = AsebaNativePopArg(vm);
-	uint16_t dest = AsebaNativePopArg(vm);
-	uint16_t deque_length = AsebaNativePopArg(vm);
-	uint16_t dest_length = AsebaNativePopArg(vm);
+    uint16_t deque = args[0];
+	uint16_t dest = args[1];
+	uint16_t deque_length = args[2];
+	uint16_t dest_length = args[3];
 
 	// Now call insert and erase with proper arguments
 	// Low-level functions will check capacity and raise exception if necessary
@@ -1500,6 +1839,11 @@ void AsebaNative_deqpopfront(AsebaVMState *vm)
 	_AsebaNative_deqerase(vm, deque, 0, dest_length, deque_length);
 }
 
+void AsebaNative_deqpopfront(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_deqpopfront, 4);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_deqpopfront =
 {
 	"deque.pop_front",
@@ -1511,13 +1855,13 @@ const AsebaNativeFunctionDescription AsebaNativeDescription_deqpopfront =
 	}
 };
 
-void AsebaNative_deqpopback(AsebaVMState *vm)
+void AsebaNativeArgs_deqpopback(AsebaVMState *vm, const int16_t *args)
 {
 	// Pop arguments off
-    uint16_t deque = AsebaNativePopArg(vm);
-	uint16_t dest = AsebaNativePopArg(vm);
-	uint16_t deque_length = AsebaNativePopArg(vm);
-	uint16_t dest_length = AsebaNativePopArg(vm);
+    uint16_t deque = args[0];
+	uint16_t dest = args[1];
+	uint16_t deque_length = args[2];
+	uint16_t dest_length = args[3];
 
     uint16_t index_val = vm->variables[deque]; // length of deque is index value, from which tuple length will be subtracted
 	
@@ -1527,6 +1871,11 @@ void AsebaNative_deqpopback(AsebaVMState *vm)
 	_AsebaNative_deqerase(vm, deque, index_val - dest_length, dest_length, deque_length);
 }
 
+void AsebaNative_deqpopback(AsebaVMState *vm)
+{
+	AsebaNativeCallWithPoppedArgs(vm, AsebaNativeArgs_deqpopback, 4);
+}
+
 const AsebaNativeFunctionDescription AsebaNativeDescription_deqpopback =
 {
 	"deque.pop_back",
@@ -90,110 +90,184 @@ static inline int16_t AsebaNativePopArg(AsebaVMState *vm)
 	return vm->stack[vm->sp--];
 }
 
+/*! Pop the argsCount arguments of a native call and pass them to function, for natives called through AsebaNativeFunction */
+static inline void AsebaNativeCallWithPoppedArgs(AsebaVMState *vm, AsebaNativeFunctionArgsPointer function, uint16_t argsCount)
+{
+	int16_t args[ASEBA_NATIVE_MAX_ARGS];
+	uint16_t i;
+	for (i = 0; i < argsCount; i++)
+		args[i] = AsebaNativePopArg(vm);
+	function(vm, args);
+}
+
+/*! Return the number of words a call to the native function of description takes from the stack: its arguments and its template parameters */
+uint16_t AsebaNativeArgsCount(const AsebaNativeFunctionDescription *description);
+
+// fixed point math functions, angles span the whole 16 bits range and results of sin and cos are 1.15
+
+/*! Return atan2(y, x) */
+int16_t aseba_atan2(int16_t y, int16_t x);
+/*! Return sin(angle) */
+int16_t aseba_sin(int16_t angle);
+/*! Return cos(angle) */
+int16_t aseba_cos(int16_t angle);
+/*! Return the integer square root of num, 0 if num is negative */
+int16_t aseba_sqrt(int16_t num);
+/*! Set dest[i] = aseba_atan2(y[i], x[i]) for i < length; dest can be y or x, but must not overlap them otherwise */
+void aseba_atan2_array(int16_t* dest, const int16_t* y, const int16_t* x, uint16_t length);
+/*! Set dest[i] = aseba_sin(angles[i]) for i < length, using SIMD on hosts; dest can be angles, but must not overlap it otherwise */
+void aseba_sin_array(int16_t* dest, const int16_t* angles, uint16_t length);
+/*! Set dest[i] = aseba_cos(angles[i]) for i < length, using SIMD on hosts; dest can be angles, but must not overlap it otherwise */
+void aseba_cos_array(int16_t* dest, const int16_t* angles, uint16_t length);
+/*! Set dest[i] = aseba_sqrt(values[i]) for i < length, using SIMD on hosts; dest can be values, but must not overlap it otherwise */
+void aseba_sqrt_array(int16_t* dest, const int16_t* values, uint16_t length);
+
 // standard natives functions
 
 /*! Function to copy a vector */
 void AsebaNative_veccopy(AsebaVMState *vm);
+/*! AsebaNative_veccopy taking its arguments prepared by the VM */
+void AsebaNativeArgs_veccopy(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_veccopy */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_veccopy;
 
 /*! Function to fill all the elements of a vector to a specific value*/
 void AsebaNative_vecfill(AsebaVMState *vm);
+/*! AsebaNative_vecfill taking its arguments prepared by the VM */
+void AsebaNativeArgs_vecfill(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_vecfill */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_vecfill;
 
 /*! Function to add a scalar to each element of a vector */
 void AsebaNative_vecaddscalar(AsebaVMState *vm);
+/*! AsebaNative_vecaddscalar taking its arguments prepared by the VM */
+void AsebaNativeArgs_vecaddscalar(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_vecaddscalar */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_vecaddscalar;
 
 /*! Function to add two vectors */
 void AsebaNative_vecadd(AsebaVMState *vm);
+/*! AsebaNative_vecadd taking its arguments prepared by the VM */
+void AsebaNativeArgs_vecadd(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_vecadd */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_vecadd;
 
 /*! Function to substract two vectors */
 void AsebaNative_vecsub(AsebaVMState *vm);
+/*! AsebaNative_vecsub taking its arguments prepared by the VM */
+void AsebaNativeArgs_vecsub(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_vecsub */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_vecsub;
 
 /*! Function to multiply two vectors elements by elements */
 void AsebaNative_vecmul(AsebaVMState *vm);
+/*! AsebaNative_vecmul taking its arguments prepared by the VM */
+void AsebaNativeArgs_vecmul(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_vecadd */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_vecmul;
 
 /*! Function to divide two vectors elements by elements  */
 void AsebaNative_vecdiv(AsebaVMState *vm);
+/*! AsebaNative_vecdiv taking its arguments prepared by the VM */
+void AsebaNativeArgs_vecdiv(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_vecsub */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_vecdiv;
 
 /*! Function to take the element by element minimum */
 void AsebaNative_vecmin(AsebaVMState *vm);
+/*! AsebaNative_vecmin taking its arguments prepared by the VM */
+void AsebaNativeArgs_vecmin(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_vecmin */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_vecmin;
 
 /*! Function to take the element by element maximum */
 void AsebaNative_vecmax(AsebaVMState *vm);
+/*! AsebaNative_vecmax taking its arguments prepared by the VM */
+void AsebaNativeArgs_vecmax(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_vecsmax */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_vecmax;
 
 /*! Function to clamp a vector of values element by element */
 void AsebaNative_vecclamp(AsebaVMState *vm);
+/*! AsebaNative_vecclamp taking its arguments prepared by the VM */
+void AsebaNativeArgs_vecclamp(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_vecclamp*/
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_vecclamp;
 
 /*! Function to perform a dot product on a vector */
 void AsebaNative_vecdot(AsebaVMState *vm);
+/*! AsebaNative_vecdot taking its arguments prepared by the VM */
+void AsebaNativeArgs_vecdot(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_vecdot */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_vecdot;
 
 /*! Function to perform statistics on a vector */
 void AsebaNative_vecstat(AsebaVMState *vm);
+/*! AsebaNative_vecstat taking its arguments prepared by the VM */
+void AsebaNativeArgs_vecstat(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_vecstat */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_vecstat;
 
 /*! Function to get indices of the bounds of a vector */
 void AsebaNative_vecargbounds(AsebaVMState *vm);
+/*! AsebaNative_vecargbounds taking its arguments prepared by the VM */
+void AsebaNativeArgs_vecargbounds(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_vecargbounds */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_vecargbounds;
 
 /*! Function to sort a vector */
 void AsebaNative_vecsort(AsebaVMState *vm);
+/*! AsebaNative_vecsort taking its arguments prepared by the VM */
+void AsebaNativeArgs_vecsort(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_vecsort */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_vecsort;
 
 /*! Function to perform dest = (a*b)/c in 32 bits */
 void AsebaNative_mathmuldiv(AsebaVMState *vm);
+/*! AsebaNative_mathmuldiv taking its arguments prepared by the VM */
+void AsebaNativeArgs_mathmuldiv(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_mathmuldiv */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_mathmuldiv;
 
 /*! Function to perform atan2 */
 void AsebaNative_mathatan2(AsebaVMState *vm);
+/*! AsebaNative_mathatan2 taking its arguments prepared by the VM */
+void AsebaNativeArgs_mathatan2(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_mathatan2 */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_mathatan2;
 
 /*! Function to perform sin */
 void AsebaNative_mathsin(AsebaVMState *vm);
+/*! AsebaNative_mathsin taking its arguments prepared by the VM */
+void AsebaNativeArgs_mathsin(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_mathsin */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_mathsin;
 
 /*! Function to perform cos */
 void AsebaNative_mathcos(AsebaVMState *vm);
+/*! AsebaNative_mathcos taking its arguments prepared by the VM */
+void AsebaNativeArgs_mathcos(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_mathcos */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_mathcos;
 
 /*! Function to perform the rotation of a vector */
 void AsebaNative_mathrot2(AsebaVMState *vm);
+/*! AsebaNative_mathrot2 taking its arguments prepared by the VM */
+void AsebaNativeArgs_mathrot2(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_mathrot2 */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_mathrot2;
 
 /*! Function to perform sqrt */
 void AsebaNative_mathsqrt(AsebaVMState *vm);
+/*! AsebaNative_mathsqrt taking its arguments prepared by the VM */
+void AsebaNativeArgs_mathsqrt(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_mathsqrt */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_mathsqrt;
 
 /*! Function to get the middle index of the largest sequence of non-zero elements */
 void AsebaNative_vecnonzerosequence(AsebaVMState *vm);
+/*! AsebaNative_vecnonzerosequence taking its arguments prepared by the VM */
+void AsebaNativeArgs_vecnonzerosequence(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_vecnonzerosequence */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_vecnonzerosequence;
 
@@ -203,43 +277,63 @@ void AsebaSetRandomSeed(uint16_t seed);
 uint16_t AsebaGetRandom(void);
 /*! Function to get a 16-bit signed random number */
 void AsebaNative_rand(AsebaVMState *vm);
+/*! AsebaNative_rand taking its arguments prepared by the VM */
+void AsebaNativeArgs_rand(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_rand */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_rand;
 	
 /*! Function that reports size of deque dest in size */
 void AsebaNative_deqsize(AsebaVMState *vm);
+/*! AsebaNative_deqsize taking its arguments prepared by the VM */
+void AsebaNativeArgs_deqsize(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_deqsize */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_deqsize;
 /*! Function that copies index-th len-dest elements of deque src to dest */
 void AsebaNative_deqget(AsebaVMState *vm);
+/*! AsebaNative_deqget taking its arguments prepared by the VM */
+void AsebaNativeArgs_deqget(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_deqget */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_deqget;
 /*! Function that copies len-src elements of src to index-th position of deque dest */
 void AsebaNative_deqset(AsebaVMState *vm);
+/*! AsebaNative_deqset taking its arguments prepared by the VM */
+void AsebaNativeArgs_deqset(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_deqset */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_deqset;
 /*! Function that copies len-src elements of src before index-th position of deque dest */
 void AsebaNative_deqinsert(AsebaVMState *vm);
+/*! AsebaNative_deqinsert taking its arguments prepared by the VM */
+void AsebaNativeArgs_deqinsert(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_deqinsert */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_deqinsert;
 /*! Function that erases len elements from deque dest starting from index-th position */
 void AsebaNative_deqerase(AsebaVMState *vm);
+/*! AsebaNative_deqerase taking its arguments prepared by the VM */
+void AsebaNativeArgs_deqerase(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_deqerase */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_deqerase;
 /*! Function that copies len-src elements of src before the front of deque dest */
 void AsebaNative_deqpushfront(AsebaVMState *vm);
+/*! AsebaNative_deqpushfront taking its arguments prepared by the VM */
+void AsebaNativeArgs_deqpushfront(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_deqpushfront */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_deqpushfront;
 /*! Function that copies len-src elements of src after the end of deque dest */
 void AsebaNative_deqpushback(AsebaVMState *vm);
+/*! AsebaNative_deqpushback taking its arguments prepared by the VM */
+void AsebaNativeArgs_deqpushback(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_deqpushback */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_deqpushback;
 /*! Function that erases len elements from deque dest starting at the front */
 void AsebaNative_deqpopfront(AsebaVMState *vm);
+/*! AsebaNative_deqpopfront taking its arguments prepared by the VM */
+void AsebaNativeArgs_deqpopfront(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_deqpopfront */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_deqpopfront;
 /*! Function that erases len elements from deque dest starting from the end */
 void AsebaNative_deqpopback(AsebaVMState *vm);
+/*! AsebaNative_deqpopback taking its arguments prepared by the VM */
+void AsebaNativeArgs_deqpopback(AsebaVMState *vm, const int16_t *args);
 /*! Description of AsebaNative_deqpopback */
 extern const AsebaNativeFunctionDescription AsebaNativeDescription_deqpopback;
 
@@ -279,6 +373,39 @@ extern const AsebaNativeFunctionDescription AsebaNativeDescription_deqpopback;
 	AsebaNative_deqpopfront, \
 	AsebaNative_deqpopback
 
+/*! snippet to include the dispatch entries of standard native functions, for AsebaVMState::nativeDispatch */
+#define ASEBA_NATIVES_STD_DISPATCH \
+	{ AsebaNativeArgs_veccopy, 3 }, \
+	{ AsebaNativeArgs_vecfill, 3 }, \
+	{ AsebaNativeArgs_vecaddscalar, 4 }, \
+	{ AsebaNativeArgs_vecadd, 4 }, \
+	{ AsebaNativeArgs_vecsub, 4 }, \
+	{ AsebaNativeArgs_vecmul, 4 }, \
+	{ AsebaNativeArgs_vecdiv, 4 }, \
+	{ AsebaNativeArgs_vecmin, 4 }, \
+	{ AsebaNativeArgs_vecmax, 4 }, \
+	{ AsebaNativeArgs_vecclamp, 5 }, \
+	{ AsebaNativeArgs_vecdot, 5 }, \
+	{ AsebaNativeArgs_vecstat, 5 }, \
+	{ AsebaNativeArgs_vecargbounds, 4 }, \
+	{ AsebaNativeArgs_vecsort, 2 }, \
+	{ AsebaNativeArgs_mathmuldiv, 5 }, \
+	{ AsebaNativeArgs_mathatan2, 4 }, \
+	{ AsebaNativeArgs_mathsin, 3 }, \
+	{ AsebaNativeArgs_mathcos, 3 }, \
+	{ AsebaNativeArgs_mathrot2, 3 }, \
+	{ AsebaNativeArgs_mathsqrt, 3 }, \
+	{ AsebaNativeArgs_rand, 2 }, \
+	{ AsebaNativeArgs_deqsize, 3 }, \
+	{ AsebaNativeArgs_deqget, 5 }, \
+	{ AsebaNativeArgs_deqset, 5 }, \
+	{ AsebaNativeArgs_deqinsert, 5 }, \
+	{ AsebaNativeArgs_deqerase, 4 }, \
+	{ AsebaNativeArgs_deqpushfront, 4 }, \
+	{ AsebaNativeArgs_deqpushback, 4 }, \
+	{ AsebaNativeArgs_deqpopfront, 4 }, \
+	{ AsebaNativeArgs_deqpopback, 4 }
+
 /*! snippet to include descriptions of standard native functions */
 #define ASEBA_NATIVES_STD_DESCRIPTIONS \
 	&AsebaNativeDescription_veccopy, \
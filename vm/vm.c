@@ -45,7 +45,10 @@ void AsebaVMInit(AsebaVMState *vm)
 {
 	vm->pc = 0;
 	vm->flags = 0;
-	vm->breakpointsCount = 0;
+	AsebaVMClearBreakpoints(vm);
+	memset(vm->whenStates, 0, sizeof(vm->whenStates));
+	vm->nativeDispatch = 0;
+	vm->nativeDispatchSize = 0;
 	
 	// fill with no event
 	vm->bytecode[0] = 0;
@@ -429,11 +432,24 @@ void AsebaVMStep(AsebaVMState *vm)
 			// evaluate condition
 			valueOne = vm->stack[vm->sp - 1];
 			valueTwo = vm->stack[vm->sp];
-			conditionResult = AsebaVMDoBinaryOperation(vm, valueOne, valueTwo, bytecode & ASEBA_BINARY_OPERATOR_MASK);
+			conditionResult = AsebaVMDoBinaryOperation(vm, valueOne, valueTwo, bytecode & ASEBA_IF_OPERATOR_MASK);
 			vm->sp -= 2;
 			
+			// a when condition is only true if it was false at its last evaluation
+			if (GET_BIT(bytecode, ASEBA_IF_IS_WHEN_BIT))
+			{
+				const uint16_t slot = ASEBA_IF_GET_WHEN_SLOT(bytecode);
+				const uint16_t wasTrue = GET_BIT(vm->whenStates[slot / 16], slot % 16);
+				if (conditionResult)
+					BIT_SET(vm->whenStates[slot / 16], slot % 16);
+				else
+					BIT_CLR(vm->whenStates[slot / 16], slot % 16);
+				if (wasTrue)
+					conditionResult = 0;
+			}
+			
 			// is the condition really true ?
-			if (conditionResult && !(GET_BIT(bytecode, ASEBA_IF_IS_WHEN_BIT) && GET_BIT(bytecode, ASEBA_IF_WAS_TRUE_BIT)))
+			if (conditionResult)
 			{
 				// if true disp
 				disp = 2;
@@ -444,12 +460,6 @@ void AsebaVMStep(AsebaVMState *vm)
 				disp = (int16_t)vm->bytecode[vm->pc + 1];
 			}
 			
-			// write back condition result
-			if (conditionResult)
-				BIT_SET(vm->bytecode[vm->pc], ASEBA_IF_WAS_TRUE_BIT);
-			else
-				BIT_CLR(vm->bytecode[vm->pc], ASEBA_IF_WAS_TRUE_BIT);
-			
 			// check pc
 			#ifdef ASEBA_ASSERT
 			if ((vm->pc + disp < 0) || (vm->pc + disp >=  vm->bytecodeSize))
@@ -483,7 +493,7 @@ void AsebaVMStep(AsebaVMState *vm)
 		case ASEBA_BYTECODE_NATIVE_CALL:
 		{
 			// call native function
-			AsebaNativeFunction(vm, bytecode & 0x0fff);
+			AsebaVMCallNative(vm, bytecode & 0x0fff);
 			
 			// increment PC
 			vm->pc ++;
@@ -531,6 +541,48 @@ void AsebaVMStep(AsebaVMState *vm)
 	} // switch bytecode...
 }
 
+/*! Return the dispatch entry of native id, or NULL if it must be called through AsebaNativeFunction */
+static const AsebaNativeDispatchEntry* AsebaVMGetNativeDispatchEntry(AsebaVMState *vm, uint16_t id)
+{
+	const AsebaNativeDispatchEntry *entry;
+	if (id >= vm->nativeDispatchSize)
+		return 0;
+	entry = &vm->nativeDispatch[id];
+	if (!entry->function || entry->argsCount > ASEBA_NATIVE_MAX_ARGS)
+		return 0;
+	return entry;
+}
+
+void AsebaVMCallNative(AsebaVMState *vm, uint16_t id)
+{
+	const AsebaNativeDispatchEntry *entry = AsebaVMGetNativeDispatchEntry(vm, id);
+	if (entry)
+	{
+		// arguments are on the stack in reverse order
+		int16_t args[ASEBA_NATIVE_MAX_ARGS];
+		const int16_t *top = &vm->stack[vm->sp];
+		uint16_t i;
+		for (i = 0; i < entry->argsCount; i++)
+			args[i] = *(top - i);
+		vm->sp -= entry->argsCount;
+		entry->function(vm, args);
+	}
+	else
+		AsebaNativeFunction(vm, id);
+}
+
+void AsebaVMCallNativeWithArgs(AsebaVMState *vm, uint16_t id, const int16_t *args, uint16_t argsAvailable)
+{
+	const AsebaNativeDispatchEntry *entry = AsebaVMGetNativeDispatchEntry(vm, id);
+	if (entry && entry->argsCount <= argsAvailable)
+	{
+		vm->sp -= entry->argsCount;
+		entry->function(vm, args);
+	}
+	else
+		AsebaVMCallNative(vm, id);
+}
+
 void AsebaVMEmitNodeSpecificError(AsebaVMState *vm, const char* message)
 {
 	uint16_t msgLen = strlen(message);
@@ -559,7 +611,20 @@ void AsebaVMEmitNodeSpecificError(AsebaVMState *vm, const char* message)
 	VM must be ready for run otherwise trashes may occur. */
 uint16_t AsebaVMCheckBreakpoint(AsebaVMState *vm)
 {
+#ifdef ASEBA_VM_BREAKPOINTS_BITMAP
+	// the bitmap tells exactly whether there is a breakpoint at pc
+	if (AsebaMaskIsClear(vm->breakpointsBitmap[vm->pc >> 4], 1 << (vm->pc & 0xf)))
+		return 0;
+	
+	AsebaMaskSet(vm->flags, ASEBA_VM_STEP_BY_STEP_MASK);
+	return 1;
+#else // ASEBA_VM_BREAKPOINTS_BITMAP
 	uint16_t i;
+	
+	// the mask rules out most instructions at the cost of a single test
+	if (AsebaMaskIsClear(vm->breakpointsMask, 1 << (vm->pc & 0xf)))
+		return 0;
+	
 	for (i = 0; i < vm->breakpointsCount; i++)
 	{
 		if (vm->breakpoints[i] == vm->pc)
@@ -570,6 +635,24 @@ uint16_t AsebaVMCheckBreakpoint(AsebaVMState *vm)
 	}
 	
 	return 0;
+#endif // ASEBA_VM_BREAKPOINTS_BITMAP
+}
+
+uint16_t AsebaVMStopAtBreakpoint(AsebaVMState *vm)
+{
+	if (AsebaVMCheckBreakpoint(vm) == 0)
+		return 0;
+	AsebaVMSendExecutionStateChanged(vm);
+	return 1;
+}
+
+uint16_t AsebaVMHasBreakpointIn(const AsebaVMState *vm, uint16_t begin, uint16_t end)
+{
+	uint16_t i;
+	for (i = 0; i < vm->breakpointsCount; i++)
+		if (vm->breakpoints[i] >= begin && vm->breakpoints[i] < end)
+			return 1;
+	return 0;
 }
 
 /*! Run without support of breakpoints.
@@ -617,12 +700,8 @@ void AsebaDebugBreakpointRun(AsebaVMState *vm, uint16_t stepsLimit)
 			stepsLimit
 		)
 		{
-			if (AsebaVMCheckBreakpoint(vm) != 0)
-			{
-				AsebaMaskSet(vm->flags, ASEBA_VM_STEP_BY_STEP_MASK);
-				AsebaVMSendExecutionStateChanged(vm);
-				return;
-			}
+			if (AsebaVMStopAtBreakpoint(vm) != 0)
+				break;
 			AsebaVMStep(vm);
 			stepsLimit--;
 			// TODO : send exception event on step limits overflow
@@ -635,12 +714,8 @@ void AsebaDebugBreakpointRun(AsebaVMState *vm, uint16_t stepsLimit)
 			AsebaMaskIsSet(vm->flags, ASEBA_VM_EVENT_RUNNING_MASK)
 		)
 		{
-			if (AsebaVMCheckBreakpoint(vm) != 0)
-			{
-				AsebaMaskSet(vm->flags, ASEBA_VM_STEP_BY_STEP_MASK);
-				AsebaVMSendExecutionStateChanged(vm);
-				return;
-			}
+			if (AsebaVMStopAtBreakpoint(vm) != 0)
+				break;
 			AsebaVMStep(vm);
 		}
 	}
@@ -664,10 +739,36 @@ uint16_t AsebaVMRun(AsebaVMState *vm, uint16_t stepsLimit)
 	else
 		AsebaDebugBareRun(vm, stepsLimit);
 	
+	if (AsebaMaskIsClear(vm->flags, ASEBA_VM_EVENT_ACTIVE_MASK) && AsebaVMEventFinishedCB)
+		AsebaVMEventFinishedCB(vm);
+	
 	return 1;
 }
 
 
+/*! Mark pc in the mask or the bitmap of breakpoints */
+static void AsebaVMMarkBreakpoint(AsebaVMState *vm, uint16_t pc)
+{
+#ifdef ASEBA_VM_BREAKPOINTS_BITMAP
+	AsebaMaskSet(vm->breakpointsBitmap[pc >> 4], 1 << (pc & 0xf));
+#else // ASEBA_VM_BREAKPOINTS_BITMAP
+	AsebaMaskSet(vm->breakpointsMask, 1 << (pc & 0xf));
+#endif // ASEBA_VM_BREAKPOINTS_BITMAP
+}
+
+/*! Recompute the mask or the bitmap of breakpoints, after some were removed */
+static void AsebaVMUpdateBreakpointsMask(AsebaVMState *vm)
+{
+	uint16_t i;
+#ifdef ASEBA_VM_BREAKPOINTS_BITMAP
+	memset(vm->breakpointsBitmap, 0, sizeof(vm->breakpointsBitmap));
+#else // ASEBA_VM_BREAKPOINTS_BITMAP
+	vm->breakpointsMask = 0;
+#endif // ASEBA_VM_BREAKPOINTS_BITMAP
+	for (i = 0; i < vm->breakpointsCount; i++)
+		AsebaVMMarkBreakpoint(vm, vm->breakpoints[i]);
+}
+
 /*! Set a breakpoint at a specific location. */
 uint8_t AsebaVMSetBreakpoint(AsebaVMState *vm, uint16_t pc)
 {
@@ -679,6 +780,7 @@ uint8_t AsebaVMSetBreakpoint(AsebaVMState *vm, uint16_t pc)
 	if (vm->breakpointsCount < ASEBA_MAX_BREAKPOINTS)
 	{
 		vm->breakpoints[vm->breakpointsCount++] = pc;
+		AsebaVMMarkBreakpoint(vm, pc);
 		return 1;
 	}
 	else
@@ -698,6 +800,7 @@ uint16_t AsebaVMClearBreakpoint(AsebaVMState *vm, uint16_t pc)
 			vm->breakpointsCount--;
 			for (j = i; j < vm->breakpointsCount; j++)
 				vm->breakpoints[j] = vm->breakpoints[j+1];
+			AsebaVMUpdateBreakpointsMask(vm);
 			return 1;
 		}
 	}
@@ -708,6 +811,7 @@ uint16_t AsebaVMClearBreakpoint(AsebaVMState *vm, uint16_t pc)
 void AsebaVMClearBreakpoints(AsebaVMState *vm)
 {
 	vm->breakpointsCount = 0;
+	AsebaVMUpdateBreakpointsMask(vm);
 }
 
 /*! Send an execution state changed message */
@@ -719,16 +823,10 @@ void AsebaVMSendExecutionStateChanged(AsebaVMState *vm)
 	AsebaSendMessageWords(vm, ASEBA_MESSAGE_EXECUTION_STATE_CHANGED, buffer, 2);
 }
 
-/*! Reset all when flags in their default states in the bytecode */
+/*! Reset all when flags in their default states */
 static void AsebaVMResetWhenFlags(AsebaVMState *vm)
 {
-	uint16_t i;
-	for (i = 0; i < vm->bytecodeSize; i++)
-	{
-		uint16_t bytecode = vm->bytecode[i];
-		if ((bytecode >> 12) == ASEBA_BYTECODE_CONDITIONAL_BRANCH)
-			BIT_CLR(vm->bytecode[i], ASEBA_IF_WAS_TRUE_BIT);
-	}
+	memset(vm->whenStates, 0, sizeof(vm->whenStates));
 }
 
 void AsebaVMDebugMessage(AsebaVMState *vm, uint16_t id, uint16_t *data, uint16_t dataLength)
@@ -903,4 +1001,152 @@ uint16_t AsebaVMShouldDropPacket(AsebaVMState *vm, uint16_t source, const uint8_
 	return 1;
 }	
 
+/*! Identifies a state saved by AsebaVMSaveState */
+#define ASEBA_VM_STATE_MAGIC 0x5356
+/*! Version of the layout of saved states, to be increased whenever it changes */
+#define ASEBA_VM_STATE_VERSION 1
+
+/*! Layout of the header of a saved state, followed by when states, breakpoints, bytecode, variables and stack */
+enum
+{
+	ASEBA_VM_STATE_MAGIC_POS = 0,
+	ASEBA_VM_STATE_VERSION_POS,
+	ASEBA_VM_STATE_BYTECODE_SIZE_POS,
+	ASEBA_VM_STATE_VARIABLES_SIZE_POS,
+	ASEBA_VM_STATE_STACK_SIZE_POS,
+	ASEBA_VM_STATE_BYTECODE_USED_POS,
+	ASEBA_VM_STATE_VARIABLES_USED_POS,
+	ASEBA_VM_STATE_STACK_USED_POS,
+	ASEBA_VM_STATE_FLAGS_POS,
+	ASEBA_VM_STATE_PC_POS,
+	ASEBA_VM_STATE_SP_POS,
+	ASEBA_VM_STATE_BREAKPOINTS_COUNT_POS,
+	ASEBA_VM_STATE_HEADER_SIZE
+};
+
+#define ASEBA_VM_STATE_WHEN_STATES_SIZE (ASEBA_MAX_WHEN_SLOTS / 16)
+
+/*! Return the length of data once its trailing zeros are removed */
+static uint16_t AsebaVMUsedLength(const uint16_t *data, uint16_t size)
+{
+	while (size > 0 && data[size - 1] == 0)
+		size--;
+	return size;
+}
+
+/*! Return the number of words of the stack that are in use */
+static uint16_t AsebaVMUsedStack(const AsebaVMState *vm)
+{
+	if (vm->sp < 0)
+		return 0;
+	if (vm->sp >= (int16_t)vm->stackSize)
+		return vm->stackSize;
+	return vm->sp + 1;
+}
+
+uint32_t AsebaVMGetStateSize(const AsebaVMState *vm)
+{
+	return (uint32_t)ASEBA_VM_STATE_HEADER_SIZE +
+		ASEBA_VM_STATE_WHEN_STATES_SIZE +
+		vm->breakpointsCount +
+		AsebaVMUsedLength(vm->bytecode, vm->bytecodeSize) +
+		AsebaVMUsedLength((const uint16_t *)vm->variables, vm->variablesSize) +
+		AsebaVMUsedStack(vm);
+}
+
+uint32_t AsebaVMSaveState(const AsebaVMState *vm, uint16_t *buffer, uint32_t bufferSize)
+{
+	const uint16_t bytecodeUsed = AsebaVMUsedLength(vm->bytecode, vm->bytecodeSize);
+	const uint16_t variablesUsed = AsebaVMUsedLength((const uint16_t *)vm->variables, vm->variablesSize);
+	const uint16_t stackUsed = AsebaVMUsedStack(vm);
+	uint32_t pos = ASEBA_VM_STATE_HEADER_SIZE;
+	
+	if (bufferSize < AsebaVMGetStateSize(vm))
+		return 0;
+	
+	buffer[ASEBA_VM_STATE_MAGIC_POS] = ASEBA_VM_STATE_MAGIC;
+	buffer[ASEBA_VM_STATE_VERSION_POS] = ASEBA_VM_STATE_VERSION;
+	buffer[ASEBA_VM_STATE_BYTECODE_SIZE_POS] = vm->bytecodeSize;
+	buffer[ASEBA_VM_STATE_VARIABLES_SIZE_POS] = vm->variablesSize;
+	buffer[ASEBA_VM_STATE_STACK_SIZE_POS] = vm->stackSize;
+	buffer[ASEBA_VM_STATE_BYTECODE_USED_POS] = bytecodeUsed;
+	buffer[ASEBA_VM_STATE_VARIABLES_USED_POS] = variablesUsed;
+	buffer[ASEBA_VM_STATE_STACK_USED_POS] = stackUsed;
+	// the running flag only makes sense inside AsebaVMRun
+	buffer[ASEBA_VM_STATE_FLAGS_POS] = vm->flags & ~ASEBA_VM_EVENT_RUNNING_MASK;
+	buffer[ASEBA_VM_STATE_PC_POS] = vm->pc;
+	buffer[ASEBA_VM_STATE_SP_POS] = (uint16_t)vm->sp;
+	buffer[ASEBA_VM_STATE_BREAKPOINTS_COUNT_POS] = vm->breakpointsCount;
+	
+	memcpy(buffer + pos, vm->whenStates, ASEBA_VM_STATE_WHEN_STATES_SIZE * sizeof(uint16_t));
+	pos += ASEBA_VM_STATE_WHEN_STATES_SIZE;
+	memcpy(buffer + pos, vm->breakpoints, vm->breakpointsCount * sizeof(uint16_t));
+	pos += vm->breakpointsCount;
+	memcpy(buffer + pos, vm->bytecode, bytecodeUsed * sizeof(uint16_t));
+	pos += bytecodeUsed;
+	memcpy(buffer + pos, vm->variables, variablesUsed * sizeof(int16_t));
+	pos += variablesUsed;
+	memcpy(buffer + pos, vm->stack, stackUsed * sizeof(int16_t));
+	pos += stackUsed;
+	
+	return pos;
+}
+
+uint16_t AsebaVMRestoreState(AsebaVMState *vm, const uint16_t *buffer, uint32_t size)
+{
+	uint16_t bytecodeUsed, variablesUsed, stackUsed, breakpointsCount;
+	int16_t sp;
+	uint32_t pos = ASEBA_VM_STATE_HEADER_SIZE;
+	uint16_t i;
+	
+	// check that the state is complete and fits vm
+	if (size < ASEBA_VM_STATE_HEADER_SIZE + ASEBA_VM_STATE_WHEN_STATES_SIZE)
+		return 0;
+	if (buffer[ASEBA_VM_STATE_MAGIC_POS] != ASEBA_VM_STATE_MAGIC || buffer[ASEBA_VM_STATE_VERSION_POS] != ASEBA_VM_STATE_VERSION)
+		return 0;
+	if (buffer[ASEBA_VM_STATE_BYTECODE_SIZE_POS] != vm->bytecodeSize ||
+		buffer[ASEBA_VM_STATE_VARIABLES_SIZE_POS] != vm->variablesSize ||
+		buffer[ASEBA_VM_STATE_STACK_SIZE_POS] != vm->stackSize)
+		return 0;
+	bytecodeUsed = buffer[ASEBA_VM_STATE_BYTECODE_USED_POS];
+	variablesUsed = buffer[ASEBA_VM_STATE_VARIABLES_USED_POS];
+	stackUsed = buffer[ASEBA_VM_STATE_STACK_USED_POS];
+	breakpointsCount = buffer[ASEBA_VM_STATE_BREAKPOINTS_COUNT_POS];
+	sp = (int16_t)buffer[ASEBA_VM_STATE_SP_POS];
+	if (bytecodeUsed > vm->bytecodeSize || variablesUsed > vm->variablesSize || stackUsed > vm->stackSize)
+		return 0;
+	if (breakpointsCount > ASEBA_MAX_BREAKPOINTS)
+		return 0;
+	if (buffer[ASEBA_VM_STATE_PC_POS] >= vm->bytecodeSize || sp < -1 || sp >= (int16_t)vm->stackSize)
+		return 0;
+	if (size != (uint32_t)ASEBA_VM_STATE_HEADER_SIZE + ASEBA_VM_STATE_WHEN_STATES_SIZE + breakpointsCount + bytecodeUsed + variablesUsed + stackUsed)
+		return 0;
+	
+	vm->flags = buffer[ASEBA_VM_STATE_FLAGS_POS];
+	vm->pc = buffer[ASEBA_VM_STATE_PC_POS];
+	vm->sp = sp;
+	memcpy(vm->whenStates, buffer + pos, ASEBA_VM_STATE_WHEN_STATES_SIZE * sizeof(uint16_t));
+	pos += ASEBA_VM_STATE_WHEN_STATES_SIZE;
+	vm->breakpointsCount = breakpointsCount;
+	memcpy(vm->breakpoints, buffer + pos, breakpointsCount * sizeof(uint16_t));
+	pos += breakpointsCount;
+	AsebaVMUpdateBreakpointsMask(vm);
+	
+	// only write the bytecode that differs, it might be shared and read-only
+	for (i = 0; i < vm->bytecodeSize; i++)
+	{
+		const uint16_t value = i < bytecodeUsed ? buffer[pos + i] : 0;
+		if (vm->bytecode[i] != value)
+			vm->bytecode[i] = value;
+	}
+	pos += bytecodeUsed;
+	
+	memcpy(vm->variables, buffer + pos, variablesUsed * sizeof(int16_t));
+	memset(vm->variables + variablesUsed, 0, (vm->variablesSize - variablesUsed) * sizeof(int16_t));
+	pos += variablesUsed;
+	memcpy(vm->stack, buffer + pos, stackUsed * sizeof(int16_t));
+	
+	return 1;
+}
+
 /*@}*/
@@ -26,6 +26,7 @@ extern "C" {
 #endif
 
 #include "../common/types.h"
+#include "../common/consts.h"
 
 /**
 	\file vm.h
@@ -53,9 +54,24 @@ else
 
 enum
 {
-	ASEBA_MAX_BREAKPOINTS = 16		//!< maximum number of simultaneous breakpoints the target supports
+	ASEBA_MAX_BREAKPOINTS = 16,		//!< maximum number of simultaneous breakpoints the target supports
+	ASEBA_NATIVE_MAX_ARGS = 16		//!< maximum number of words a native function called through AsebaNativeDispatchEntry takes from the stack
 };
 
+struct AsebaVMState;
+
+/*! Signature of a native function called with its arguments prepared by the VM.
+	args holds the addresses of the arguments followed by the values of the template parameters,
+	in the order of the description of the function, as AsebaNativePopArg would return them. */
+typedef void (*AsebaNativeFunctionArgsPointer)(struct AsebaVMState *vm, const int16_t *args);
+
+/*! How the VM calls a native function without going through AsebaNativeFunction */
+typedef struct
+{
+	AsebaNativeFunctionArgsPointer function; /*!< function to call, or NULL to call AsebaNativeFunction instead */
+	uint16_t argsCount; /*!< number of words a call takes from the stack: arguments and template parameters */
+} AsebaNativeDispatchEntry;
+
 /*! This structure contains the state of the Aseba VM.
 	This is the required and the sufficient data for the VM to run.
 	This is not sufficient for the compiler to build bytecode, as there is
@@ -65,8 +81,12 @@ enum
 	ALL fields of this structure have to be initialized correctly for
 	aseba to work. An initial call to AsebaVMInitStep must be done prior
 	to any call to AsebaVMPeriodicStep or AsebaVMEventStep.
+	Execution never writes bytecode, only AsebaVMInit and the reception of
+	new bytecode do, so VMs running the same program can point, after
+	AsebaVMInit, to a single shared bytecode buffer, which can be read-only
+	as long as they do not receive bytecode.
 */
-typedef struct
+typedef struct AsebaVMState
 {
 	// node id
 	uint16_t nodeId;
@@ -87,10 +107,20 @@ typedef struct
 	uint16_t flags;
 	uint16_t pc;
 	int16_t sp;
+	uint16_t whenStates[ASEBA_MAX_WHEN_SLOTS / 16]; /*!< for each when slot, whether its condition was true at its last evaluation */
 	
 	// breakpoint
 	uint16_t breakpoints[ASEBA_MAX_BREAKPOINTS];
 	uint16_t breakpointsCount;
+#ifdef ASEBA_VM_BREAKPOINTS_BITMAP
+	uint16_t breakpointsBitmap[0x10000 / 16]; /*!< bit pc % 16 of word pc / 16 is set if there is a breakpoint at pc */
+#else // ASEBA_VM_BREAKPOINTS_BITMAP
+	uint16_t breakpointsMask; /*!< bit pc % 16 is set if there is a breakpoint at pc, so that most instructions need not look at breakpoints */
+#endif // ASEBA_VM_BREAKPOINTS_BITMAP
+	
+	// natives
+	const AsebaNativeDispatchEntry *nativeDispatch; /*!< natives called directly by the VM, indexed by id, NULL to call all of them through AsebaNativeFunction */
+	uint16_t nativeDispatchSize; /*!< number of entries in nativeDispatch */
 } AsebaVMState;
 
 // Macros to work with masks
@@ -112,6 +142,7 @@ typedef struct
 	This is not sufficient to have a working VM.
 	nodeId and bytecode, variables, and stack along with their sizes must be set outside this function.
 	The content of the variable array is zeroed by this function.
+	The native dispatch table is cleared, targets providing one set nativeDispatch after this call.
 */
 void AsebaVMInit(AsebaVMState *vm);
 
@@ -129,16 +160,50 @@ uint16_t AsebaVMSetupEvent(AsebaVMState *vm, uint16_t event);
 	Return 1 if anything was executed, 0 otherwise. */
 uint16_t AsebaVMRun(AsebaVMState *vm, uint16_t stepsLimit);
 
+/*! If there is a breakpoint at vm->pc, switch to step-by-step mode, notify the hosts and return 1, return 0 otherwise. */
+uint16_t AsebaVMStopAtBreakpoint(AsebaVMState *vm);
+
+/*! Return 1 if there is a breakpoint in [begin, end[, 0 otherwise. */
+uint16_t AsebaVMHasBreakpointIn(const AsebaVMState *vm, uint16_t begin, uint16_t end);
+
+/*! Set a breakpoint at pc, return 1 on success or 0 if ASEBA_MAX_BREAKPOINTS are already set. */
+uint8_t AsebaVMSetBreakpoint(AsebaVMState *vm, uint16_t pc);
+
+/*! Clear all breakpoints, glue must use this rather than resetting breakpointsCount so that breakpointsMask or breakpointsBitmap stays consistent. */
+void AsebaVMClearBreakpoints(AsebaVMState *vm);
+
 /*! Execute a debug action from a debug message. 
 	dataLength is given in number of uint16_t. */
 void AsebaVMDebugMessage(AsebaVMState *vm, uint16_t id, uint16_t *data, uint16_t dataLength);
 
+/*! Call native function id, directly through nativeDispatch if it has an entry for id, through AsebaNativeFunction otherwise */
+void AsebaVMCallNative(AsebaVMState *vm, uint16_t id);
+
+/*! Like AsebaVMCallNative, but args holds the argsAvailable words on top of the stack, resolved when the bytecode was loaded,
+	in the order AsebaNativePopArg would return them; they are passed directly to the native if it needs no more */
+void AsebaVMCallNativeWithArgs(AsebaVMState *vm, uint16_t id, const int16_t *args, uint16_t argsAvailable);
+
 /*! Can be called by glue code (including native functions), to stop vm and emit a node specific error */
 void AsebaVMEmitNodeSpecificError(AsebaVMState *vm, const char* message);
 
 /*! Return non-zero if VM will ignore the packet, 0 otherwise */
 uint16_t AsebaVMShouldDropPacket(AsebaVMState *vm, uint16_t source, const uint8_t* data);
 
+/*! Return the number of words AsebaVMSaveState needs to save the state of vm */
+uint32_t AsebaVMGetStateSize(const AsebaVMState *vm);
+
+/*! Save the state of vm to buffer: bytecode, variables, used stack, pc, sp, flags, when states and breakpoints.
+	Trailing zeros of bytecode and variables are not stored. nodeId and the native dispatch table are not part of the state.
+	Return the number of words written, or 0 if bufferSize is smaller than AsebaVMGetStateSize. */
+uint32_t AsebaVMSaveState(const AsebaVMState *vm, uint16_t *buffer, uint32_t bufferSize);
+
+/*! Restore in vm the state saved by AsebaVMSaveState in the size words of buffer.
+	vm must be set up with bytecode, variables and stack of the same sizes as the saved VM.
+	Bytecode is only written where it differs, so VMs sharing a read-only bytecode buffer can restore states of the same program.
+	JIT users must call AsebaJitInvalidate afterwards if the bytecode changed.
+	Return 1 on success, or 0 if buffer does not hold a state for vm, in which case vm is unchanged. */
+uint16_t AsebaVMRestoreState(AsebaVMState *vm, const uint16_t *buffer, uint32_t size);
+
 // Functions implemented outside by the glue/transport layer
 
 /*! Called by AsebaStep if there is a message (not an user event) to send.
@@ -185,6 +250,13 @@ static void AsebaVMResetCB(AsebaVMState *vm) {}
 void __attribute__((weak)) AsebaVMResetCB(AsebaVMState *vm);
 #endif // DISABLE_WEAK_CALLBACKS
 
+/*! Called by AsebaVMRun and its variants when the event being executed finished */
+#ifdef DISABLE_WEAK_CALLBACKS
+static void AsebaVMEventFinishedCB(AsebaVMState *vm) {}
+#else // DISABLE_WEAK_CALLBACKS
+void __attribute__((weak)) AsebaVMEventFinishedCB(AsebaVMState *vm);
+#endif // DISABLE_WEAK_CALLBACKS
+
 /*! Called by AsebaVMEmitNodeSpecificError to be notified when VM hit an execution error
 	Is also called for wrong array access or division by 0 with message == NULL */
 #ifdef DISABLE_WEAK_CALLBACKS